@@ -27,6 +27,9 @@ const ConnectTokenBytes = 1024
 const MaxServersPerConnectToken = 8
 const ConnectTokenExpireSeconds = 30
 const ServerAddress = "127.0.0.1:40000"
+const CipherSuiteChaCha20Poly1305 = 0
+const CipherSuiteAES256GCM = 1
+const ServerCipherSuite = CipherSuiteAES256GCM
 
 type ConnectToken struct {
     ProtocolId         string `json:"protocolId"`
@@ -36,6 +39,7 @@ type ConnectToken struct {
     ServerAddresses [] string `json:"serverAddresses"`
     ClientToServerKey  string `json:"clientToServerKey"`
     ServerToClientKey  string `json:"serverToClientKey"`
+    CipherSuite        string `json:"cipherSuite"`
 }
 
 func GenerateKey() [] byte {
@@ -77,6 +81,7 @@ func GenerateConnectToken( protocolId uint64, clientId uint64, serverAddresses [
     connectToken.ServerAddresses = serverAddresses
     connectToken.ClientToServerKey = base64.StdEncoding.EncodeToString( GenerateKey() )
     connectToken.ServerToClientKey = base64.StdEncoding.EncodeToString( GenerateKey() )
+    connectToken.CipherSuite = strconv.Itoa( ServerCipherSuite )
     return connectToken
 }
 
@@ -98,6 +103,7 @@ type MatchResponse struct {
     ClientToServerKey               string `json:"clientToServerKey"`
     ServerToClientKey               string `json:"serverToClientKey"`
     ConnectTokenExpireTimestamp     string `json:"connectTokenExpireTimestamp"`
+    CipherSuite                     string `json:"cipherSuite"`
 }
 
 func GenerateMatchResponse( connectToken ConnectToken, nonce uint64 ) ( MatchResponse, bool ) {
@@ -109,6 +115,7 @@ func GenerateMatchResponse( connectToken ConnectToken, nonce uint64 ) ( MatchRes
     matchResponse.ClientToServerKey = connectToken.ClientToServerKey
     matchResponse.ServerToClientKey = connectToken.ServerToClientKey
     matchResponse.ConnectTokenExpireTimestamp = connectToken.ExpireTimestamp
+    matchResponse.CipherSuite = connectToken.CipherSuite
     return matchResponse, ok
 }
 
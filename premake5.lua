@@ -5,10 +5,16 @@ if os.is "windows" then
     debug_libs = { "sodium-debug", "mbedtls-debug", "mbedx509-debug", "mbedcrypto-debug" }
     release_libs = { "sodium-release", "mbedtls-release", "mbedx509-release", "mbedcrypto-release" }
 else
-    debug_libs = { "sodium", "mbedtls", "mbedx509", "mbedcrypto" }
+    debug_libs = { "sodium", "mbedtls", "mbedx509", "mbedcrypto", "pthread" }
     release_libs = debug_libs
 end
 
+newoption
+{
+    trigger     = "io_uring",
+    description = "Use io_uring for network transport socket IO (Linux only)",
+}
+
 solution "Yojimbo"
     kind "ConsoleApp"
     language "C++"
@@ -22,6 +28,9 @@ solution "Yojimbo"
         targetdir "bin/"  
     end
     rtti "Off"
+    if _OPTIONS["io_uring"] then
+        defines { "YOJIMBO_IO_URING=1" }
+    end
     flags { "ExtraWarnings", "StaticRuntime", "FloatFast", "EnableSSE2" }
     configuration "Debug"
         symbols "On"
@@ -75,6 +84,10 @@ project "profile"
     files { "tests/profile.cpp", "tests/shared.h" }
     links { "yojimbo" }
 
+project "benchmark"
+    files { "tests/benchmark.cpp", "tests/shared.h" }
+    links { "yojimbo" }
+
 if not os.is "windows" then
 
     -- MacOSX and Linux.
@@ -236,6 +249,18 @@ if not os.is "windows" then
         end
     }
 
+    newaction
+    {
+        trigger     = "benchmark",
+        description = "Build and run benchmarks",
+        execute = function ()
+            os.execute "test ! -e Makefile && premake5 gmake"
+            if os.execute "make -j32 benchmark" == 0 then
+                os.execute "./bin/benchmark"
+            end
+        end
+    }
+
     newaction
     {
         trigger     = "cppcheck",
@@ -0,0 +1,1898 @@
+/*
+    Benchmarks.
+
+    Copyright © 2016, The Network Protocol Company, Inc.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define SERVER 1
+#define CLIENT 1
+#define MATCHER 1
+
+#include "shared.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static bool ShouldRun( int argc, char ** argv, const char * name )
+{
+    if ( argc < 2 )
+        return true;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        if ( strstr( name, argv[i] ) )
+            return true;
+    }
+
+    return false;
+}
+
+static Address GetBenchmarkAddress( int index )
+{
+    return Address( 10, uint8_t( index >> 16 ), uint8_t( index >> 8 ), uint8_t( index ), 40000 + ( index % 1000 ) );
+}
+
+/*
+    The context manager used to do a linear search over all mappings.
+    Kept here as the baseline for comparison.
+ */
+
+class LinearContextManager
+{
+public:
+
+    explicit LinearContextManager( int maxContextMappings )
+    {
+        m_maxContextMappings = maxContextMappings;
+        m_numContextMappings = 0;
+        m_allocated = new int[maxContextMappings];
+        m_address = new Address[maxContextMappings];
+        m_context = new TransportContext[maxContextMappings];
+        memset( m_allocated, 0, sizeof( int ) * maxContextMappings );
+    }
+
+    ~LinearContextManager()
+    {
+        delete [] m_allocated;
+        delete [] m_address;
+        delete [] m_context;
+    }
+
+    bool AddContextMapping( const Address & address, const TransportContext & context )
+    {
+        for ( int i = 0; i < m_maxContextMappings; ++i )
+        {
+            if ( !m_allocated[i] )
+            {
+                m_allocated[i] = true;
+                m_context[i] = context;
+                m_address[i] = address;
+                if ( i + 1 > m_numContextMappings )
+                    m_numContextMappings = i + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const TransportContext * GetContext( const Address & address ) const
+    {
+        for ( int i = 0; i < m_numContextMappings; ++i )
+        {
+            if ( m_allocated[i] && m_address[i] == address )
+                return &m_context[i];
+        }
+        return NULL;
+    }
+
+private:
+
+    int m_maxContextMappings;
+    int m_numContextMappings;
+    int * m_allocated;
+    Address * m_address;
+    TransportContext * m_context;
+};
+
+template <typename T> double BenchmarkContextLookups( T & contextManager, const Address * lookups, int numLookups, int numIterations )
+{
+    int numFound = 0;
+
+    const double startTime = platform_time();
+
+    for ( int i = 0; i < numIterations; ++i )
+    {
+        for ( int j = 0; j < numLookups; ++j )
+        {
+            if ( contextManager.GetContext( lookups[j] ) )
+                numFound++;
+        }
+    }
+
+    const double finishTime = platform_time();
+
+    if ( numFound != numLookups * numIterations )
+        printf( "error: only found %d/%d contexts\n", numFound, numLookups * numIterations );
+
+    return ( finishTime - startTime ) / ( double( numLookups ) * numIterations ) * 1000000000.0;
+}
+
+void benchmark_context_manager()
+{
+    printf( "context manager lookups:\n\n" );
+
+    const int NumLookups = 4096;
+
+    Address * lookups = new Address[NumLookups];
+
+    TestPacketFactory packetFactory;
+
+    const int mappingCounts[] = { 64, 1024, 8192 };
+
+    for ( int i = 0; i < int( sizeof( mappingCounts ) / sizeof( int ) ); ++i )
+    {
+        const int numMappings = mappingCounts[i];
+
+        TransportContext context( GetDefaultAllocator(), packetFactory );
+
+        LinearContextManager * linearContextManager = new LinearContextManager( numMappings );
+        TransportContextManager * hashContextManager = new TransportContextManager( GetDefaultAllocator(), numMappings );
+
+        for ( int j = 0; j < numMappings; ++j )
+        {
+            linearContextManager->AddContextMapping( GetBenchmarkAddress( j ), context );
+            hashContextManager->AddContextMapping( GetBenchmarkAddress( j ), context );
+        }
+
+        for ( int j = 0; j < NumLookups; ++j )
+            lookups[j] = GetBenchmarkAddress( random_int( 0, numMappings - 1 ) );
+
+        // keep the total work roughly constant, so the linear search at large mapping counts doesn't take forever
+
+        const int numIterations = ( 1 << 20 ) / numMappings + 1;
+
+        const double linearTime = BenchmarkContextLookups( *linearContextManager, lookups, NumLookups, numIterations );
+        const double hashTime = BenchmarkContextLookups( *hashContextManager, lookups, NumLookups, numIterations * 64 );
+
+        printf( " + %5d mappings: linear %8.2fns, hash %6.2fns, speedup %.1fx\n", numMappings, linearTime, hashTime, linearTime / hashTime );
+
+        delete linearContextManager;
+        delete hashContextManager;
+    }
+
+    printf( "\n" );
+
+    delete [] lookups;
+}
+
+/*
+    The server used to keep connect token entries in a flat array, and scan all of them
+    for a matching mac and the oldest entry on every connection request.
+    Kept here as the baseline for comparison.
+ */
+
+class LinearConnectTokenFilter
+{
+public:
+
+    explicit LinearConnectTokenFilter( int maxEntries )
+    {
+        m_maxEntries = maxEntries;
+        m_entries = new ConnectTokenEntry[maxEntries];
+    }
+
+    ~LinearConnectTokenFilter()
+    {
+        delete [] m_entries;
+    }
+
+    bool FindOrAdd( const Address & address, const uint8_t * mac, double time, uint64_t /*expireTimestamp*/, uint64_t /*timestamp*/ )
+    {
+        int matchingTokenIndex = -1;
+        int oldestTokenIndex = -1;
+        double oldestTokenTime = 0.0;
+        for ( int i = 0; i < m_maxEntries; ++i )
+        {
+            if ( memcmp( mac, m_entries[i].mac, MacBytes ) == 0 )
+                matchingTokenIndex = i;
+
+            if ( oldestTokenIndex == -1 || m_entries[i].time < oldestTokenTime )
+            {
+                oldestTokenTime = m_entries[i].time;
+                oldestTokenIndex = i;
+            }
+        }
+
+        if ( matchingTokenIndex == -1 )
+        {
+            m_entries[oldestTokenIndex].time = time;
+            m_entries[oldestTokenIndex].address = address;
+            memcpy( m_entries[oldestTokenIndex].mac, mac, MacBytes );
+            return true;
+        }
+
+        return m_entries[matchingTokenIndex].address == address;
+    }
+
+private:
+
+    int m_maxEntries;
+    ConnectTokenEntry * m_entries;
+};
+
+/*
+    Replays a connect storm arriving at 100k connection requests per-second.
+    Even requests carry a fresh connect token. Odd requests replay one of the last
+    64 tokens from a spoofed address, and should all be rejected.
+ */
+
+const int ConnectRequestsPerSecond = 100000;
+const int ConnectTokenLifetime = 30;
+
+template <typename T> double BenchmarkConnectTokenFilter( T & filter, const uint8_t * macs, int numRequests, int & numRejected )
+{
+    numRejected = 0;
+
+    const uint64_t startTimestamp = 1000000;
+
+    int numTokens = 0;
+
+    const double startTime = platform_time();
+
+    for ( int i = 0; i < numRequests; ++i )
+    {
+        const double time = i / double( ConnectRequestsPerSecond );
+
+        const uint64_t timestamp = startTimestamp + uint64_t( time );
+
+        int token;
+        Address address;
+
+        if ( ( i & 1 ) == 0 || numTokens == 0 )
+        {
+            token = numTokens++;
+            address = GetBenchmarkAddress( token );
+        }
+        else
+        {
+            token = numTokens - 1 - ( i % 64 ) % numTokens;
+            address = GetBenchmarkAddress( numRequests + i );
+        }
+
+        if ( !filter.FindOrAdd( address, macs + token * MacBytes, time, timestamp + ConnectTokenLifetime, timestamp ) )
+            numRejected++;
+    }
+
+    const double finishTime = platform_time();
+
+    return ( finishTime - startTime ) / double( numRequests ) * 1000000000.0;
+}
+
+void benchmark_connect_token_filter()
+{
+    printf( "connect token filter at %d connection requests per-second:\n\n", ConnectRequestsPerSecond );
+
+    // one second of requests with the hash set. the linear scan gets fewer requests at large sizes so it finishes in reasonable time
+
+    const int NumRequests = ConnectRequestsPerSecond;
+
+    uint8_t * macs = new uint8_t[NumRequests*MacBytes];
+
+    RandomBytes( macs, NumRequests * MacBytes );
+
+    const int clientCounts[] = { MaxClients, 1024, MaxServerClients };
+
+    for ( int i = 0; i < int( sizeof( clientCounts ) / sizeof( int ) ); ++i )
+    {
+        const int numEntries = clientCounts[i] * ConnectTokenEntriesPerClient;
+
+        const int numLinearRequests = NumRequests / ( numEntries / 1024 + 1 );
+
+        LinearConnectTokenFilter * linearFilter = new LinearConnectTokenFilter( numEntries );
+        ConnectTokenFilter * hashFilter = new ConnectTokenFilter( GetDefaultAllocator(), numEntries );
+
+        int linearRejected = 0;
+        int hashRejected = 0;
+
+        const double linearTime = BenchmarkConnectTokenFilter( *linearFilter, macs, numLinearRequests, linearRejected );
+        const double hashTime = BenchmarkConnectTokenFilter( *hashFilter, macs, NumRequests, hashRejected );
+
+        if ( linearRejected != numLinearRequests / 2 || hashRejected != NumRequests / 2 )
+            printf( "error: expected half of the connection requests to be rejected as replays\n" );
+
+        printf( " + %6d entries: linear %9.2fns, hash %6.2fns, speedup %.1fx. hash handles %.1fM requests/sec\n", numEntries, linearTime, hashTime, linearTime / hashTime, 1000.0 / hashTime );
+
+        delete linearFilter;
+        delete hashFilter;
+    }
+
+    printf( "\n" );
+
+    delete [] macs;
+}
+
+/*
+    Server ticks with many connected clients, each sending a steady stream of messages.
+    Only the server side of each tick is timed: updating connections, generating packets,
+    and serializing and encrypting them in the transport.
+ */
+
+static const int WorkerBenchmarkClients = 256;
+
+static const int WorkerBenchmarkTicks = 200;
+
+static const int WorkerBenchmarkMessagesPerTick = 4;
+
+double BenchmarkServerWorkers( int numWorkerThreads, int & numPacketsWritten )
+{
+    ClientServerConfig clientServerConfig;
+    clientServerConfig.maxClients = WorkerBenchmarkClients;
+    clientServerConfig.clientMemory = 256 * 1024;
+    clientServerConfig.serverPerClientMemory = 256 * 1024;
+    clientServerConfig.serverWorkerThreads = numWorkerThreads;
+    clientServerConfig.connectionConfig.channel[0].maxBlockSize = 1024;
+    clientServerConfig.connectionConfig.channel[0].fragmentSize = 256;
+
+    Address serverAddress( "::1", ServerPort );
+
+    NetworkSimulator * networkSimulator = new NetworkSimulator( GetDefaultAllocator(), WorkerBenchmarkClients * 64 );
+
+    double time = 100.0;
+
+    LocalTransport * serverTransport = new LocalTransport( GetDefaultAllocator(), *networkSimulator, serverAddress, ProtocolId, time );
+
+    GameServer * server = new GameServer( GetDefaultAllocator(), *serverTransport, clientServerConfig, time );
+
+    server->SetServerAddress( serverAddress );
+
+    server->Start();
+
+    LocalMatcher matcher;
+
+    LocalTransport ** clientTransports = new LocalTransport*[WorkerBenchmarkClients];
+    GameClient ** clients = new GameClient*[WorkerBenchmarkClients];
+
+    for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+    {
+        clientTransports[i] = new LocalTransport( GetDefaultAllocator(), *networkSimulator, Address( "::1", ClientPort + i ), ProtocolId, time );
+
+        clients[i] = new GameClient( GetDefaultAllocator(), *clientTransports[i], clientServerConfig, time );
+
+        uint8_t connectTokenData[ConnectTokenBytes];
+        uint8_t connectTokenNonce[NonceBytes];
+        uint8_t clientToServerKey[KeyBytes];
+        uint8_t serverToClientKey[KeyBytes];
+        uint64_t connectTokenExpireTimestamp;
+        int numServerAddresses;
+        Address serverAddresses[MaxServersPerConnect];
+
+        memset( connectTokenNonce, 0, NonceBytes );
+
+        if ( !matcher.RequestMatch( 1 + i, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp, numServerAddresses, serverAddresses ) )
+        {
+            printf( "error: request match failed\n" );
+            exit( 1 );
+        }
+
+        clients[i]->Connect( 1 + i, serverAddresses, numServerAddresses, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp );
+    }
+
+    double serverTime = 0.0;
+
+    int numTicks = 0;
+
+    for ( int tick = 0; numTicks < WorkerBenchmarkTicks && tick < 10000; ++tick )
+    {
+        const bool connected = server->GetNumConnectedClients() == WorkerBenchmarkClients;
+
+        if ( connected )
+        {
+            for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+            {
+                for ( int j = 0; j < WorkerBenchmarkMessagesPerTick && server->CanSendMsg( i ); ++j )
+                {
+                    Message * message = server->CreateMsg( i, TEST_MESSAGE );
+                    if ( message )
+                        server->SendMsg( i, message );
+                }
+            }
+        }
+
+        const double sendStartTime = platform_time();
+
+        server->SendPackets();
+
+        serverTransport->WritePackets();
+
+        const double sendFinishTime = platform_time();
+
+        for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+        {
+            clients[i]->SendPackets();
+            clientTransports[i]->WritePackets();
+        }
+
+        serverTransport->ReadPackets();
+
+        for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+            clientTransports[i]->ReadPackets();
+
+        server->ReceivePackets();
+
+        for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+        {
+            clients[i]->ReceivePackets();
+
+            while ( Message * message = clients[i]->ReceiveMsg() )
+                clients[i]->ReleaseMsg( message );
+        }
+
+        server->CheckForTimeOut();
+
+        for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+            clients[i]->CheckForTimeOut();
+
+        time += 0.01;
+
+        for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+        {
+            clients[i]->AdvanceTime( time );
+            clientTransports[i]->AdvanceTime( time );
+        }
+
+        const double advanceStartTime = platform_time();
+
+        server->AdvanceTime( time );
+
+        const double advanceFinishTime = platform_time();
+
+        serverTransport->AdvanceTime( time );
+
+        if ( connected )
+        {
+            serverTime += ( sendFinishTime - sendStartTime ) + ( advanceFinishTime - advanceStartTime );
+            numTicks++;
+        }
+    }
+
+    if ( numTicks < WorkerBenchmarkTicks )
+        printf( "error: only %d/%d clients connected\n", server->GetNumConnectedClients(), WorkerBenchmarkClients );
+
+    numPacketsWritten = int( serverTransport->GetCounter( TRANSPORT_COUNTER_PACKETS_WRITTEN ) );
+
+    for ( int i = 0; i < WorkerBenchmarkClients; ++i )
+    {
+        clients[i]->Disconnect();
+        delete clients[i];
+        delete clientTransports[i];
+    }
+
+    delete [] clients;
+    delete [] clientTransports;
+
+    server->Stop();
+
+    delete server;
+    delete serverTransport;
+    delete networkSimulator;
+
+    return numTicks > 0 ? serverTime / numTicks * 1000000.0 : 0.0;
+}
+
+void benchmark_server_workers()
+{
+    const int numCores = platform_num_cores();
+
+    printf( "server tick with %d clients, 1 to %d cores:\n\n", WorkerBenchmarkClients, numCores );
+
+    double baseTime = 0.0;
+
+    for ( int numWorkerThreads = 0; numWorkerThreads < numCores; ++numWorkerThreads )
+    {
+        int numPacketsWritten = 0;
+
+        const double tickTime = BenchmarkServerWorkers( numWorkerThreads, numPacketsWritten );
+
+        if ( numWorkerThreads == 0 )
+            baseTime = tickTime;
+
+        printf( " + %2d cores: %9.2fus per-tick, speedup %.2fx (%d packets written)\n", numWorkerThreads + 1, tickTime, baseTime / tickTime, numPacketsWritten );
+    }
+
+    printf( "\n" );
+}
+
+/*
+    Handing values between threads through a mutex-protected queue vs. the lock-free queues.
+    Throughput streams values from one or more producer threads to a consumer. Latency
+    bounces a value back and forth between two threads through a pair of queues.
+ */
+
+static const int QueueBenchmarkSize = 1024;
+
+static const int QueueBenchmarkValues = 1000000;
+
+static const int QueueBenchmarkRoundTrips = 100000;
+
+static const int MaxQueueBenchmarkProducers = 4;
+
+class MutexQueue
+{
+public:
+
+    MutexQueue( Allocator & allocator, int size ) : m_queue( allocator, size )
+    {
+        m_mutex = platform_mutex_create( allocator );
+        m_allocator = &allocator;
+    }
+
+    ~MutexQueue()
+    {
+        platform_mutex_destroy( *m_allocator, m_mutex );
+    }
+
+    bool Push( const uint32_t & value )
+    {
+        platform_mutex_acquire( m_mutex );
+        const bool full = m_queue.IsFull();
+        if ( !full )
+            m_queue.Push( value );
+        platform_mutex_release( m_mutex );
+        return !full;
+    }
+
+    bool Pop( uint32_t & value )
+    {
+        platform_mutex_acquire( m_mutex );
+        const bool empty = m_queue.IsEmpty();
+        if ( !empty )
+            value = m_queue.Pop();
+        platform_mutex_release( m_mutex );
+        return !empty;
+    }
+
+private:
+
+    Allocator * m_allocator;
+    PlatformMutex * m_mutex;
+    Queue<uint32_t> m_queue;
+};
+
+template <typename T> struct QueueBenchmarkThreadData
+{
+    T * queue;
+    T * replyQueue;
+    int numValues;
+};
+
+template <typename T> static void QueueBenchmarkProducer( void * data )
+{
+    QueueBenchmarkThreadData<T> * thread = (QueueBenchmarkThreadData<T>*) data;
+
+    for ( int i = 0; i < thread->numValues; ++i )
+    {
+        while ( !thread->queue->Push( uint32_t( i ) ) )
+            platform_sleep( 0.0 );
+    }
+}
+
+template <typename T> static void QueueBenchmarkEcho( void * data )
+{
+    QueueBenchmarkThreadData<T> * thread = (QueueBenchmarkThreadData<T>*) data;
+
+    for ( int i = 0; i < thread->numValues; ++i )
+    {
+        uint32_t value;
+
+        while ( !thread->queue->Pop( value ) )
+            platform_sleep( 0.0 );
+
+        while ( !thread->replyQueue->Push( value ) )
+            platform_sleep( 0.0 );
+    }
+}
+
+template <typename T> double BenchmarkQueueThroughput( int numProducers )
+{
+    T queue( GetDefaultAllocator(), QueueBenchmarkSize );
+
+    const int numValuesPerProducer = QueueBenchmarkValues / numProducers;
+
+    QueueBenchmarkThreadData<T> data[MaxQueueBenchmarkProducers];
+    PlatformThread * threads[MaxQueueBenchmarkProducers];
+
+    const double startTime = platform_time();
+
+    for ( int i = 0; i < numProducers; ++i )
+    {
+        data[i].queue = &queue;
+        data[i].replyQueue = NULL;
+        data[i].numValues = numValuesPerProducer;
+        threads[i] = platform_thread_create( GetDefaultAllocator(), QueueBenchmarkProducer<T>, &data[i] );
+    }
+
+    const int numValues = numValuesPerProducer * numProducers;
+
+    for ( int i = 0; i < numValues; ++i )
+    {
+        uint32_t value;
+        while ( !queue.Pop( value ) )
+            platform_sleep( 0.0 );
+    }
+
+    const double finishTime = platform_time();
+
+    for ( int i = 0; i < numProducers; ++i )
+    {
+        platform_thread_join( threads[i] );
+        platform_thread_destroy( GetDefaultAllocator(), threads[i] );
+    }
+
+    return numValues / ( finishTime - startTime ) / 1000000.0;
+}
+
+template <typename T> double BenchmarkQueueLatency()
+{
+    T queue( GetDefaultAllocator(), QueueBenchmarkSize );
+    T replyQueue( GetDefaultAllocator(), QueueBenchmarkSize );
+
+    QueueBenchmarkThreadData<T> data;
+    data.queue = &queue;
+    data.replyQueue = &replyQueue;
+    data.numValues = QueueBenchmarkRoundTrips;
+
+    PlatformThread * thread = platform_thread_create( GetDefaultAllocator(), QueueBenchmarkEcho<T>, &data );
+
+    const double startTime = platform_time();
+
+    for ( int i = 0; i < QueueBenchmarkRoundTrips; ++i )
+    {
+        while ( !queue.Push( uint32_t( i ) ) )
+            platform_sleep( 0.0 );
+
+        uint32_t value;
+        while ( !replyQueue.Pop( value ) )
+            platform_sleep( 0.0 );
+
+        if ( value != uint32_t( i ) )
+            printf( "error: round trip returned %u, expected %d\n", value, i );
+    }
+
+    const double finishTime = platform_time();
+
+    platform_thread_join( thread );
+    platform_thread_destroy( GetDefaultAllocator(), thread );
+
+    return ( finishTime - startTime ) / QueueBenchmarkRoundTrips * 1000000000.0;
+}
+
+void benchmark_queues()
+{
+    printf( "queues handing %d values between threads:\n\n", QueueBenchmarkValues );
+
+    const double mutexThroughput = BenchmarkQueueThroughput<MutexQueue>( 1 );
+    const double spscThroughput = BenchmarkQueueThroughput< SPSCQueue<uint32_t> >( 1 );
+    const double mpscThroughput = BenchmarkQueueThroughput< MPSCQueue<uint32_t> >( 1 );
+
+    printf( " + 1 producer:  mutex %6.2fM/sec, spsc %6.2fM/sec (%.1fx), mpsc %6.2fM/sec (%.1fx)\n", mutexThroughput, spscThroughput, spscThroughput / mutexThroughput, mpscThroughput, mpscThroughput / mutexThroughput );
+
+    const double mutexThroughputShared = BenchmarkQueueThroughput<MutexQueue>( MaxQueueBenchmarkProducers );
+    const double mpscThroughputShared = BenchmarkQueueThroughput< MPSCQueue<uint32_t> >( MaxQueueBenchmarkProducers );
+
+    printf( " + %d producers: mutex %6.2fM/sec, mpsc %6.2fM/sec (%.1fx)\n", MaxQueueBenchmarkProducers, mutexThroughputShared, mpscThroughputShared, mpscThroughputShared / mutexThroughputShared );
+
+    const double mutexLatency = BenchmarkQueueLatency<MutexQueue>();
+    const double spscLatency = BenchmarkQueueLatency< SPSCQueue<uint32_t> >();
+    const double mpscLatency = BenchmarkQueueLatency< MPSCQueue<uint32_t> >();
+
+    printf( " + round trip:  mutex %8.2fns, spsc %8.2fns, mpsc %8.2fns\n", mutexLatency, spscLatency, mpscLatency );
+
+    printf( "\n" );
+}
+
+const int CryptoBenchmarkBytes = 64 * 1024 * 1024;
+
+static double BenchmarkCipherSuite( int cipherSuite, int packetBytes, bool useCipherState )
+{
+    uint8_t key[KeyBytes];
+    uint8_t nonce[NonceBytes];
+    uint8_t mac[MacBytes];
+
+    GenerateKey( key );
+    memset( nonce, 0, NonceBytes );
+
+    uint8_t cipherStateBuffer[CipherStateBytes + 15];
+    uint8_t * cipherState = (uint8_t*) ( ( uintptr_t( cipherStateBuffer ) + 15 ) & ~uintptr_t( 15 ) );
+
+    if ( !useCipherState )
+        cipherState = NULL;
+    else if ( !InitializeCipherState( cipherState, key, cipherSuite ) )
+        return 0.0;
+
+    uint8_t * packetData = (uint8_t*) YOJIMBO_ALLOCATE( GetDefaultAllocator(), packetBytes );
+    memset( packetData, 0, packetBytes );
+
+    const int numPackets = CryptoBenchmarkBytes / packetBytes;
+
+    const double startTime = platform_time();
+
+    for ( int i = 0; i < numPackets; ++i )
+    {
+        nonce[0] = uint8_t( i );
+
+        if ( !Encrypt_InPlace( packetData, packetBytes, mac, nonce, key, cipherSuite, cipherState ) || 
+             !Decrypt_InPlace( packetData, packetBytes, mac, nonce, key, cipherSuite, cipherState ) )
+        {
+            printf( "error: %s failed to round trip a %d byte packet\n", GetCipherSuiteName( cipherSuite ), packetBytes );
+            break;
+        }
+    }
+
+    const double finishTime = platform_time();
+
+    YOJIMBO_FREE( GetDefaultAllocator(), packetData );
+
+    return double( numPackets ) * packetBytes / ( finishTime - startTime ) / ( 1024.0 * 1024.0 );
+}
+
+void benchmark_crypto()
+{
+    printf( "packet cipher suites encrypting and decrypting %dMB in place:\n\n", CryptoBenchmarkBytes / ( 1024 * 1024 ) );
+
+    const int packetSizes[] = { 16, 64, 256, 1200, 4096 };
+
+    for ( int i = 0; i < int( sizeof( packetSizes ) / sizeof( packetSizes[0] ) ); ++i )
+    {
+        printf( " + %4d byte packets:", packetSizes[i] );
+
+        for ( int cipherSuite = 0; cipherSuite < CIPHER_SUITE_NUM_VALUES; ++cipherSuite )
+        {
+            if ( !IsCipherSuiteAvailable( cipherSuite ) )
+            {
+                printf( "  %s unavailable", GetCipherSuiteName( cipherSuite ) );
+                continue;
+            }
+
+            printf( "  %s %8.2fMB/sec", GetCipherSuiteName( cipherSuite ), BenchmarkCipherSuite( cipherSuite, packetSizes[i], false ) );
+
+            // cipher suites with precomputed cipher state are measured again with it, the way the transport uses them
+
+            const double cachedThroughput = BenchmarkCipherSuite( cipherSuite, packetSizes[i], true );
+
+            if ( cachedThroughput > 0.0 )
+                printf( " (cached %8.2fMB/sec)", cachedThroughput );
+        }
+
+        printf( "\n" );
+    }
+
+    printf( "\n" );
+}
+
+/*
+    The bitpacker used to flush and fill its scratch value a dword at a time, and copied byte arrays a dword at a time between bitpacked head and tail bytes.
+    Kept here as the baseline for comparison. Writes exactly the same bits as BitWriter.
+ */
+
+class DwordBitWriter
+{
+public:
+
+    DwordBitWriter( void * data, int bytes ) : m_data( (uint8_t*) data ), m_scratch( 0 ), m_wordIndex( 0 ), m_scratchBits( 0 ), m_bitsWritten( 0 ) { (void) bytes; }
+
+    void WriteBits( uint32_t value, int bits )
+    {
+        m_scratch |= uint64_t( value ) << m_scratchBits;
+        m_scratchBits += bits;
+        if ( m_scratchBits >= 32 )
+        {
+            const uint32_t word = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
+            memcpy( m_data + m_wordIndex * 4, &word, 4 );
+            m_scratch >>= 32;
+            m_scratchBits -= 32;
+            m_wordIndex++;
+        }
+        m_bitsWritten += bits;
+    }
+
+    void WriteAlign()
+    {
+        if ( m_bitsWritten % 8 )
+            WriteBits( 0, 8 - m_bitsWritten % 8 );
+    }
+
+    void WriteBytes( const uint8_t * data, int bytes )
+    {
+        int headBytes = ( 4 - ( m_bitsWritten % 32 ) / 8 ) % 4;
+        if ( headBytes > bytes )
+            headBytes = bytes;
+        for ( int i = 0; i < headBytes; ++i )
+            WriteBits( data[i], 8 );
+        if ( headBytes == bytes )
+            return;
+        FlushBits();
+        const int numWords = ( bytes - headBytes ) / 4;
+        memcpy( m_data + m_wordIndex * 4, data + headBytes, numWords * 4 );
+        m_bitsWritten += numWords * 32;
+        m_wordIndex += numWords;
+        m_scratch = 0;
+        for ( int i = headBytes + numWords * 4; i < bytes; ++i )
+            WriteBits( data[i], 8 );
+    }
+
+    void FlushBits()
+    {
+        if ( m_scratchBits != 0 )
+        {
+            const uint32_t word = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
+            memcpy( m_data + m_wordIndex * 4, &word, 4 );
+            m_scratch >>= 32;
+            m_scratchBits -= 32;
+            m_wordIndex++;
+        }
+    }
+
+    int GetBytesWritten() const { return ( m_bitsWritten + 7 ) / 8; }
+
+private:
+
+    uint8_t * m_data;
+    uint64_t m_scratch;
+    int m_wordIndex;
+    int m_scratchBits;
+    int m_bitsWritten;
+};
+
+class DwordBitReader
+{
+public:
+
+    DwordBitReader( const void * data, int bytes ) : m_data( (const uint8_t*) data ), m_numBytes( bytes ), m_scratch( 0 ), m_wordIndex( 0 ), m_scratchBits( 0 ), m_bitsRead( 0 ) {}
+
+    uint32_t ReadBits( int bits )
+    {
+        m_bitsRead += bits;
+        if ( m_scratchBits < bits )
+        {
+            uint32_t word = 0;
+            const int wordBytes = m_numBytes - m_wordIndex * 4;
+            memcpy( &word, m_data + m_wordIndex * 4, ( wordBytes < 4 ) ? wordBytes : 4 );
+            m_scratch |= uint64_t( network_to_host( word ) ) << m_scratchBits;
+            m_scratchBits += 32;
+            m_wordIndex++;
+        }
+        const uint32_t output = m_scratch & ( ( uint64_t(1) << bits ) - 1 );
+        m_scratch >>= bits;
+        m_scratchBits -= bits;
+        return output;
+    }
+
+    bool ReadAlign()
+    {
+        if ( m_bitsRead % 8 )
+            return ReadBits( 8 - m_bitsRead % 8 ) == 0;
+        return true;
+    }
+
+    void ReadBytes( uint8_t * data, int bytes )
+    {
+        int headBytes = ( 4 - ( m_bitsRead % 32 ) / 8 ) % 4;
+        if ( headBytes > bytes )
+            headBytes = bytes;
+        for ( int i = 0; i < headBytes; ++i )
+            data[i] = (uint8_t) ReadBits( 8 );
+        if ( headBytes == bytes )
+            return;
+        const int numWords = ( bytes - headBytes ) / 4;
+        memcpy( data + headBytes, m_data + m_wordIndex * 4, numWords * 4 );
+        m_bitsRead += numWords * 32;
+        m_wordIndex += numWords;
+        m_scratchBits = 0;
+        for ( int i = headBytes + numWords * 4; i < bytes; ++i )
+            data[i] = (uint8_t) ReadBits( 8 );
+    }
+
+private:
+
+    const uint8_t * m_data;
+    int m_numBytes;
+    uint64_t m_scratch;
+    int m_wordIndex;
+    int m_scratchBits;
+    int m_bitsRead;
+};
+
+const int BitpackerBenchmarkPacketBytes = 1200;
+const int BitpackerBenchmarkPackets = 200000;
+const int BitpackerBenchmarkMaxValues = BitpackerBenchmarkPacketBytes * 8;
+const int BitpackerBenchmarkByteArrayBytes = 64;
+
+/*
+    Each pattern is a sequence of bit counts, like the serialize_* calls in a packet serialize function would make.
+    A bit count of zero stands for serialize_bytes of a byte array: an align followed by BitpackerBenchmarkByteArrayBytes bytes.
+ */
+
+struct BitpackerBenchmarkPattern
+{
+    const char * name;
+    int numValues;
+    int bits[BitpackerBenchmarkMaxValues];
+    uint32_t values[BitpackerBenchmarkMaxValues];
+};
+
+static void InitBitpackerBenchmarkPattern( BitpackerBenchmarkPattern & pattern, const char * name, const int * bitCycle, int bitCycleLength )
+{
+    pattern.name = name;
+    pattern.numValues = 0;
+
+    int totalBits = 0;
+
+    for ( int i = 0; ; ++i )
+    {
+        const int bits = bitCycle[i % bitCycleLength];
+        const int worstCaseBits = bits ? bits : 7 + BitpackerBenchmarkByteArrayBytes * 8;
+        if ( totalBits + worstCaseBits > ( BitpackerBenchmarkPacketBytes - 4 ) * 8 )
+            break;
+        pattern.bits[pattern.numValues] = bits;
+        pattern.values[pattern.numValues] = bits ? uint32_t( rand() ) & uint32_t( ( 1ULL << bits ) - 1 ) : 0;
+        pattern.numValues++;
+        totalBits += worstCaseBits;
+    }
+}
+
+template <typename Writer, typename Reader> void BenchmarkBitpackerPattern( const BitpackerBenchmarkPattern & pattern, double & writeBitsPerNanosecond, double & readBitsPerNanosecond )
+{
+    uint8_t packet[BitpackerBenchmarkPacketBytes];
+    uint8_t byteArray[BitpackerBenchmarkByteArrayBytes];
+    memset( packet, 0, sizeof( packet ) );
+    memset( byteArray, 0x5A, sizeof( byteArray ) );
+
+    int packetBytes = 0;
+
+    double startTime = platform_time();
+
+    for ( int i = 0; i < BitpackerBenchmarkPackets; ++i )
+    {
+        Writer writer( packet, BitpackerBenchmarkPacketBytes );
+        for ( int j = 0; j < pattern.numValues; ++j )
+        {
+            if ( pattern.bits[j] )
+            {
+                writer.WriteBits( pattern.values[j], pattern.bits[j] );
+            }
+            else
+            {
+                writer.WriteAlign();
+                writer.WriteBytes( byteArray, BitpackerBenchmarkByteArrayBytes );
+            }
+        }
+        writer.FlushBits();
+        packetBytes = writer.GetBytesWritten();
+    }
+
+    double finishTime = platform_time();
+
+    const double totalBits = double( packetBytes ) * 8 * BitpackerBenchmarkPackets;
+
+    writeBitsPerNanosecond = totalBits / ( ( finishTime - startTime ) * 1000000000.0 );
+
+    uint32_t checksum = 0;
+
+    startTime = platform_time();
+
+    for ( int i = 0; i < BitpackerBenchmarkPackets; ++i )
+    {
+        Reader reader( packet, packetBytes );
+        for ( int j = 0; j < pattern.numValues; ++j )
+        {
+            if ( pattern.bits[j] )
+            {
+                checksum += reader.ReadBits( pattern.bits[j] ) ^ pattern.values[j];
+            }
+            else
+            {
+                reader.ReadAlign();
+                reader.ReadBytes( byteArray, BitpackerBenchmarkByteArrayBytes );
+                checksum += byteArray[0] ^ 0x5A;
+            }
+        }
+    }
+
+    finishTime = platform_time();
+
+    readBitsPerNanosecond = totalBits / ( ( finishTime - startTime ) * 1000000000.0 );
+
+    if ( checksum != 0 )
+        printf( "error: %s read back different values than were written\n", pattern.name );
+}
+
+void benchmark_bitpacker()
+{
+    printf( "bitpacker writing and reading %d x %d byte packets (bits/ns):\n\n", BitpackerBenchmarkPackets, BitpackerBenchmarkPacketBytes );
+
+    static const int bools[] = { 1 };
+    static const int bytes[] = { 8 };
+    static const int ints[] = { 32 };
+    static const int mixed[] = { 1, 3, 7, 8, 10, 16, 5, 22, 1, 32, 2, 12 };
+    static const int byteArrays[] = { 3, 0, 1, 10 };
+
+    static BitpackerBenchmarkPattern patterns[5];
+
+    InitBitpackerBenchmarkPattern( patterns[0], "serialize_bool", bools, 1 );
+    InitBitpackerBenchmarkPattern( patterns[1], "serialize_int [0,255]", bytes, 1 );
+    InitBitpackerBenchmarkPattern( patterns[2], "serialize_bits 32", ints, 1 );
+    InitBitpackerBenchmarkPattern( patterns[3], "serialize_int mixed ranges", mixed, sizeof( mixed ) / sizeof( mixed[0] ) );
+    InitBitpackerBenchmarkPattern( patterns[4], "serialize_bytes (64 bytes)", byteArrays, sizeof( byteArrays ) / sizeof( byteArrays[0] ) );
+
+    for ( int i = 0; i < int( sizeof( patterns ) / sizeof( patterns[0] ) ); ++i )
+    {
+        double dwordWrite, dwordRead, qwordWrite, qwordRead;
+
+        BenchmarkBitpackerPattern<DwordBitWriter,DwordBitReader>( patterns[i], dwordWrite, dwordRead );
+        BenchmarkBitpackerPattern<BitWriter,BitReader>( patterns[i], qwordWrite, qwordRead );
+
+        printf( " + %-28s write %6.2f -> %6.2f (%.2fx), read %6.2f -> %6.2f (%.2fx)\n", patterns[i].name, dwordWrite, qwordWrite, qwordWrite / dwordWrite, dwordRead, qwordRead, qwordRead / dwordRead );
+    }
+
+    printf( "\n" );
+}
+
+const int ChecksumBenchmarkBytes = 256 * 1024 * 1024;
+
+static double BenchmarkChecksum( int checksumType, bool software, int packetBytes )
+{
+    uint8_t packet[4096];
+    for ( int i = 0; i < packetBytes; ++i )
+        packet[i] = (uint8_t) rand();
+
+    const int numPackets = ChecksumBenchmarkBytes / packetBytes;
+
+    uint32_t result = 0;
+
+    const double startTime = platform_time();
+
+    for ( int i = 0; i < numPackets; ++i )
+    {
+        if ( software )
+            result ^= calculate_crc32c_software( packet, packetBytes );
+        else
+            result ^= calculate_checksum( checksumType, packet, packetBytes );
+    }
+
+    const double finishTime = platform_time();
+
+    // keep the result live so the loop isn't optimized away
+
+    if ( result == 0x12345678 )
+        printf( "*" );
+
+    return ChecksumBenchmarkBytes / ( finishTime - startTime ) / ( 1024 * 1024 );
+}
+
+void benchmark_checksum()
+{
+    printf( "unencrypted packet checksums over %dMB (crc32c %s):\n\n", ChecksumBenchmarkBytes / ( 1024 * 1024 ), is_crc32c_hardware_accelerated() ? "hardware accelerated" : "software only" );
+
+    const int packetSizes[] = { 64, 256, 1200, 4096 };
+
+    for ( int i = 0; i < int( sizeof( packetSizes ) / sizeof( packetSizes[0] ) ); ++i )
+    {
+        const double crc32 = BenchmarkChecksum( CHECKSUM_CRC32, false, packetSizes[i] );
+        const double crc32c_software = BenchmarkChecksum( CHECKSUM_CRC32C, true, packetSizes[i] );
+        const double crc32c = BenchmarkChecksum( CHECKSUM_CRC32C, false, packetSizes[i] );
+
+        printf( " + %4d byte packets: crc32 %9.2fMB/sec, crc32c software %9.2fMB/sec, crc32c %9.2fMB/sec (%.2fx)\n", packetSizes[i], crc32, crc32c_software, crc32c, crc32c / crc32 );
+    }
+
+    printf( "\n" );
+}
+
+const int MessageBenchmarkClients = 64;
+const int MessageBenchmarkTicks = 60 * 60;
+const int MessageBenchmarkMessagesPerTick = 8;
+
+static void BenchmarkMessageFactories( int messagePoolSize, double & nanosecondsPerMessage, double & allocatorCallsPerSecond )
+{
+    // each client has its own allocator and message factory, like the server. every tick each client creates a batch of small messages, and releases the batch from the previous tick
+
+    const int ClientMemory = 256 * 1024;
+
+    uint8_t * memory = (uint8_t*) malloc( ClientMemory * MessageBenchmarkClients );
+
+    TLSF_Allocator * allocators[MessageBenchmarkClients];
+    TestMessageFactory * messageFactories[MessageBenchmarkClients];
+    Message * messages[MessageBenchmarkClients][2][MessageBenchmarkMessagesPerTick];
+
+    for ( int i = 0; i < MessageBenchmarkClients; ++i )
+    {
+        allocators[i] = new TLSF_Allocator( memory + i * ClientMemory, ClientMemory );
+        messageFactories[i] = new TestMessageFactory( *allocators[i] );
+        if ( messagePoolSize > 0 )
+        {
+            messageFactories[i]->EnablePooling( messagePoolSize );
+            messageFactories[i]->PreallocateMessages();
+        }
+        memset( messages[i], 0, sizeof( messages[i] ) );
+    }
+
+    uint64_t startAllocatorCalls = 0;
+    for ( int i = 0; i < MessageBenchmarkClients; ++i )
+        startAllocatorCalls += messageFactories[i]->GetNumAllocatorCalls();
+
+    const double startTime = platform_time();
+
+    for ( int tick = 0; tick < MessageBenchmarkTicks; ++tick )
+    {
+        for ( int i = 0; i < MessageBenchmarkClients; ++i )
+        {
+            Message ** current = messages[i][tick&1];
+            Message ** previous = messages[i][(tick+1)&1];
+
+            for ( int j = 0; j < MessageBenchmarkMessagesPerTick; ++j )
+            {
+                if ( previous[j] )
+                    messageFactories[i]->Release( previous[j] );
+                previous[j] = NULL;
+
+                current[j] = messageFactories[i]->Create( TEST_MESSAGE );
+                ( (TestMessage*) current[j] )->sequence = uint16_t( tick );
+            }
+        }
+    }
+
+    const double finishTime = platform_time();
+
+    uint64_t finishAllocatorCalls = 0;
+    for ( int i = 0; i < MessageBenchmarkClients; ++i )
+        finishAllocatorCalls += messageFactories[i]->GetNumAllocatorCalls();
+
+    const int numMessages = MessageBenchmarkTicks * MessageBenchmarkClients * MessageBenchmarkMessagesPerTick;
+
+    nanosecondsPerMessage = ( finishTime - startTime ) * 1000000000.0 / numMessages;
+
+    // allocator calls per-second of simulated time at 60 ticks per-second, not wall clock time
+
+    allocatorCallsPerSecond = double( finishAllocatorCalls - startAllocatorCalls ) / ( MessageBenchmarkTicks / 60.0 );
+
+    for ( int i = 0; i < MessageBenchmarkClients; ++i )
+    {
+        for ( int j = 0; j < MessageBenchmarkMessagesPerTick; ++j )
+        {
+            for ( int k = 0; k < 2; ++k )
+            {
+                if ( messages[i][k][j] )
+                    messageFactories[i]->Release( messages[i][k][j] );
+            }
+        }
+        delete messageFactories[i];
+        delete allocators[i];
+    }
+
+    free( memory );
+}
+
+void benchmark_message_factory()
+{
+    printf( "message factories for %d clients creating %d messages per-tick at 60Hz:\n\n", MessageBenchmarkClients, MessageBenchmarkMessagesPerTick );
+
+    double unpooledTime, unpooledCalls;
+    double pooledTime, pooledCalls;
+
+    BenchmarkMessageFactories( 0, unpooledTime, unpooledCalls );
+    BenchmarkMessageFactories( 2 * MessageBenchmarkMessagesPerTick, pooledTime, pooledCalls );
+
+    printf( " + allocated: %6.2fns per-message, %9.0f allocator calls per-second\n", unpooledTime, unpooledCalls );
+    printf( " + pooled:    %6.2fns per-message, %9.0f allocator calls per-second (%.2fx)\n", pooledTime, pooledCalls, unpooledTime / pooledTime );
+
+    printf( "\n" );
+}
+
+const int BroadcastBenchmarkClients = 64;
+const int BroadcastBenchmarkBlockSize = 16 * 1024;
+const int BroadcastBenchmarkIterations = 1000;
+
+static double BenchmarkBroadcastBlock( bool shared, int & bytesAllocated )
+{
+    // attach the same block to a message for every client, each client with its own allocator and message factory like the server, then release the messages
+
+    const int ClientMemory = 256 * 1024;
+
+    uint8_t * memory = (uint8_t*) malloc( ClientMemory * ( BroadcastBenchmarkClients + 1 ) );
+
+    TLSF_Allocator globalAllocator( memory, ClientMemory );
+
+    TLSF_Allocator * allocators[BroadcastBenchmarkClients];
+    TestMessageFactory * messageFactories[BroadcastBenchmarkClients];
+
+    for ( int i = 0; i < BroadcastBenchmarkClients; ++i )
+    {
+        allocators[i] = new TLSF_Allocator( memory + ( i + 1 ) * ClientMemory, ClientMemory );
+        messageFactories[i] = new TestMessageFactory( *allocators[i] );
+    }
+
+    uint8_t * blockData = (uint8_t*) malloc( BroadcastBenchmarkBlockSize );
+    for ( int i = 0; i < BroadcastBenchmarkBlockSize; ++i )
+        blockData[i] = (uint8_t) rand();
+
+    BlockMessage * messages[BroadcastBenchmarkClients];
+
+    bytesAllocated = 0;
+
+    const double startTime = platform_time();
+
+    for ( int iteration = 0; iteration < BroadcastBenchmarkIterations; ++iteration )
+    {
+        SharedBlock * sharedBlock = shared ? YOJIMBO_NEW( globalAllocator, SharedBlock, globalAllocator, blockData, BroadcastBenchmarkBlockSize ) : NULL;
+
+        for ( int i = 0; i < BroadcastBenchmarkClients; ++i )
+        {
+            messages[i] = (BlockMessage*) messageFactories[i]->Create( TEST_BLOCK_MESSAGE );
+
+            if ( shared )
+            {
+                messages[i]->AttachSharedBlock( sharedBlock );
+            }
+            else
+            {
+                uint8_t * copy = (uint8_t*) YOJIMBO_ALLOCATE( *allocators[i], BroadcastBenchmarkBlockSize );
+                memcpy( copy, blockData, BroadcastBenchmarkBlockSize );
+                messages[i]->AttachBlock( *allocators[i], copy, BroadcastBenchmarkBlockSize );
+            }
+        }
+
+        if ( iteration == 0 )
+            bytesAllocated = shared ? BroadcastBenchmarkBlockSize : BroadcastBenchmarkBlockSize * BroadcastBenchmarkClients;
+
+        for ( int i = 0; i < BroadcastBenchmarkClients; ++i )
+            messageFactories[i]->Release( messages[i] );
+
+        if ( sharedBlock )
+        {
+            sharedBlock->Release();
+            YOJIMBO_DELETE( globalAllocator, SharedBlock, sharedBlock );
+        }
+    }
+
+    const double finishTime = platform_time();
+
+    for ( int i = 0; i < BroadcastBenchmarkClients; ++i )
+    {
+        delete messageFactories[i];
+        delete allocators[i];
+    }
+
+    free( blockData );
+    free( memory );
+
+    return ( finishTime - startTime ) * 1000000.0 / BroadcastBenchmarkIterations;
+}
+
+void benchmark_shared_blocks()
+{
+    printf( "attaching a %dKB block to messages for %d clients:\n\n", BroadcastBenchmarkBlockSize / 1024, BroadcastBenchmarkClients );
+
+    int copiedBytes, sharedBytes;
+
+    const double copiedTime = BenchmarkBroadcastBlock( false, copiedBytes );
+    const double sharedTime = BenchmarkBroadcastBlock( true, sharedBytes );
+
+    printf( " + copied per-client: %8.2fus per-broadcast, %7d block bytes allocated\n", copiedTime, copiedBytes );
+    printf( " + shared:            %8.2fus per-broadcast, %7d block bytes allocated (%.2fx)\n", sharedTime, sharedBytes, copiedTime / sharedTime );
+
+    printf( "\n" );
+}
+
+const int SnapshotBenchmarkClients = 64;
+const int SnapshotBenchmarkEntities = 24;
+const int SnapshotBenchmarkIterations = 2000;
+
+struct SnapshotBenchmarkMessage : public Message
+{
+    struct Entity
+    {
+        int position[3];
+        uint32_t orientation[3];
+        bool interacting;
+    };
+
+    Entity entities[SnapshotBenchmarkEntities];
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        for ( int i = 0; i < SnapshotBenchmarkEntities; ++i )
+        {
+            for ( int j = 0; j < 3; ++j )
+                serialize_int( stream, entities[i].position[j], -1000, 1000 );
+            for ( int j = 0; j < 3; ++j )
+                serialize_bits( stream, entities[i].orientation[j], 10 );
+            serialize_bool( stream, entities[i].interacting );
+        }
+        return true;
+    }
+
+    YOJIMBO_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+YOJIMBO_MESSAGE_FACTORY_START( SnapshotBenchmarkMessageFactory, MessageFactory, 1 );
+    YOJIMBO_DECLARE_MESSAGE_TYPE( 0, SnapshotBenchmarkMessage );
+YOJIMBO_MESSAGE_FACTORY_FINISH();
+
+static double BenchmarkBroadcastSnapshot( bool serializeOnce )
+{
+    // write a snapshot message into channel packet data for every client, either serializing it per-client or copying in the bits of a payload serialized once
+
+    ChannelConfig channelConfig;
+    channelConfig.type = CHANNEL_TYPE_UNRELIABLE_UNORDERED;
+
+    SnapshotBenchmarkMessageFactory messageFactory( GetDefaultAllocator() );
+
+    SnapshotBenchmarkMessage * snapshot = (SnapshotBenchmarkMessage*) messageFactory.Create( 0 );
+    for ( int i = 0; i < SnapshotBenchmarkEntities; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            snapshot->entities[i].position[j] = rand() % 2001 - 1000;
+            snapshot->entities[i].orientation[j] = rand() % 1024;
+        }
+        snapshot->entities[i].interacting = ( rand() & 1 ) != 0;
+    }
+
+    const int PacketBytes = 1024;
+
+    uint8_t * packetData = (uint8_t*) malloc( PacketBytes );
+    uint8_t * payloadData = (uint8_t*) malloc( PacketBytes );
+
+    Message * messages[SnapshotBenchmarkClients];
+    ChannelPacketData packets[SnapshotBenchmarkClients];
+
+    for ( int i = 0; i < SnapshotBenchmarkClients; ++i )
+    {
+        packets[i].Initialize();
+        packets[i].channelId = 0;
+        packets[i].message.numMessages = 1;
+        packets[i].message.messages = &messages[i];
+    }
+
+    const double startTime = platform_time();
+
+    for ( int iteration = 0; iteration < SnapshotBenchmarkIterations; ++iteration )
+    {
+        // like the server, each broadcast creates a message per-client
+
+        SharedBlock * payload = NULL;
+
+        if ( serializeOnce )
+        {
+            WriteStream stream( payloadData, PacketBytes );
+            snapshot->SerializeInternal( stream );
+            stream.Flush();
+            payload = YOJIMBO_NEW( GetDefaultAllocator(), SharedBlock, GetDefaultAllocator(), payloadData, stream.GetBytesProcessed() );
+
+            for ( int i = 0; i < SnapshotBenchmarkClients; ++i )
+            {
+                messages[i] = messageFactory.Create( 0 );
+                messages[i]->AttachSerializedPayload( payload, stream.GetBitsProcessed() );
+            }
+        }
+        else
+        {
+            for ( int i = 0; i < SnapshotBenchmarkClients; ++i )
+            {
+                messages[i] = messageFactory.Create( 0 );
+                memcpy( ( (SnapshotBenchmarkMessage*) messages[i] )->entities, snapshot->entities, sizeof( snapshot->entities ) );
+            }
+        }
+
+        for ( int i = 0; i < SnapshotBenchmarkClients; ++i )
+        {
+            WriteStream stream( packetData, PacketBytes );
+            packets[i].SerializeInternal( stream, messageFactory, &channelConfig, 1 );
+            stream.Flush();
+        }
+
+        for ( int i = 0; i < SnapshotBenchmarkClients; ++i )
+            messageFactory.Release( messages[i] );
+
+        if ( payload )
+        {
+            payload->Release();
+            YOJIMBO_DELETE( GetDefaultAllocator(), SharedBlock, payload );
+        }
+    }
+
+    const double finishTime = platform_time();
+
+    messageFactory.Release( snapshot );
+
+    free( packetData );
+    free( payloadData );
+
+    return ( finishTime - startTime ) * 1000000.0 / SnapshotBenchmarkIterations;
+}
+
+void benchmark_broadcast()
+{
+    printf( "writing a %d entity snapshot message into packets for %d clients:\n\n", SnapshotBenchmarkEntities, SnapshotBenchmarkClients );
+
+    const double perClientTime = BenchmarkBroadcastSnapshot( false );
+    const double onceTime = BenchmarkBroadcastSnapshot( true );
+
+    printf( " + serialized per-client: %8.2fus per-broadcast\n", perClientTime );
+    printf( " + serialized once:       %8.2fus per-broadcast (%.2fx)\n", onceTime, perClientTime / onceTime );
+
+    printf( "\n" );
+}
+
+const int ResendBenchmarkEntities = 16;
+
+template <typename Stream> bool SerializeQuantizedFloat( Stream & stream, float & value, float min, float max, float resolution )
+{
+    const int maxInteger = (int) ceil( ( max - min ) / resolution );
+    int integer = 0;
+    if ( Stream::IsWriting )
+        integer = (int) floor( ( value - min ) / resolution + 0.5f );
+    serialize_int( stream, integer, 0, maxInteger );
+    if ( Stream::IsReading )
+        value = min + integer * resolution;
+    return true;
+}
+
+struct ResendBenchmarkMessage : public Message
+{
+    // entity state quantized as it is written, like most game snapshots: positions and velocities to fixed point, orientations to the smallest three quaternion components
+
+    struct Entity
+    {
+        float position[3];
+        float velocity[3];
+        float orientation[4];
+    };
+
+    Entity entities[ResendBenchmarkEntities];
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        for ( int i = 0; i < ResendBenchmarkEntities; ++i )
+        {
+            Entity & entity = entities[i];
+
+            for ( int j = 0; j < 3; ++j )
+            {
+                if ( !SerializeQuantizedFloat( stream, entity.position[j], -1000.0f, 1000.0f, 1.0f / 512.0f ) )
+                    return false;
+            }
+
+            for ( int j = 0; j < 3; ++j )
+            {
+                if ( !SerializeQuantizedFloat( stream, entity.velocity[j], -64.0f, 64.0f, 1.0f / 64.0f ) )
+                    return false;
+            }
+
+            uint32_t largest = 0;
+            if ( Stream::IsWriting )
+            {
+                for ( int j = 1; j < 4; ++j )
+                {
+                    if ( fabs( entity.orientation[j] ) > fabs( entity.orientation[largest] ) )
+                        largest = j;
+                }
+            }
+
+            serialize_bits( stream, largest, 2 );
+
+            const float sign = entity.orientation[largest] < 0.0f ? -1.0f : 1.0f;
+            float sumSquares = 0.0f;
+
+            for ( int j = 0; j < 4; ++j )
+            {
+                if ( j == (int) largest )
+                    continue;
+                float component = entity.orientation[j] * sign;
+                if ( !SerializeQuantizedFloat( stream, component, -0.7072f, 0.7072f, 1.0f / 256.0f ) )
+                    return false;
+                if ( Stream::IsReading )
+                    entity.orientation[j] = component;
+                sumSquares += component * component;
+            }
+
+            if ( Stream::IsReading )
+                entity.orientation[largest] = sqrtf( sumSquares < 1.0f ? 1.0f - sumSquares : 0.0f );
+        }
+
+        return true;
+    }
+
+    YOJIMBO_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+YOJIMBO_MESSAGE_FACTORY_START( ResendBenchmarkMessageFactory, MessageFactory, 1 );
+    YOJIMBO_DECLARE_MESSAGE_TYPE( 0, ResendBenchmarkMessage );
+YOJIMBO_MESSAGE_FACTORY_FINISH();
+
+const int ResendBenchmarkTicks = 6000;
+const int ResendBenchmarkMessagesPerTick = 4;
+const int ResendBenchmarkLatencyTicks = 6;
+const double ResendBenchmarkDeltaTime = 1.0 / 60.0;
+
+static void BenchmarkReliableResends( bool cacheSerializedMessages, int packetLoss, double & microsecondsPerTick, double & sendsPerMessage )
+{
+    // sends snapshot messages over a reliable-ordered channel, with latency and packet loss, and times the sender where messages are serialized: sending messages and writing packets
+
+    TestPacketFactory packetFactory;
+    ResendBenchmarkMessageFactory messageFactory( GetDefaultAllocator() );
+
+    ConnectionConfig connectionConfig;
+    connectionConfig.connectionPacketType = TEST_PACKET_CONNECTION;
+    connectionConfig.channel[0].packetBudget = -1;
+    connectionConfig.channel[0].cacheSerializedMessages = cacheSerializedMessages;
+
+    ConnectionContext connectionContext;
+    connectionContext.messageFactory = &messageFactory;
+    connectionContext.connectionConfig = &connectionConfig;
+
+    Connection sender( GetDefaultAllocator(), packetFactory, messageFactory, connectionConfig );
+    Connection receiver( GetDefaultAllocator(), packetFactory, messageFactory, connectionConfig );
+
+    const int PacketBytes = connectionConfig.maxPacketSize;
+
+    // packets in flight, indexed by the tick they arrive on. packetBytes is zero if the packet was lost
+
+    uint8_t * senderPackets[ResendBenchmarkLatencyTicks];
+    uint8_t * receiverPackets[ResendBenchmarkLatencyTicks];
+    int senderPacketBytes[ResendBenchmarkLatencyTicks];
+    int receiverPacketBytes[ResendBenchmarkLatencyTicks];
+
+    for ( int i = 0; i < ResendBenchmarkLatencyTicks; ++i )
+    {
+        senderPackets[i] = (uint8_t*) malloc( PacketBytes );
+        receiverPackets[i] = (uint8_t*) malloc( PacketBytes );
+        senderPacketBytes[i] = 0;
+        receiverPacketBytes[i] = 0;
+    }
+
+    ResendBenchmarkMessage snapshot;
+    for ( int i = 0; i < ResendBenchmarkEntities; ++i )
+    {
+        ResendBenchmarkMessage::Entity & entity = snapshot.entities[i];
+
+        float length = 0.0f;
+        for ( int j = 0; j < 4; ++j )
+        {
+            entity.orientation[j] = float( rand() % 2001 - 1000 ) + 0.5f;
+            length += entity.orientation[j] * entity.orientation[j];
+        }
+
+        for ( int j = 0; j < 4; ++j )
+            entity.orientation[j] /= sqrtf( length );
+
+        for ( int j = 0; j < 3; ++j )
+        {
+            entity.position[j] = float( rand() % 2000 - 1000 ) + float( rand() % 512 ) / 512.0f;
+            entity.velocity[j] = float( rand() % 128 - 64 ) + float( rand() % 64 ) / 64.0f;
+        }
+    }
+
+    int numMessagesSent = 0;
+    int numMessagesWritten = 0;
+
+    double time = 100.0;
+    double senderTime = 0.0;
+
+    for ( int tick = 0; tick < ResendBenchmarkTicks; ++tick )
+    {
+        const int slot = tick % ResendBenchmarkLatencyTicks;
+
+        // deliver the packets sent ResendBenchmarkLatencyTicks ago
+
+        if ( senderPacketBytes[slot] )
+        {
+            ReadStream stream( senderPackets[slot], senderPacketBytes[slot] );
+            stream.SetContext( &connectionContext );
+            ConnectionPacket * packet = (ConnectionPacket*) packetFactory.Create( TEST_PACKET_CONNECTION );
+            if ( packet->SerializeInternal( stream ) )
+                receiver.ProcessPacket( packet );
+            packet->Destroy();
+        }
+
+        if ( receiverPacketBytes[slot] )
+        {
+            ReadStream stream( receiverPackets[slot], receiverPacketBytes[slot] );
+            stream.SetContext( &connectionContext );
+            ConnectionPacket * packet = (ConnectionPacket*) packetFactory.Create( TEST_PACKET_CONNECTION );
+            if ( packet->SerializeInternal( stream ) )
+                sender.ProcessPacket( packet );
+            packet->Destroy();
+        }
+
+        while ( Message * message = receiver.ReceiveMsg() )
+            messageFactory.Release( message );
+
+        double startTime = platform_time();
+
+        for ( int i = 0; i < ResendBenchmarkMessagesPerTick && sender.CanSendMsg(); ++i )
+        {
+            ResendBenchmarkMessage * message = (ResendBenchmarkMessage*) messageFactory.Create( 0 );
+            memcpy( message->entities, snapshot.entities, sizeof( snapshot.entities ) );
+            sender.SendMsg( message );
+            numMessagesSent++;
+        }
+
+        senderTime += platform_time() - startTime;
+
+        ConnectionPacket * senderPacket = sender.GeneratePacket();
+
+        startTime = platform_time();
+
+        WriteStream senderStream( senderPackets[slot], PacketBytes );
+        senderStream.SetContext( &connectionContext );
+        senderPacket->SerializeInternal( senderStream );
+        senderStream.Flush();
+
+        senderTime += platform_time() - startTime;
+
+        for ( int i = 0; i < senderPacket->numChannelEntries; ++i )
+        {
+            if ( !senderPacket->channelEntry[i].blockMessage )
+                numMessagesWritten += senderPacket->channelEntry[i].message.numMessages;
+        }
+
+        senderPacket->Destroy();
+
+        senderPacketBytes[slot] = ( rand() % 100 ) >= packetLoss ? senderStream.GetBytesProcessed() : 0;
+
+        ConnectionPacket * receiverPacket = receiver.GeneratePacket();
+        WriteStream receiverStream( receiverPackets[slot], PacketBytes );
+        receiverStream.SetContext( &connectionContext );
+        receiverPacket->SerializeInternal( receiverStream );
+        receiverStream.Flush();
+        receiverPacket->Destroy();
+
+        receiverPacketBytes[slot] = ( rand() % 100 ) >= packetLoss ? receiverStream.GetBytesProcessed() : 0;
+
+        time += ResendBenchmarkDeltaTime;
+
+        sender.AdvanceTime( time );
+        receiver.AdvanceTime( time );
+    }
+
+    microsecondsPerTick = senderTime * 1000000.0 / ResendBenchmarkTicks;
+    sendsPerMessage = double( numMessagesWritten ) / numMessagesSent;
+
+    for ( int i = 0; i < ResendBenchmarkLatencyTicks; ++i )
+    {
+        free( senderPackets[i] );
+        free( receiverPackets[i] );
+    }
+}
+
+void benchmark_reliable_resends()
+{
+    printf( "sending %d entity snapshot messages over a reliable-ordered channel, %dms latency:\n\n", ResendBenchmarkEntities, int( ResendBenchmarkLatencyTicks * ResendBenchmarkDeltaTime * 1000.0 + 0.5 ) );
+
+    const int packetLoss[] = { 0, 5, 10, 20 };
+
+    for ( int i = 0; i < (int) ( sizeof( packetLoss ) / sizeof( packetLoss[0] ) ); ++i )
+    {
+        double serializedTime, serializedSends;
+        double cachedTime, cachedSends;
+
+        srand( i );
+        BenchmarkReliableResends( false, packetLoss[i], serializedTime, serializedSends );
+
+        srand( i );
+        BenchmarkReliableResends( true, packetLoss[i], cachedTime, cachedSends );
+
+        printf( " + %2d%% loss: %.2f sends per-message\n", packetLoss[i], serializedSends );
+        printf( "    - serialized per-send: %6.2fus per-tick\n", serializedTime );
+        printf( "    - cached:              %6.2fus per-tick (%.2fx)\n", cachedTime, serializedTime / cachedTime );
+    }
+
+    printf( "\n" );
+}
+
+const int SendQueueBenchmarkTicks = 2000;
+const int SendQueueBenchmarkMessagesPerTick = 8;
+const double SendQueueBenchmarkDeltaTime = 1.0 / 60.0;
+
+static double BenchmarkSendQueueDepth( int latencyTicks )
+{
+    // keeps the send queue half full by acking messages only after a round trip of latencyTicks each way, with a resend time longer than the round trip, so nothing in the send queue is due for resend when packets are generated
+
+    TestPacketFactory packetFactory;
+    TestMessageFactory messageFactory;
+
+    ConnectionConfig connectionConfig;
+    connectionConfig.connectionPacketType = TEST_PACKET_CONNECTION;
+    connectionConfig.channel[0].sendQueueSize = 4 * latencyTicks * SendQueueBenchmarkMessagesPerTick;
+    connectionConfig.channel[0].receiveQueueSize = 4 * latencyTicks * SendQueueBenchmarkMessagesPerTick;
+    connectionConfig.channel[0].messageResendTime = float( ( 2 * latencyTicks + 2 ) * SendQueueBenchmarkDeltaTime );
+
+    ConnectionContext connectionContext;
+    connectionContext.messageFactory = &messageFactory;
+    connectionContext.connectionConfig = &connectionConfig;
+
+    Connection sender( GetDefaultAllocator(), packetFactory, messageFactory, connectionConfig );
+    Connection receiver( GetDefaultAllocator(), packetFactory, messageFactory, connectionConfig );
+
+    const int PacketBytes = connectionConfig.maxPacketSize;
+
+    uint8_t ** senderPackets = (uint8_t**) malloc( sizeof( uint8_t* ) * latencyTicks );
+    uint8_t ** receiverPackets = (uint8_t**) malloc( sizeof( uint8_t* ) * latencyTicks );
+    int * senderPacketBytes = (int*) malloc( sizeof( int ) * latencyTicks );
+    int * receiverPacketBytes = (int*) malloc( sizeof( int ) * latencyTicks );
+
+    for ( int i = 0; i < latencyTicks; ++i )
+    {
+        senderPackets[i] = (uint8_t*) malloc( PacketBytes );
+        receiverPackets[i] = (uint8_t*) malloc( PacketBytes );
+        senderPacketBytes[i] = 0;
+        receiverPacketBytes[i] = 0;
+    }
+
+    uint16_t sequence = 0;
+
+    double time = 100.0;
+    double generateTime = 0.0;
+
+    for ( int tick = 0; tick < SendQueueBenchmarkTicks; ++tick )
+    {
+        const int slot = tick % latencyTicks;
+
+        if ( senderPacketBytes[slot] )
+        {
+            ReadStream stream( senderPackets[slot], senderPacketBytes[slot] );
+            stream.SetContext( &connectionContext );
+            ConnectionPacket * packet = (ConnectionPacket*) packetFactory.Create( TEST_PACKET_CONNECTION );
+            if ( packet->SerializeInternal( stream ) )
+                receiver.ProcessPacket( packet );
+            packet->Destroy();
+        }
+
+        if ( receiverPacketBytes[slot] )
+        {
+            ReadStream stream( receiverPackets[slot], receiverPacketBytes[slot] );
+            stream.SetContext( &connectionContext );
+            ConnectionPacket * packet = (ConnectionPacket*) packetFactory.Create( TEST_PACKET_CONNECTION );
+            if ( packet->SerializeInternal( stream ) )
+                sender.ProcessPacket( packet );
+            packet->Destroy();
+        }
+
+        while ( Message * message = receiver.ReceiveMsg() )
+            messageFactory.Release( message );
+
+        for ( int i = 0; i < SendQueueBenchmarkMessagesPerTick && sender.CanSendMsg(); ++i )
+        {
+            TestMessage * message = (TestMessage*) messageFactory.Create( TEST_MESSAGE );
+            message->sequence = sequence++;
+            sender.SendMsg( message );
+        }
+
+        const double startTime = platform_time();
+
+        ConnectionPacket * senderPacket = sender.GeneratePacket();
+
+        generateTime += platform_time() - startTime;
+
+        WriteStream senderStream( senderPackets[slot], PacketBytes );
+        senderStream.SetContext( &connectionContext );
+        senderPacket->SerializeInternal( senderStream );
+        senderStream.Flush();
+        senderPacketBytes[slot] = senderStream.GetBytesProcessed();
+        senderPacket->Destroy();
+
+        ConnectionPacket * receiverPacket = receiver.GeneratePacket();
+        WriteStream receiverStream( receiverPackets[slot], PacketBytes );
+        receiverStream.SetContext( &connectionContext );
+        receiverPacket->SerializeInternal( receiverStream );
+        receiverStream.Flush();
+        receiverPacketBytes[slot] = receiverStream.GetBytesProcessed();
+        receiverPacket->Destroy();
+
+        time += SendQueueBenchmarkDeltaTime;
+
+        sender.AdvanceTime( time );
+        receiver.AdvanceTime( time );
+    }
+
+
+    for ( int i = 0; i < latencyTicks; ++i )
+    {
+        free( senderPackets[i] );
+        free( receiverPackets[i] );
+    }
+
+    free( senderPackets );
+    free( receiverPackets );
+    free( senderPacketBytes );
+    free( receiverPacketBytes );
+
+    return generateTime * 1000000.0 / SendQueueBenchmarkTicks;
+}
+
+void benchmark_send_queue()
+{
+    printf( "generating packets for a reliable-ordered channel, %d messages sent per-packet:\n\n", SendQueueBenchmarkMessagesPerTick );
+
+    const int latencyTicks[] = { 2, 8, 32, 128 };
+
+    for ( int i = 0; i < (int) ( sizeof( latencyTicks ) / sizeof( latencyTicks[0] ) ); ++i )
+    {
+        const double microsecondsPerPacket = BenchmarkSendQueueDepth( latencyTicks[i] );
+        printf( " + send queue size %5d, ~%4d messages in flight: %6.2fus per-packet\n", 4 * latencyTicks[i] * SendQueueBenchmarkMessagesPerTick, 2 * latencyTicks[i] * SendQueueBenchmarkMessagesPerTick, microsecondsPerPacket );
+    }
+
+    printf( "\n" );
+}
+
+int main( int argc, char ** argv )
+{
+    if ( !InitializeYojimbo() )
+    {
+        printf( "error: failed to initialize yojimbo\n" );
+        exit( 1 );
+    }
+
+    srand( 0 );
+
+    printf( "\n" );
+
+    if ( ShouldRun( argc, argv, "context_manager" ) )
+        benchmark_context_manager();
+
+    if ( ShouldRun( argc, argv, "connect_token_filter" ) )
+        benchmark_connect_token_filter();
+
+    if ( ShouldRun( argc, argv, "server_workers" ) )
+        benchmark_server_workers();
+
+    if ( ShouldRun( argc, argv, "queues" ) )
+        benchmark_queues();
+
+    if ( ShouldRun( argc, argv, "crypto" ) )
+        benchmark_crypto();
+
+    if ( ShouldRun( argc, argv, "bitpacker" ) )
+        benchmark_bitpacker();
+
+    if ( ShouldRun( argc, argv, "checksum" ) )
+        benchmark_checksum();
+
+    if ( ShouldRun( argc, argv, "message_factory" ) )
+        benchmark_message_factory();
+
+    if ( ShouldRun( argc, argv, "shared_blocks" ) )
+        benchmark_shared_blocks();
+
+    if ( ShouldRun( argc, argv, "broadcast" ) )
+        benchmark_broadcast();
+
+    if ( ShouldRun( argc, argv, "reliable_resends" ) )
+        benchmark_reliable_resends();
+
+    if ( ShouldRun( argc, argv, "send_queue" ) )
+        benchmark_send_queue();
+
+    ShutdownYojimbo();
+
+    return 0;
+}
@@ -225,6 +225,12 @@ int ProfileMain()
 
     signal( SIGINT, interrupt_handler ); 
 
+    // track how long the server spends doing socket IO each tick, so the average and worst case can be compared across socket backends
+
+    uint64_t numTicks = 0;
+    double totalServerIOTime = 0.0;
+    double maxServerIOTime = 0.0;
+
     while ( !quit )
     {
         serverData->server->SendPackets();
@@ -232,13 +238,26 @@ int ProfileMain()
         for ( int i = 0; i < MaxClients; ++i )
             clientData[i].client->SendPackets();
 
+        const double serverWriteStartTime = platform_time();
+
         serverData->transport->WritePackets();
 
+        double serverIOTime = platform_time() - serverWriteStartTime;
+
         for ( int i = 0; i < MaxClients; ++i )
             clientData[i].transport->WritePackets();
 
+        const double serverReadStartTime = platform_time();
+
         serverData->transport->ReadPackets();
 
+        serverIOTime += platform_time() - serverReadStartTime;
+
+        numTicks++;
+        totalServerIOTime += serverIOTime;
+        if ( serverIOTime > maxServerIOTime )
+            maxServerIOTime = serverIOTime;
+
         for ( int i = 0; i < MaxClients; ++i )
             clientData[i].transport->ReadPackets();
 
@@ -356,6 +375,20 @@ int ProfileMain()
         printf( "\n\nstopped\n" );
     }
 
+    NetworkTransport * serverTransport = (NetworkTransport*) serverData->transport;
+
+    printf( "\nserver transport (%s):\n", serverTransport->IsUsingIOUring() ? "io_uring" : "sockets" );
+    printf( " - packets written: %" PRIu64 "\n", serverTransport->GetCounter( TRANSPORT_COUNTER_PACKETS_WRITTEN ) );
+    printf( " - packets read: %" PRIu64 "\n", serverTransport->GetCounter( TRANSPORT_COUNTER_PACKETS_READ ) );
+    printf( " - send system calls: %" PRIu64 "\n", serverTransport->GetCounter( TRANSPORT_COUNTER_SEND_SYSTEM_CALLS ) );
+    printf( " - receive system calls: %" PRIu64 "\n", serverTransport->GetCounter( TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS ) );
+
+    if ( numTicks > 0 )
+    {
+        printf( " - average io time per tick: %.3fms\n", totalServerIOTime / numTicks * 1000.0 );
+        printf( " - worst io time per tick: %.3fms\n", maxServerIOTime * 1000.0 );
+    }
+
 	delete [] clientData;
 
 	delete serverData;
@@ -102,7 +102,8 @@ int ConnectMain( int argc, char * argv[] )
                     matchResponse.connectTokenNonce, 
                     matchResponse.clientToServerKey,
                     matchResponse.serverToClientKey,
-                    matchResponse.connectTokenExpireTimestamp );
+                    matchResponse.connectTokenExpireTimestamp,
+                    matchResponse.cipherSuite );
 
     const double deltaTime = 0.1;
 
@@ -288,12 +288,19 @@ static uint8_t private_key[KeyBytes] = { 0x60, 0x6a, 0xbe, 0x6e, 0xc9, 0x19, 0x1
 class LocalMatcher
 {
     uint64_t m_nonce;
+    int m_cipherSuite;
 
 public:
 
-    LocalMatcher()
+    LocalMatcher( int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 )
     {
         m_nonce = 0;
+        m_cipherSuite = cipherSuite;
+    }
+
+    int GetCipherSuite() const
+    {
+        return m_cipherSuite;
     }
 
     bool RequestMatch( uint64_t clientId, 
@@ -314,7 +321,7 @@ public:
         serverAddresses[0] = Address( "::1", serverPortOverride == -1 ? ServerPort : serverPortOverride );
 
         ConnectToken token;
-        GenerateConnectToken( token, clientId, numServerAddresses, serverAddresses, ProtocolId, 10 );
+        GenerateConnectToken( token, clientId, numServerAddresses, serverAddresses, ProtocolId, 10, m_cipherSuite );
         token.expireTimestamp += timestampOffsetInSeconds;
 
         memcpy( clientToServerKey, token.clientToServerKey, KeyBytes );
@@ -342,7 +349,7 @@ public:
 class GameServer : public Server
 {
     uint32_t m_userPacketSequence;
-    uint64_t m_numUserPacketsReceived[MaxClients];
+    uint64_t m_numUserPacketsReceived[MaxServerClients];
 
     void Initialize()
     {
@@ -439,6 +446,10 @@ protected:
                 printf( "ignored connection request from %s. client id %" PRIx64 " already connected\n", addressString, connectToken.clientId );
                 break;
 
+            case SERVER_CONNECTION_REQUEST_IGNORED_CIPHER_SUITE_NOT_ALLOWED:
+                printf( "ignored connection request from %s. cipher suite not allowed\n", addressString );
+                break;
+
             case SERVER_CONNECTION_REQUEST_IGNORED_FAILED_TO_ADD_ENCRYPTION_MAPPING:
                 printf( "ignored connection request from %s. failed to add encryption mapping\n", addressString );
                 break;
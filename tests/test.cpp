@@ -147,6 +147,121 @@ void test_queue()
     check( queue.GetSize() == QueueSize );
 }
 
+struct QueueProducerData
+{
+    MPSCQueue<uint32_t> * queue;
+    uint32_t producerIndex;
+    int numValues;
+};
+
+static void QueueProducerThread( void * data )
+{
+    QueueProducerData * producer = (QueueProducerData*) data;
+
+    for ( int i = 0; i < producer->numValues; ++i )
+    {
+        // the top byte says which producer the value came from, so the consumer can check each producer's values stay in order
+
+        const uint32_t value = ( producer->producerIndex << 24 ) | uint32_t( i );
+
+        while ( !producer->queue->Push( value ) )
+            platform_sleep( 0.0 );
+    }
+}
+
+void test_lock_free_queues()
+{
+    {
+        SPSCQueue<int> queue( GetDefaultAllocator(), 100 );
+
+        check( queue.GetSize() == 128 );
+        check( queue.IsEmpty() );
+
+        // go round the ring a few times so the indices wrap
+
+        int value = 0;
+
+        for ( int iteration = 0; iteration < 5; ++iteration )
+        {
+            for ( int i = 0; i < queue.GetSize(); ++i )
+                check( queue.Push( iteration * 1000 + i ) );
+
+            check( !queue.Push( -1 ) );
+
+            for ( int i = 0; i < queue.GetSize(); ++i )
+            {
+                check( queue.Pop( value ) );
+                check( value == iteration * 1000 + i );
+            }
+
+            check( !queue.Pop( value ) );
+            check( queue.IsEmpty() );
+        }
+
+        int * entry = queue.GetPushEntry();
+        check( entry );
+        *entry = 42;
+        check( queue.IsEmpty() );
+        queue.CommitPush();
+        check( !queue.IsEmpty() );
+        check( queue.GetPopEntry() && *queue.GetPopEntry() == 42 );
+        queue.CommitPop();
+        check( queue.IsEmpty() );
+    }
+
+    {
+        const int NumProducers = 4;
+        const int NumValuesPerProducer = 10000;
+
+        MPSCQueue<uint32_t> queue( GetDefaultAllocator(), 256 );
+
+        check( queue.GetSize() == 256 );
+        check( queue.IsEmpty() );
+
+        QueueProducerData producers[NumProducers];
+        PlatformThread * threads[NumProducers];
+
+        for ( int i = 0; i < NumProducers; ++i )
+        {
+            producers[i].queue = &queue;
+            producers[i].producerIndex = i;
+            producers[i].numValues = NumValuesPerProducer;
+            threads[i] = platform_thread_create( GetDefaultAllocator(), QueueProducerThread, &producers[i] );
+            check( threads[i] );
+        }
+
+        int numReceived[NumProducers];
+        memset( numReceived, 0, sizeof( numReceived ) );
+
+        int totalReceived = 0;
+
+        while ( totalReceived < NumProducers * NumValuesPerProducer )
+        {
+            uint32_t value;
+            if ( !queue.Pop( value ) )
+            {
+                platform_sleep( 0.0 );
+                continue;
+            }
+
+            const int producerIndex = value >> 24;
+            check( producerIndex >= 0 && producerIndex < NumProducers );
+            check( int( value & 0xFFFFFF ) == numReceived[producerIndex] );
+            numReceived[producerIndex]++;
+            totalReceived++;
+        }
+
+        for ( int i = 0; i < NumProducers; ++i )
+        {
+            platform_thread_join( threads[i] );
+            platform_thread_destroy( GetDefaultAllocator(), threads[i] );
+            check( numReceived[i] == NumValuesPerProducer );
+        }
+
+        check( queue.IsEmpty() );
+    }
+}
+
 void test_base64()
 {
     const int BufferSize = 256;
@@ -242,6 +357,167 @@ void test_bitpacker()
     check( reader.GetBitsRemaining() == bytesWritten * 8 - bitsWritten );
 }
 
+void test_bitpacker_bytes()
+{
+    // mixes bit values, aligns and byte arrays at every offset, and checks the bitpacked data bit for bit against the format: bit n of the stream is bit n%8 of byte n/8
+
+    const int BufferSize = 1024;
+    const int NumIterations = 64;
+
+    uint8_t buffer[BufferSize];
+    uint8_t expected[BufferSize];
+
+    for ( int iteration = 0; iteration < NumIterations; ++iteration )
+    {
+        memset( buffer, 0xFF, sizeof( buffer ) );
+        memset( expected, 0, sizeof( expected ) );
+
+        BitWriter writer( buffer, BufferSize );
+
+        uint32_t values[256];
+        int bits[256];
+        int numValues = 0;
+        int expectedBits = 0;
+
+        while ( numValues < 256 && expectedBits < ( BufferSize - 64 ) * 8 )
+        {
+            const int i = numValues++;
+
+            if ( ( rand() % 8 ) == 0 )
+            {
+                // byte array: write an align, then 0-37 bytes. bits[i] is minus the number of bytes
+
+                writer.WriteAlign();
+                expectedBits = writer.GetBitsWritten();
+
+                const int numBytes = rand() % 38;
+
+                uint8_t data[37];
+                for ( int j = 0; j < numBytes; ++j )
+                {
+                    data[j] = uint8_t( rand() );
+                    expected[expectedBits/8+j] = data[j];
+                }
+
+                writer.WriteBytes( data, numBytes );
+
+                expectedBits += numBytes * 8;
+                values[i] = numBytes ? data[0] : 0;
+                bits[i] = -numBytes;
+            }
+            else
+            {
+                bits[i] = 1 + rand() % 32;
+                values[i] = uint32_t( ( uint64_t( rand() ) << 16 ^ uint64_t( rand() ) ) & ( ( 1ULL << bits[i] ) - 1 ) );
+
+                writer.WriteBits( values[i], bits[i] );
+
+                for ( int j = 0; j < bits[i]; ++j )
+                {
+                    if ( values[i] & ( 1U << j ) )
+                        expected[(expectedBits+j)/8] |= uint8_t( 1 << ( ( expectedBits + j ) % 8 ) );
+                }
+
+                expectedBits += bits[i];
+            }
+
+            check( writer.GetBitsWritten() == expectedBits );
+        }
+
+        writer.FlushBits();
+
+        const int bytesWritten = writer.GetBytesWritten();
+
+        check( bytesWritten == ( expectedBits + 7 ) / 8 );
+        check( memcmp( buffer, expected, bytesWritten ) == 0 );
+
+        // nothing past the last byte is touched
+
+        for ( int j = bytesWritten; j < BufferSize; ++j )
+            check( buffer[j] == 0xFF );
+
+        BitReader reader( buffer, bytesWritten );
+
+        for ( int i = 0; i < numValues; ++i )
+        {
+            if ( bits[i] <= 0 )
+            {
+                check( reader.ReadAlign() );
+
+                uint8_t data[37];
+                reader.ReadBytes( data, -bits[i] );
+
+                if ( bits[i] < 0 )
+                    check( data[0] == values[i] );
+            }
+            else
+            {
+                check( reader.ReadBits( bits[i] ) == values[i] );
+            }
+        }
+
+        check( reader.GetBitsRead() == expectedBits );
+    }
+}
+
+void test_bitpacker_from_buffer()
+{
+    // copies bits written by one bit writer into another at every offset relative to the scratch value, then reads them back alongside the bits written around them
+
+    const int BufferSize = 256;
+    const int NumIterations = 256;
+
+    uint8_t source[BufferSize];
+    uint8_t buffer[BufferSize];
+
+    for ( int iteration = 0; iteration < NumIterations; ++iteration )
+    {
+        const int sourceBits = rand() % ( ( BufferSize - 32 ) * 8 / 2 );
+
+        uint32_t sourceValues[BufferSize*8];
+        int numSourceValues = 0;
+
+        BitWriter sourceWriter( source, BufferSize );
+        for ( int bits = 0; bits < sourceBits; bits++ )
+        {
+            sourceValues[numSourceValues] = rand() & 1;
+            sourceWriter.WriteBits( sourceValues[numSourceValues++], 1 );
+        }
+        sourceWriter.FlushBits();
+
+        const int offsetBits = iteration % 64 + 64 * ( rand() % 2 );
+        const uint32_t prefix = uint32_t( rand() );
+        const uint32_t suffix = uint32_t( rand() ) & 0x7FFF;
+
+        memset( buffer, 0xFF, sizeof( buffer ) );
+
+        BitWriter writer( buffer, BufferSize );
+
+        for ( int i = 0; i < offsetBits; ++i )
+            writer.WriteBits( ( prefix >> ( i % 32 ) ) & 1, 1 );
+
+        writer.WriteBitsFromBuffer( source, sourceBits );
+        writer.WriteBits( suffix, 15 );
+        writer.FlushBits();
+
+        check( writer.GetBitsWritten() == offsetBits + sourceBits + 15 );
+        check( writer.GetBytesWritten() == ( offsetBits + sourceBits + 15 + 7 ) / 8 );
+
+        for ( int i = writer.GetBytesWritten(); i < BufferSize; ++i )
+            check( buffer[i] == 0xFF );
+
+        BitReader reader( buffer, writer.GetBytesWritten() );
+
+        for ( int i = 0; i < offsetBits; ++i )
+            check( reader.ReadBits( 1 ) == ( ( prefix >> ( i % 32 ) ) & 1 ) );
+
+        for ( int i = 0; i < numSourceValues; ++i )
+            check( reader.ReadBits( 1 ) == sourceValues[i] );
+
+        check( reader.ReadBits( 15 ) == suffix );
+    }
+}
+
 const int MaxItems = 11;
 
 struct TestData
@@ -401,6 +677,37 @@ void test_packets()
     c->Destroy();
 }
 
+void test_crc32c()
+{
+    const char * check_string = "123456789";
+
+    check( calculate_crc32c( (const uint8_t*) check_string, 9 ) == 0xE3069283 );
+    check( calculate_crc32c_software( (const uint8_t*) check_string, 9 ) == 0xE3069283 );
+    check( calculate_checksum( CHECKSUM_CRC32C, (const uint8_t*) check_string, 9 ) == 0xE3069283 );
+    check( calculate_checksum( CHECKSUM_CRC32, (const uint8_t*) check_string, 9 ) == calculate_crc32( (const uint8_t*) check_string, 9 ) );
+
+    const int BufferSize = 1024;
+
+    uint8_t buffer[BufferSize];
+    for ( int i = 0; i < BufferSize; ++i )
+        buffer[i] = (uint8_t) rand();
+
+    // the dispatched path (hardware when available) must match the software path for every alignment and tail length, and chain the same way
+
+    for ( int i = 0; i < 1000; ++i )
+    {
+        const int offset = rand() % 16;
+        const int length = rand() % ( BufferSize - offset );
+        const int split = length > 0 ? rand() % length : 0;
+
+        const uint32_t expected = calculate_crc32c_software( buffer + offset, length );
+
+        check( calculate_crc32c( buffer + offset, length ) == expected );
+        check( calculate_crc32c( buffer + offset + split, length - split, calculate_crc32c( buffer + offset, split ) ) == expected );
+        check( calculate_crc32c_software( buffer + offset + split, length - split, calculate_crc32c_software( buffer + offset, split ) ) == expected );
+    }
+}
+
 void test_address_ipv4()
 {
     char buffer[MaxAddressLength];
@@ -657,35 +964,105 @@ void test_encrypt_and_decrypt()
     memset( key, 1, sizeof( key ) );
     memset( nonce, 1, sizeof( nonce ) );
 
-    uint8_t encrypted_packet[2048];
-
-    int encrypted_length;
-    if ( !Encrypt( packet, packet_length, encrypted_packet, encrypted_length, nonce, key ) )
-    {
-        printf( "error: failed to encrypt\n" );
-        exit(1);
-    }
+    // known answers for each cipher suite. the MAC comes first, then the encrypted message
 
     const int expected_encrypted_length = 17;
-    const uint8_t expected_encrypted_packet[] = { 0xfa, 0x6c, 0x91, 0xf7, 0xef, 0xdc, 0xed, 0x22, 0x09, 0x23, 0xd5, 0xbf, 0xa1, 0xe9, 0x17, 0x70, 0x14 };
-    if ( encrypted_length != expected_encrypted_length || memcmp( expected_encrypted_packet, encrypted_packet, encrypted_length ) != 0 )
+    const uint8_t expected_encrypted_packet[CIPHER_SUITE_NUM_VALUES][17] = 
     {
-        printf( "error: packet encryption failed\n" );
-        exit(1);
-    }
+        { 0xae, 0xc5, 0x64, 0xc9, 0xa3, 0xb3, 0x99, 0x37, 0xd2, 0x4f, 0x23, 0xd1, 0x53, 0xe1, 0x5f, 0xda, 0xd6 },       // CIPHER_SUITE_CHACHA20_POLY1305
+        { 0xff, 0xcf, 0xa6, 0x46, 0x58, 0x55, 0x6a, 0xfa, 0x0b, 0xd3, 0xf7, 0xf7, 0xe7, 0xff, 0x6c, 0x79, 0xdc },       // CIPHER_SUITE_AES256_GCM
+    };
 
-    uint8_t decrypted_packet[2048];
-    int decrypted_length;
-    if ( !Decrypt( encrypted_packet, encrypted_length, decrypted_packet, decrypted_length, nonce, key ) )
-    {
-        printf( "error: failed to decrypt\n" );
-        exit(1);
-    }
+    check( IsCipherSuiteAvailable( CIPHER_SUITE_CHACHA20_POLY1305 ) );
+    check( !IsCipherSuiteAvailable( CIPHER_SUITE_NUM_VALUES ) );
+    check( SelectCipherSuite( CIPHER_SUITE_CHACHA20_POLY1305 ) == CIPHER_SUITE_CHACHA20_POLY1305 );
+    check( SelectCipherSuite( CIPHER_SUITE_AES256_GCM ) == ( IsCipherSuiteAvailable( CIPHER_SUITE_AES256_GCM ) ? CIPHER_SUITE_AES256_GCM : CIPHER_SUITE_CHACHA20_POLY1305 ) );
 
-    if ( decrypted_length != packet_length || memcmp( packet, decrypted_packet, packet_length ) != 0 )
+    for ( int cipherSuite = 0; cipherSuite < CIPHER_SUITE_NUM_VALUES; ++cipherSuite )
     {
-        printf( "error: decrypted packet does not match original packet\n" );
-        exit(1);
+        // aes-256-gcm needs aes-ni and pclmul. skip it on computers without them
+
+        if ( !IsCipherSuiteAvailable( cipherSuite ) )
+            continue;
+
+        uint8_t encrypted_packet[2048];
+
+        int encrypted_length;
+        if ( !Encrypt( packet, packet_length, encrypted_packet, encrypted_length, nonce, key, cipherSuite ) )
+        {
+            printf( "error: failed to encrypt\n" );
+            exit(1);
+        }
+
+        if ( encrypted_length != expected_encrypted_length || memcmp( expected_encrypted_packet[cipherSuite], encrypted_packet, encrypted_length ) != 0 )
+        {
+            printf( "error: packet encryption failed\n" );
+            exit(1);
+        }
+
+        uint8_t decrypted_packet[2048];
+        int decrypted_length;
+        if ( !Decrypt( encrypted_packet, encrypted_length, decrypted_packet, decrypted_length, nonce, key, cipherSuite ) )
+        {
+            printf( "error: failed to decrypt\n" );
+            exit(1);
+        }
+
+        if ( decrypted_length != packet_length || memcmp( packet, decrypted_packet, packet_length ) != 0 )
+        {
+            printf( "error: decrypted packet does not match original packet\n" );
+            exit(1);
+        }
+
+        // a packet must not decrypt with a different cipher suite than it was encrypted with
+
+        for ( int otherCipherSuite = 0; otherCipherSuite < CIPHER_SUITE_NUM_VALUES; ++otherCipherSuite )
+        {
+            if ( otherCipherSuite != cipherSuite )
+                check( !Decrypt( encrypted_packet, encrypted_length, decrypted_packet, decrypted_length, nonce, key, otherCipherSuite ) );
+        }
+
+        // in place encryption must write exactly the same bytes, with the MAC in front of the message
+
+        uint8_t in_place_packet[2048];
+        memcpy( in_place_packet + MacBytes, packet, packet_length );
+
+        check( Encrypt_InPlace( in_place_packet + MacBytes, packet_length, in_place_packet, nonce, key, cipherSuite ) );
+        check( memcmp( expected_encrypted_packet[cipherSuite], in_place_packet, expected_encrypted_length ) == 0 );
+
+        // a modified packet must fail to decrypt
+
+        uint8_t modified_packet[2048];
+        memcpy( modified_packet, in_place_packet, expected_encrypted_length );
+        modified_packet[MacBytes] ^= 1;
+        check( !Decrypt_InPlace( modified_packet + MacBytes, packet_length, modified_packet, nonce, key, cipherSuite ) );
+
+        check( Decrypt_InPlace( in_place_packet + MacBytes, packet_length, in_place_packet, nonce, key, cipherSuite ) );
+        check( memcmp( packet, in_place_packet + MacBytes, packet_length ) == 0 );
+
+        // precomputed cipher state must encrypt and decrypt exactly the same as the key it was expanded from. only aes-256-gcm has any
+
+        uint8_t cipherStateBuffer[CipherStateBytes + 15];
+        uint8_t * cipherState = (uint8_t*) ( ( uintptr_t( cipherStateBuffer ) + 15 ) & ~uintptr_t( 15 ) );
+
+        const bool hasCipherState = InitializeCipherState( cipherState, key, cipherSuite );
+
+        check( hasCipherState == ( cipherSuite == CIPHER_SUITE_AES256_GCM ) );
+
+        if ( hasCipherState )
+        {
+            memcpy( in_place_packet + MacBytes, packet, packet_length );
+
+            check( Encrypt_InPlace( in_place_packet + MacBytes, packet_length, in_place_packet, nonce, key, cipherSuite, cipherState ) );
+            check( memcmp( expected_encrypted_packet[cipherSuite], in_place_packet, expected_encrypted_length ) == 0 );
+
+            memcpy( modified_packet, in_place_packet, expected_encrypted_length );
+            modified_packet[MacBytes] ^= 1;
+            check( !Decrypt_InPlace( modified_packet + MacBytes, packet_length, modified_packet, nonce, key, cipherSuite, cipherState ) );
+
+            check( Decrypt_InPlace( in_place_packet + MacBytes, packet_length, in_place_packet, nonce, key, cipherSuite, cipherState ) );
+            check( memcmp( packet, in_place_packet + MacBytes, packet_length ) == 0 );
+        }
     }
 }
 
@@ -693,7 +1070,7 @@ void test_encryption_manager()
 {
 	const double EncryptionMappingTimeout = 5.0f;
 
-    EncryptionManager encryptionManager;
+    EncryptionManager encryptionManager( GetDefaultAllocator() );
 
     struct EncryptionMapping
     {
@@ -816,147 +1193,1088 @@ void test_encryption_manager()
     }
 }
 
-void test_client_server_tokens()
+void test_encryption_manager_cipher_state()
 {
-    uint8_t key[KeyBytes];
+    const double EncryptionMappingTimeout = 5.0;
 
-    uint64_t clientId = 1;
+    EncryptionManager encryptionManager( GetDefaultAllocator() );
 
-    uint8_t connectTokenData[ConnectTokenBytes];
-    uint8_t challengeTokenData[ChallengeTokenBytes];
-    
-    uint8_t connectTokenNonce[NonceBytes];
-    uint8_t challengeTokenNonce[NonceBytes];
+    const Address address( "::1", 20000 );
 
-    uint8_t clientToServerKey[KeyBytes];
-    uint8_t serverToClientKey[KeyBytes];
+    uint8_t sendKey[KeyBytes];
+    uint8_t receiveKey[KeyBytes];
 
-    int numServerAddresses;
-    Address serverAddresses[MaxServersPerConnect];
+    GenerateKey( sendKey );
+    GenerateKey( receiveKey );
 
-    memset( connectTokenNonce, 0, NonceBytes );
-    memset( challengeTokenNonce, 0, NonceBytes );
+    double time = 100.0;
 
-    GenerateKey( key );
+    check( encryptionManager.GetSendCipherState( -1 ) == NULL );
+    check( encryptionManager.GetReceiveCipherState( -1 ) == NULL );
 
-    numServerAddresses = 1;
-    serverAddresses[0] = Address( "::1", ServerPort );
+    // chacha20-poly1305 has no cipher state, so packets are encrypted with the key
 
-    memset( connectTokenNonce, 0, NonceBytes );
+    check( encryptionManager.AddEncryptionMapping( address, sendKey, receiveKey, time, EncryptionMappingTimeout, CIPHER_SUITE_CHACHA20_POLY1305 ) );
 
-    uint64_t connectTokenExpireTimestamp;
+    int encryptionIndex = encryptionManager.FindEncryptionMapping( address, time );
 
-    {
-        ConnectToken token;
-        GenerateConnectToken( token, clientId, numServerAddresses, serverAddresses, ProtocolId, 10 );
+    check( encryptionIndex != -1 );
+    check( encryptionManager.GetSendCipherState( encryptionIndex ) == NULL );
+    check( encryptionManager.GetReceiveCipherState( encryptionIndex ) == NULL );
 
-        connectTokenExpireTimestamp = token.expireTimestamp;
+    if ( !IsCipherSuiteAvailable( CIPHER_SUITE_AES256_GCM ) )
+        return;
 
-        char json[2048];
+    // replacing the keys with aes-256-gcm expands the cipher state once, up front
 
-        check( WriteConnectTokenToJSON( token, json, sizeof( json ) ) );
+    check( encryptionManager.AddEncryptionMapping( address, sendKey, receiveKey, time, EncryptionMappingTimeout, CIPHER_SUITE_AES256_GCM ) );
 
-        check( strlen( json ) > 0 );
+    check( encryptionManager.FindEncryptionMapping( address, time ) == encryptionIndex );
 
-        ConnectToken readToken;
-        check( ReadConnectTokenFromJSON( json, readToken ) );
-        check( token == readToken );
+    const uint8_t * sendCipherState = encryptionManager.GetSendCipherState( encryptionIndex );
+    const uint8_t * receiveCipherState = encryptionManager.GetReceiveCipherState( encryptionIndex );
 
-        memcpy( clientToServerKey, token.clientToServerKey, KeyBytes );
-        memcpy( serverToClientKey, token.serverToClientKey, KeyBytes );
+    check( sendCipherState );
+    check( receiveCipherState );
+    check( ( uintptr_t( sendCipherState ) & 15 ) == 0 );
+    check( ( uintptr_t( receiveCipherState ) & 15 ) == 0 );
 
-        if ( !EncryptConnectToken( token, connectTokenData, connectTokenNonce, key ) )
-        {
-            printf( "error: failed to encrypt connect token\n" );
-            exit( 1 );
-        }
-    }
+    // the cipher state must match the key it was expanded from
 
-    ConnectToken connectToken;
-    if ( !DecryptConnectToken( connectTokenData, connectToken, connectTokenNonce, key, connectTokenExpireTimestamp ) )
-    {
-        printf( "error: failed to decrypt connect token\n" );
-        exit( 1 );
-    }
+    uint8_t nonce[NonceBytes];
+    memset( nonce, 0, NonceBytes );
 
-    check( connectToken.clientId == clientId );
-    check( connectToken.numServerAddresses == 1 );
-    check( connectToken.serverAddresses[0] == Address( "::1", ServerPort ) );
-    check( memcmp( connectToken.clientToServerKey, clientToServerKey, KeyBytes ) == 0 );
-    check( memcmp( connectToken.serverToClientKey, serverToClientKey, KeyBytes ) == 0 );
+    uint8_t message[64];
+    memset( message, 0x5A, sizeof( message ) );
 
-    Address clientAddress( "::1", ClientPort );
+    uint8_t expected[MacBytes + sizeof( message )];
+    memcpy( expected + MacBytes, message, sizeof( message ) );
+    check( Encrypt_InPlace( expected + MacBytes, sizeof( message ), expected, nonce, sendKey, CIPHER_SUITE_AES256_GCM ) );
 
-    ChallengeToken challengeToken;
-    if ( !GenerateChallengeToken( connectToken, connectTokenData, challengeToken ) )
-    {
-        printf( "error: failed to generate challenge token\n" );
-        exit( 1 );
-    }
+    uint8_t encrypted[MacBytes + sizeof( message )];
+    memcpy( encrypted + MacBytes, message, sizeof( message ) );
+    check( Encrypt_InPlace( encrypted + MacBytes, sizeof( message ), encrypted, nonce, sendKey, CIPHER_SUITE_AES256_GCM, sendCipherState ) );
 
-    if ( !EncryptChallengeToken( challengeToken, challengeTokenData, challengeTokenNonce, key ) )
-    {
-        printf( "error: failed to encrypt challenge token\n" );
-        exit( 1 );
-    }
+    check( memcmp( encrypted, expected, sizeof( expected ) ) == 0 );
 
-    ChallengeToken decryptedChallengeToken;
-    if ( !DecryptChallengeToken( challengeTokenData, decryptedChallengeToken, challengeTokenNonce, key ) )
-    {
-        printf( "error: failed to decrypt challenge token\n" );
-        exit( 1 );
-    }
+    check( !Decrypt_InPlace( encrypted + MacBytes, sizeof( message ), encrypted, nonce, receiveKey, CIPHER_SUITE_AES256_GCM, receiveCipherState ) );
 
-    check( challengeToken.clientId == clientId );
-    check( memcmp( challengeToken.connectTokenMac, connectTokenData, MacBytes ) == 0 );
-    check( memcmp( challengeToken.clientToServerKey, clientToServerKey, KeyBytes ) == 0 );
-    check( memcmp( challengeToken.serverToClientKey, serverToClientKey, KeyBytes ) == 0 );
-}
+    // switching back to chacha20-poly1305 drops the cipher state
+
+    check( encryptionManager.AddEncryptionMapping( address, sendKey, receiveKey, time, EncryptionMappingTimeout, CIPHER_SUITE_CHACHA20_POLY1305 ) );
+
+    check( encryptionManager.GetSendCipherState( encryptionIndex ) == NULL );
+    check( encryptionManager.GetReceiveCipherState( encryptionIndex ) == NULL );
+
+    check( encryptionManager.AddEncryptionMapping( address, sendKey, receiveKey, time, EncryptionMappingTimeout, CIPHER_SUITE_AES256_GCM ) );
+    check( encryptionManager.GetSendCipherState( encryptionIndex ) );
+
+    check( encryptionManager.RemoveEncryptionMapping( address, time ) );
+
+    check( encryptionManager.GetSendCipherState( encryptionIndex ) == NULL );
+    check( encryptionManager.GetReceiveCipherState( encryptionIndex ) == NULL );
+
+    // cipher state is wiped on reset, and expanded again when a mapping that needs it is added
+
+    check( encryptionManager.AddEncryptionMapping( address, sendKey, receiveKey, time, EncryptionMappingTimeout, CIPHER_SUITE_AES256_GCM ) );
+
+    encryptionManager.ResetEncryptionMappings();
+
+    check( encryptionManager.GetSendCipherState( encryptionIndex ) == NULL );
+    check( encryptionManager.GetReceiveCipherState( encryptionIndex ) == NULL );
+
+    check( encryptionManager.AddEncryptionMapping( address, sendKey, receiveKey, time, EncryptionMappingTimeout, CIPHER_SUITE_AES256_GCM ) );
+
+    encryptionIndex = encryptionManager.FindEncryptionMapping( address, time );
+
+    check( encryptionIndex != -1 );
+
+    sendCipherState = encryptionManager.GetSendCipherState( encryptionIndex );
+
+    check( sendCipherState );
+
+    memcpy( encrypted + MacBytes, message, sizeof( message ) );
+    check( Encrypt_InPlace( encrypted + MacBytes, sizeof( message ), encrypted, nonce, sendKey, CIPHER_SUITE_AES256_GCM, sendCipherState ) );
+    check( memcmp( encrypted, expected, sizeof( expected ) ) == 0 );
+}
+
+void test_encryption_manager_timeouts()
+{
+    EncryptionManager encryptionManager( GetDefaultAllocator() );
+
+    uint8_t sendKey[KeyBytes];
+    uint8_t receiveKey[KeyBytes];
+
+    GenerateKey( sendKey );
+    GenerateKey( receiveKey );
+
+    double time = 100.0;
+
+    // fill every encryption mapping. mapping i times out after i+1 seconds
+
+    for ( int i = 0; i < MaxEncryptionMappings; ++i )
+        check( encryptionManager.AddEncryptionMapping( Address( "::1", 20000 + i ), sendKey, receiveKey, time, 1.0 + i ) );
+
+    check( !encryptionManager.AddEncryptionMapping( Address( "::1", 50000 ), sendKey, receiveKey, time, 1.0 ) );
+
+    // keep the first mapping alive by index, the way a cached encryption index in a transport context does
+
+    const int touchedIndex = encryptionManager.FindEncryptionMapping( Address( "::1", 20000 ), time );
+
+    check( touchedIndex != -1 );
+
+    for ( int i = 0; i < 10; ++i )
+    {
+        time += 1.0;
+        encryptionManager.TouchEncryptionMapping( touchedIndex, time );
+    }
+
+    time += 0.5;
+
+    check( encryptionManager.FindEncryptionMapping( Address( "::1", 20000 ), time ) == touchedIndex );
+
+    for ( int i = 1; i < MaxEncryptionMappings; ++i )
+    {
+        const int encryptionIndex = encryptionManager.FindEncryptionMapping( Address( "::1", 20000 + i ), time );
+
+        if ( i < 10 )
+            check( encryptionIndex == -1 );
+        else
+            check( encryptionIndex != -1 );
+    }
+
+    // timed out mappings free up their slots for new mappings
+
+    for ( int i = 0; i < 9; ++i )
+        check( encryptionManager.AddEncryptionMapping( Address( "::1", 50000 + i ), sendKey, receiveKey, time, 1.0 ) );
+
+    check( !encryptionManager.AddEncryptionMapping( Address( "::1", 50009 ), sendKey, receiveKey, time, 1.0 ) );
+
+    // re-adding an existing mapping with a shorter timeout makes it time out sooner
+
+    check( encryptionManager.AddEncryptionMapping( Address( "::1", 20000 + MaxEncryptionMappings - 1 ), sendKey, receiveKey, time, 0.1 ) );
+
+    time += 0.2;
+
+    check( encryptionManager.FindEncryptionMapping( Address( "::1", 20000 + MaxEncryptionMappings - 1 ), time ) == -1 );
+    check( encryptionManager.FindEncryptionMapping( Address( "::1", 20000 + MaxEncryptionMappings - 2 ), time ) != -1 );
+}
+
+void test_transport_context_manager()
+{
+    TestPacketFactory packetFactory;
+
+    const int NumContextMappings = 1000;
+
+    TransportContextManager contextManager( GetDefaultAllocator(), NumContextMappings );
+
+    TransportContext context( GetDefaultAllocator(), packetFactory );
+
+    // fill every slot. mix IPv4 and IPv6 addresses that only differ by a few bits, so nearby addresses collide in the hash table
+
+    for ( int i = 0; i < NumContextMappings; ++i )
+    {
+        const Address address = ( i & 1 ) ? Address( "::1", 20000 + i ) : Address( 127, 0, 0, 1, 20000 + i );
+
+        check( contextManager.GetContext( address ) == NULL );
+
+        context.encryptionIndex = i;
+
+        check( contextManager.AddContextMapping( address, context ) );
+    }
+
+    check( contextManager.GetNumContextMappings() == NumContextMappings );
+
+    check( !contextManager.AddContextMapping( Address( "::1", 50000 ), context ) );
+
+    // remove every third context mapping and make sure all others can still be found
+
+    for ( int i = 0; i < NumContextMappings; i += 3 )
+    {
+        const Address address = ( i & 1 ) ? Address( "::1", 20000 + i ) : Address( 127, 0, 0, 1, 20000 + i );
+
+        check( contextManager.RemoveContextMapping( address ) );
+        check( !contextManager.RemoveContextMapping( address ) );
+    }
+
+    for ( int i = 0; i < NumContextMappings; ++i )
+    {
+        const Address address = ( i & 1 ) ? Address( "::1", 20000 + i ) : Address( 127, 0, 0, 1, 20000 + i );
+
+        const TransportContext * result = contextManager.GetContext( address );
+
+        if ( i % 3 == 0 )
+        {
+            check( result == NULL );
+        }
+        else
+        {
+            check( result );
+            check( result->encryptionIndex == i );
+            check( result->packetFactory == &packetFactory );
+        }
+    }
+
+    // adding an existing address updates its context in place
+
+    context.encryptionIndex = -100;
+
+    check( contextManager.AddContextMapping( Address( "::1", 20001 ), context ) );
+
+    check( contextManager.GetContext( Address( "::1", 20001 ) )->encryptionIndex == -100 );
+
+    check( contextManager.GetNumContextMappings() == NumContextMappings - ( NumContextMappings + 2 ) / 3 );
+
+    contextManager.ResetContextMappings();
+
+    check( contextManager.GetNumContextMappings() == 0 );
+    check( contextManager.GetContext( Address( "::1", 20001 ) ) == NULL );
+}
+
+void test_connect_token_filter()
+{
+    const int MaxEntries = 100;
+
+    ConnectTokenFilter filter( GetDefaultAllocator(), MaxEntries );
+
+    const Address address( "::1", 20000 );
+    const Address otherAddress( "::1", 20001 );
+
+    const uint64_t timestamp = 1000;
+
+    uint8_t mac[MaxEntries*2][MacBytes];
+    for ( int i = 0; i < MaxEntries * 2; ++i )
+        RandomBytes( mac[i], MacBytes );
+
+    // the same token is accepted again from the same address, but not from a different address
+
+    for ( int i = 0; i < MaxEntries; ++i )
+    {
+        check( !filter.Find( mac[i] ) );
+        check( filter.FindOrAdd( address, mac[i], 0.0, timestamp + i + 1, timestamp ) );
+        check( filter.Find( mac[i] ) );
+    }
+
+    check( filter.GetNumEntries() == MaxEntries );
+
+    for ( int i = 0; i < MaxEntries; ++i )
+    {
+        check( filter.FindOrAdd( address, mac[i], 0.0, timestamp + i + 1, timestamp ) );
+        check( !filter.FindOrAdd( otherAddress, mac[i], 0.0, timestamp + i + 1, timestamp ) );
+    }
+
+    // once full, adding a new token evicts the oldest entry
+
+    check( filter.FindOrAdd( address, mac[MaxEntries], 0.0, timestamp + 1000, timestamp ) );
+
+    check( filter.GetNumEntries() == MaxEntries );
+    check( !filter.Find( mac[0] ) );
+    check( filter.Find( mac[1] ) );
+
+    // entries for tokens that have expired are evicted
+
+    check( filter.FindOrAdd( address, mac[MaxEntries+1], 0.0, timestamp + 1000, timestamp + MaxEntries / 2 ) );
+
+    check( filter.GetNumEntries() == MaxEntries / 2 + 2 );
+    check( !filter.Find( mac[MaxEntries/2 - 1] ) );
+    check( filter.Find( mac[MaxEntries/2] ) );
+    check( filter.FindOrAdd( otherAddress, mac[1], 0.0, timestamp + 1000, timestamp + MaxEntries / 2 ) );
+
+    filter.Reset();
+
+    check( filter.GetNumEntries() == 0 );
+    check( !filter.Find( mac[MaxEntries] ) );
+}
+
+void test_timer_wheel()
+{
+    const int NumTimers = 256;
+
+    const double TickTime = 0.001;
+
+    double time = 100.0;
+
+    TimerWheel timerWheel( GetDefaultAllocator(), NumTimers, TickTime, time );
+
+    // schedule timers from a few ticks out to well past the range of the first two levels, so timers cascade down
+
+    double expireTime[NumTimers];
+
+    for ( int i = 0; i < NumTimers; ++i )
+    {
+        expireTime[i] = time + random_float( 0.0f, 10.0f );
+        timerWheel.Schedule( i, expireTime[i] );
+    }
+
+    check( timerWheel.GetNumScheduledTimers() == NumTimers );
+
+    // cancel and reschedule some timers
+
+    for ( int i = 0; i < NumTimers; i += 4 )
+    {
+        timerWheel.Cancel( i );
+        check( !timerWheel.IsScheduled( i ) );
+    }
+
+    for ( int i = 0; i < NumTimers; i += 8 )
+    {
+        expireTime[i] = time + random_float( 0.0f, 5.0f );
+        timerWheel.Schedule( i, expireTime[i] );
+    }
+
+    bool fired[NumTimers];
+    memset( fired, 0, sizeof( fired ) );
+
+    int numFired = 0;
+
+    while ( timerWheel.GetNumScheduledTimers() > 0 )
+    {
+        time += random_float( 0.0f, 0.05f );
+
+        const int numFiredTimers = timerWheel.AdvanceTime( time );
+
+        for ( int i = 0; i < numFiredTimers; ++i )
+        {
+            const int timerIndex = timerWheel.GetFiredTimer( i );
+
+            // timers never fire early, and fire no later than a tick after the time they were due
+
+            check( !fired[timerIndex] );
+            check( !timerWheel.IsScheduled( timerIndex ) );
+            check( expireTime[timerIndex] <= time );
+            check( expireTime[timerIndex] + 0.05 + TickTime * 2 > time );
+
+            fired[timerIndex] = true;
+            numFired++;
+        }
+    }
+
+    check( numFired == NumTimers - NumTimers / 4 + NumTimers / 8 );
+
+    for ( int i = 0; i < NumTimers; ++i )
+        check( fired[i] == ( i % 4 != 0 || i % 8 == 0 ) );
+
+    // timers scheduled in the past fire on the next tick
+
+    timerWheel.Schedule( 0, time - 1.0 );
+
+    check( timerWheel.AdvanceTime( time ) == 0 );
+    check( timerWheel.AdvanceTime( time + TickTime * 2 ) == 1 );
+    check( timerWheel.GetFiredTimer( 0 ) == 0 );
+}
+
+struct WorkerPoolTestData
+{
+    int numItems;
+    int * processed;
+    int * worker;
+};
+
+static void WorkerPoolTestFunction( void * data, int workerIndex, int begin, int end )
+{
+    WorkerPoolTestData * testData = (WorkerPoolTestData*) data;
+    for ( int i = begin; i < end; ++i )
+    {
+        testData->processed[i]++;
+        testData->worker[i] = workerIndex;
+    }
+}
+
+void test_worker_pool()
+{
+    const int NumItems = 1000;
+
+    int processed[NumItems];
+    int worker[NumItems];
+
+    WorkerPoolTestData data;
+    data.numItems = NumItems;
+    data.processed = processed;
+    data.worker = worker;
+
+    const int NumThreads[] = { 0, 1, 3 };
+
+    for ( int i = 0; i < int( sizeof( NumThreads ) / sizeof( int ) ); ++i )
+    {
+        WorkerPool workerPool( GetDefaultAllocator(), NumThreads[i] );
+
+        check( workerPool.GetNumWorkers() == NumThreads[i] + 1 );
+
+        for ( int iteration = 0; iteration < 10; ++iteration )
+        {
+            memset( processed, 0, sizeof( processed ) );
+            memset( worker, -1, sizeof( worker ) );
+
+            const int numItems = ( iteration == 0 ) ? 1 : NumItems - iteration;
+
+            workerPool.Run( WorkerPoolTestFunction, &data, numItems );
+
+            // every item is processed exactly once, and each worker gets a contiguous range of items in order
+
+            for ( int j = 0; j < numItems; ++j )
+            {
+                check( processed[j] == 1 );
+                check( worker[j] >= 0 && worker[j] < workerPool.GetNumWorkers() );
+                if ( j > 0 )
+                    check( worker[j] >= worker[j-1] );
+            }
+
+            for ( int j = numItems; j < NumItems; ++j )
+                check( processed[j] == 0 );
+        }
+
+        workerPool.Run( WorkerPoolTestFunction, &data, 0 );
+    }
+}
+
+void test_client_server_tokens()
+{
+    uint8_t key[KeyBytes];
+
+    uint64_t clientId = 1;
+
+    uint8_t connectTokenData[ConnectTokenBytes];
+    uint8_t challengeTokenData[ChallengeTokenBytes];
+    
+    uint8_t connectTokenNonce[NonceBytes];
+    uint8_t challengeTokenNonce[NonceBytes];
+
+    uint8_t clientToServerKey[KeyBytes];
+    uint8_t serverToClientKey[KeyBytes];
+
+    int numServerAddresses;
+    Address serverAddresses[MaxServersPerConnect];
+
+    memset( connectTokenNonce, 0, NonceBytes );
+    memset( challengeTokenNonce, 0, NonceBytes );
+
+    GenerateKey( key );
+
+    numServerAddresses = 1;
+    serverAddresses[0] = Address( "::1", ServerPort );
+
+    memset( connectTokenNonce, 0, NonceBytes );
+
+    uint64_t connectTokenExpireTimestamp;
+
+    {
+        ConnectToken token;
+        GenerateConnectToken( token, clientId, numServerAddresses, serverAddresses, ProtocolId, 10, CIPHER_SUITE_AES256_GCM );
+
+        check( token.cipherSuite == CIPHER_SUITE_AES256_GCM );
+
+        connectTokenExpireTimestamp = token.expireTimestamp;
+
+        char json[2048];
+
+        check( WriteConnectTokenToJSON( token, json, sizeof( json ) ) );
+
+        check( strlen( json ) > 0 );
+
+        ConnectToken readToken;
+        check( ReadConnectTokenFromJSON( json, readToken ) );
+        check( token == readToken );
+
+        memcpy( clientToServerKey, token.clientToServerKey, KeyBytes );
+        memcpy( serverToClientKey, token.serverToClientKey, KeyBytes );
+
+        if ( !EncryptConnectToken( token, connectTokenData, connectTokenNonce, key ) )
+        {
+            printf( "error: failed to encrypt connect token\n" );
+            exit( 1 );
+        }
+    }
+
+    ConnectToken connectToken;
+    if ( !DecryptConnectToken( connectTokenData, connectToken, connectTokenNonce, key, connectTokenExpireTimestamp ) )
+    {
+        printf( "error: failed to decrypt connect token\n" );
+        exit( 1 );
+    }
+
+    check( connectToken.clientId == clientId );
+    check( connectToken.numServerAddresses == 1 );
+    check( connectToken.serverAddresses[0] == Address( "::1", ServerPort ) );
+    check( memcmp( connectToken.clientToServerKey, clientToServerKey, KeyBytes ) == 0 );
+    check( memcmp( connectToken.serverToClientKey, serverToClientKey, KeyBytes ) == 0 );
+
+    Address clientAddress( "::1", ClientPort );
+
+    ChallengeToken challengeToken;
+    if ( !GenerateChallengeToken( connectToken, connectTokenData, challengeToken ) )
+    {
+        printf( "error: failed to generate challenge token\n" );
+        exit( 1 );
+    }
+
+    if ( !EncryptChallengeToken( challengeToken, challengeTokenData, challengeTokenNonce, key ) )
+    {
+        printf( "error: failed to encrypt challenge token\n" );
+        exit( 1 );
+    }
+
+    ChallengeToken decryptedChallengeToken;
+    if ( !DecryptChallengeToken( challengeTokenData, decryptedChallengeToken, challengeTokenNonce, key ) )
+    {
+        printf( "error: failed to decrypt challenge token\n" );
+        exit( 1 );
+    }
+
+    check( challengeToken.clientId == clientId );
+    check( memcmp( challengeToken.connectTokenMac, connectTokenData, MacBytes ) == 0 );
+    check( memcmp( challengeToken.clientToServerKey, clientToServerKey, KeyBytes ) == 0 );
+    check( memcmp( challengeToken.serverToClientKey, serverToClientKey, KeyBytes ) == 0 );
+}
+
+void test_packet_processor_read_packets()
+{
+    const int NumClients = 2;
+    const int NumPacketsPerClient = 50;
+    const int NumJobs = NumClients * NumPacketsPerClient + 2;
+
+    PacketProcessor packetProcessor( GetDefaultAllocator(), ProtocolId, 256 );
+
+    TestPacketFactory packetFactory[NumClients];
+
+    ReplayProtection replayProtection[NumClients];
+
+    uint8_t key[NumClients][KeyBytes];
+
+    uint8_t allPacketTypes[NUM_TEST_PACKETS];
+    memset( allPacketTypes, 1, sizeof( allPacketTypes ) );
+
+    const int packetStride = packetProcessor.GetAbsoluteMaxPacketSize();
+
+    uint8_t * packetData = (uint8_t*) malloc( NumJobs * packetStride );
+
+    PacketWriteJob writeJobs[NumJobs];
+    PacketReadJob readJobs[NumJobs];
+
+    // interleave encrypted packets from each client. each client has its own key, packet factory and replay protection, so it gets its own shard
+
+    for ( int i = 0; i < NumClients; ++i )
+        GenerateKey( key[i] );
+
+    for ( int i = 0; i < NumJobs; ++i )
+    {
+        const int client = ( i < NumJobs - 2 ) ? ( i % NumClients ) : ( i - ( NumJobs - 2 ) );
+
+        TestPacketA * packet = (TestPacketA*) packetFactory[client].Create( TEST_PACKET_A );
+        check( packet );
+        packet->a = i % 10;
+
+        PacketWriteJob & job = writeJobs[i];
+        memset( &job, 0, sizeof( job ) );
+        job.packet = packet;
+        job.sequence = i / NumClients;
+        job.encrypt = true;
+        job.key = key[client];
+        job.streamAllocator = &GetDefaultAllocator();
+        job.packetFactory = &packetFactory[client];
+        job.shard = client;
+        job.packetData = packetData + i * packetStride;
+    }
+
+    packetProcessor.WritePackets( writeJobs, NumJobs, NULL );
+
+    for ( int i = 0; i < NumJobs; ++i )
+    {
+        check( writeJobs[i].error == PACKET_PROCESSOR_ERROR_NONE );
+        writeJobs[i].packet->Destroy();
+    }
+
+    // the second to last packet replays the first packet from client 0. the last packet is from client 1 and has been tampered with
+
+    memcpy( packetData + ( NumJobs - 2 ) * packetStride, packetData, writeJobs[0].packetBytes );
+    writeJobs[NumJobs-2].packetBytes = writeJobs[0].packetBytes;
+
+    packetData[(NumJobs-1)*packetStride + writeJobs[NumJobs-1].packetBytes - 1] ^= 0xFF;
+
+    for ( int i = 0; i < NumJobs; ++i )
+    {
+        const int client = writeJobs[i].shard;
+
+        PacketReadJob & job = readJobs[i];
+        memset( &job, 0, sizeof( job ) );
+        job.packetData = packetData + i * packetStride;
+        job.packetBytes = writeJobs[i].packetBytes;
+        job.key = key[client];
+        job.encryptedPacketTypes = allPacketTypes;
+        job.unencryptedPacketTypes = allPacketTypes;
+        job.streamAllocator = &GetDefaultAllocator();
+        job.packetFactory = &packetFactory[client];
+        job.replayProtection = &replayProtection[client];
+        job.shard = client;
+    }
+
+    WorkerPool workerPool( GetDefaultAllocator(), 3 );
+
+    packetProcessor.ReadPackets( readJobs, NumJobs, &workerPool );
+
+    for ( int i = 0; i < NumJobs - 2; ++i )
+    {
+        const PacketReadJob & job = readJobs[i];
+        check( job.error == PACKET_PROCESSOR_ERROR_NONE );
+        check( job.encrypted );
+        check( job.sequence == uint64_t( i / NumClients ) );
+        check( job.packet );
+        check( job.packet->GetType() == TEST_PACKET_A );
+        check( ( (TestPacketA*) job.packet )->a == i % 10 );
+        job.packet->Destroy();
+    }
+
+    check( readJobs[NumJobs-2].error == PACKET_PROCESSOR_ERROR_PACKET_ALREADY_RECEIVED );
+    check( readJobs[NumJobs-2].packet == NULL );
+
+    check( readJobs[NumJobs-1].error == PACKET_PROCESSOR_ERROR_DECRYPT_FAILED );
+    check( readJobs[NumJobs-1].packet == NULL );
+
+    free( packetData );
+}
+
+void test_packet_processor_checksums()
+{
+    const int NumJobs = 4;
+
+    PacketProcessor writer( GetDefaultAllocator(), ProtocolId, 256 );
+    PacketProcessor reader( GetDefaultAllocator(), ProtocolId, 256 );
+
+    check( writer.GetChecksumType() == CHECKSUM_CRC32C );
+
+    TestPacketFactory packetFactory;
+
+    uint8_t allPacketTypes[NUM_TEST_PACKETS];
+    memset( allPacketTypes, 1, sizeof( allPacketTypes ) );
+
+    const int packetStride = writer.GetAbsoluteMaxPacketSize();
+
+    uint8_t * packetData = (uint8_t*) malloc( NumJobs * packetStride );
+
+    // unencrypted packets record their checksum type in the prefix byte, so the reader accepts both whatever its own setting is
+
+    for ( int checksumType = 0; checksumType < CHECKSUM_NUM_VALUES; ++checksumType )
+    {
+        writer.SetChecksumType( checksumType );
+        reader.SetChecksumType( ( checksumType + 1 ) % CHECKSUM_NUM_VALUES );
+
+        PacketWriteJob writeJobs[NumJobs];
+        PacketReadJob readJobs[NumJobs];
+
+        for ( int i = 0; i < NumJobs; ++i )
+        {
+            TestPacketA * packet = (TestPacketA*) packetFactory.Create( TEST_PACKET_A );
+            check( packet );
+            packet->a = i;
+
+            PacketWriteJob & job = writeJobs[i];
+            memset( &job, 0, sizeof( job ) );
+            job.packet = packet;
+            job.streamAllocator = &GetDefaultAllocator();
+            job.packetFactory = &packetFactory;
+            job.packetData = packetData + i * packetStride;
+        }
+
+        writer.WritePackets( writeJobs, NumJobs, NULL );
+
+        for ( int i = 0; i < NumJobs; ++i )
+        {
+            check( writeJobs[i].error == PACKET_PROCESSOR_ERROR_NONE );
+            writeJobs[i].packet->Destroy();
+        }
+
+        // the last packet is corrupted after the prefix byte, so it must fail the checksum
+
+        packetData[(NumJobs-1)*packetStride + writeJobs[NumJobs-1].packetBytes - 1] ^= 0xFF;
+
+        for ( int i = 0; i < NumJobs; ++i )
+        {
+            PacketReadJob & job = readJobs[i];
+            memset( &job, 0, sizeof( job ) );
+            job.packetData = packetData + i * packetStride;
+            job.packetBytes = writeJobs[i].packetBytes;
+            job.encryptedPacketTypes = allPacketTypes;
+            job.unencryptedPacketTypes = allPacketTypes;
+            job.streamAllocator = &GetDefaultAllocator();
+            job.packetFactory = &packetFactory;
+        }
+
+        reader.ReadPackets( readJobs, NumJobs, NULL );
+
+        for ( int i = 0; i < NumJobs - 1; ++i )
+        {
+            const PacketReadJob & job = readJobs[i];
+            check( job.error == PACKET_PROCESSOR_ERROR_NONE );
+            check( !job.encrypted );
+            check( job.packet );
+            check( job.packet->GetType() == TEST_PACKET_A );
+            check( ( (TestPacketA*) job.packet )->a == i );
+            job.packet->Destroy();
+        }
+
+        check( readJobs[NumJobs-1].error == PACKET_PROCESSOR_ERROR_READ_PACKET_FAILED );
+        check( readJobs[NumJobs-1].packet == NULL );
+    }
+
+    free( packetData );
+}
 
 void test_unencrypted_packets()
 {
     Address clientAddress( "::1", ClientPort );
     Address serverAddress( "::1", ServerPort );
 
-    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+
+    double time = 100.0;
+
+    TestPacketFactory packetFactory;
+
+    TransportContext context( GetDefaultAllocator(), packetFactory );
+
+    LocalTransport clientTransport( GetDefaultAllocator(), networkSimulator, clientAddress, ProtocolId, time );
+    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+
+    clientTransport.SetNetworkConditions( 250, 250, 5, 10 );
+    serverTransport.SetNetworkConditions( 250, 250, 5, 10 );
+
+    clientTransport.SetContext( context );
+    serverTransport.SetContext( context );
+
+    clientTransport.EnablePacketEncryption();
+    serverTransport.EnablePacketEncryption();
+
+    check( clientTransport.IsEncryptedPacketType( CLIENT_SERVER_PACKET_KEEPALIVE ) );
+    check( serverTransport.IsEncryptedPacketType( CLIENT_SERVER_PACKET_KEEPALIVE ) );
+
+    clientTransport.DisableEncryptionForPacketType( CLIENT_SERVER_PACKET_KEEPALIVE );
+
+    check( !clientTransport.IsEncryptedPacketType( CLIENT_SERVER_PACKET_KEEPALIVE ) );
+
+    const int NumIterations = 32;
+
+    int numPacketsReceived = 0;
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        Packet * sendPacket = packetFactory.Create( CLIENT_SERVER_PACKET_KEEPALIVE );
+        check( sendPacket );
+        clientTransport.SendPacket( serverAddress, sendPacket, 0, false );
+
+        clientTransport.WritePackets();
+
+        serverTransport.ReadPackets();
+
+        while ( true )
+        {
+            Address address;
+            uint64_t sequence;
+            Packet * packet = serverTransport.ReceivePacket( address, &sequence );
+            if ( !packet )
+                break;
+            if ( packet->GetType() == CLIENT_SERVER_PACKET_KEEPALIVE )
+                numPacketsReceived++;
+        }
+
+        clientTransport.AdvanceTime( time );
+        serverTransport.AdvanceTime( time );
+
+        time += 0.1;
+    }
+
+    check( numPacketsReceived == 0 );
+}
+
+void test_network_transport_batching()
+{
+    double time = 100.0;
+
+    TestPacketFactory packetFactory;
+
+    TransportContext context( GetDefaultAllocator(), packetFactory );
+
+    const int ReceiveBatchSize = 8;
+
+    NetworkTransport clientTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time );
+    NetworkTransport serverTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time, DefaultMaxPacketSize, DefaultPacketSendQueueSize, DefaultPacketReceiveQueueSize, DefaultSocketSendBufferSize, DefaultSocketReceiveBufferSize, ReceiveBatchSize );
+
+    check( !clientTransport.IsError() );
+    check( !serverTransport.IsError() );
+
+    clientTransport.SetContext( context );
+    serverTransport.SetContext( context );
+
+    const Address serverAddress = serverTransport.GetAddress();
+
+    const int NumPackets = 100;
+
+    for ( int i = 0; i < NumPackets; ++i )
+    {
+        Packet * sendPacket = packetFactory.Create( TEST_PACKET_A );
+        check( sendPacket );
+        clientTransport.SendPacket( serverAddress, sendPacket, 0, false );
+    }
+
+    clientTransport.WritePackets();
+
+    const int NumSendBatches = ( NumPackets + DefaultSocketSendBatchSize - 1 ) / DefaultSocketSendBatchSize;
+
+    check( clientTransport.GetCounter( TRANSPORT_COUNTER_SEND_BATCHES ) == (uint64_t) NumSendBatches );
+    check( clientTransport.GetCounter( TRANSPORT_COUNTER_SEND_BATCH_PACKETS ) == NumPackets );
+    check( clientTransport.GetCounter( TRANSPORT_COUNTER_SEND_SYSTEM_CALLS ) >= (uint64_t) NumSendBatches );
+    check( clientTransport.GetCounter( TRANSPORT_COUNTER_SEND_SYSTEM_CALLS ) <= NumPackets );
+    check( clientTransport.GetCounter( TRANSPORT_COUNTER_SEND_PACKET_FAILURES ) == 0 );
+
+    int numPacketsReceived = 0;
+
+    for ( int i = 0; i < 100 && numPacketsReceived < NumPackets; ++i )
+    {
+        serverTransport.ReadPackets();
+
+        while ( true )
+        {
+            Address address;
+            uint64_t sequence;
+            Packet * packet = serverTransport.ReceivePacket( address, &sequence );
+            if ( !packet )
+                break;
+            check( packet->GetType() == TEST_PACKET_A );
+            check( address == clientTransport.GetAddress() );
+            packet->Destroy();
+            numPacketsReceived++;
+        }
+
+        platform_sleep( 0.001 );
+    }
+
+    check( numPacketsReceived == NumPackets );
+
+    const uint64_t numBatches = serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_BATCHES );
+
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS ) == NumPackets );
+    check( numBatches >= ( NumPackets + ReceiveBatchSize - 1 ) / ReceiveBatchSize );
+    check( numBatches <= NumPackets );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_BATCHES_FULL ) <= numBatches );
+}
+
+void test_network_transport_segmentation_offload()
+{
+    double time = 100.0;
+
+    TestPacketFactory packetFactory;
+
+    TransportContext context( GetDefaultAllocator(), packetFactory );
+
+    NetworkTransport clientTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time );
+    NetworkTransport serverTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time );
+
+    check( !clientTransport.IsError() );
+    check( !serverTransport.IsError() );
+
+    // segmentation offload is optional. if the kernel doesn't support it, packets must still get through
+
+    clientTransport.EnableSegmentationOffload();
+    serverTransport.EnableSegmentationOffload();
+
+    clientTransport.SetContext( context );
+    serverTransport.SetContext( context );
+
+    const Address serverAddress = serverTransport.GetAddress();
+
+    const int NumPackets = 100;
+
+    for ( int i = 0; i < NumPackets; ++i )
+    {
+        Packet * sendPacket = packetFactory.Create( TEST_PACKET_A );
+        check( sendPacket );
+        clientTransport.SendPacket( serverAddress, sendPacket, 0, false );
+    }
+
+    clientTransport.WritePackets();
+
+    check( clientTransport.GetCounter( TRANSPORT_COUNTER_SEND_BATCH_PACKETS ) == NumPackets );
+    check( clientTransport.GetCounter( TRANSPORT_COUNTER_SEND_SEGMENTED_PACKETS ) <= NumPackets );
+
+    int numPacketsReceived = 0;
+
+    for ( int i = 0; i < 100 && numPacketsReceived < NumPackets; ++i )
+    {
+        serverTransport.ReadPackets();
+
+        while ( true )
+        {
+            Address address;
+            uint64_t sequence;
+            Packet * packet = serverTransport.ReceivePacket( address, &sequence );
+            if ( !packet )
+                break;
+            check( packet->GetType() == TEST_PACKET_A );
+            check( address == clientTransport.GetAddress() );
+            packet->Destroy();
+            numPacketsReceived++;
+        }
+
+        platform_sleep( 0.001 );
+    }
+
+    check( numPacketsReceived == NumPackets );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS ) == NumPackets );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_COALESCED_PACKETS ) <= NumPackets );
+
+    // datagrams are read in batches, even when each one holds a single packet
+
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_BATCHES ) < NumPackets );
+}
+
+#if YOJIMBO_PLATFORM != YOJIMBO_PLATFORM_WINDOWS
 
+void test_multi_socket_network_transport()
+{
     double time = 100.0;
 
     TestPacketFactory packetFactory;
 
     TransportContext context( GetDefaultAllocator(), packetFactory );
 
-    LocalTransport clientTransport( GetDefaultAllocator(), networkSimulator, clientAddress, ProtocolId, time );
-    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+    const int NumSockets = 4;
+    const int NumClients = 8;
 
-    clientTransport.SetNetworkConditions( 250, 250, 5, 10 );
-    serverTransport.SetNetworkConditions( 250, 250, 5, 10 );
+    MultiSocketNetworkTransport serverTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time, NumSockets );
+
+    check( !serverTransport.IsError() );
+    check( serverTransport.GetNumSockets() == NumSockets );
+    check( serverTransport.GetAddress().GetPort() != 0 );
 
-    clientTransport.SetContext( context );
     serverTransport.SetContext( context );
 
-    clientTransport.EnablePacketEncryption();
-    serverTransport.EnablePacketEncryption();
+    NetworkTransport * clientTransport[NumClients];
 
-    check( clientTransport.IsEncryptedPacketType( CLIENT_SERVER_PACKET_KEEPALIVE ) );
-    check( serverTransport.IsEncryptedPacketType( CLIENT_SERVER_PACKET_KEEPALIVE ) );
+    for ( int i = 0; i < NumClients; ++i )
+    {
+        clientTransport[i] = YOJIMBO_NEW( GetDefaultAllocator(), NetworkTransport, GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time );
+        check( !clientTransport[i]->IsError() );
+        clientTransport[i]->SetContext( context );
+    }
 
-    clientTransport.DisableEncryptionForPacketType( CLIENT_SERVER_PACKET_KEEPALIVE );
+    // send packets from multiple clients, so the kernel has different flows to spread across the server sockets
 
-    check( !clientTransport.IsEncryptedPacketType( CLIENT_SERVER_PACKET_KEEPALIVE ) );
+    const int NumPacketsPerClient = 25;
+    const int NumPackets = NumClients * NumPacketsPerClient;
 
-    const int NumIterations = 32;
+    for ( int i = 0; i < NumClients; ++i )
+    {
+        for ( int j = 0; j < NumPacketsPerClient; ++j )
+        {
+            Packet * sendPacket = packetFactory.Create( TEST_PACKET_A );
+            check( sendPacket );
+            clientTransport[i]->SendPacket( serverTransport.GetAddress(), sendPacket, 0, false );
+        }
+
+        clientTransport[i]->WritePackets();
+    }
 
     int numPacketsReceived = 0;
 
-    for ( int i = 0; i < NumIterations; ++i )
+    for ( int i = 0; i < 1000 && numPacketsReceived < NumPackets; ++i )
     {
-        Packet * sendPacket = packetFactory.Create( CLIENT_SERVER_PACKET_KEEPALIVE );
-        check( sendPacket );
-        clientTransport.SendPacket( serverAddress, sendPacket, 0, false );
+        serverTransport.ReadPackets();
+
+        while ( true )
+        {
+            Address address;
+            uint64_t sequence;
+            Packet * packet = serverTransport.ReceivePacket( address, &sequence );
+            if ( !packet )
+                break;
+            check( packet->GetType() == TEST_PACKET_A );
+            packet->Destroy();
+            numPacketsReceived++;
+        }
+
+        platform_sleep( 0.001 );
+    }
+
+    check( numPacketsReceived == NumPackets );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS ) == NumPackets );
+
+    // packets sent from the server go out through the first socket, on the shared port
+
+    Packet * replyPacket = packetFactory.Create( TEST_PACKET_A );
+    check( replyPacket );
+    serverTransport.SendPacket( clientTransport[0]->GetAddress(), replyPacket, 0, false );
+    serverTransport.WritePackets();
+
+    bool receivedReply = false;
+
+    for ( int i = 0; i < 1000 && !receivedReply; ++i )
+    {
+        clientTransport[0]->ReadPackets();
+
+        Address address;
+        uint64_t sequence;
+        Packet * packet = clientTransport[0]->ReceivePacket( address, &sequence );
+        if ( packet )
+        {
+            check( address == serverTransport.GetAddress() );
+            packet->Destroy();
+            receivedReply = true;
+        }
+
+        platform_sleep( 0.001 );
+    }
+
+    check( receivedReply );
+
+    for ( int i = 0; i < NumClients; ++i )
+    {
+        YOJIMBO_DELETE( GetDefaultAllocator(), NetworkTransport, clientTransport[i] );
+    }
+}
+
+#endif // #if YOJIMBO_PLATFORM != YOJIMBO_PLATFORM_WINDOWS
+
+void test_threaded_network_transport()
+{
+    double time = 100.0;
+
+    TestPacketFactory packetFactory;
+
+    TransportContext context( GetDefaultAllocator(), packetFactory );
+
+    // small batches and rings, so the test goes through many ring slots and wraps around
+
+    const int BatchSize = 4;
+    const int QueueSize = 64;
+
+    ThreadedNetworkTransport serverTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time, DefaultMaxPacketSize, QueueSize, QueueSize, DefaultSocketSendBufferSize, DefaultSocketReceiveBufferSize, BatchSize, BatchSize );
+
+    NetworkTransport clientTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time );
+
+    check( !serverTransport.IsError() );
+    check( !clientTransport.IsError() );
+    check( serverTransport.GetAddress().GetPort() != 0 );
+
+    serverTransport.SetContext( context );
+    clientTransport.SetContext( context );
+
+    const int NumPackets = 200;
+
+    int numPacketsReceived = 0;
+    int numPacketsSent = 0;
+
+    for ( int i = 0; i < 1000 && numPacketsReceived < NumPackets; ++i )
+    {
+        for ( int j = 0; j < 10 && numPacketsSent < NumPackets; ++j )
+        {
+            TestPacketA * sendPacket = (TestPacketA*) packetFactory.Create( TEST_PACKET_A );
+            check( sendPacket );
+            sendPacket->a = numPacketsSent++ % 10;
+            clientTransport.SendPacket( serverTransport.GetAddress(), sendPacket, 0, false );
+        }
 
         clientTransport.WritePackets();
 
+        platform_sleep( 0.001 );
+
         serverTransport.ReadPackets();
 
         while ( true )
@@ -966,17 +2284,171 @@ void test_unencrypted_packets()
             Packet * packet = serverTransport.ReceivePacket( address, &sequence );
             if ( !packet )
                 break;
-            if ( packet->GetType() == CLIENT_SERVER_PACKET_KEEPALIVE )
-                numPacketsReceived++;
+            check( packet->GetType() == TEST_PACKET_A );
+            check( ( (TestPacketA*) packet )->a == numPacketsReceived % 10 );
+            check( address == clientTransport.GetAddress() );
+            packet->Destroy();
+            numPacketsReceived++;
         }
+    }
 
-        clientTransport.AdvanceTime( time );
-        serverTransport.AdvanceTime( time );
+    check( numPacketsReceived == NumPackets );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS ) == NumPackets );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS ) > 0 );
 
-        time += 0.1;
+    // packets sent from the server are handed to the IO thread, which sends them from the same socket
+
+    const int NumReplies = 10;
+
+    for ( int i = 0; i < NumReplies; ++i )
+    {
+        Packet * replyPacket = packetFactory.Create( TEST_PACKET_A );
+        check( replyPacket );
+        serverTransport.SendPacket( clientTransport.GetAddress(), replyPacket, 0, false );
     }
 
-    check( numPacketsReceived == 0 );
+    serverTransport.WritePackets();
+
+    int numRepliesReceived = 0;
+
+    for ( int i = 0; i < 1000 && numRepliesReceived < NumReplies; ++i )
+    {
+        clientTransport.ReadPackets();
+
+        while ( true )
+        {
+            Address address;
+            uint64_t sequence;
+            Packet * packet = clientTransport.ReceivePacket( address, &sequence );
+            if ( !packet )
+                break;
+            check( address == serverTransport.GetAddress() );
+            packet->Destroy();
+            numRepliesReceived++;
+        }
+
+        platform_sleep( 0.001 );
+    }
+
+    check( numRepliesReceived == NumReplies );
+
+    serverTransport.ReadPackets();
+
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_SEND_BATCH_PACKETS ) == NumReplies );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_SEND_SYSTEM_CALLS ) > 0 );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_SEND_QUEUE_OVERFLOW ) == 0 );
+}
+
+enum MaxSizeTestPacketTypes
+{
+    TEST_PACKET_MAX_SIZE = NUM_TEST_PACKETS,
+    NUM_MAX_SIZE_TEST_PACKETS
+};
+
+const int MaxSizeTestPacketBytes = 52;
+
+struct TestMaxSizePacket : public Packet
+{
+    uint8_t data[MaxSizeTestPacketBytes];
+
+    TestMaxSizePacket()
+    {
+        for ( int i = 0; i < MaxSizeTestPacketBytes; ++i )
+            data[i] = (uint8_t) i;
+    }
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        serialize_bytes( stream, data, MaxSizeTestPacketBytes );
+        return true;
+    }
+
+    YOJIMBO_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+YOJIMBO_PACKET_FACTORY_START( MaxSizeTestPacketFactory, TestPacketFactory, NUM_MAX_SIZE_TEST_PACKETS );
+    YOJIMBO_DECLARE_PACKET_TYPE( TEST_PACKET_MAX_SIZE, TestMaxSizePacket );
+YOJIMBO_PACKET_FACTORY_FINISH();
+
+void test_threaded_network_transport_encrypted_packets()
+{
+    double time = 100.0;
+
+    MaxSizeTestPacketFactory packetFactory;
+
+    TransportContext context( GetDefaultAllocator(), packetFactory );
+
+    // encrypted packets are larger than the max packet size, by the encryption prefix and the MAC. the client can receive them because its max packet size is larger
+
+    const int MaxPacketSize = 64;
+    const int BatchSize = 1;
+    const int QueueSize = 4;
+
+    ThreadedNetworkTransport serverTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time, MaxPacketSize, QueueSize, QueueSize, DefaultSocketSendBufferSize, DefaultSocketReceiveBufferSize, BatchSize, BatchSize );
+
+    NetworkTransport clientTransport( GetDefaultAllocator(), Address( "127.0.0.1", 0 ), ProtocolId, time );
+
+    check( !serverTransport.IsError() );
+    check( !clientTransport.IsError() );
+
+    serverTransport.SetContext( context );
+    clientTransport.SetContext( context );
+
+    serverTransport.EnablePacketEncryption();
+    clientTransport.EnablePacketEncryption();
+
+    uint8_t serverToClientKey[KeyBytes];
+    uint8_t clientToServerKey[KeyBytes];
+
+    GenerateKey( serverToClientKey );
+    GenerateKey( clientToServerKey );
+
+    check( serverTransport.AddEncryptionMapping( clientTransport.GetAddress(), serverToClientKey, clientToServerKey, 10.0 ) );
+    check( clientTransport.AddEncryptionMapping( serverTransport.GetAddress(), clientToServerKey, serverToClientKey, 10.0 ) );
+
+    // send more packets than there are send ring slots, one write at a time, so every slot is written with a max size encrypted packet
+
+    const int NumPackets = 16;
+
+    int numPacketsReceived = 0;
+
+    for ( int i = 0; i < NumPackets; ++i )
+    {
+        Packet * sendPacket = packetFactory.Create( TEST_PACKET_MAX_SIZE );
+        check( sendPacket );
+        serverTransport.SendPacket( clientTransport.GetAddress(), sendPacket, 0, false );
+        serverTransport.WritePackets();
+
+        for ( int j = 0; j < 1000; ++j )
+        {
+            clientTransport.ReadPackets();
+
+            Address address;
+            uint64_t sequence;
+            Packet * packet = clientTransport.ReceivePacket( address, &sequence );
+            if ( packet )
+            {
+                check( packet->GetType() == TEST_PACKET_MAX_SIZE );
+                check( address == serverTransport.GetAddress() );
+                for ( int k = 0; k < MaxSizeTestPacketBytes; ++k )
+                {
+                    check( ( (TestMaxSizePacket*) packet )->data[k] == (uint8_t) k );
+                }
+                packet->Destroy();
+                numPacketsReceived++;
+                break;
+            }
+
+            platform_sleep( 0.001 );
+        }
+    }
+
+    check( numPacketsReceived == NumPackets );
+
+    serverTransport.ReadPackets();
+
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_ENCRYPTED_PACKETS_WRITTEN ) == NumPackets );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_SEND_QUEUE_OVERFLOW ) == 0 );
 }
 
 void test_allocator_tlsf()
@@ -2106,36 +3578,160 @@ void test_client_server_connect_token_invalid()
     clientTransport.SetNetworkConditions( 250, 250, 5, 10 );
     serverTransport.SetNetworkConditions( 250, 250, 5, 10 );
 
-    const int NumIterations = 1000;
+    const int NumIterations = 1000;
+
+    ClientServerConfig clientServerConfig;
+    clientServerConfig.enableMessages = false;
+
+    GameClient client( GetDefaultAllocator(), clientTransport, clientServerConfig, time );
+    GameServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
+
+    server.SetServerAddress( serverAddress );
+    
+    server.Start();
+
+    uint64_t connectTokenExpireTimestamp = ::time( NULL ) + 100;
+
+    client.Connect( clientId, serverAddress, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp );
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        Client * clients[] = { &client };
+        Server * servers[] = { &server };
+        Transport * transports[] = { &clientTransport, &serverTransport };
+
+        PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
+    }
+
+    check( client.ConnectionFailed() );
+    check( server.GetCounter( SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_FAILED_TO_DECRYPT_CONNECT_TOKEN ) > 0 );
+    check( client.GetClientState() == CLIENT_STATE_CONNECTION_REQUEST_TIMEOUT );
+
+    server.Stop();
+}
+
+class CipherSuiteTestServer : public GameServer
+{
+    bool m_canUseAES;
+
+public:
+
+    CipherSuiteTestServer( Allocator & allocator, Transport & transport, const ClientServerConfig & config, double time, bool canUseAES )
+        : GameServer( allocator, transport, config, time ), m_canUseAES( canUseAES ) {}
+
+    bool CanUseCipherSuite( int cipherSuite ) const
+    {
+        if ( cipherSuite == CIPHER_SUITE_AES256_GCM && !m_canUseAES )
+            return false;
+        return GameServer::CanUseCipherSuite( cipherSuite );
+    }
+};
+
+void test_client_server_cipher_suites()
+{
+    struct CipherSuiteCase
+    {
+        int tokenCipherSuite;
+        int clientCipherSuite;
+        bool serverCanUseAES;
+        int expectedCipherSuite;
+        int connectedCipherSuite;
+    };
+
+    const CipherSuiteCase cases[] = 
+    {
+        { CIPHER_SUITE_AES256_GCM, CIPHER_SUITE_AES256_GCM, true, SelectCipherSuite( CIPHER_SUITE_AES256_GCM ), SelectCipherSuite( CIPHER_SUITE_AES256_GCM ) },
+        { CIPHER_SUITE_AES256_GCM, CIPHER_SUITE_CHACHA20_POLY1305, true, CIPHER_SUITE_CHACHA20_POLY1305, CIPHER_SUITE_CHACHA20_POLY1305 },
+        { CIPHER_SUITE_CHACHA20_POLY1305, CIPHER_SUITE_AES256_GCM, true, CIPHER_SUITE_CHACHA20_POLY1305, CIPHER_SUITE_CHACHA20_POLY1305 },
+
+        // the server can't run AES-256-GCM, so it ignores the request and the client retries with ChaCha20-Poly1305
+
+        { CIPHER_SUITE_AES256_GCM, CIPHER_SUITE_AES256_GCM, false, SelectCipherSuite( CIPHER_SUITE_AES256_GCM ), CIPHER_SUITE_CHACHA20_POLY1305 },
+    };
+
+    const int NumCases = sizeof( cases ) / sizeof( cases[0] );
+
+    for ( int i = 0; i < NumCases; ++i )
+    {
+        uint64_t clientId = 1;
+
+        uint8_t connectTokenData[ConnectTokenBytes];
+        uint8_t connectTokenNonce[NonceBytes];
+
+        uint8_t clientToServerKey[KeyBytes];
+        uint8_t serverToClientKey[KeyBytes];
+
+        int numServerAddresses;
+        Address serverAddresses[MaxServersPerConnect];
+
+        memset( connectTokenNonce, 0, NonceBytes );
+
+        GenerateKey( private_key );
+
+        uint64_t connectTokenExpireTimestamp;
+
+        LocalMatcher tokenMatcher( cases[i].tokenCipherSuite );
+
+        if ( !tokenMatcher.RequestMatch( clientId, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp, numServerAddresses, serverAddresses ) )
+        {
+            printf( "error: request match failed\n" );
+            exit( 1 );
+        }
+
+        Address clientAddress( "::1", ClientPort );
+        Address serverAddress( "::1", ServerPort );
+
+        NetworkSimulator networkSimulator( GetDefaultAllocator() );
+
+        double time = 100.0;
+
+        LocalTransport clientTransport( GetDefaultAllocator(), networkSimulator, clientAddress, ProtocolId, time );
+        LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+
+        ClientServerConfig clientServerConfig;
+        clientServerConfig.enableMessages = false;
+        clientServerConfig.cipherSuite = cases[i].clientCipherSuite;
+
+        GameClient client( GetDefaultAllocator(), clientTransport, clientServerConfig, time );
+
+        CipherSuiteTestServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time, cases[i].serverCanUseAES );
+
+        server.SetServerAddress( serverAddress );
+        
+        server.Start();
+
+        client.Connect( clientId, serverAddress, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp, tokenMatcher.GetCipherSuite() );
 
-    ClientServerConfig clientServerConfig;
-    clientServerConfig.enableMessages = false;
+        check( client.GetCipherSuite() == cases[i].expectedCipherSuite );
 
-    GameClient client( GetDefaultAllocator(), clientTransport, clientServerConfig, time );
-    GameServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
+        while ( true )
+        {
+            Client * clients[] = { &client };
+            Server * servers[] = { &server };
+            Transport * transports[] = { &clientTransport, &serverTransport };
 
-    server.SetServerAddress( serverAddress );
-    
-    server.Start();
+            PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
 
-    uint64_t connectTokenExpireTimestamp = ::time( NULL ) + 100;
+            if ( client.ConnectionFailed() )
+            {
+                printf( "error: client connect failed!\n" );
+                exit( 1 );
+            }
 
-    client.Connect( clientId, serverAddress, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp );
+            if ( !client.IsConnecting() && client.IsConnected() && server.GetNumConnectedClients() == 1 )
+                break;
+        }
 
-    for ( int i = 0; i < NumIterations; ++i )
-    {
-        Client * clients[] = { &client };
-        Server * servers[] = { &server };
-        Transport * transports[] = { &clientTransport, &serverTransport };
+        check( !client.IsConnecting() && client.IsConnected() && server.GetNumConnectedClients() == 1 );
+        check( client.GetCipherSuite() == cases[i].connectedCipherSuite );
 
-        PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
-    }
+        const bool fellBack = cases[i].expectedCipherSuite != cases[i].connectedCipherSuite;
+        check( ( server.GetCounter( SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_CIPHER_SUITE_NOT_ALLOWED ) > 0 ) == fellBack );
 
-    check( client.ConnectionFailed() );
-    check( server.GetCounter( SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_FAILED_TO_DECRYPT_CONNECT_TOKEN ) > 0 );
-    check( client.GetClientState() == CLIENT_STATE_CONNECTION_REQUEST_TIMEOUT );
+        client.Disconnect();
 
-    server.Stop();
+        server.Stop();
+    }
 }
 
 void test_client_server_connect_address_already_connected()
@@ -2808,10 +4404,32 @@ void test_bit_array()
         }
     }
 
+    // verify find next set bit finds every set bit in order, and respects the end of the range
+
+    int numBitsFound = 0;
+
+    for ( int i = bit_array.FindNextSetBit( 0, Size ); i < Size; i = bit_array.FindNextSetBit( i + 1, Size ) )
+    {
+        check( ( i % 10 ) == 0 );
+        check( i == numBitsFound * 10 );
+        numBitsFound++;
+    }
+
+    check( numBitsFound == Size / 10 );
+
+    check( bit_array.FindNextSetBit( 1, 10 ) == 10 );
+    check( bit_array.FindNextSetBit( 1, 11 ) == 10 );
+    check( bit_array.FindNextSetBit( 71, 80 ) == 80 );
+    check( bit_array.FindNextSetBit( 71, 300 ) == 80 );
+    check( bit_array.FindNextSetBit( 200, 200 ) == 200 );
+    check( bit_array.FindNextSetBit( 291, Size ) == Size );
+
     // clear and verify all bits are zero
 
     bit_array.Clear();
 
+    check( bit_array.FindNextSetBit( 0, Size ) == Size );
+
     for ( int i = 0; i < Size; ++i )
     {
         check( bit_array.GetBit(i) == 0 );
@@ -3116,11 +4734,300 @@ void PumpConnectionUpdate( double & time, Connection & sender, Connection & rece
     sender.AdvanceTime( time );
     receiver.AdvanceTime( time );
 
-    senderTransport.AdvanceTime( time );
-    receiverTransport.AdvanceTime( time );
+    senderTransport.AdvanceTime( time );
+    receiverTransport.AdvanceTime( time );
+}
+
+void test_message_factory_pooling()
+{
+    TestMessageFactory messageFactory;
+
+    check( !messageFactory.IsPoolingEnabled() );
+
+    messageFactory.EnablePooling( 4 );
+    messageFactory.SetPoolSize( TEST_BLOCK_MESSAGE, 2 );
+    messageFactory.PreallocateMessages();
+
+    check( messageFactory.IsPoolingEnabled() );
+
+    const uint64_t numAllocatorCalls = messageFactory.GetNumAllocatorCalls();
+
+    // messages come out of the preallocated pool, aligned to a cache line, and released messages are reused without touching the allocator
+
+    Message * messages[4];
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        messages[i] = messageFactory.Create( TEST_MESSAGE );
+        check( messages[i] );
+        check( messages[i]->GetType() == TEST_MESSAGE );
+        check( messages[i]->GetRefCount() == 1 );
+        check( ( uintptr_t( messages[i] ) & ( CacheLineBytes - 1 ) ) == 0 );
+        ( (TestMessage*) messages[i] )->sequence = uint16_t( 1000 + i );
+    }
+
+    check( messageFactory.GetNumAllocatorCalls() == numAllocatorCalls );
+
+    Message * released = messages[2];
+    messageFactory.Release( messages[2] );
+    messages[2] = messageFactory.Create( TEST_MESSAGE );
+    check( messages[2] == released );
+    check( ( (TestMessage*) messages[2] )->sequence == 0 );
+
+    check( messageFactory.GetNumAllocatorCalls() == numAllocatorCalls );
+
+    // running out grows the pool by another chunk
+
+    Message * extra = messageFactory.Create( TEST_MESSAGE );
+    check( extra );
+    check( messageFactory.GetNumAllocatorCalls() == numAllocatorCalls + 1 );
+
+    messageFactory.AddRef( extra );
+    messageFactory.Release( extra );
+    check( extra->GetRefCount() == 1 );
+    messageFactory.Release( extra );
+
+    for ( int i = 0; i < 4; ++i )
+        messageFactory.Release( messages[i] );
+
+    // block messages still free their blocks when they go back to the pool
+
+    for ( int i = 0; i < 8; ++i )
+    {
+        BlockMessage * blockMessage = (BlockMessage*) messageFactory.Create( TEST_BLOCK_MESSAGE );
+        check( blockMessage );
+        check( blockMessage->GetBlockData() == NULL );
+        uint8_t * blockData = (uint8_t*) YOJIMBO_ALLOCATE( messageFactory.GetAllocator(), 64 );
+        blockMessage->AttachBlock( messageFactory.GetAllocator(), blockData, 64 );
+        messageFactory.Release( blockMessage );
+    }
+
+    check( messageFactory.GetNumAllocatorCalls() == numAllocatorCalls + 1 );
+
+    // without pooling, every create and release is an allocator call
+
+    TestMessageFactory unpooledMessageFactory;
+
+    for ( int i = 0; i < 8; ++i )
+    {
+        Message * message = unpooledMessageFactory.Create( TEST_MESSAGE );
+        check( message );
+        unpooledMessageFactory.Release( message );
+    }
+
+    check( unpooledMessageFactory.GetNumAllocatorCalls() == 16 );
+}
+
+void ConnectionReliableOrderedMessagesTest( bool cacheSerializedMessages )
+{
+    TestPacketFactory packetFactory;
+
+    TestMessageFactory messageFactory;
+
+    ConnectionConfig connectionConfig;
+    connectionConfig.connectionPacketType = TEST_PACKET_CONNECTION;
+    connectionConfig.channel[0].cacheSerializedMessages = cacheSerializedMessages;
+
+    TestConnection sender( packetFactory, messageFactory, connectionConfig );
+    TestConnection receiver( packetFactory, messageFactory, connectionConfig );
+
+    ConnectionContext connectionContext;
+    connectionContext.messageFactory = &messageFactory;
+    connectionContext.connectionConfig = &connectionConfig;
+
+    const int NumMessagesSent = 64;
+
+    for ( int i = 0; i < NumMessagesSent; ++i )
+    {
+        TestMessage * message = (TestMessage*) messageFactory.Create( TEST_MESSAGE );
+        check( message );
+        message->sequence = i;
+        sender.SendMsg( message );
+        check( ( message->GetSerializedPayload() != NULL ) == cacheSerializedMessages );
+    }
+
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+
+    networkSimulator.SetJitter( 250 );
+    networkSimulator.SetLatency( 1000 );
+    networkSimulator.SetDuplicate( 50 );
+    networkSimulator.SetPacketLoss( 50 );
+
+    const int SenderPort = 10000;
+    const int ReceiverPort = 10001;
+
+    Address senderAddress( "::1", SenderPort );
+    Address receiverAddress( "::1", ReceiverPort );
+
+    double time = 100.0;
+
+    TransportContext transportContext( GetDefaultAllocator(), packetFactory );
+    transportContext.connectionContext = &connectionContext;
+
+    LocalTransport senderTransport( GetDefaultAllocator(), networkSimulator, senderAddress, ProtocolId, time );
+    LocalTransport receiverTransport( GetDefaultAllocator(), networkSimulator, receiverAddress, ProtocolId, time );
+
+    senderTransport.SetContext( transportContext );
+    receiverTransport.SetContext( transportContext );
+
+    int numMessagesReceived = 0;
+
+    const int NumIterations = 1000;
+
+    for ( int i = 0; i < NumIterations; ++i )
+    {
+        PumpConnectionUpdate( time, sender, receiver, senderTransport, receiverTransport );
+
+        while ( true )
+        {
+            Message * message = receiver.ReceiveMsg();
+
+            if ( !message )
+                break;
+
+            check( message->GetId() == (int) numMessagesReceived );
+            check( message->GetType() == TEST_MESSAGE );
+
+            TestMessage * testMessage = (TestMessage*) message;
+
+            check( testMessage->sequence == numMessagesReceived );
+
+            ++numMessagesReceived;
+
+            messageFactory.Release( message );
+        }
+
+        if ( numMessagesReceived == NumMessagesSent )
+            break;
+    }
+
+    check( numMessagesReceived == NumMessagesSent );
+}
+
+void test_connection_reliable_ordered_messages()
+{
+    ConnectionReliableOrderedMessagesTest( false );
+}
+
+void test_connection_reliable_ordered_messages_cached()
+{
+    ConnectionReliableOrderedMessagesTest( true );
+}
+
+struct TestConnectionContextMessage : public Message
+{
+    uint16_t sequence;
+
+    TestConnectionContextMessage()
+    {
+        sequence = 0;
+    }
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        // fails without the connection context, like messages that size fields from the connection config
+
+        const ConnectionContext * context = (const ConnectionContext*) stream.GetContext();
+        if ( !context || context->magic != ConnectionContextMagic || !context->connectionConfig )
+            return false;
+
+        serialize_bits( stream, sequence, 16 );
+
+        return true;
+    }
+
+    YOJIMBO_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+enum TestConnectionContextMessageType
+{
+    TEST_CONNECTION_CONTEXT_MESSAGE,
+    NUM_TEST_CONNECTION_CONTEXT_MESSAGE_TYPES
+};
+
+YOJIMBO_MESSAGE_FACTORY_START( TestConnectionContextMessageFactory, MessageFactory, NUM_TEST_CONNECTION_CONTEXT_MESSAGE_TYPES );
+    YOJIMBO_DECLARE_MESSAGE_TYPE( TEST_CONNECTION_CONTEXT_MESSAGE, TestConnectionContextMessage );
+YOJIMBO_MESSAGE_FACTORY_FINISH();
+
+void test_connection_reliable_ordered_messages_cached_context()
+{
+    TestPacketFactory packetFactory;
+
+    TestConnectionContextMessageFactory messageFactory;
+
+    ConnectionConfig connectionConfig;
+    connectionConfig.connectionPacketType = TEST_PACKET_CONNECTION;
+    connectionConfig.channel[0].cacheSerializedMessages = true;
+
+    TestConnection sender( packetFactory, messageFactory, connectionConfig );
+    TestConnection receiver( packetFactory, messageFactory, connectionConfig );
+
+    ConnectionContext connectionContext;
+    connectionContext.messageFactory = &messageFactory;
+    connectionContext.connectionConfig = &connectionConfig;
+
+    // messages are cached with the connection context, so they are cached even though they can't serialize without it
+
+    sender.SetContext( &connectionContext, NULL );
+    receiver.SetContext( &connectionContext, NULL );
+
+    const int NumMessagesSent = 64;
+
+    for ( int i = 0; i < NumMessagesSent; ++i )
+    {
+        TestConnectionContextMessage * message = (TestConnectionContextMessage*) messageFactory.Create( TEST_CONNECTION_CONTEXT_MESSAGE );
+        check( message );
+        message->sequence = i;
+        sender.SendMsg( message );
+        check( message->GetSerializedPayload() != NULL );
+    }
+
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+
+    networkSimulator.SetLatency( 250 );
+    networkSimulator.SetPacketLoss( 50 );
+
+    Address senderAddress( "::1", 10000 );
+    Address receiverAddress( "::1", 10001 );
+
+    double time = 100.0;
+
+    TransportContext transportContext( GetDefaultAllocator(), packetFactory );
+    transportContext.connectionContext = &connectionContext;
+
+    LocalTransport senderTransport( GetDefaultAllocator(), networkSimulator, senderAddress, ProtocolId, time );
+    LocalTransport receiverTransport( GetDefaultAllocator(), networkSimulator, receiverAddress, ProtocolId, time );
+
+    senderTransport.SetContext( transportContext );
+    receiverTransport.SetContext( transportContext );
+
+    int numMessagesReceived = 0;
+
+    for ( int i = 0; i < 1000 && numMessagesReceived < NumMessagesSent; ++i )
+    {
+        PumpConnectionUpdate( time, sender, receiver, senderTransport, receiverTransport );
+
+        while ( true )
+        {
+            Message * message = receiver.ReceiveMsg();
+
+            if ( !message )
+                break;
+
+            check( message->GetType() == TEST_CONNECTION_CONTEXT_MESSAGE );
+            check( ( (TestConnectionContextMessage*) message )->sequence == numMessagesReceived );
+
+            ++numMessagesReceived;
+
+            messageFactory.Release( message );
+        }
+    }
+
+    check( numMessagesReceived == NumMessagesSent );
+    check( sender.GetError() == CONNECTION_ERROR_NONE );
 }
 
-void test_connection_reliable_ordered_messages()
+void test_connection_reliable_ordered_messages_small_queue()
 {
     TestPacketFactory packetFactory;
 
@@ -3128,6 +5035,9 @@ void test_connection_reliable_ordered_messages()
 
     ConnectionConfig connectionConfig;
     connectionConfig.connectionPacketType = TEST_PACKET_CONNECTION;
+    connectionConfig.channel[0].sendQueueSize = 64;
+    connectionConfig.channel[0].receiveQueueSize = 64;
+    connectionConfig.channel[0].maxMessagesPerPacket = 8;
 
     TestConnection sender( packetFactory, messageFactory, connectionConfig );
     TestConnection receiver( packetFactory, messageFactory, connectionConfig );
@@ -3136,16 +5046,6 @@ void test_connection_reliable_ordered_messages()
     connectionContext.messageFactory = &messageFactory;
     connectionContext.connectionConfig = &connectionConfig;
 
-    const int NumMessagesSent = 64;
-
-    for ( int i = 0; i < NumMessagesSent; ++i )
-    {
-        TestMessage * message = (TestMessage*) messageFactory.Create( TEST_MESSAGE );
-        check( message );
-        message->sequence = i;
-        sender.SendMsg( message );
-    }
-
     NetworkSimulator networkSimulator( GetDefaultAllocator() );
 
     networkSimulator.SetJitter( 250 );
@@ -3170,12 +5070,26 @@ void test_connection_reliable_ordered_messages()
     senderTransport.SetContext( transportContext );
     receiverTransport.SetContext( transportContext );
 
+    // keep the send queue full, so messages wrap around the send queue many times while others wait to be resent
+
+    const int NumMessagesSent = 1000;
+
+    int numMessagesSent = 0;
     int numMessagesReceived = 0;
 
-    const int NumIterations = 1000;
+    const int NumIterations = 10000;
 
     for ( int i = 0; i < NumIterations; ++i )
     {
+        while ( numMessagesSent < NumMessagesSent && sender.CanSendMsg() )
+        {
+            TestMessage * message = (TestMessage*) messageFactory.Create( TEST_MESSAGE );
+            check( message );
+            message->sequence = numMessagesSent;
+            sender.SendMsg( message );
+            ++numMessagesSent;
+        }
+
         PumpConnectionUpdate( time, sender, receiver, senderTransport, receiverTransport );
 
         while ( true )
@@ -3185,12 +5099,12 @@ void test_connection_reliable_ordered_messages()
             if ( !message )
                 break;
 
-            check( message->GetId() == (int) numMessagesReceived );
+            check( message->GetId() == (uint16_t) numMessagesReceived );
             check( message->GetType() == TEST_MESSAGE );
 
             TestMessage * testMessage = (TestMessage*) message;
 
-            check( testMessage->sequence == numMessagesReceived );
+            check( testMessage->sequence == (uint16_t) numMessagesReceived );
 
             ++numMessagesReceived;
 
@@ -3924,116 +5838,533 @@ void ProcessClientToServerMessages( Server & server, int clientIndex, int & numM
             break;
         }
 
-        server.ReleaseMsg( clientIndex, message );
-    }
-}
+        server.ReleaseMsg( clientIndex, message );
+    }
+}
+
+void ClientServerMessagesTest( int messagePoolSize )
+{
+    GenerateKey( private_key );
+
+    const uint64_t clientId = 1;
+
+    Address clientAddress( "::1", ClientPort );
+    Address serverAddress( "::1", ServerPort );
+
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+
+    double time = 100.0;
+    
+    LocalTransport clientTransport( GetDefaultAllocator(), networkSimulator, clientAddress, ProtocolId, time );
+    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+
+    ClientServerConfig clientServerConfig;
+    clientServerConfig.connectionConfig.maxPacketSize = 256;
+    clientServerConfig.connectionConfig.numChannels = 1;
+    clientServerConfig.connectionConfig.channel[0].type = CHANNEL_TYPE_RELIABLE_ORDERED;
+    clientServerConfig.connectionConfig.channel[0].maxBlockSize = 1024;
+    clientServerConfig.connectionConfig.channel[0].fragmentSize = 200;
+    clientServerConfig.messagePoolSize = messagePoolSize;
+
+    GameClient client( GetDefaultAllocator(), clientTransport, clientServerConfig, time );
+    GameServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
+
+    server.SetServerAddress( serverAddress );
+    
+    server.Start();
+
+    for ( int iteration = 0; iteration < 2; ++iteration )
+    {
+        clientTransport.Reset();
+        serverTransport.Reset();
+
+        ConnectClient( client, clientId, serverAddress );
+
+        while ( true )
+        {
+            Client * clients[] = { &client };
+            Server * servers[] = { &server };
+            Transport * transports[] = { &clientTransport, &serverTransport };
+
+            PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
+
+            if ( client.ConnectionFailed() )
+            {
+                printf( "error: client connect failed!\n" );
+                exit( 1 );
+            }
+
+            if ( !client.IsConnecting() && client.IsConnected() && server.GetNumConnectedClients() == 1 )
+                break;
+        }
+
+        check( !client.IsConnecting() && client.IsConnected() && server.GetNumConnectedClients() == 1 );
+        check( client.GetClientIndex() == 0 && server.IsClientConnected(0) );
+
+        const int NumMessagesSent = 64;
+
+        SendClientToServerMessages( client, NumMessagesSent );
+
+        SendServerToClientMessages( server, client.GetClientIndex(), NumMessagesSent );
+
+        int numMessagesReceivedFromClient = 0;
+        int numMessagesReceivedFromServer = 0;
+
+        const int NumIterations = 10000;
+
+        for ( int i = 0; i < NumIterations; ++i )
+        {
+            Client * clients[] = { &client };
+            Server * servers[] = { &server };
+            Transport * transports[] = { &clientTransport, &serverTransport };
+
+            PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
+
+            ProcessServerToClientMessages( client, numMessagesReceivedFromServer );
+
+            ProcessClientToServerMessages( server, client.GetClientIndex(), numMessagesReceivedFromClient );
+
+            if ( numMessagesReceivedFromClient == NumMessagesSent && numMessagesReceivedFromServer == NumMessagesSent )
+                break;
+        }
+
+        check( numMessagesReceivedFromClient == NumMessagesSent );
+        check( numMessagesReceivedFromServer == NumMessagesSent );
+
+        client.Disconnect();
+
+        for ( int i = 0; i < NumIterations; ++i )
+        {
+            Client * clients[] = { &client };
+            Server * servers[] = { &server };
+            Transport * transports[] = { &clientTransport, &serverTransport };
+
+            PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
+
+            if ( !client.IsConnected() && server.GetNumConnectedClients() == 0 )
+                break;
+        }
+
+        check( !client.IsConnected() && server.GetNumConnectedClients() == 0 );
+    }
+
+    server.Stop();
+}
+
+void test_client_server_messages()
+{
+    ClientServerMessagesTest( 0 );
+}
+
+void test_client_server_messages_pooled()
+{
+    ClientServerMessagesTest( 16 );
+}
+
+void test_client_server_shared_blocks()
+{
+    GenerateKey( private_key );
+
+    const int NumClients = 4;
+
+    ClientServerConfig clientServerConfig;
+    clientServerConfig.serverWorkerThreads = 2;
+    clientServerConfig.connectionConfig.maxPacketSize = 256;
+    clientServerConfig.connectionConfig.numChannels = 1;
+    clientServerConfig.connectionConfig.channel[0].type = CHANNEL_TYPE_RELIABLE_ORDERED;
+    clientServerConfig.connectionConfig.channel[0].maxBlockSize = 1024;
+    clientServerConfig.connectionConfig.channel[0].fragmentSize = 200;
+
+    Address serverAddress( "::1", ServerPort );
+
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+    
+    double time = 100.0;
+
+    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+
+    GameServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
+
+    server.SetServerAddress( serverAddress );
+    
+    server.Start( NumClients );
+
+    LocalTransport * clientTransports[NumClients];
+    CreateClientTransports( NumClients, clientTransports, networkSimulator, time );
+
+    GameClient * clients[NumClients];
+    CreateClients( NumClients, clients, clientTransports, clientServerConfig, time );
+
+    ConnectClients( NumClients, clients, serverAddress );
+
+    Server * servers[] = { &server };
+    Transport * transports[NumClients+1];
+    transports[0] = &serverTransport;
+    for ( int i = 0; i < NumClients; ++i )
+        transports[1+i] = clientTransports[i];
+
+    while ( true )
+    {
+        PumpClientServerUpdate( time, (Client**) clients, NumClients, servers, 1, transports, 1 + NumClients );
+
+        if ( AllClientsConnected( NumClients, server, clients ) )
+            break;
+    }
+
+    check( AllClientsConnected( NumClients, server, clients ) );
+
+    // attach one copy of the block to a message for every client
+
+    const int BlockSize = 1000;
+
+    uint8_t blockData[BlockSize];
+    for ( int i = 0; i < BlockSize; ++i )
+        blockData[i] = uint8_t( i * 7 );
+
+    SharedBlock * sharedBlock = server.CreateSharedBlock( blockData, BlockSize );
+
+    check( sharedBlock );
+    check( sharedBlock->GetBlockSize() == BlockSize );
+    check( memcmp( sharedBlock->GetBlockData(), blockData, BlockSize ) == 0 );
+    check( server.GetNumSharedBlocks() == 1 );
+
+    for ( int i = 0; i < NumClients; ++i )
+    {
+        const int clientIndex = clients[i]->GetClientIndex();
+
+        TestBlockMessage * message = (TestBlockMessage*) server.CreateMsg( clientIndex, TEST_BLOCK_MESSAGE );
+        check( message );
+        message->AttachSharedBlock( sharedBlock );
+        check( message->GetSharedBlock() == sharedBlock );
+        check( message->GetBlockData() == sharedBlock->GetBlockData() );
+        check( message->GetAllocator() == NULL );
+        server.SendMsg( clientIndex, message );
+    }
+
+    check( sharedBlock->GetRefCount() == 1 + NumClients );
+
+    server.ReleaseSharedBlock( sharedBlock );
+
+    check( server.GetNumSharedBlocks() == 1 );
+
+    // every client receives its own copy of the block. the shared block is freed once all messages have been acked
+
+    bool received[NumClients];
+    memset( received, 0, sizeof( received ) );
+
+    const int NumIterations = 10000;
+
+    for ( int iteration = 0; iteration < NumIterations; ++iteration )
+    {
+        PumpClientServerUpdate( time, (Client**) clients, NumClients, servers, 1, transports, 1 + NumClients );
+
+        for ( int i = 0; i < NumClients; ++i )
+        {
+            Message * message = clients[i]->ReceiveMsg();
+            if ( !message )
+                continue;
+
+            check( message->GetType() == TEST_BLOCK_MESSAGE );
+
+            BlockMessage * blockMessage = (BlockMessage*) message;
+            check( blockMessage->GetSharedBlock() == NULL );
+            check( blockMessage->GetBlockSize() == BlockSize );
+            check( memcmp( blockMessage->GetBlockData(), blockData, BlockSize ) == 0 );
+
+            received[i] = true;
+
+            clients[i]->ReleaseMsg( message );
+        }
+
+        bool allReceived = true;
+        for ( int i = 0; i < NumClients; ++i )
+            allReceived &= received[i];
+
+        if ( allReceived && server.GetNumSharedBlocks() == 0 )
+            break;
+    }
+
+    for ( int i = 0; i < NumClients; ++i )
+        check( received[i] );
+
+    check( server.GetNumSharedBlocks() == 0 );
+
+    // shared blocks still referenced by messages in flight are freed when the server stops
+
+    sharedBlock = server.CreateSharedBlock( blockData, BlockSize );
+    check( sharedBlock );
+
+    TestBlockMessage * message = (TestBlockMessage*) server.CreateMsg( clients[0]->GetClientIndex(), TEST_BLOCK_MESSAGE );
+    check( message );
+    message->AttachSharedBlock( sharedBlock );
+    server.SendMsg( clients[0]->GetClientIndex(), message );
+    server.ReleaseSharedBlock( sharedBlock );
+
+    check( server.GetNumSharedBlocks() == 1 );
+
+    DestroyClients( NumClients, clients );
+
+    DestroyTransports( NumClients, clientTransports );
+
+    server.Stop();
+
+    check( server.GetNumSharedBlocks() == 0 );
+}
+
+struct TestAlignedMessage : public Message
+{
+    uint16_t sequence;
+    uint8_t data[5];
+
+    TestAlignedMessage()
+    {
+        sequence = 0;
+        memset( data, 0, sizeof( data ) );
+    }
+
+    template <typename Stream> bool Serialize( Stream & stream )
+    {
+        serialize_bits( stream, sequence, 16 );
+        serialize_bytes( stream, data, sizeof( data ) );
+        return true;
+    }
+
+    YOJIMBO_VIRTUAL_SERIALIZE_FUNCTIONS();
+};
+
+enum BroadcastTestMessageType
+{
+    TEST_ALIGNED_MESSAGE = NUM_TEST_MESSAGE_TYPES,
+    NUM_BROADCAST_TEST_MESSAGE_TYPES
+};
+
+YOJIMBO_MESSAGE_FACTORY_START( BroadcastTestMessageFactory, TestMessageFactory, NUM_BROADCAST_TEST_MESSAGE_TYPES );
+    YOJIMBO_DECLARE_MESSAGE_TYPE( TEST_ALIGNED_MESSAGE, TestAlignedMessage );
+YOJIMBO_MESSAGE_FACTORY_FINISH();
+
+class BroadcastTestServer : public GameServer
+{
+public:
+
+    explicit BroadcastTestServer( Allocator & allocator, Transport & transport, const ClientServerConfig & config, double time ) 
+        : GameServer( allocator, transport, config, time ) {}
 
-void test_client_server_messages()
+protected:
+
+    YOJIMBO_SERVER_MESSAGE_FACTORY( BroadcastTestMessageFactory );
+};
+
+class BroadcastTestClient : public GameClient
 {
-    GenerateKey( private_key );
+public:
 
-    const uint64_t clientId = 1;
+    explicit BroadcastTestClient( Allocator & allocator, Transport & transport, const ClientServerConfig & config, double time ) 
+        : GameClient( allocator, transport, config, time ) {}
 
-    Address clientAddress( "::1", ClientPort );
-    Address serverAddress( "::1", ServerPort );
+protected:
 
-    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+    YOJIMBO_CLIENT_MESSAGE_FACTORY( BroadcastTestMessageFactory );
+};
 
-    double time = 100.0;
-    
-    LocalTransport clientTransport( GetDefaultAllocator(), networkSimulator, clientAddress, ProtocolId, time );
-    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+void test_client_server_broadcast_messages()
+{
+    GenerateKey( private_key );
+
+    const int NumClients = 4;
 
     ClientServerConfig clientServerConfig;
     clientServerConfig.connectionConfig.maxPacketSize = 256;
-    clientServerConfig.connectionConfig.numChannels = 1;
+    clientServerConfig.connectionConfig.numChannels = 2;
     clientServerConfig.connectionConfig.channel[0].type = CHANNEL_TYPE_RELIABLE_ORDERED;
     clientServerConfig.connectionConfig.channel[0].maxBlockSize = 1024;
     clientServerConfig.connectionConfig.channel[0].fragmentSize = 200;
+    clientServerConfig.connectionConfig.channel[1].type = CHANNEL_TYPE_UNRELIABLE_UNORDERED;
 
-    GameClient client( GetDefaultAllocator(), clientTransport, clientServerConfig, time );
-    GameServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
+    Address serverAddress( "::1", ServerPort );
+
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+    
+    double time = 100.0;
+
+    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+
+    BroadcastTestServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
 
     server.SetServerAddress( serverAddress );
     
-    server.Start();
+    server.Start( NumClients );
 
-    for ( int iteration = 0; iteration < 2; ++iteration )
+    LocalTransport * clientTransports[NumClients];
+    CreateClientTransports( NumClients, clientTransports, networkSimulator, time );
+
+    GameClient * clients[NumClients];
+    for ( int i = 0; i < NumClients; ++i )
+        clients[i] = YOJIMBO_NEW( GetDefaultAllocator(), BroadcastTestClient, GetDefaultAllocator(), *clientTransports[i], clientServerConfig, time );
+
+    ConnectClients( NumClients, clients, serverAddress );
+
+    Server * servers[] = { &server };
+    Transport * transports[NumClients+1];
+    transports[0] = &serverTransport;
+    for ( int i = 0; i < NumClients; ++i )
+        transports[1+i] = clientTransports[i];
+
+    while ( true )
     {
-        clientTransport.Reset();
-        serverTransport.Reset();
+        PumpClientServerUpdate( time, (Client**) clients, NumClients, servers, 1, transports, 1 + NumClients );
 
-        ConnectClient( client, clientId, serverAddress );
+        if ( AllClientsConnected( NumClients, server, clients ) )
+            break;
+    }
 
-        while ( true )
-        {
-            Client * clients[] = { &client };
-            Server * servers[] = { &server };
-            Transport * transports[] = { &clientTransport, &serverTransport };
+    check( AllClientsConnected( NumClients, server, clients ) );
 
-            PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
+    // broadcast messages that are copied in as bits, an aligned message that is read back for each client, and a block message sharing its block
 
-            if ( client.ConnectionFailed() )
-            {
-                printf( "error: client connect failed!\n" );
-                exit( 1 );
-            }
+    const int NumTestMessages = 8;
+    const int NumMessagesSent = NumTestMessages + 2;
+    const int BlockSize = 600;
 
-            if ( !client.IsConnecting() && client.IsConnected() && server.GetNumConnectedClients() == 1 )
-                break;
-        }
+    for ( int i = 0; i < NumTestMessages; ++i )
+    {
+        TestMessage * message = (TestMessage*) server.CreateBroadcastMsg( TEST_MESSAGE );
+        check( message );
+        message->sequence = uint16_t( i );
+        server.BroadcastMsg( message );
+    }
 
-        check( !client.IsConnecting() && client.IsConnected() && server.GetNumConnectedClients() == 1 );
-        check( client.GetClientIndex() == 0 && server.IsClientConnected(0) );
+    TestAlignedMessage * alignedMessage = (TestAlignedMessage*) server.CreateBroadcastMsg( TEST_ALIGNED_MESSAGE );
+    check( alignedMessage );
+    alignedMessage->sequence = NumTestMessages;
+    for ( int i = 0; i < (int) sizeof( alignedMessage->data ); ++i )
+        alignedMessage->data[i] = uint8_t( 100 + i );
+    server.BroadcastMsg( alignedMessage );
 
-        const int NumMessagesSent = 64;
+    TestBlockMessage * blockMessage = (TestBlockMessage*) server.CreateBroadcastMsg( TEST_BLOCK_MESSAGE );
+    check( blockMessage );
+    blockMessage->sequence = NumTestMessages + 1;
+    uint8_t * blockData = (uint8_t*) YOJIMBO_ALLOCATE( server.GetGlobalAllocator(), BlockSize );
+    for ( int i = 0; i < BlockSize; ++i )
+        blockData[i] = uint8_t( i * 3 );
+    blockMessage->AttachBlock( server.GetGlobalAllocator(), blockData, BlockSize );
+    server.BroadcastMsg( blockMessage );
 
-        SendClientToServerMessages( client, NumMessagesSent );
+    check( server.GetNumSharedBlocks() > 0 );
 
-        SendServerToClientMessages( server, client.GetClientIndex(), NumMessagesSent );
+    int numMessagesReceived[NumClients];
+    memset( numMessagesReceived, 0, sizeof( numMessagesReceived ) );
 
-        int numMessagesReceivedFromClient = 0;
-        int numMessagesReceivedFromServer = 0;
+    const int NumIterations = 10000;
 
-        const int NumIterations = 10000;
+    for ( int iteration = 0; iteration < NumIterations; ++iteration )
+    {
+        PumpClientServerUpdate( time, (Client**) clients, NumClients, servers, 1, transports, 1 + NumClients );
 
-        for ( int i = 0; i < NumIterations; ++i )
+        bool allReceived = true;
+
+        for ( int i = 0; i < NumClients; ++i )
         {
-            Client * clients[] = { &client };
-            Server * servers[] = { &server };
-            Transport * transports[] = { &clientTransport, &serverTransport };
+            while ( true )
+            {
+                Message * message = clients[i]->ReceiveMsg();
+                if ( !message )
+                    break;
 
-            PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
+                const int index = numMessagesReceived[i];
 
-            ProcessServerToClientMessages( client, numMessagesReceivedFromServer );
+                check( message->GetId() == index );
 
-            ProcessClientToServerMessages( server, client.GetClientIndex(), numMessagesReceivedFromClient );
+                if ( index < NumTestMessages )
+                {
+                    check( message->GetType() == TEST_MESSAGE );
+                    check( ( (TestMessage*) message )->sequence == index );
+                }
+                else if ( index == NumTestMessages )
+                {
+                    check( message->GetType() == TEST_ALIGNED_MESSAGE );
+                    TestAlignedMessage * receivedMessage = (TestAlignedMessage*) message;
+                    check( receivedMessage->sequence == index );
+                    for ( int j = 0; j < (int) sizeof( receivedMessage->data ); ++j )
+                        check( receivedMessage->data[j] == uint8_t( 100 + j ) );
+                }
+                else
+                {
+                    check( message->GetType() == TEST_BLOCK_MESSAGE );
+                    TestBlockMessage * receivedMessage = (TestBlockMessage*) message;
+                    check( receivedMessage->sequence == index );
+                    check( receivedMessage->GetBlockSize() == BlockSize );
+                    for ( int j = 0; j < BlockSize; ++j )
+                        check( receivedMessage->GetBlockData()[j] == uint8_t( j * 3 ) );
+                }
 
-            if ( numMessagesReceivedFromClient == NumMessagesSent && numMessagesReceivedFromServer == NumMessagesSent )
-                break;
+                numMessagesReceived[i]++;
+
+                clients[i]->ReleaseMsg( message );
+            }
+
+            allReceived &= numMessagesReceived[i] == NumMessagesSent;
         }
 
-        check( numMessagesReceivedFromClient == NumMessagesSent );
-        check( numMessagesReceivedFromServer == NumMessagesSent );
+        if ( allReceived && server.GetNumSharedBlocks() == 0 )
+            break;
+    }
 
-        client.Disconnect();
+    for ( int i = 0; i < NumClients; ++i )
+        check( numMessagesReceived[i] == NumMessagesSent );
 
-        for ( int i = 0; i < NumIterations; ++i )
+    // the payloads and the shared block are freed once every client has acked its messages
+
+    check( server.GetNumSharedBlocks() == 0 );
+
+    // unreliable-unordered channels copy the payload bits in too. keep broadcasting until every client gets one through the packet loss
+
+    bool received[NumClients];
+    memset( received, 0, sizeof( received ) );
+
+    for ( int iteration = 0; iteration < NumIterations; ++iteration )
+    {
+        TestMessage * message = (TestMessage*) server.CreateBroadcastMsg( TEST_MESSAGE );
+        check( message );
+        message->sequence = 1234;
+        server.BroadcastMsg( message, 1 );
+
+        PumpClientServerUpdate( time, (Client**) clients, NumClients, servers, 1, transports, 1 + NumClients );
+
+        bool allReceived = true;
+
+        for ( int i = 0; i < NumClients; ++i )
         {
-            Client * clients[] = { &client };
-            Server * servers[] = { &server };
-            Transport * transports[] = { &clientTransport, &serverTransport };
+            while ( true )
+            {
+                Message * receivedMessage = clients[i]->ReceiveMsg( 1 );
+                if ( !receivedMessage )
+                    break;
 
-            PumpClientServerUpdate( time, clients, 1, servers, 1, transports, 2 );
+                check( receivedMessage->GetType() == TEST_MESSAGE );
+                check( ( (TestMessage*) receivedMessage )->sequence == 1234 );
 
-            if ( !client.IsConnected() && server.GetNumConnectedClients() == 0 )
-                break;
+                received[i] = true;
+
+                clients[i]->ReleaseMsg( receivedMessage );
+            }
+
+            allReceived &= received[i];
         }
 
-        check( !client.IsConnected() && server.GetNumConnectedClients() == 0 );
+        if ( allReceived )
+            break;
     }
 
+    for ( int i = 0; i < NumClients; ++i )
+        check( received[i] );
+
+    DestroyClients( NumClients, clients );
+
+    DestroyTransports( NumClients, clientTransports );
+
     server.Stop();
+
+    check( server.GetNumSharedBlocks() == 0 );
 }
 
 void test_client_server_start_stop_restart()
@@ -4102,6 +6433,203 @@ void test_client_server_start_stop_restart()
     }
 }
 
+void test_client_server_max_clients_config()
+{
+    GenerateKey( private_key );
+
+    const int MaxTestClients = 100;
+    const int NumTestClients = 80;
+
+    ClientServerConfig clientServerConfig;
+    clientServerConfig.enableMessages = false;
+    clientServerConfig.maxClients = MaxTestClients;
+    clientServerConfig.serverPerClientMemory = 64 * 1024;
+
+    Address serverAddress( "::1", ServerPort );
+
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+    
+    double time = 100.0;
+
+    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+
+    GameServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
+
+    server.SetServerAddress( serverAddress );
+
+    server.Start();
+
+    check( server.GetMaxClients() == MaxTestClients );
+
+    LocalTransport * clientTransports[NumTestClients];
+    CreateClientTransports( NumTestClients, clientTransports, networkSimulator, time );
+
+    GameClient * clients[NumTestClients];
+    CreateClients( NumTestClients, clients, clientTransports, clientServerConfig, time );
+
+    ConnectClients( NumTestClients, clients, serverAddress );
+
+    for ( int i = 0; i < 1000; ++i )
+    {
+        Server * servers[] = { &server };
+        Transport * transports[NumTestClients+1];
+        transports[0] = &serverTransport;
+        for ( int j = 0; j < NumTestClients; ++j )
+            transports[1+j] = clientTransports[j];
+
+        PumpClientServerUpdate( time, (Client**) clients, NumTestClients, servers, 1, transports, 1 + NumTestClients );
+
+        if ( AnyClientDisconnected( NumTestClients, clients ) )
+            break;
+
+        if ( AllClientsConnected( NumTestClients, server, clients ) )
+            break;
+    }
+
+    check( AllClientsConnected( NumTestClients, server, clients ) );
+    check( server.GetNumConnectedClients() == NumTestClients );
+    check( server.GetCounter( SERVER_COUNTER_TIMER_EVENTS_FIRED ) > 0 );
+
+    // disconnecting a client in the middle must free its slot for reuse
+
+    const int clientIndex = clients[NumTestClients/2]->GetClientIndex();
+    const Address clientAddress = server.GetClientAddress( clientIndex );
+
+    server.DisconnectClient( clientIndex, false );
+
+    check( !server.IsClientConnected( clientIndex ) );
+    check( server.GetNumConnectedClients() == NumTestClients - 1 );
+    check( server.FindClientIndex( clients[NumTestClients/2]->GetClientId() ) == -1 );
+    check( server.FindClientIndex( clientAddress ) == -1 );
+
+    // the remaining clients must still be found by id and by address
+
+    for ( int i = 0; i < NumTestClients; ++i )
+    {
+        if ( i == NumTestClients/2 )
+            continue;
+        const int index = clients[i]->GetClientIndex();
+        check( server.FindClientIndex( clients[i]->GetClientId() ) == index );
+        check( server.FindClientIndex( server.GetClientAddress( index ) ) == index );
+    }
+
+    DestroyClients( NumTestClients, clients );
+
+    DestroyTransports( NumTestClients, clientTransports );
+
+    server.Stop();
+
+    check( server.GetNumConnectedClients() == 0 );
+}
+
+void test_client_server_worker_threads()
+{
+    GenerateKey( private_key );
+
+    const int NumTestClients = 8;
+
+    ClientServerConfig clientServerConfig;
+    clientServerConfig.maxClients = NumTestClients;
+    clientServerConfig.serverPerClientMemory = 256 * 1024;
+    clientServerConfig.serverWorkerThreads = 3;
+    clientServerConfig.connectionConfig.maxPacketSize = 256;
+    clientServerConfig.connectionConfig.numChannels = 1;
+    clientServerConfig.connectionConfig.channel[0].type = CHANNEL_TYPE_RELIABLE_ORDERED;
+    clientServerConfig.connectionConfig.channel[0].maxBlockSize = 1024;
+    clientServerConfig.connectionConfig.channel[0].fragmentSize = 200;
+
+    Address serverAddress( "::1", ServerPort );
+
+    NetworkSimulator networkSimulator( GetDefaultAllocator() );
+    
+    double time = 100.0;
+
+    LocalTransport serverTransport( GetDefaultAllocator(), networkSimulator, serverAddress, ProtocolId, time );
+
+    GameServer server( GetDefaultAllocator(), serverTransport, clientServerConfig, time );
+
+    server.SetServerAddress( serverAddress );
+
+    server.Start();
+
+    LocalTransport * clientTransports[NumTestClients];
+    CreateClientTransports( NumTestClients, clientTransports, networkSimulator, time );
+
+    GameClient * clients[NumTestClients];
+    CreateClients( NumTestClients, clients, clientTransports, clientServerConfig, time );
+
+    ConnectClients( NumTestClients, clients, serverAddress );
+
+    Server * servers[] = { &server };
+    Transport * transports[NumTestClients+1];
+    transports[0] = &serverTransport;
+    for ( int i = 0; i < NumTestClients; ++i )
+        transports[1+i] = clientTransports[i];
+
+    for ( int i = 0; i < 1000; ++i )
+    {
+        PumpClientServerUpdate( time, (Client**) clients, NumTestClients, servers, 1, transports, 1 + NumTestClients );
+
+        if ( AnyClientDisconnected( NumTestClients, clients ) )
+            break;
+
+        if ( AllClientsConnected( NumTestClients, server, clients ) )
+            break;
+    }
+
+    check( AllClientsConnected( NumTestClients, server, clients ) );
+
+    // messages are generated and encrypted on worker threads. each client must receive its own messages, in order
+
+    const int NumMessagesSent = 64;
+
+    int numMessagesReceivedFromClient[NumTestClients];
+    int numMessagesReceivedFromServer[NumTestClients];
+
+    for ( int i = 0; i < NumTestClients; ++i )
+    {
+        SendClientToServerMessages( *clients[i], NumMessagesSent );
+        SendServerToClientMessages( server, clients[i]->GetClientIndex(), NumMessagesSent );
+        numMessagesReceivedFromClient[i] = 0;
+        numMessagesReceivedFromServer[i] = 0;
+    }
+
+    for ( int iteration = 0; iteration < 10000; ++iteration )
+    {
+        PumpClientServerUpdate( time, (Client**) clients, NumTestClients, servers, 1, transports, 1 + NumTestClients );
+
+        bool allReceived = true;
+
+        for ( int i = 0; i < NumTestClients; ++i )
+        {
+            ProcessServerToClientMessages( *clients[i], numMessagesReceivedFromServer[i] );
+
+            ProcessClientToServerMessages( server, clients[i]->GetClientIndex(), numMessagesReceivedFromClient[i] );
+
+            if ( numMessagesReceivedFromClient[i] != NumMessagesSent || numMessagesReceivedFromServer[i] != NumMessagesSent )
+                allReceived = false;
+        }
+
+        if ( allReceived )
+            break;
+    }
+
+    for ( int i = 0; i < NumTestClients; ++i )
+    {
+        check( numMessagesReceivedFromClient[i] == NumMessagesSent );
+        check( numMessagesReceivedFromServer[i] == NumMessagesSent );
+    }
+
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_ENCRYPT_PACKET_FAILURES ) == 0 );
+    check( serverTransport.GetCounter( TRANSPORT_COUNTER_WRITE_PACKET_FAILURES ) == 0 );
+
+    DestroyClients( NumTestClients, clients );
+
+    DestroyTransports( NumTestClients, clientTransports );
+
+    server.Stop();
+}
+
 void test_client_server_message_failed_to_serialize_reliable_ordered()
 {
     GenerateKey( private_key );
@@ -4455,16 +6983,35 @@ int main()
     {
         RUN_TEST( test_endian );
         RUN_TEST( test_queue );
+        RUN_TEST( test_lock_free_queues );
         RUN_TEST( test_base64 );
         RUN_TEST( test_bitpacker );
+        RUN_TEST( test_bitpacker_bytes );
+        RUN_TEST( test_bitpacker_from_buffer );
         RUN_TEST( test_stream );
         RUN_TEST( test_packets );
+        RUN_TEST( test_crc32c );
         RUN_TEST( test_address_ipv4 );
         RUN_TEST( test_address_ipv6 );
         RUN_TEST( test_packet_sequence );
         RUN_TEST( test_encrypt_and_decrypt );
         RUN_TEST( test_encryption_manager );
+        RUN_TEST( test_encryption_manager_cipher_state );
+        RUN_TEST( test_encryption_manager_timeouts );
+        RUN_TEST( test_transport_context_manager );
+        RUN_TEST( test_connect_token_filter );
+        RUN_TEST( test_timer_wheel );
+        RUN_TEST( test_worker_pool );
+        RUN_TEST( test_packet_processor_read_packets );
+        RUN_TEST( test_packet_processor_checksums );
         RUN_TEST( test_unencrypted_packets );
+        RUN_TEST( test_network_transport_batching );
+        RUN_TEST( test_network_transport_segmentation_offload );
+#if YOJIMBO_PLATFORM != YOJIMBO_PLATFORM_WINDOWS
+        RUN_TEST( test_multi_socket_network_transport );
+#endif // #if YOJIMBO_PLATFORM != YOJIMBO_PLATFORM_WINDOWS
+        RUN_TEST( test_threaded_network_transport );
+        RUN_TEST( test_threaded_network_transport_encrypted_packets );
         RUN_TEST( test_allocator_tlsf );
         RUN_TEST( test_client_server_tokens );
         RUN_TEST( test_client_server_connect );
@@ -4481,6 +7028,7 @@ int main()
         RUN_TEST( test_client_server_connect_token_expired );
         RUN_TEST( test_client_server_connect_token_whitelist );
         RUN_TEST( test_client_server_connect_token_invalid );
+        RUN_TEST( test_client_server_cipher_suites );
         RUN_TEST( test_client_server_connect_address_already_connected );
         RUN_TEST( test_client_server_connect_client_id_already_connected );
         RUN_TEST( test_client_server_connect_multiple_servers );
@@ -4498,14 +7046,23 @@ int main()
         RUN_TEST( test_generate_ack_bits );
         RUN_TEST( test_connection_counters );
         RUN_TEST( test_connection_acks );
+        RUN_TEST( test_message_factory_pooling );
         RUN_TEST( test_connection_reliable_ordered_messages );
+        RUN_TEST( test_connection_reliable_ordered_messages_cached );
+        RUN_TEST( test_connection_reliable_ordered_messages_cached_context );
+        RUN_TEST( test_connection_reliable_ordered_messages_small_queue );
         RUN_TEST( test_connection_reliable_ordered_blocks );
         RUN_TEST( test_connection_reliable_ordered_messages_and_blocks );
         RUN_TEST( test_connection_reliable_ordered_messages_and_blocks_multiple_channels );
         RUN_TEST( test_connection_unreliable_unordered_messages );
         RUN_TEST( test_connection_unreliable_unordered_blocks );
         RUN_TEST( test_client_server_messages );
+        RUN_TEST( test_client_server_messages_pooled );
+        RUN_TEST( test_client_server_shared_blocks );
+        RUN_TEST( test_client_server_broadcast_messages );
         RUN_TEST( test_client_server_start_stop_restart );
+        RUN_TEST( test_client_server_max_clients_config );
+        RUN_TEST( test_client_server_worker_threads );
         RUN_TEST( test_client_server_message_failed_to_serialize_reliable_ordered );
         RUN_TEST( test_client_server_message_failed_to_serialize_unreliable_unordered );
         RUN_TEST( test_client_server_message_exhaust_stream_allocator );
@@ -44,6 +44,8 @@
 #include "yojimbo_message.h"
 #include "yojimbo_connection.h"
 #include "yojimbo_replay_protection.h"
+#include "yojimbo_timer_wheel.h"
+#include "yojimbo_worker_pool.h"
 
 /** @file */
 
@@ -334,6 +334,34 @@ namespace yojimbo
                                       && !IsLoopback();
     }
 
+    uint32_t Address::GetHash() const
+    {
+        uint64_t key = ( uint64_t( m_type ) << 16 ) | m_port;
+
+        if ( m_type == ADDRESS_IPV4 )
+        {
+            key ^= uint64_t( m_address.ipv4 ) << 32;
+        }
+        else if ( m_type == ADDRESS_IPV6 )
+        {
+            for ( int i = 0; i < 8; ++i )
+            {
+                key ^= uint64_t( m_address.ipv6[i] ) << ( 16 * ( i & 3 ) );
+                key *= 0x9E3779B97F4A7C15ULL;
+            }
+        }
+
+        // 64 bit finalizer from murmur3. every input bit affects every output bit
+
+        key ^= key >> 33;
+        key *= 0xFF51AFD7ED558CCDULL;
+        key ^= key >> 33;
+        key *= 0xC4CEB9FE1A85EC53ULL;
+        key ^= key >> 33;
+
+        return uint32_t( key );
+    }
+
     bool Address::operator ==( const Address & other ) const
     {
         if ( m_type != other.m_type )
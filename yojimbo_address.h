@@ -335,6 +335,16 @@ namespace yojimbo
 
         bool IsGlobalUnicast() const;
 
+        /**
+            Get a hash of the address.
+
+            Covers the address type, address data and port, so addresses that compare equal always have the same hash. Cheap enough to call for every packet sent and received, which is what it's used for when looking up per-address data in hash tables.
+
+            @returns A 32 bit hash of the address.
+         */
+
+        uint32_t GetHash() const;
+
         // -----------------------------------
 
         bool operator ==( const Address & other ) const;
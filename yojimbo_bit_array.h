@@ -25,6 +25,7 @@
 #ifndef YOJIMBO_BIT_ARRAY_H
 #define YOJIMBO_BIT_ARRAY_H
 
+#include "yojimbo_common.h"
 #include "yojimbo_allocator.h"
 
 /** @file */
@@ -134,6 +135,37 @@ namespace yojimbo
             return ( m_data[data_index] >> bit_index ) & 1;
         }
 
+        /**
+            Find the first bit set to 1 in the range [index,end).
+
+            Skips over 64 bits at a time, so this is fast even when only a few bits in the range are set.
+
+            @param index The index of the first bit to check.
+            @param end One past the index of the last bit to check.
+
+            @returns The index of the first bit set to 1, or end if no bit in the range is set.
+         */
+
+        int FindNextSetBit( int index, int end ) const
+        {
+            assert( index >= 0 );
+            assert( index <= end );
+            assert( end <= m_size );
+            if ( index == end )
+                return end;
+            int data_index = index >> 6;
+            const int last_data_index = ( end - 1 ) >> 6;
+            uint64_t bits = m_data[data_index] & ( ~uint64_t(0) << ( index & ( (1<<6) - 1 ) ) );
+            while ( !bits )
+            {
+                if ( ++data_index > last_data_index )
+                    return end;
+                bits = m_data[data_index];
+            }
+            const int result = ( data_index << 6 ) + trailing_zeros( bits );
+            return result < end ? result : end;
+        }
+
         /**
             Gets the size of the bit array, in number of bits.
 
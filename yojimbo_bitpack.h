@@ -39,9 +39,9 @@ namespace yojimbo
 
         Integer bit values are written to a 64 bit scratch value from right to left.
 
-        Once the low 32 bits of the scratch is filled with bits it is flushed to memory as a dword and the scratch value is shifted right by 32.
+        Once the scratch value is full it is flushed to memory as a qword, and bits that didn't fit carry over into the next scratch value. This halves the number of flushes compared to flushing each dword, and every flush is a full 64 bits so there is no partial word to handle in the inner loop.
 
-        The bit stream is written to memory in little endian order, which is considered network byte order for this library.
+        The bit stream is written to memory in little endian order, which is considered network byte order for this library. Bits are packed into the stream in the same order whether they are flushed a dword or a qword at a time, so the bitpacked data is the same as it has always been.
 
         @see BitReader
      */
@@ -55,17 +55,17 @@ namespace yojimbo
 
 			Creates a bit writer object to write to the specified buffer. 
 			
-            @param data The pointer to the buffer to fill with bitpacked data.
-            @param bytes The size of the buffer in bytes. Must be a multiple of 4, because the bitpacker reads and writes memory as dwords, not bytes.
+            @param data The pointer to the buffer to fill with bitpacked data. Does not need to be aligned.
+            @param bytes The size of the buffer in bytes. Must be a multiple of 4.
          */
 
-        BitWriter( void * data, int bytes ) : m_data( (uint32_t*) data ), m_numWords( bytes / 4 )
+        BitWriter( void * data, int bytes ) : m_data( (uint8_t*) data ), m_numBytes( bytes )
         {
             assert( data );
             assert( ( bytes % 4 ) == 0 );
-            m_numBits = m_numWords * 32;
+            m_numBits = m_numBytes * 8;
             m_bitsWritten = 0;
-            m_wordIndex = 0;
+            m_byteIndex = 0;
             m_scratch = 0;
             m_scratchBits = 0;
         }
@@ -77,7 +77,7 @@ namespace yojimbo
 
             A boolean value writes just 1 bit to the buffer, a value in range [0,31] can be written with just 5 bits and so on.
 
-	        IMPORTANT: When you have finished writing to your buffer, take care to call BitWrite::FlushBits, otherwise the last dword of data will not get flushed to memory!
+	        IMPORTANT: When you have finished writing to your buffer, take care to call BitWrite::FlushBits, otherwise the last qword of data will not get flushed to memory!
 
             @param value The integer value to write to the buffer. Must be in [0,(1<<bits)-1].
             @param bits The number of bits to encode in [1,32].
@@ -96,16 +96,20 @@ namespace yojimbo
 
             m_scratchBits += bits;
 
-            if ( m_scratchBits >= 32 )
+            m_bitsWritten += bits;
+
+            if ( m_scratchBits >= 64 )
             {
-                assert( m_wordIndex < m_numWords );
-                m_data[m_wordIndex] = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
-                m_scratch >>= 32;
-                m_scratchBits -= 32;
-                m_wordIndex++;
-            }
+                assert( m_byteIndex + 8 <= m_numBytes );
+                const uint64_t word = host_to_network( m_scratch );
+                memcpy( m_data + m_byteIndex, &word, 8 );
+                m_byteIndex += 8;
+                m_scratchBits -= 64;
 
-            m_bitsWritten += bits;
+                // the high bits of value that were shifted out of the scratch value start the next one. shifts by [1,32], so this is zero when nothing overflowed
+
+                m_scratch = uint64_t( value ) >> ( bits - m_scratchBits );
+            }
         }
 
 		/**
@@ -135,7 +139,7 @@ namespace yojimbo
 
 			Use this when you have to copy a large block of data into your bitstream.
 
-			Faster than just writing each byte to the bit stream via BitWriter::WriteBits( value, 8 ), because it aligns to byte index and copies into the buffer without bitpacking.
+			Faster than just writing each byte to the bit stream via BitWriter::WriteBits( value, 8 ), because once the bit stream is byte aligned, the bytes land in the buffer exactly as they are. The scratch value is flushed and the whole array is copied into the buffer with one memcpy, wherever it falls relative to dword boundaries.
 
 			@param data The byte array data to write to the bit stream.
 			@param bytes The number of bytes to write.
@@ -147,47 +151,82 @@ namespace yojimbo
         {
             assert( GetAlignBits() == 0 );
             assert( m_bitsWritten + bytes * 8 <= m_numBits );
-            assert( ( m_bitsWritten % 32 ) == 0 || ( m_bitsWritten % 32 ) == 8 || ( m_bitsWritten % 32 ) == 16 || ( m_bitsWritten % 32 ) == 24 );
+            assert( ( m_scratchBits % 8 ) == 0 );
 
-            int headBytes = ( 4 - ( m_bitsWritten % 32 ) / 8 ) % 4;
-            if ( headBytes > bytes )
-                headBytes = bytes;
-            for ( int i = 0; i < headBytes; ++i )
-                WriteBits( data[i], 8 );
-            if ( headBytes == bytes )
-                return;
+            const uint64_t word = host_to_network( m_scratch );
+            memcpy( m_data + m_byteIndex, &word, m_scratchBits / 8 );
 
-            FlushBits();
+            memcpy( m_data + m_bitsWritten / 8, data, bytes );
 
-            assert( GetAlignBits() == 0 );
+            m_bitsWritten += bytes * 8;
+            m_byteIndex = m_bitsWritten / 8;
+            m_scratch = 0;
+            m_scratchBits = 0;
+        }
+
+		/**
+			Write bits previously written by another bit writer to the bit stream.
+
+			Unlike BitWriter::WriteBytes, the bit stream does not need to be aligned. The source bits are read a qword at a time and shifted into place against the scratch value, so copying in a large run of bits costs one flush per qword instead of one write per value.
+
+			@param data The bitpacked data to copy from, as flushed to memory by a bit writer. Must be readable up to the next dword boundary after the last bit.
+			@param bits The number of bits to write.
+
+            @see BitWriter::WriteBits
+		 */
+
+        void WriteBitsFromBuffer( const uint8_t * data, int bits )
+        {
+            assert( data );
+            assert( bits >= 0 );
+            assert( m_bitsWritten + bits <= m_numBits );
+
+            const int numQwords = bits / 64;
 
-            int numWords = ( bytes - headBytes ) / 4;
-            if ( numWords > 0 )
+            uint64_t scratch = m_scratch;
+            const int scratchBits = m_scratchBits;
+            int byteIndex = m_byteIndex;
+
+            for ( int i = 0; i < numQwords; ++i )
             {
-                assert( ( m_bitsWritten % 32 ) == 0 );
-                memcpy( &m_data[m_wordIndex], data + headBytes, numWords * 4 );
-                m_bitsWritten += numWords * 32;
-                m_wordIndex += numWords;
-                m_scratch = 0;
+                assert( byteIndex + 8 <= m_numBytes );
+                uint64_t value;
+                memcpy( &value, data + i * 8, 8 );
+                value = network_to_host( value );
+                scratch |= value << scratchBits;
+                const uint64_t word = host_to_network( scratch );
+                memcpy( m_data + byteIndex, &word, 8 );
+                byteIndex += 8;
+                scratch = scratchBits ? value >> ( 64 - scratchBits ) : 0;
             }
 
-            assert( GetAlignBits() == 0 );
-
-            int tailStart = headBytes + numWords * 4;
-            int tailBytes = bytes - tailStart;
-            assert( tailBytes >= 0 && tailBytes < 4 );
-            for ( int i = 0; i < tailBytes; ++i )
-                WriteBits( data[tailStart+i], 8 );
+            m_scratch = scratch;
+            m_byteIndex = byteIndex;
+            m_bitsWritten += numQwords * 64;
 
-            assert( GetAlignBits() == 0 );
+            int remainderBits = bits - numQwords * 64;
+            const uint8_t * remainder = data + numQwords * 8;
 
-            assert( headBytes + numWords * 4 + tailBytes == bytes );
+            while ( remainderBits > 0 )
+            {
+                const int valueBits = remainderBits < 32 ? remainderBits : 32;
+                uint32_t value;
+                memcpy( &value, remainder, 4 );
+                value = network_to_host( value );
+                if ( valueBits < 32 )
+                    value &= ( 1U << valueBits ) - 1;
+                WriteBits( value, valueBits );
+                remainder += 4;
+                remainderBits -= valueBits;
+            }
         }
 
 		/**
 			Flush any remaining bits to memory.
 
-			Call this once after you've finished writing bits to flush the last dword of scratch to memory!
+			Call this once after you've finished writing bits to flush the last qword of scratch to memory!
+
+            Only the bytes holding bits that were written are flushed, so nothing is written past BitWriter::GetBytesWritten. The scratch value is left as it is, so it's safe to keep writing bits after a flush.
 
             @see BitWriter::WriteBits
 		 */
@@ -196,11 +235,9 @@ namespace yojimbo
         {
             if ( m_scratchBits != 0 )
             {
-                assert( m_wordIndex < m_numWords );
-                m_data[m_wordIndex] = host_to_network( uint32_t( m_scratch & 0xFFFFFFFF ) );
-                m_scratch >>= 32;
-                m_scratchBits -= 32;
-                m_wordIndex++;                
+                assert( m_byteIndex + ( m_scratchBits + 7 ) / 8 <= m_numBytes );
+                const uint64_t word = host_to_network( m_scratch );
+                memcpy( m_data + m_byteIndex, &word, ( m_scratchBits + 7 ) / 8 );
             }
         }
 
@@ -249,7 +286,7 @@ namespace yojimbo
 
         const uint8_t * GetData() const
         {
-            return (uint8_t*) m_data;
+            return m_data;
         }
 
 		/**
@@ -257,9 +294,9 @@ namespace yojimbo
 
 			This is effectively the size of the packet that you should send after you have finished bitpacking values with this class.
 
-			The returned value is not always a multiple of 4, even though we flush dwords to memory. You won't miss any data in this case because the order of bits written is designed to work with the little endian memory layout.
+			The returned value is not always a multiple of 4 or 8, even though we flush qwords to memory. You won't miss any data in this case because the order of bits written is designed to work with the little endian memory layout.
 
-			IMPORTANT: Make sure you call BitWriter::FlushBits before calling this method, otherwise you risk missing the last dword of data.
+			IMPORTANT: Make sure you call BitWriter::FlushBits before calling this method, otherwise you risk missing the last qword of data.
 		 */
 
         int GetBytesWritten() const
@@ -269,13 +306,13 @@ namespace yojimbo
 
     private:
 
-        uint32_t * m_data;									///< The buffer we are writing to, as a uint32_t * because we're writing dwords at a time.
-        uint64_t m_scratch;									///< The scratch value where we write bits to (right to left). 64 bit for overflow. Once # of bits in scratch is >= 32, the low 32 bits are flushed to memory.
+        uint8_t * m_data;									///< The buffer we are writing to. Written a qword at a time, via memcpy so the buffer does not need to be aligned.
+        uint64_t m_scratch;									///< The scratch value where we write bits to (right to left). Once all 64 bits are filled, it is flushed to memory and the bits that overflowed start the next scratch value.
         int m_numBits;										///< The number of bits in the buffer. This is equivalent to the size of the buffer in bytes multiplied by 8. Note that the buffer size must always be a multiple of 4.
-        int m_numWords;										///< The number of words in the buffer. This is equivalent to the size of the buffer in bytes divided by 4. Note that the buffer size must always be a multiple of 4.
+        int m_numBytes;										///< The number of bytes in the buffer. Note that the buffer size must always be a multiple of 4.
         int m_bitsWritten;									///< The number of bits written so far.
-        int m_wordIndex;									///< The current word index. The next word flushed to memory will be at this index in m_data.
-        int m_scratchBits;									///< The number of bits in scratch. When this is >= 32, the low 32 bits of scratch is flushed to memory as a dword and scratch is shifted right by 32.
+        int m_byteIndex;									///< The byte offset in m_data where the bits in scratch start. The next qword flushed to memory is written here.
+        int m_scratchBits;									///< The number of bits in scratch, in [0,63]. When this reaches 64, scratch is flushed to memory as a qword.
     };
 
     /**
@@ -283,7 +320,7 @@ namespace yojimbo
 
         Relies on the user reconstructing the exact same set of bit reads as bit writes when the buffer was written. This is an unattributed bitpacked binary stream!
 
-        Implementation: 32 bit dwords are read in from memory to the high bits of a scratch value as required. The user reads off bit values from the scratch value from the right, after which the scratch value is shifted by the same number of bits.
+        Implementation: 64 bit qwords are read in from memory as required. When a read needs more bits than are left in the scratch value, the remaining bits are combined with the low bits of the next qword, and the rest of that qword becomes the new scratch value. The user reads off bit values from the scratch value from the right, after which the scratch value is shifted by the same number of bits.
      */
 
     class BitReader
@@ -295,7 +332,7 @@ namespace yojimbo
 
             Non-multiples of four buffer sizes are supported, as this naturally tends to occur when packets are read from the network.
 
-			However, actual buffer allocated for the packet data must round up at least to the next 4 bytes in memory, because the bit reader reads dwords from memory not bytes.
+            The buffer does not need to be aligned, and nothing past the last byte is read, so packets can be read in place from anywhere inside a larger buffer. For example, straight after the header of a packet decrypted in place.
 
             @param data Pointer to the bitpacked data to read.
             @param bytes The number of bytes of bitpacked data to read.
@@ -303,18 +340,14 @@ namespace yojimbo
             @see BitWriter
          */
 
-#ifndef NDEBUG
-        BitReader( const void * data, int bytes ) : m_data( (const uint32_t*) data ), m_numBytes( bytes ), m_numWords( ( bytes + 3 ) / 4)
-#else // #ifndef NDEBUG
-        BitReader( const void * data, int bytes ) : m_data( (const uint32_t*) data ), m_numBytes( bytes )
-#endif // #ifndef NDEBUG
+        BitReader( const void * data, int bytes ) : m_data( (const uint8_t*) data ), m_numBytes( bytes )
         {
             assert( data );
             m_numBits = m_numBytes * 8;
             m_bitsRead = 0;
             m_scratch = 0;
             m_scratchBits = 0;
-            m_wordIndex = 0;
+            m_byteIndex = 0;
         }
 
         /**
@@ -350,25 +383,36 @@ namespace yojimbo
             assert( bits > 0 );
             assert( bits <= 32 );
             assert( m_bitsRead + bits <= m_numBits );
+            assert( m_scratchBits >= 0 && m_scratchBits < 64 );
 
             m_bitsRead += bits;
 
-            assert( m_scratchBits >= 0 && m_scratchBits <= 64 );
+            const uint64_t mask = ( uint64_t(1) << bits ) - 1;
 
-            if ( m_scratchBits < bits )
+            if ( m_scratchBits >= bits )
             {
-                assert( m_wordIndex < m_numWords );
-                m_scratch |= uint64_t( network_to_host( m_data[m_wordIndex] ) ) << m_scratchBits;
-                m_scratchBits += 32;
-                m_wordIndex++;
+                const uint32_t output = uint32_t( m_scratch & mask );
+                m_scratch >>= bits;
+                m_scratchBits -= bits;
+                return output;
             }
 
-            assert( m_scratchBits >= bits );
+            assert( m_byteIndex < m_numBytes );
+
+            // the last qword may be partial. zero fill it rather than read past the end of the buffer
+
+            uint64_t word = 0;
+            const int wordBytes = m_numBytes - m_byteIndex;
+            memcpy( &word, m_data + m_byteIndex, ( wordBytes < 8 ) ? wordBytes : 8 );
+            word = network_to_host( word );
+            m_byteIndex += 8;
 
-            const uint32_t output = m_scratch & ( (uint64_t(1)<<bits) - 1 );
+            // m_scratchBits < bits <= 32, so both shifts are in range
 
-            m_scratch >>= bits;
-            m_scratchBits -= bits;
+            const uint32_t output = uint32_t( ( m_scratch | ( word << m_scratchBits ) ) & mask );
+
+            m_scratch = word >> ( bits - m_scratchBits );
+            m_scratchBits += 64 - bits;
 
             return output;
         }
@@ -403,6 +447,8 @@ namespace yojimbo
         /**
             Read bytes from the bitpacked data.
 
+            Once the bit stream is byte aligned the bytes are in the buffer exactly as they were written, so they are copied out with one memcpy and the scratch value is dropped. The next read fetches a new qword starting right after them.
+
             @see BitWriter::WriteBytes
          */
 
@@ -410,39 +456,13 @@ namespace yojimbo
         {
             assert( GetAlignBits() == 0 );
             assert( m_bitsRead + bytes * 8 <= m_numBits );
-            assert( ( m_bitsRead % 32 ) == 0 || ( m_bitsRead % 32 ) == 8 || ( m_bitsRead % 32 ) == 16 || ( m_bitsRead % 32 ) == 24 );
 
-            int headBytes = ( 4 - ( m_bitsRead % 32 ) / 8 ) % 4;
-            if ( headBytes > bytes )
-                headBytes = bytes;
-            for ( int i = 0; i < headBytes; ++i )
-                data[i] = (uint8_t) ReadBits( 8 );
-            if ( headBytes == bytes )
-                return;
+            memcpy( data, m_data + m_bitsRead / 8, bytes );
 
-            assert( GetAlignBits() == 0 );
-
-            int numWords = ( bytes - headBytes ) / 4;
-            if ( numWords > 0 )
-            {
-                assert( ( m_bitsRead % 32 ) == 0 );
-                memcpy( data + headBytes, &m_data[m_wordIndex], numWords * 4 );
-                m_bitsRead += numWords * 32;
-                m_wordIndex += numWords;
-                m_scratchBits = 0;
-            }
-
-            assert( GetAlignBits() == 0 );
-
-            int tailStart = headBytes + numWords * 4;
-            int tailBytes = bytes - tailStart;
-            assert( tailBytes >= 0 && tailBytes < 4 );
-            for ( int i = 0; i < tailBytes; ++i )
-                data[tailStart+i] = (uint8_t) ReadBits( 8 );
-
-            assert( GetAlignBits() == 0 );
-
-            assert( headBytes + numWords * 4 + tailBytes == bytes );
+            m_bitsRead += bytes * 8;
+            m_byteIndex = m_bitsRead / 8;
+            m_scratch = 0;
+            m_scratchBits = 0;
         }
 
         /**
@@ -482,16 +502,13 @@ namespace yojimbo
 
     private:
 
-        const uint32_t * m_data;							///< The bitpacked data we're reading as a dword array.
-        uint64_t m_scratch;									///< The scratch value. New data is read in 32 bits at a top to the left of this buffer, and data is read off to the right.
+        const uint8_t * m_data;								///< The bitpacked data we're reading. Read a qword at a time, via memcpy so the buffer does not need to be aligned.
+        uint64_t m_scratch;									///< The scratch value. Holds the bits of the last qword read from memory that haven't been read off to the right yet.
         int m_numBits;										///< Number of bits to read in the buffer. Of course, we can't *really* know this so it's actually m_numBytes * 8.
         int m_numBytes;										///< Number of bytes to read in the buffer. We know this, and this is the non-rounded up version.
-#ifndef NDEBUG
-        int m_numWords;										///< Number of words to read in the buffer. This is rounded up to the next word if necessary.
-#endif // #ifndef NDEBUG
         int m_bitsRead;										///< Number of bits read from the buffer so far.
-        int m_scratchBits;									///< Number of bits currently in the scratch value. If the user wants to read more bits than this, we have to go fetch another dword from memory.
-        int m_wordIndex;									///< Index of the next word to read from memory.
+        int m_scratchBits;									///< Number of bits currently in the scratch value, in [0,63]. If the user wants to read more bits than this, we have to go fetch another qword from memory.
+        int m_byteIndex;									///< Byte offset in m_data of the next qword to read from memory.
     };
 }
 
@@ -28,6 +28,80 @@
 
 namespace yojimbo
 {
+    static bool SerializePayload( WriteStream & stream, const uint8_t * payloadData, int payloadBits )
+    {
+        return stream.SerializeBitsFromBuffer( payloadData, payloadBits );
+    }
+
+    static bool SerializePayload( MeasureStream & stream, const uint8_t * payloadData, int payloadBits )
+    {
+        return stream.SerializeBitsFromBuffer( payloadData, payloadBits );
+    }
+
+    static bool SerializePayload( ReadStream & stream, const uint8_t * payloadData, int payloadBits )
+    {
+        (void) stream;
+        (void) payloadData;
+        (void) payloadBits;
+        assert( false );
+        return false;
+    }
+
+    template <typename Stream> bool SerializeMessage( Stream & stream, Message * message )
+    {
+        // messages with a serialized payload attached are written by copying in the payload bits, instead of serializing the message again
+
+        const SharedBlock * payload = message->GetSerializedPayload();
+
+        if ( !Stream::IsWriting || !payload )
+            return message->SerializeInternal( stream );
+
+        return SerializePayload( stream, payload->GetBlockData(), message->GetSerializedPayloadBits() );
+    }
+
+    SharedBlock * SerializeMessagePayload( Allocator & allocator, Message * message, void * context, void * userContext, int & payloadBits, bool & aligned )
+    {
+        assert( message );
+
+        MeasureStream measureStream( allocator );
+        measureStream.SetContext( context );
+        measureStream.SetUserContext( userContext );
+        message->SerializeInternal( measureStream );
+
+        // round up to whole dwords for the write stream, keeping at least one so empty messages still get a payload
+
+        const int payloadBytes = ( measureStream.GetBitsProcessed() / 32 + 1 ) * 4;
+
+        SharedBlock * payload = YOJIMBO_NEW( allocator, SharedBlock, allocator, payloadBytes );
+        if ( !payload )
+            return NULL;
+
+        bool result = payload->GetBlockData() != NULL;
+
+        if ( result )
+        {
+            WriteStream stream( payload->GetBlockData(), payloadBytes, allocator );
+            stream.SetContext( context );
+            stream.SetUserContext( userContext );
+            result = message->SerializeInternal( stream );
+            stream.Flush();
+
+            // alignment padding depends on where the message lands in the packet, so messages that align can't have their bits copied in
+
+            payloadBits = stream.GetBitsProcessed();
+            aligned = stream.GetNumAligns() > 0;
+        }
+
+        if ( !result )
+        {
+            payload->Release();
+            YOJIMBO_DELETE( allocator, SharedBlock, payload );
+            return NULL;
+        }
+
+        return payload;
+    }
+
     void ChannelPacketData::Initialize()
     {
         channelId = 0;
@@ -145,7 +219,7 @@ namespace yojimbo
 
                 assert( messages[i] );
 
-                if ( !messages[i]->SerializeInternal( stream ) )
+                if ( !SerializeMessage( stream, messages[i] ) )
                 {
                     debug_printf( "error: failed to serialize message of type %d (SerializeOrderedMessages)\n", messageTypes[i] );
                     return false;
@@ -245,7 +319,7 @@ namespace yojimbo
 
                 assert( messages[i] );
 
-                if ( !messages[i]->SerializeInternal( stream ) )
+                if ( !SerializeMessage( stream, messages[i] ) )
                 {
                     debug_printf( "error: failed to serialize message type %d (SerializeUnorderedMessages)\n", messageTypes[i] );
                     return false;
@@ -325,7 +399,7 @@ namespace yojimbo
 
             assert( block.message );
 
-            if ( !block.message->SerializeInternal( stream ) )
+            if ( !SerializeMessage( stream, (Message*) block.message ) )
             {
                 debug_printf( "error: failed to serialize block message of type %d (SerializeBlockFragment)\n", block.messageType );
                 return false;
@@ -431,6 +505,10 @@ namespace yojimbo
 
         m_listener = NULL;
 
+        m_context = NULL;
+
+        m_userContext = NULL;
+
         m_error = CHANNEL_ERROR_NONE;
 
         m_time = 0.0;
@@ -486,7 +564,12 @@ namespace yojimbo
         
         m_messageReceiveQueue = YOJIMBO_NEW( *m_allocator, SequenceBuffer<MessageReceiveQueueEntry>, *m_allocator, m_config.receiveQueueSize );
         
-        m_sentPacketMessageIds = (uint16_t*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( uint16_t ) * m_config.maxMessagesPerPacket * m_config.sendQueueSize );
+        m_sentPacketMessageIds = (uint16_t*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( uint16_t ) * m_config.maxMessagesPerPacket * m_config.sentPacketBufferSize );
+
+        m_readyMessages = YOJIMBO_NEW( *m_allocator, BitArray, *m_allocator, m_config.sendQueueSize );
+
+        m_resendHead = -1;
+        m_resendTail = -1;
 
         if ( !config.disableBlocks )
         {
@@ -513,6 +596,8 @@ namespace yojimbo
         YOJIMBO_DELETE( *m_allocator, SequenceBuffer<MessageSendQueueEntry>, m_messageSendQueue );
         YOJIMBO_DELETE( *m_allocator, SequenceBuffer<MessageReceiveQueueEntry>, m_messageReceiveQueue );
         
+        YOJIMBO_DELETE( *m_allocator, BitArray, m_readyMessages );
+        
         YOJIMBO_FREE( *m_allocator, m_sentPacketMessageIds );
 
         m_sentPacketMessageIds = NULL;
@@ -532,7 +617,7 @@ namespace yojimbo
         {
             MessageSendQueueEntry * entry = m_messageSendQueue->GetAtIndex( i );
             if ( entry && entry->message )
-                m_messageFactory->Release( entry->message );
+                ReleaseSendQueueMessage( entry );
         }
 
         for ( int i = 0; i < m_messageReceiveQueue->GetSize(); ++i )
@@ -546,6 +631,10 @@ namespace yojimbo
         m_messageSendQueue->Reset();
         m_messageReceiveQueue->Reset();
 
+        m_readyMessages->Clear();
+        m_resendHead = -1;
+        m_resendTail = -1;
+
         if ( m_sendBlock )
         {
             m_sendBlock->Reset();
@@ -608,18 +697,26 @@ namespace yojimbo
 
         entry->block = message->IsBlockMessage();
         entry->message = message;
+        entry->payload = NULL;
         entry->measuredBits = 0;
         entry->timeLastSent = -1.0;
 
+        m_readyMessages->SetBit( m_messageSendQueue->GetIndex( m_sendMessageId ) );
+
         if ( message->IsBlockMessage() )
         {
             assert( ((BlockMessage*)message)->GetBlockSize() > 0 );
             assert( ((BlockMessage*)message)->GetBlockSize() <= m_config.maxBlockSize );
         }
 
+        if ( m_config.cacheSerializedMessages && !entry->block && !message->GetSerializedPayload() )
+            CacheSerializedMessage( entry );
+
         MeasureStream measureStream;
+        measureStream.SetContext( m_context );
+        measureStream.SetUserContext( m_userContext );
 
-        message->SerializeInternal( measureStream );
+        SerializeMessage( measureStream, message );
 
         entry->measuredBits = measureStream.GetBitsProcessed();
 
@@ -721,13 +818,21 @@ namespace yojimbo
 
         const int messageLimit = min( m_config.sendQueueSize, m_config.receiveQueueSize );
 
+        const int sendQueueSize = m_messageSendQueue->GetSize();
+
         uint16_t previousMessageId = 0;
 
         int usedBits = ConservativeMessageHeaderEstimate;
 
         int giveUpCounter = 0;
 
-        for ( int i = 0; i < messageLimit; ++i )
+        UpdateReadyMessages();
+
+        // only visit messages that can be sent now. messages waiting on their resend time are skipped a word of the ready bit array at a time
+
+        int i = 0;
+
+        while ( i < messageLimit )
         {
             if ( availableBits - usedBits < giveUpBits )
                 break;
@@ -735,17 +840,29 @@ namespace yojimbo
             if ( giveUpCounter > m_config.sendQueueSize )
                 break;
 
+            const int index = m_messageSendQueue->GetIndex( m_oldestUnackedMessageId + i );
+
+            const int end = index + min( messageLimit - i, sendQueueSize - index );
+
+            const int readyIndex = m_readyMessages->FindNextSetBit( index, end );
+
+            i += readyIndex - index;
+
+            if ( readyIndex == end )
+                continue;
+
             uint16_t messageId = m_oldestUnackedMessageId + i;
 
+            i++;
+
             MessageSendQueueEntry * entry = m_messageSendQueue->Find( messageId );
 
-            if ( !entry )
-                continue;
+            assert( entry );
 
             if ( entry->block )
                 break;
             
-            if ( entry->timeLastSent + m_config.messageResendTime <= m_time && availableBits >= (int) entry->measuredBits )
+            if ( availableBits >= (int) entry->measuredBits )
             {                
                 int messageBits = entry->measuredBits + messageTypeBits;
                 
@@ -772,6 +889,10 @@ namespace yojimbo
                 
                 entry->timeLastSent = m_time;
 
+                m_readyMessages->ClearBit( readyIndex );
+
+                AddToResendList( readyIndex );
+
                 previousMessageId = messageId;
             }
 
@@ -902,7 +1023,7 @@ namespace yojimbo
                 assert( sendQueueEntry->message );
                 assert( sendQueueEntry->message->GetId() == messageId );
 
-                m_messageFactory->Release( sendQueueEntry->message );
+                ReleaseSendQueueMessage( sendQueueEntry );
 
                 m_messageSendQueue->Remove( messageId );
 
@@ -929,7 +1050,7 @@ namespace yojimbo
 
                     assert( sendQueueEntry );
 
-                    m_messageFactory->Release( sendQueueEntry->message );
+                    ReleaseSendQueueMessage( sendQueueEntry );
 
                     m_messageSendQueue->Remove( messageId );
 
@@ -939,6 +1060,129 @@ namespace yojimbo
         }
     }
 
+    void ReliableOrderedChannel::CacheSerializedMessage( MessageSendQueueEntry * entry )
+    {
+        assert( entry );
+        assert( entry->message );
+        assert( !entry->payload );
+
+        // messages that align can't have their bits copied into packets, so they are serialized each time they are sent, as usual
+
+        int payloadBits = 0;
+        bool aligned = false;
+
+        SharedBlock * payload = SerializeMessagePayload( *m_allocator, entry->message, m_context, m_userContext, payloadBits, aligned );
+        if ( !payload )
+            return;
+
+        if ( aligned )
+        {
+            payload->Release();
+            YOJIMBO_DELETE( *m_allocator, SharedBlock, payload );
+            return;
+        }
+
+        entry->message->AttachSerializedPayload( payload, payloadBits );
+        entry->payload = payload;
+    }
+
+    void ReliableOrderedChannel::ReleaseSendQueueMessage( MessageSendQueueEntry * entry )
+    {
+        assert( entry );
+        assert( entry->message );
+
+        // packets may still hold a reference to the message. once the payload is detached they serialize the message itself, so the payload can be freed right away
+
+        if ( entry->payload )
+        {
+            entry->message->DetachSerializedPayload();
+            entry->payload->Release();
+            assert( entry->payload->GetRefCount() == 0 );
+            YOJIMBO_DELETE( *m_allocator, SharedBlock, entry->payload );
+            entry->payload = NULL;
+        }
+
+        // the message is either ready to send, or waiting in the resend list
+
+        const int index = m_messageSendQueue->GetIndex( entry->message->GetId() );
+
+        if ( m_readyMessages->GetBit( index ) )
+            m_readyMessages->ClearBit( index );
+        else
+            RemoveFromResendList( index );
+
+        m_messageFactory->Release( entry->message );
+    }
+
+    void ReliableOrderedChannel::AddToResendList( int index )
+    {
+        MessageSendQueueEntry * entry = m_messageSendQueue->GetAtIndex( index );
+
+        assert( entry );
+
+        if ( m_resendTail == -1 )
+        {
+            m_resendHead = index;
+        }
+        else
+        {
+            m_messageSendQueue->GetAtIndex( m_resendTail )->resendNext = uint16_t( index );
+            entry->resendPrev = uint16_t( m_resendTail );
+        }
+
+        m_resendTail = index;
+    }
+
+    void ReliableOrderedChannel::RemoveFromResendList( int index )
+    {
+        MessageSendQueueEntry * entry = m_messageSendQueue->GetAtIndex( index );
+
+        assert( entry );
+
+        // the links of the front and back messages are not valid, so check against the head and tail instead
+
+        const bool head = index == m_resendHead;
+        const bool tail = index == m_resendTail;
+
+        if ( head && tail )
+        {
+            m_resendHead = -1;
+            m_resendTail = -1;
+        }
+        else if ( head )
+        {
+            m_resendHead = entry->resendNext;
+        }
+        else if ( tail )
+        {
+            m_resendTail = entry->resendPrev;
+        }
+        else
+        {
+            m_messageSendQueue->GetAtIndex( entry->resendPrev )->resendNext = entry->resendNext;
+            m_messageSendQueue->GetAtIndex( entry->resendNext )->resendPrev = entry->resendPrev;
+        }
+    }
+
+    void ReliableOrderedChannel::UpdateReadyMessages()
+    {
+        while ( m_resendHead != -1 )
+        {
+            const int index = m_resendHead;
+
+            MessageSendQueueEntry * entry = m_messageSendQueue->GetAtIndex( index );
+
+            assert( entry );
+
+            if ( entry->timeLastSent + m_config.messageResendTime > m_time )
+                break;
+
+            RemoveFromResendList( index );
+
+            m_readyMessages->SetBit( index );
+        }
+    }
+
     void ReliableOrderedChannel::UpdateOldestUnackedMessageId()
     {
         const uint16_t stopMessageId = m_messageSendQueue->GetSequence();
@@ -1352,8 +1596,10 @@ namespace yojimbo
             assert( message );
 
             MeasureStream measureStream;
+            measureStream.SetContext( m_context );
+            measureStream.SetUserContext( m_userContext );
 
-            message->SerializeInternal( measureStream );
+            SerializeMessage( measureStream, message );
 
             if ( message->IsBlockMessage() )
             {
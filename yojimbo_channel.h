@@ -120,6 +120,25 @@ namespace yojimbo
         bool SerializeInternal( MeasureStream & stream, MessageFactory & messageFactory, const ChannelConfig * channelConfigs, int numChannels );
     };
 
+    /**
+        Serialize a message once, so its bits can be copied into packets instead of serializing the message again.
+
+        Messages that align (eg. serialize_bytes, serialize_string) pad a different number of bits depending on where they land in a packet, so their bits can't be copied. They are still serialized, but flagged as aligned.
+
+        @param allocator The allocator used to allocate the payload.
+        @param message The message to serialize.
+        @param context The context set on the streams, the same as the one packets are written with. May be NULL.
+        @param userContext The user context set on the streams. May be NULL.
+        @param payloadBits The number of bits the message serialized to (out).
+        @param aligned Set to true if the message aligns, so its bits can't be copied into packets (out).
+
+        @returns The payload holding the serialized message, allocated with the allocator. The caller owns its one reference, and frees it. NULL if the message failed to serialize, or the payload could not be allocated.
+
+        @see Message::AttachSerializedPayload
+     */
+
+    SharedBlock * SerializeMessagePayload( Allocator & allocator, Message * message, void * context, void * userContext, int & payloadBits, bool & aligned );
+
     /// Implement this interface to receive callbacks for channel events.
 
     class ChannelListener
@@ -304,6 +323,19 @@ namespace yojimbo
 
         void SetListener( ChannelListener * listener ) { m_listener = listener; }
 
+        /**
+            Set the contexts that messages sent on this channel are serialized with, outside of packet reads and writes.
+
+            Messages are measured when they are sent, and serialized up front when ChannelConfig::cacheSerializedMessages is set, so those streams need the same contexts the packet streams use. The connection passes in its connection context and user context.
+
+            @param context The context set on streams that serialize messages. See Stream::GetContext.
+            @param userContext The user context set on streams that serialize messages. See Stream::GetUserContext.
+
+            @see Connection::SetContext
+         */
+
+        void SetContext( void * context, void * userContext ) { m_context = context; m_userContext = userContext; }
+
         /**
             Get the channel error level.
 
@@ -365,6 +397,10 @@ namespace yojimbo
 
         MessageFactory * m_messageFactory;                                              ///< Message factory for creating and destroying messages.
 
+        void * m_context;                                                               ///< Context set on streams that measure and cache messages. See Channel::SetContext.
+
+        void * m_userContext;                                                           ///< User context set on streams that measure and cache messages. See Channel::SetContext.
+
 		uint64_t m_counters[CHANNEL_COUNTER_NUM_COUNTERS];                              ///< Counters for unit testing, stats etc.
     };
 
@@ -597,8 +633,11 @@ namespace yojimbo
         {
             Message * message;                                                          ///< Pointer to the message. When inserted in the send queue the message has one reference. It is released when the message is acked and removed from the send queue.
             double timeLastSent;                                                        ///< The time the message was last sent. Used to implement ChannelConfig::messageResendTime.
+            SharedBlock * payload;                                                      ///< The serialized payload this channel cached for the message. See ChannelConfig::cacheSerializedMessages. NULL if nothing was cached.
             uint32_t measuredBits : 31;                                                 ///< The number of bits the message takes up in a bit stream.
             uint32_t block : 1;                                                         ///< 1 if this is a block message. Block messages are treated differently to regular messages when sent over a reliable-ordered channel.
+            uint16_t resendNext;                                                        ///< Send queue index of the next message in the resend list. Not valid for the message at the back of the list.
+            uint16_t resendPrev;                                                        ///< Send queue index of the previous message in the resend list. Not valid for the message at the front of the list.
         };
 
         /**
@@ -625,6 +664,50 @@ namespace yojimbo
             uint64_t blockFragmentId : 16;                                              ///< The block fragment id. Valid only if "block" is 1.
         };
 
+        /**
+            Serialize a message in the send queue once, so its bits are copied into each packet it is sent in, instead of serializing it every time it is resent.
+
+            Only called when ChannelConfig::cacheSerializedMessages is set. If the message aligns, or the payload can't be allocated, nothing is cached and the message is serialized each time it is sent as usual.
+
+            @param entry The send queue entry for the message.
+         */
+
+        void CacheSerializedMessage( MessageSendQueueEntry * entry );
+
+        /**
+            Release a message in the send queue, once it has been acked or the channel is reset.
+
+            Frees the serialized payload cached for the message, if any.
+
+            @param entry The send queue entry for the message.
+         */
+
+        void ReleaseSendQueueMessage( MessageSendQueueEntry * entry );
+
+        /**
+            Add a message that was just sent to the back of the resend list.
+
+            Every message has the same resend time, so messages become due for resend in the order they were sent, and the front of the resend list is always the next message due.
+
+            @param index The send queue index of the message.
+         */
+
+        void AddToResendList( int index );
+
+        /**
+            Remove a message from the resend list.
+
+            @param index The send queue index of the message.
+         */
+
+        void RemoveFromResendList( int index );
+
+        /**
+            Move messages that are due for resend from the front of the resend list to the set of messages ready to send.
+         */
+
+        void UpdateReadyMessages();
+
 		/**
             Internal state for a block being sent across the reliable ordered channel.
             
@@ -743,6 +826,9 @@ namespace yojimbo
         SequenceBuffer<MessageSendQueueEntry> * m_messageSendQueue;						///< Message send queue.
 		SequenceBuffer<MessageReceiveQueueEntry> * m_messageReceiveQueue;               ///< Message receive queue.
         uint16_t * m_sentPacketMessageIds;                                              ///< Array of n message ids per sent connection packet. Allows the maximum number of messages per-packet to be allocated dynamically.
+        BitArray * m_readyMessages;                                                     ///< Bit n is set if the message at send queue index n can be sent now: it is new, due for resend, or a block message. Lets GetMessagesToSend skip over messages waiting on their resend time.
+        int m_resendHead;                                                               ///< Send queue index of the message at the front of the resend list (sent longest ago). -1 if the list is empty.
+        int m_resendTail;                                                               ///< Send queue index of the message at the back of the resend list (sent most recently). -1 if the list is empty.
         SendBlockData * m_sendBlock;                                                    ///< Data about the block being currently sent.
         ReceiveBlockData * m_receiveBlock;                                              ///< Data about the block being currently received.
 
@@ -53,6 +53,8 @@ namespace yojimbo
 #endif // #if !YOJIMBO_SECURE_MODE
         m_sequence = 0;
         m_connectTokenExpireTimestamp = 0;
+        m_cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
+        m_requestedCipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
         m_shouldDisconnect = false;
         m_shouldDisconnectState = CLIENT_STATE_DISCONNECTED;
         m_serverAddressIndex = 0;
@@ -156,9 +158,10 @@ namespace yojimbo
                           const uint8_t * connectTokenNonce,
                           const uint8_t * clientToServerKey,
                           const uint8_t * serverToClientKey,
-                          uint64_t connectTokenExpireTimestamp )
+                          uint64_t connectTokenExpireTimestamp,
+                          int cipherSuite )
     {
-        Connect( clientId, &serverAddress, 1, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp );
+        Connect( clientId, &serverAddress, 1, connectTokenData, connectTokenNonce, clientToServerKey, serverToClientKey, connectTokenExpireTimestamp, cipherSuite );
     }
 
     void Client::Connect( uint64_t clientId, 
@@ -167,7 +170,8 @@ namespace yojimbo
                           const uint8_t * connectTokenNonce,
                           const uint8_t * clientToServerKey,
                           const uint8_t * serverToClientKey,
-                          uint64_t connectTokenExpireTimestamp )
+                          uint64_t connectTokenExpireTimestamp,
+                          int cipherSuite )
     {
         assert( numServerAddresses > 0 );
         assert( numServerAddresses <= MaxServersPerConnect );
@@ -192,6 +196,10 @@ namespace yojimbo
 
         m_connectTokenExpireTimestamp = connectTokenExpireTimestamp;
 
+        // only use the cipher suite in the connect token if we asked for it and this computer can run it. the server always accepts the fallback
+
+        m_requestedCipherSuite = ( cipherSuite == m_config.cipherSuite ) ? SelectCipherSuite( cipherSuite ) : CIPHER_SUITE_CHACHA20_POLY1305;
+
         SetEncryptedPacketTypes();
 
         InternalSecureConnect( m_serverAddresses[0] );
@@ -342,6 +350,7 @@ namespace yojimbo
                     packet->connectTokenExpireTimestamp = m_connectTokenExpireTimestamp;
                     memcpy( packet->connectTokenData, m_connectTokenData, ConnectTokenBytes );
                     memcpy( packet->connectTokenNonce, m_connectTokenNonce, NonceBytes );
+                    packet->cipherSuite = m_cipherSuite;
 
                     SendPacketToServer_Internal( packet );
                 }
@@ -452,6 +461,15 @@ namespace yojimbo
                     Disconnect( CLIENT_STATE_CONNECTION_REQUEST_TIMEOUT, false );
                     return;
                 }
+
+                // servers that can't use the cipher suite we asked for ignore the request. every server accepts chacha20-poly1305, so retry with that
+
+                if ( m_cipherSuite != CIPHER_SUITE_CHACHA20_POLY1305 && m_lastPacketReceiveTime + m_config.cipherSuiteFallbackTime < time )
+                {
+                    debug_printf( "no challenge with %s. falling back to %s\n", GetCipherSuiteName( m_cipherSuite ), GetCipherSuiteName( CIPHER_SUITE_CHACHA20_POLY1305 ) );
+                    m_cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
+                    m_transport->AddEncryptionMapping( m_serverAddress, m_clientToServerKey, m_serverToClientKey, m_config.connectionTimeOut, m_cipherSuite );
+                }
             }
             break;
 
@@ -535,6 +553,11 @@ namespace yojimbo
         return m_clientIndex;
     }
 
+    int Client::GetCipherSuite() const
+    {
+        return m_cipherSuite;
+    }
+
     uint64_t Client::GetCounter( int index ) const 
     {
         assert( index >= 0 );
@@ -579,6 +602,12 @@ namespace yojimbo
                 m_messageFactory = CreateMessageFactory( *m_clientAllocator );
                 
                 assert( m_messageFactory );
+
+                if ( m_config.messagePoolSize > 0 )
+                {
+                    m_messageFactory->EnablePooling( m_config.messagePoolSize );
+                    m_messageFactory->PreallocateMessages();
+                }
                 
                 m_connection = YOJIMBO_NEW( *m_clientAllocator, Connection, *m_clientAllocator, *m_packetFactory, *m_messageFactory, m_config.connectionConfig );
                 
@@ -601,6 +630,9 @@ namespace yojimbo
             m_connectionContext.messageFactory = m_messageFactory;
             m_connectionContext.connectionConfig = &m_config.connectionConfig;
             m_transportContext.connectionContext = &m_connectionContext;
+
+            if ( m_connection )
+                m_connection->SetContext( &m_connectionContext, m_userContext );
         }
 
         m_transport->SetContext( m_transportContext );
@@ -768,9 +800,11 @@ namespace yojimbo
 
         SetClientState( CLIENT_STATE_SENDING_CONNECTION_REQUEST );
 
+        m_cipherSuite = m_requestedCipherSuite;
+
         m_transport->ResetEncryptionMappings();
 
-        m_transport->AddEncryptionMapping( serverAddress, m_clientToServerKey, m_serverToClientKey, m_config.connectionTimeOut );
+        m_transport->AddEncryptionMapping( serverAddress, m_clientToServerKey, m_serverToClientKey, m_config.connectionTimeOut, m_cipherSuite );
     }
 
     void Client::SendPacketToServer( Packet * packet )
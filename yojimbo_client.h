@@ -217,6 +217,7 @@ namespace yojimbo
             @param clientToServerKey The encryption key for client to server packets.
             @param serverToClientKey The encryption key for server to client packets.
             @param connectTokenExpireTimestamp The timestamp for when the connect token expires. Used by the server to quickly reject stale connect tokens without decrypting them.
+            @param cipherSuite The cipher suite in the connect token, from the matcher. See yojimbo::CipherSuite. The client uses it if ClientServerConfig::cipherSuite asks for it and it is available, otherwise it falls back to yojimbo::CIPHER_SUITE_CHACHA20_POLY1305. It also falls back if the server ignores requests for it. See ClientServerConfig::cipherSuiteFallbackTime.
          */
 
         void Connect( uint64_t clientId,
@@ -225,7 +226,8 @@ namespace yojimbo
                       const uint8_t * connectTokenNonce,
                       const uint8_t * clientToServerKey,
                       const uint8_t * serverToClientKey,
-                      uint64_t connectTokenExpireTimestamp );
+                      uint64_t connectTokenExpireTimestamp,
+                      int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 );
 
         /** 
             Connect to a list of servers (secure).
@@ -244,6 +246,7 @@ namespace yojimbo
             @param clientToServerKey The encryption key for client to server packets.
             @param serverToClientKey The encryption key for server to client packets.
             @param connectTokenExpireTimestamp The timestamp for when the connect token expires. Used by the server to quickly reject stale connect tokens without decrypting them.
+            @param cipherSuite The cipher suite in the connect token, from the matcher. See yojimbo::CipherSuite. The client uses it if ClientServerConfig::cipherSuite asks for it and it is available, otherwise it falls back to yojimbo::CIPHER_SUITE_CHACHA20_POLY1305. It also falls back if the server ignores requests for it. See ClientServerConfig::cipherSuiteFallbackTime.
          */
 
         void Connect( uint64_t clientId, 
@@ -252,7 +255,8 @@ namespace yojimbo
                       const uint8_t * connectTokenNonce,
                       const uint8_t * clientToServerKey,
                       const uint8_t * serverToClientKey,
-                      uint64_t connectTokenExpireTimestamp );
+                      uint64_t connectTokenExpireTimestamp,
+                      int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 );
 
         /**
             Disconnect from the server.
@@ -389,6 +393,16 @@ namespace yojimbo
 
         int GetClientIndex() const;
 
+        /**
+            Get the cipher suite used to encrypt packets for the current secure connection.
+
+            This is negotiated in Client::Connect from the cipher suite in the connect token and ClientServerConfig::cipherSuite. It changes to ChaCha20-Poly1305 if the server doesn't answer a request for any other cipher suite within ClientServerConfig::cipherSuiteFallbackTime.
+
+            @returns The cipher suite. See yojimbo::CipherSuite.
+         */
+
+        int GetCipherSuite() const;
+
         /**
             Get a counter value.
 
@@ -727,6 +741,10 @@ namespace yojimbo
 
         ClientState m_clientState;                                          ///< The current client state.
 
+        int m_cipherSuite;                                                  ///< The cipher suite used to encrypt packets for secure connect. Sent to the server in the connection request packet.
+
+        int m_requestedCipherSuite;                                         ///< The cipher suite negotiated in Client::Connect. Each server is asked for this first, before falling back to ChaCha20-Poly1305.
+
         uint64_t m_connectTokenExpireTimestamp;                             ///< Expire timestamp for connect token used in secure connect. This is used as the additional data in the connect token AEAD, so we can quickly reject stale connect tokens without decrypting them.
 
         int m_serverAddressIndex;                                           ///< Current index in the server address array. This is the server we are currently connecting to.
@@ -52,12 +52,14 @@ namespace yojimbo
         uint64_t connectTokenExpireTimestamp;                                           ///< The timestamp when the connect token expires. Connect tokens are typically short lived (45 seconds only).
         uint8_t connectTokenData[ConnectTokenBytes];                                    ///< Encrypted connect token data generated by matchmaker. See matcher.go
         uint8_t connectTokenNonce[NonceBytes];                                          ///< Nonce required to decrypt the connect token. Basically a sequence number. Increments with each connect token generated by matcher.go.
+        int cipherSuite;                                                                ///< The cipher suite the client will encrypt packets with. Either the cipher suite in the connect token, or yojimbo::CIPHER_SUITE_CHACHA20_POLY1305 if the client can't use it.
 
         ConnectionRequestPacket()
         {
             connectTokenExpireTimestamp = 0;
             memset( connectTokenData, 0, sizeof( connectTokenData ) );
             memset( connectTokenNonce, 0, sizeof( connectTokenNonce ) );
+            cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
         }
 
         template <typename Stream> bool Serialize( Stream & stream )
@@ -65,6 +67,7 @@ namespace yojimbo
             serialize_uint64( stream, connectTokenExpireTimestamp );
             serialize_bytes( stream, connectTokenData, sizeof( connectTokenData ) );
             serialize_bytes( stream, connectTokenNonce, sizeof( connectTokenNonce ) );
+            serialize_int( stream, cipherSuite, 0, CIPHER_SUITE_NUM_VALUES - 1 );
             return true;
         }
 
@@ -173,7 +176,7 @@ namespace yojimbo
 
         template <typename Stream> bool Serialize( Stream & stream )
         { 
-            serialize_int( stream, clientIndex, 0, MaxClients - 1 );
+            serialize_int( stream, clientIndex, 0, MaxServerClients - 1 );
 #if !YOJIMBO_SECURE_MODE
             serialize_uint64( stream, clientSalt );
 #endif // #if !YOJIMBO_SECURE_MODE
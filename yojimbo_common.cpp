@@ -34,6 +34,17 @@
 #include <stdio.h>
 #include <mbedtls/base64.h>
 
+#if defined( __x86_64__ ) || defined( _M_X64 )
+#define YOJIMBO_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define YOJIMBO_TARGET_SSE42
+#else // #ifdef _MSC_VER
+#define YOJIMBO_TARGET_SSE42 __attribute__(( target( "sse4.2" ) ))
+#endif // #ifdef _MSC_VER
+#endif // #if defined( __x86_64__ ) || defined( _M_X64 )
+
 namespace yojimbo
 {
     void compress_packet_sequence( uint64_t sequence, uint8_t & prefix_byte, int & num_sequence_bytes, uint8_t * sequence_bytes )
@@ -149,6 +160,131 @@ namespace yojimbo
         return crc32 ^ 0xFFFFFFFF;
     }
 
+    /*
+        Slicing-by-8 tables for CRC32C. Table 0 is the usual byte at a time table for the reflected Castagnoli polynomial.
+        Table n gives the CRC of a byte followed by n zero bytes, so 8 bytes can be looked up independently and combined with xor.
+     */
+
+    struct CRC32CTables
+    {
+        uint32_t table[8][256];
+
+        CRC32CTables()
+        {
+            for ( uint32_t i = 0; i < 256; ++i )
+            {
+                uint32_t crc = i;
+                for ( int j = 0; j < 8; ++j )
+                    crc = ( crc >> 1 ) ^ ( 0x82F63B78 & ( 0 - ( crc & 1 ) ) );
+                table[0][i] = crc;
+            }
+
+            for ( int n = 1; n < 8; ++n )
+            {
+                for ( int i = 0; i < 256; ++i )
+                    table[n][i] = ( table[n-1][i] >> 8 ) ^ table[0][table[n-1][i] & 0xFF];
+            }
+        }
+    };
+
+    static const CRC32CTables crc32c_tables;
+
+    uint32_t calculate_crc32c_software( const uint8_t * buffer, size_t length, uint32_t crc32c )
+    {
+        const uint32_t (*table)[256] = crc32c_tables.table;
+
+        crc32c ^= 0xFFFFFFFF;
+
+        // assembled a byte at a time so it works on any endian. compilers turn this into plain loads on little endian
+
+        while ( length >= 8 )
+        {
+            const uint32_t low = crc32c ^ ( uint32_t( buffer[0] ) | uint32_t( buffer[1] ) << 8 | uint32_t( buffer[2] ) << 16 | uint32_t( buffer[3] ) << 24 );
+            const uint32_t high = uint32_t( buffer[4] ) | uint32_t( buffer[5] ) << 8 | uint32_t( buffer[6] ) << 16 | uint32_t( buffer[7] ) << 24;
+
+            crc32c = table[7][low & 0xFF] ^ table[6][( low >> 8 ) & 0xFF] ^ table[5][( low >> 16 ) & 0xFF] ^ table[4][low >> 24] ^
+                     table[3][high & 0xFF] ^ table[2][( high >> 8 ) & 0xFF] ^ table[1][( high >> 16 ) & 0xFF] ^ table[0][high >> 24];
+
+            buffer += 8;
+            length -= 8;
+        }
+
+        for ( size_t i = 0; i < length; ++i )
+            crc32c = ( crc32c >> 8 ) ^ table[0][( crc32c ^ buffer[i] ) & 0xFF];
+
+        return crc32c ^ 0xFFFFFFFF;
+    }
+
+#if YOJIMBO_CRC32C_SSE42
+
+    static bool detect_sse42()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid( info, 1 );
+        return ( info[2] & ( 1 << 20 ) ) != 0;
+#else // #ifdef _MSC_VER
+        __builtin_cpu_init();
+        return __builtin_cpu_supports( "sse4.2" ) != 0;
+#endif // #ifdef _MSC_VER
+    }
+
+    static const bool crc32c_hardware = detect_sse42();
+
+    static YOJIMBO_TARGET_SSE42 uint32_t calculate_crc32c_sse42( const uint8_t * buffer, size_t length, uint32_t crc32c )
+    {
+        uint64_t crc = crc32c ^ 0xFFFFFFFF;
+
+        while ( length >= 8 )
+        {
+            uint64_t value;
+            memcpy( &value, buffer, 8 );
+            crc = _mm_crc32_u64( crc, value );
+            buffer += 8;
+            length -= 8;
+        }
+
+        uint32_t crc32 = uint32_t( crc );
+
+        for ( size_t i = 0; i < length; ++i )
+            crc32 = _mm_crc32_u8( crc32, buffer[i] );
+
+        return crc32 ^ 0xFFFFFFFF;
+    }
+
+#endif // #if YOJIMBO_CRC32C_SSE42
+
+    uint32_t calculate_crc32c( const uint8_t * buffer, size_t length, uint32_t crc32c )
+    {
+#if YOJIMBO_CRC32C_SSE42
+        if ( crc32c_hardware )
+            return calculate_crc32c_sse42( buffer, length, crc32c );
+#endif // #if YOJIMBO_CRC32C_SSE42
+
+        return calculate_crc32c_software( buffer, length, crc32c );
+    }
+
+    bool is_crc32c_hardware_accelerated()
+    {
+#if YOJIMBO_CRC32C_SSE42
+        return crc32c_hardware;
+#else // #if YOJIMBO_CRC32C_SSE42
+        return false;
+#endif // #if YOJIMBO_CRC32C_SSE42
+    }
+
+    uint32_t calculate_checksum( int checksumType, const uint8_t * buffer, size_t length, uint32_t checksum )
+    {
+        switch ( checksumType )
+        {
+            case CHECKSUM_CRC32:    return calculate_crc32( buffer, length, checksum );
+            case CHECKSUM_CRC32C:   return calculate_crc32c( buffer, length, checksum );
+            default:
+                assert( false );
+                return 0;
+        }
+    }
+
     uint32_t hash_data( const uint8_t * data, uint32_t length, uint32_t hash )
     {
         assert( data );
@@ -243,6 +243,25 @@ namespace yojimbo
 #endif // #ifdef __GNUC__
     }
 
+    /**
+        Calculates the number of trailing zero bits in an unsigned 64 bit integer.
+
+        @param x The input integer value. Must not be zero.
+
+        @returns The index of the lowest bit set to 1 in the input value.
+     */
+
+    inline int trailing_zeros( uint64_t x )
+    {
+        assert( x );
+#ifdef __GNUC__
+        return __builtin_ctzll( x );
+#else // #ifdef __GNUC__
+        const uint64_t lowest = ( x & ( ~x + 1 ) ) - 1;
+        return popcount( uint32_t( lowest ) ) + popcount( uint32_t( lowest >> 32 ) );
+#endif // #ifdef __GNUC__
+    }
+
     /**
         Calculates the log base 2 of an unsigned 32 bit integer.
     
@@ -503,6 +522,57 @@ namespace yojimbo
 
     uint32_t calculate_crc32( const uint8_t * buffer, size_t length, uint32_t crc32 = 0 );
 
+    /**
+        Calculates the CRC32C of a buffer.
+
+        CRC32C uses the Castagnoli polynomial, which x86 CPUs with SSE4.2 calculate in hardware 8 bytes at a time. Whether the CPU has SSE4.2 is detected once at startup. Otherwise this falls back to yojimbo::calculate_crc32c_software.
+
+        @param buffer The input buffer.
+        @param length The length of the buffer (bytes).
+        @param crc32c The previous crc32c result, for concatenating multiple buffers into one CRC32C (optional).
+
+        @returns The CRC32C of the packet buffer.
+
+        @see is_crc32c_hardware_accelerated
+     */
+
+    uint32_t calculate_crc32c( const uint8_t * buffer, size_t length, uint32_t crc32c = 0 );
+
+    /**
+        Calculates the CRC32C of a buffer in software.
+
+        Uses slicing-by-8: eight lookup tables let each step process 8 bytes at once, instead of a byte at a time. Always gives the same result as yojimbo::calculate_crc32c.
+
+        @param buffer The input buffer.
+        @param length The length of the buffer (bytes).
+        @param crc32c The previous crc32c result, for concatenating multiple buffers into one CRC32C (optional).
+
+        @returns The CRC32C of the packet buffer.
+     */
+
+    uint32_t calculate_crc32c_software( const uint8_t * buffer, size_t length, uint32_t crc32c = 0 );
+
+    /**
+        Is yojimbo::calculate_crc32c done in hardware on this computer?
+
+        @returns True if the CPU has the SSE4.2 crc32 instruction and yojimbo was built for a CPU architecture where it is used.
+     */
+
+    bool is_crc32c_hardware_accelerated();
+
+    /**
+        Calculates a packet checksum of a buffer.
+
+        @param checksumType The checksum to calculate. See yojimbo::ChecksumType.
+        @param buffer The input buffer.
+        @param length The length of the buffer (bytes).
+        @param checksum The previous checksum result, for concatenating multiple buffers into one checksum (optional).
+
+        @returns The checksum of the packet buffer.
+     */
+
+    uint32_t calculate_checksum( int checksumType, const uint8_t * buffer, size_t length, uint32_t checksum = 0 );
+
     /**
         Implementation of the 64 bit murmur hash.
 
@@ -68,6 +68,22 @@
 
 #define YOJIMBO_SOCKETS                             1
 
+#if !defined( YOJIMBO_SOCKET_BATCHING )
+#if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_UNIX && defined( __linux__ )
+#define YOJIMBO_SOCKET_BATCHING                     1               ///< Use recvmmsg and sendmmsg to read and write multiple packets per-system call. Only supported on Linux. Other platforms fall back to reading and writing one packet at a time.
+#else // #if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_UNIX && defined( __linux__ )
+#define YOJIMBO_SOCKET_BATCHING                     0
+#endif // #if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_UNIX && defined( __linux__ )
+#endif // #if !defined( YOJIMBO_SOCKET_BATCHING )
+
+#if !defined( YOJIMBO_IO_URING )
+#define YOJIMBO_IO_URING                            0               ///< Set to 1 to use io_uring for network transport socket IO. Linux only. Requires kernel 6.0 or later at runtime for multishot recvmsg. The network transport falls back to regular socket IO if io_uring is not available.
+#endif // #if !defined( YOJIMBO_IO_URING )
+
+#if YOJIMBO_IO_URING && !YOJIMBO_SOCKET_BATCHING
+#error YOJIMBO_IO_URING is only supported on Linux with YOJIMBO_SOCKET_BATCHING
+#endif // #if YOJIMBO_IO_URING && !YOJIMBO_SOCKET_BATCHING
+
 #if !defined( YOJIMBO_SECURE_MODE )
 #define YOJIMBO_SECURE_MODE                         0               ///< IMPORTANT: This should be set to 1 in your retail build!
 #endif // #if !defined( YOJIMBO_SECURE_MODE )
@@ -95,7 +111,8 @@
 
 namespace yojimbo
 {
-    const int MaxClients = 64;                                      ///< The maximum number of clients supported by this library. You can increase this if you want, but this library is designed around patterns that work best for [2,64] player games. If your game has less than 64 clients, reducing this will save memory.
+    const int MaxClients = 64;                                      ///< The default number of client slots on a server. Servers can allocate more client slots at runtime via ClientServerConfig::maxClients, up to MaxServerClients. If your game has less than 64 clients, reducing this will save memory.
+    const int MaxServerClients = 4096;                              ///< The maximum number of client slots a server can allocate at runtime. Bounds the client index sent in keep-alive packets.
     const int MaxChannels = 64;                                     ///< The maximum number of message channels supported by this library. If you need less than 64 channels, reducing this will save memory.
     const int ConnectTokenBytes = 1024;                             ///< The size of a connect token (bytes). Connect tokens are generated by matcher.go and sent from client to server as part of the secure connection process.
     const int ChallengeTokenBytes = 256;                            ///< Size of a challenge token (bytes). Challenge tokens are sent back from server to client as part of secure connect. Challenge tokens are intentionally smaller than connect tokens to avoid DDoS amplification attacks.
@@ -103,21 +120,59 @@ namespace yojimbo
     const int NonceBytes = 8;                                       ///< The size of a nonce (number, used only once) used as part of the encryption. Corresponds to a 64 bit sequence number that increases with block of data that is encrypted.
     const int KeyBytes = 32;                                        ///< Size of the encryption key used for symmetric encryption of packets and tokens (bytes).
     const int MacBytes = 16;                                        ///< Size of the message authentication code (MAC) sent with each encrypted packet and token (bytes). Used to quickly test if a packet or token has been modified and reject before attempting to decrypt it.
-    const int MaxContextMappings = MaxClients;                      ///< The maximum number transport context mappings. When a Transport is used with a Server, we need one context per-connected client, so this is set to MaxClients by default. If you use transport directly without client/server, you might want to set this to some different number.
-    const int MaxEncryptionMappings = MaxClients * 8;               ///< The maximum number of encryption mappings for a transport. Encryption mappings are needed for potential clients during the connection negotiation process, and per-client once they are fully connected. Because multiple clients can be negotiating connection at the same time, this needs to be some multiple of MaxClients.
-    const int MaxConnectTokenEntries = MaxClients * 16;             ///< The maximum number of connect tokens entries stored in the Server when filtering out connect tokens that have already been used to protect against packet replay attacks. This should be a generous multiple of MaxClients.
+    const int CipherStateBytes = 512;                               ///< Size of the precomputed cipher state expanded from a key, so the key schedule is not redone for every packet (bytes). See yojimbo::InitializeCipherState.
+    const int CacheLineBytes = 64;                                  ///< Size of a cache line (bytes). Data written by different threads is padded to this, so the threads don't fight over the same cache line. Pooled messages are aligned to it too.
+    const int EncryptionMappingsPerClient = 8;                      ///< The number of encryption mappings per-client slot. Encryption mappings are needed for potential clients during the connection negotiation process, and per-client once they are fully connected. Because multiple clients can be negotiating connection at the same time, this needs to be more than one.
+    const int ConnectTokenEntriesPerClient = 16;                    ///< The number of connect token entries per-client slot stored in the Server when filtering out connect tokens that have already been used. This should be generous.
+    const double ServerTimerResolution = 0.001;                     ///< Resolution of the timer wheels the server uses to schedule keep-alive packets and client timeouts (seconds). Keep-alives and timeouts happen up to this much later than their exact time.
+    const int MaxContextMappings = MaxClients;                      ///< The default maximum number transport context mappings. When a Transport is used with a Server, we need one context per-connected client, so this is set to MaxClients by default. The server resizes this on Server::Start to match the number of client slots.
+    const int MaxEncryptionMappings = MaxClients * EncryptionMappingsPerClient; ///< The default maximum number of encryption mappings for a transport. The server resizes this on Server::Start to match the number of client slots.
+    const int MaxConnectTokenEntries = MaxClients * ConnectTokenEntriesPerClient; ///< The number of connect tokens entries stored in the Server for the default number of client slots. Protects against packet replay attacks.
     const int ReplayProtectionBufferSize = 64;                      ///< The size of the replay protection buffer (number of packets). Packets that fit in this buffer are passed to the application the first time they are received and rejected after that. Packets older than the buffer size are rejected. Protects against packets being recorded and replayed in an attempt to corrupt internal protocol state.
     const int DefaultMaxPacketSize = 4 * 1024;                      ///< The default maximum packet size that can be sent with a transport. You can override this by passing in a different value to the transport constructor.
+    const int MaxSocketSegments = 64;                               ///< The maximum number of packets coalesced into a single datagram with UDP segmentation offload (GSO/GRO). Matches UDP_MAX_SEGMENTS on older Linux kernels.
+    const int MaxSocketSegmentBytes = 65507;                        ///< The maximum total size of a datagram sent or received with UDP segmentation offload. This is the largest UDP payload that fits in an IPv4 packet.
+    const int MaxSocketSegmentBatchSize = 8;                        ///< The maximum number of datagrams read with one system call by the network transport when receive segmentation offload (GRO) is enabled. Each datagram needs a MaxSocketSegmentBytes receive buffer, so this is kept smaller than the regular receive batch size.
+    const int DefaultIOUringReceiveBuffers = 256;                   ///< The default number of receive buffers registered with io_uring by the network transport. Must be a power of two. See YOJIMBO_IO_URING.
+    const int DefaultSocketSendBatchSize = 32;                      ///< The default number of packets staged by the network transport in Transport::WritePackets before they are flushed to the socket as a batch. With YOJIMBO_SOCKET_BATCHING each batch is usually sent with a single system call.
     const int DefaultPacketSendQueueSize = 1024;                    ///< The default packet send queue size for a transport (number of packets). You can override this by passing in a different value to the transport constructor.
     const int DefaultPacketReceiveQueueSize = 1024;                 ///< The default packet receive queue size for a transport (number of packets). You can override this by passing in a different value to the transport constructor.
     const int DefaultSocketSendBufferSize = 1024 * 1024;            ///< The default socket send buffer size for a transport (bytes). Corresponds to SO_SNDBUF on the socket. You can override this by passing in a different value to the transport constructor.
     const int DefaultSocketReceiveBufferSize = 1024 * 1024;         ///< The default socket receive buffer size for a transport (bytes). Corresponds to SO_RECBUF on the socket. You can override this by passing in a different value to the transport constructor.
+    const int DefaultSocketReceiveBatchSize = 32;                   ///< The default number of packets read from the socket in each batch by the network transport. With YOJIMBO_SOCKET_BATCHING each batch is read with a single system call. You can override this by passing in a different value to the transport constructor.
+    const double IOThreadWaitTime = 0.001;                          ///< How long the IO thread in ThreadedNetworkTransport waits for packets to arrive on the socket before it checks for packets to send again (seconds). This bounds the extra latency on sent packets.
     const int ConservativeMessageHeaderEstimate = 32;               ///< Conservative message header estimate used when checking that message data fits within the packet budget. See YOJIMBO_VALIDATE_PACKET_BUDGET
     const int ConservativeFragmentHeaderEstimate = 64;              ///< Conservative fragment header estimate used when checking that message data fits within the packet budget. See YOJIMBO_VALIDATE_PACKET_BUDGET
     const int ConservativeChannelHeaderEstimate = 32;               ///< Conservative channel header estimate used when checking that message data fits within the packet budget. See YOJIMBO_VALIDATE_PACKET_BUDGET
     const int ConservativeConnectionPacketHeaderEstimate = 128;     ///< Conservative packet header estimate used when checking that message data fits within the packet budget. See YOJIMBO_VALIDATE_PACKET_BUDGET
 	const uint32_t SerializeCheckValue = 0x12345678;				///< The value written to the stream for serialize checks. See WriteStream::SerializeCheck and ReadStream::SerializeCheck.
 
+    /**
+        Cipher suite used to encrypt and authenticate packets sent between client and server.
+
+        Both cipher suites have the same key, nonce and MAC sizes, so the wire format is identical apart from the bytes themselves. See yojimbo::Encrypt_InPlace.
+     */
+
+    enum CipherSuite
+    {
+        CIPHER_SUITE_CHACHA20_POLY1305,                             ///< ChaCha20-Poly1305. Fast in software, so it is available everywhere. This is the fallback when AES-256-GCM is not available.
+        CIPHER_SUITE_AES256_GCM,                                    ///< AES-256-GCM. Much faster per-byte than ChaCha20-Poly1305 on CPUs with AES-NI and PCLMUL, but only available on those CPUs. See yojimbo::IsCipherSuiteAvailable.
+        CIPHER_SUITE_NUM_VALUES
+    };
+
+    /**
+        Checksum used to detect corrupt and foreign unencrypted packets.
+
+        Encrypted packets don't need a checksum, the MAC already covers them. Unencrypted packets record which checksum they were written with, so a receiver can check either. See PacketProcessor::SetChecksumType.
+     */
+
+    enum ChecksumType
+    {
+        CHECKSUM_CRC32,                                             ///< The original CRC32 (IEEE 802.3 polynomial), calculated a byte at a time with a lookup table.
+        CHECKSUM_CRC32C,                                            ///< CRC32C (Castagnoli polynomial). Calculated with the SSE4.2 crc32 instruction when the CPU has it, otherwise with a slicing-by-8 lookup table. Faster than CHECKSUM_CRC32 either way. See yojimbo::calculate_crc32c.
+        CHECKSUM_NUM_VALUES
+    };
+
     /// Channel type. Determines the reliability and ordering guarantees for a channel.
 
     enum ChannelType
@@ -167,6 +222,7 @@ namespace yojimbo
         int fragmentSize;                                           ///< Blocks are split up into fragments of this size when sent over a reliable-ordered channel (bytes).
         float messageResendTime;                                    ///< Minimum delay between message resends (seconds). Avoids sending the same message too frequently.
         float fragmentResendTime;                                   ///< Minimum delay between fragment resends (seconds). Avoids sending the same fragment too frequently.
+        bool cacheSerializedMessages;                               ///< Serialize each message once when it is sent, and copy those bits into every packet it is resent in. Saves CPU under packet loss, at the cost of memory for the bits of each message in the send queue. Reliable-ordered channels only. Messages are cached with the contexts passed to Connection::SetContext, so messages that read the stream context see the same context as when they are written into packets.
 
         ChannelConfig() : type ( CHANNEL_TYPE_RELIABLE_ORDERED )
         {
@@ -180,6 +236,7 @@ namespace yojimbo
             fragmentSize = 1024;
             messageResendTime = 0.1f;
             fragmentResendTime = 0.25f;
+            cacheSerializedMessages = false;
         }
 
         int GetMaxFragmentsPerBlock() const
@@ -232,6 +289,11 @@ namespace yojimbo
         float connectionKeepAliveSendRate;                      ///< Keep alive packets are sent at this rate between client and server if no other packets are sent by the client or server. Avoids timeout in situations where you are not sending packets at a steady rate (packets per-second).
         float connectionTimeOut;                                ///< Once a connection is established, it times out if it hasn't received any packets from the other side in this amount of time (seconds).
         bool enableMessages;                                    ///< If this is true then you can send messages between client and server. Set to false if you don't want to use messages and you want to extend the protocol by adding new packet types instead.
+        int messagePoolSize;                                    ///< If non-zero, message factories created by the client and server keep released messages in per-type pools and preallocate this many messages of each type, so sending and receiving messages doesn't go through the allocator. Preallocated messages come out of clientMemory and serverPerClientMemory. 0 allocates and frees each message. See MessageFactory::EnablePooling.
+        int maxClients;                                         ///< The number of client slots allocated by Server::Start, unless overridden by the value passed to it. Must be in range [1,MaxServerClients]. Per-client arrays on the server and the mapping tables on its transport are sized from this.
+        int serverWorkerThreads;                                ///< Number of worker threads the server creates to update connections, generate packets and encrypt packets for connected clients in parallel. The thread calling into the server does a share of the work too. 0 processes all clients on the calling thread.
+        int cipherSuite;                                        ///< The cipher suite the client would like to encrypt packets with. See yojimbo::CipherSuite. The client only uses AES-256-GCM if this asks for it, the connect token allows it and the CPU supports it. Otherwise it falls back to ChaCha20-Poly1305. The server accepts either, as long as the connect token allows it and it can run it. See Server::CanUseCipherSuite.
+        float cipherSuiteFallbackTime;                          ///< If the client asks a server for any cipher suite other than ChaCha20-Poly1305 and gets no challenge back in this amount of time, it retries with ChaCha20-Poly1305, which every server accepts. Covers servers without AES-NI. Should be less than connectionNegotiationTimeOut (seconds).
         ConnectionConfig connectionConfig;                      ///< Configures connection properties and message channels between client and server. Must be identical between client and server to work properly. Only used if enableMessages is true.
 
         ClientServerConfig()
@@ -245,6 +307,11 @@ namespace yojimbo
             connectionKeepAliveSendRate = 10.0f;
             connectionTimeOut = 5.0f;
             enableMessages = true;
+            messagePoolSize = 0;
+            maxClients = MaxClients;
+            serverWorkerThreads = 0;
+            cipherSuite = CIPHER_SUITE_AES256_GCM;
+            cipherSuiteFallbackTime = 1.0f;
         }
     };
 }
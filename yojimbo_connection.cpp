@@ -214,6 +214,12 @@ namespace yojimbo
         YOJIMBO_DELETE( *m_allocator, SequenceBuffer<ConnectionReceivedPacketData>, m_receivedPackets );
     }
 
+    void Connection::SetContext( void * context, void * userContext )
+    {
+        for ( int i = 0; i < m_connectionConfig.numChannels; ++i )
+            m_channel[i]->SetContext( context, userContext );
+    }
+
     void Connection::Reset()
     {
         m_error = CONNECTION_ERROR_NONE;
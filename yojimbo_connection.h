@@ -367,6 +367,20 @@ namespace yojimbo
 
         void SetListener( ConnectionListener * listener ) { m_listener = listener; }
 
+        /**
+            Set the contexts that channels serialize messages with when they are sent.
+
+            Set these to the same connection context and user context that connection packets are read and written with, so messages see the same contexts when they are measured and cached as when they are written into packets. Client and server do this for you.
+
+            @param context The connection context. See ConnectionContext.
+            @param userContext The user context. See Stream::GetUserContext.
+
+            @see Channel::SetContext
+            @see ChannelConfig::cacheSerializedMessages
+         */
+
+        void SetContext( void * context, void * userContext );
+
         /**
             Set the client index.
 
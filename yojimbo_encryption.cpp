@@ -49,16 +49,113 @@ namespace yojimbo
         randombytes_buf( data, bytes );
     }
 
-    bool Encrypt( const uint8_t * message, int messageLength, uint8_t * encryptedMessage, int & encryptedMessageLength, const uint8_t * nonce, const uint8_t * key )
+    bool IsCipherSuiteAvailable( int cipherSuite )
     {
-        assert( KeyBytes == crypto_secretbox_KEYBYTES );
-        assert( MacBytes == crypto_secretbox_MACBYTES );
+        switch ( cipherSuite )
+        {
+            case CIPHER_SUITE_CHACHA20_POLY1305:    return true;
+            case CIPHER_SUITE_AES256_GCM:           return crypto_aead_aes256gcm_is_available() != 0;
+            default:                                return false;
+        }
+    }
 
-        uint8_t actual_nonce[crypto_secretbox_NONCEBYTES];
-        memset( actual_nonce, 0, sizeof( actual_nonce ) );
-        memcpy( actual_nonce, nonce, NonceBytes );
+    int SelectCipherSuite( int preferredCipherSuite )
+    {
+        return IsCipherSuiteAvailable( preferredCipherSuite ) ? preferredCipherSuite : CIPHER_SUITE_CHACHA20_POLY1305;
+    }
+
+    const char * GetCipherSuiteName( int cipherSuite )
+    {
+        switch ( cipherSuite )
+        {
+            case CIPHER_SUITE_CHACHA20_POLY1305:    return "ChaCha20-Poly1305";
+            case CIPHER_SUITE_AES256_GCM:           return "AES-256-GCM";
+            default:                                return "???";
+        }
+    }
+
+    bool InitializeCipherState( uint8_t * cipherState, const uint8_t * key, int cipherSuite )
+    {
+        assert( cipherState );
+        assert( key );
+        assert( ( uintptr_t( cipherState ) & 15 ) == 0 );
+        assert( sizeof( crypto_aead_aes256gcm_state ) == CipherStateBytes );
+
+        if ( cipherSuite != CIPHER_SUITE_AES256_GCM || !crypto_aead_aes256gcm_is_available() )
+            return false;
+
+        return crypto_aead_aes256gcm_beforenm( (crypto_aead_aes256gcm_state*) cipherState, key ) == 0;
+    }
+
+    static bool encrypt_detached( uint8_t * encryptedMessage, uint8_t * mac, const uint8_t * message, int messageLength, const uint8_t * nonce, const uint8_t * key, int cipherSuite, const uint8_t * cipherState )
+    {
+        assert( KeyBytes == crypto_aead_chacha20poly1305_KEYBYTES );
+        assert( MacBytes == crypto_aead_chacha20poly1305_ABYTES );
+        assert( KeyBytes == crypto_aead_aes256gcm_KEYBYTES );
+        assert( MacBytes == crypto_aead_aes256gcm_ABYTES );
+
+        // packet sequence numbers are the nonce. chacha20-poly1305 takes exactly that many bytes, aes-256-gcm takes more so it is zero padded
+
+        switch ( cipherSuite )
+        {
+            case CIPHER_SUITE_CHACHA20_POLY1305:
+            {
+                assert( NonceBytes == crypto_aead_chacha20poly1305_NPUBBYTES );
 
-        if ( crypto_secretbox_easy( encryptedMessage, message, messageLength, actual_nonce, key ) != 0 )
+                return crypto_aead_chacha20poly1305_encrypt_detached( encryptedMessage, mac, NULL, message, (unsigned long long) messageLength, NULL, 0, NULL, nonce, key ) == 0;
+            }
+
+            case CIPHER_SUITE_AES256_GCM:
+            {
+                assert( crypto_aead_aes256gcm_is_available() );
+
+                uint8_t actual_nonce[crypto_aead_aes256gcm_NPUBBYTES];
+                memset( actual_nonce, 0, sizeof( actual_nonce ) );
+                memcpy( actual_nonce, nonce, NonceBytes );
+
+                if ( cipherState )
+                    return crypto_aead_aes256gcm_encrypt_detached_afternm( encryptedMessage, mac, NULL, message, (unsigned long long) messageLength, NULL, 0, NULL, actual_nonce, (const crypto_aead_aes256gcm_state*) cipherState ) == 0;
+
+                return crypto_aead_aes256gcm_encrypt_detached( encryptedMessage, mac, NULL, message, (unsigned long long) messageLength, NULL, 0, NULL, actual_nonce, key ) == 0;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    static bool decrypt_detached( uint8_t * decryptedMessage, const uint8_t * encryptedMessage, int encryptedMessageLength, const uint8_t * mac, const uint8_t * nonce, const uint8_t * key, int cipherSuite, const uint8_t * cipherState )
+    {
+        switch ( cipherSuite )
+        {
+            case CIPHER_SUITE_CHACHA20_POLY1305:
+            {
+                return crypto_aead_chacha20poly1305_decrypt_detached( decryptedMessage, NULL, encryptedMessage, (unsigned long long) encryptedMessageLength, mac, NULL, 0, nonce, key ) == 0;
+            }
+
+            case CIPHER_SUITE_AES256_GCM:
+            {
+                if ( !crypto_aead_aes256gcm_is_available() )
+                    return false;
+
+                uint8_t actual_nonce[crypto_aead_aes256gcm_NPUBBYTES];
+                memset( actual_nonce, 0, sizeof( actual_nonce ) );
+                memcpy( actual_nonce, nonce, NonceBytes );
+
+                if ( cipherState )
+                    return crypto_aead_aes256gcm_decrypt_detached_afternm( decryptedMessage, NULL, encryptedMessage, (unsigned long long) encryptedMessageLength, mac, NULL, 0, actual_nonce, (const crypto_aead_aes256gcm_state*) cipherState ) == 0;
+
+                return crypto_aead_aes256gcm_decrypt_detached( decryptedMessage, NULL, encryptedMessage, (unsigned long long) encryptedMessageLength, mac, NULL, 0, actual_nonce, key ) == 0;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    bool Encrypt( const uint8_t * message, int messageLength, uint8_t * encryptedMessage, int & encryptedMessageLength, const uint8_t * nonce, const uint8_t * key, int cipherSuite )
+    {
+        if ( !encrypt_detached( encryptedMessage + MacBytes, encryptedMessage, message, messageLength, nonce, key, cipherSuite, NULL ) )
             return false;
 
         encryptedMessageLength = messageLength + MacBytes;
@@ -68,16 +165,12 @@ namespace yojimbo
  
     bool Decrypt( const uint8_t * encryptedMessage, int encryptedMessageLength, 
                   uint8_t * decryptedMessage, int & decryptedMessageLength, 
-                  const uint8_t * nonce, const uint8_t * key )
+                  const uint8_t * nonce, const uint8_t * key, int cipherSuite )
     {
-        assert( KeyBytes == crypto_secretbox_KEYBYTES );
-        assert( MacBytes == crypto_secretbox_MACBYTES );
-
-        uint8_t actual_nonce[crypto_secretbox_NONCEBYTES];
-        memset( actual_nonce, 0, sizeof( actual_nonce ) );
-        memcpy( actual_nonce, nonce, NonceBytes );
+        if ( encryptedMessageLength < MacBytes )
+            return false;
 
-        if ( crypto_secretbox_open_easy( decryptedMessage, encryptedMessage, encryptedMessageLength, actual_nonce, key ) != 0 )
+        if ( !decrypt_detached( decryptedMessage, encryptedMessage + MacBytes, encryptedMessageLength - MacBytes, encryptedMessage, nonce, key, cipherSuite, NULL ) )
             return false;
 
         decryptedMessageLength = encryptedMessageLength - MacBytes;
@@ -85,6 +178,16 @@ namespace yojimbo
         return true;
     }
 
+    bool Encrypt_InPlace( uint8_t * message, int messageLength, uint8_t * mac, const uint8_t * nonce, const uint8_t * key, int cipherSuite, const uint8_t * cipherState )
+    {
+        return encrypt_detached( message, mac, message, messageLength, nonce, key, cipherSuite, cipherState );
+    }
+
+    bool Decrypt_InPlace( uint8_t * message, int messageLength, const uint8_t * mac, const uint8_t * nonce, const uint8_t * key, int cipherSuite, const uint8_t * cipherState )
+    {
+        return decrypt_detached( message, message, messageLength, mac, nonce, key, cipherSuite, cipherState );
+    }
+
     bool Encrypt_AEAD( const uint8_t * message, uint64_t messageLength, 
                        uint8_t * encryptedMessage, uint64_t &  encryptedMessageLength,
                        const uint8_t * additional, uint64_t additionalLength,
@@ -136,55 +239,320 @@ namespace yojimbo
         return result == 0;
     }
 
-    EncryptionManager::EncryptionManager()
+    EncryptionManager::EncryptionManager( Allocator & allocator, int maxEncryptionMappings )
     {
+        assert( maxEncryptionMappings > 0 );
+
+        m_allocator = &allocator;
+        m_maxEncryptionMappings = maxEncryptionMappings;
+
+        int hashSize = 1;
+        while ( hashSize < maxEncryptionMappings * 2 )
+            hashSize *= 2;
+
+        m_hashMask = hashSize - 1;
+        m_hashTable = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * hashSize );
+        m_freeMappings = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * maxEncryptionMappings );
+        m_heap = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * maxEncryptionMappings );
+        m_heapPosition = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * maxEncryptionMappings );
+        m_expireTime = (double*) YOJIMBO_ALLOCATE( allocator, sizeof( double ) * maxEncryptionMappings );
+        m_lastAccessTime = (double*) YOJIMBO_ALLOCATE( allocator, sizeof( double ) * maxEncryptionMappings );
+        m_timeout = (double*) YOJIMBO_ALLOCATE( allocator, sizeof( double ) * maxEncryptionMappings );
+        m_address = (Address*) YOJIMBO_ALLOCATE( allocator, sizeof( Address ) * maxEncryptionMappings );
+        m_sendKey = (uint8_t*) YOJIMBO_ALLOCATE( allocator, KeyBytes * maxEncryptionMappings );
+        m_receiveKey = (uint8_t*) YOJIMBO_ALLOCATE( allocator, KeyBytes * maxEncryptionMappings );
+        m_cipherSuite = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * maxEncryptionMappings );
+        m_hasCipherState = (bool*) YOJIMBO_ALLOCATE( allocator, sizeof( bool ) * maxEncryptionMappings );
+        m_cipherStateData = (uint8_t**) YOJIMBO_ALLOCATE( allocator, sizeof( uint8_t* ) * maxEncryptionMappings );
+        m_cipherState = (uint8_t**) YOJIMBO_ALLOCATE( allocator, sizeof( uint8_t* ) * maxEncryptionMappings );
+
+        // cipher state is 1KB per-mapping, and servers have many more mapping slots than mappings using AES-256-GCM. allocate it on demand
+
+        memset( m_hasCipherState, 0, sizeof( bool ) * maxEncryptionMappings );
+        memset( m_cipherStateData, 0, sizeof( uint8_t* ) * maxEncryptionMappings );
+        memset( m_cipherState, 0, sizeof( uint8_t* ) * maxEncryptionMappings );
+
         ResetEncryptionMappings();
     }
 
-    bool EncryptionManager::AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double time, double timeout )
+    EncryptionManager::~EncryptionManager()
     {
-#if YOJIMBO_DEBUG_SPAM
+        assert( m_allocator );
+
+        YOJIMBO_FREE( *m_allocator, m_hashTable );
+        YOJIMBO_FREE( *m_allocator, m_freeMappings );
+        YOJIMBO_FREE( *m_allocator, m_heap );
+        YOJIMBO_FREE( *m_allocator, m_heapPosition );
+        YOJIMBO_FREE( *m_allocator, m_expireTime );
+        YOJIMBO_FREE( *m_allocator, m_lastAccessTime );
+        YOJIMBO_FREE( *m_allocator, m_timeout );
+        YOJIMBO_FREE( *m_allocator, m_address );
+        YOJIMBO_FREE( *m_allocator, m_sendKey );
+        YOJIMBO_FREE( *m_allocator, m_receiveKey );
+        YOJIMBO_FREE( *m_allocator, m_cipherSuite );
+        for ( int i = 0; i < m_maxEncryptionMappings; ++i )
         {
-            char addressString[MaxAddressLength];
-            address.ToString( addressString, sizeof( addressString ) );
-            debug_printf( "add encryption mapping: %s (t=%f)\n", addressString, time );
+            if ( m_cipherStateData[i] )
+            {
+                memset( m_cipherState[i], 0, CipherStateBytes * 2 );
+                YOJIMBO_FREE( *m_allocator, m_cipherStateData[i] );
+            }
         }
-#endif // #if YOJIMBO_DEBUG_SPAM
 
-        for ( int i = 0; i < m_numEncryptionMappings; ++i )
+        YOJIMBO_FREE( *m_allocator, m_hasCipherState );
+        YOJIMBO_FREE( *m_allocator, m_cipherStateData );
+        YOJIMBO_FREE( *m_allocator, m_cipherState );
+    }
+
+    int EncryptionManager::FindSlot( const Address & address ) const
+    {
+        int slot = address.GetHash() & m_hashMask;
+
+        while ( true )
+        {
+            const int index = m_hashTable[slot];
+            if ( index < 0 || m_address[index] == address )
+                return slot;
+            slot = ( slot + 1 ) & m_hashMask;
+        }
+    }
+
+    void EncryptionManager::HeapSiftUp( int position )
+    {
+        const int index = m_heap[position];
+
+        while ( position > 0 )
         {
-            if ( m_address[i] == address && m_lastAccessTime[i] + m_timeout[i] >= time )
+            const int parent = ( position - 1 ) / 2;
+            if ( m_expireTime[m_heap[parent]] <= m_expireTime[index] )
+                break;
+            m_heap[position] = m_heap[parent];
+            m_heapPosition[m_heap[position]] = position;
+            position = parent;
+        }
+
+        m_heap[position] = index;
+        m_heapPosition[index] = position;
+    }
+
+    void EncryptionManager::HeapSiftDown( int position )
+    {
+        const int index = m_heap[position];
+
+        while ( true )
+        {
+            int child = position * 2 + 1;
+            if ( child >= m_numEncryptionMappings )
+                break;
+            if ( child + 1 < m_numEncryptionMappings && m_expireTime[m_heap[child+1]] < m_expireTime[m_heap[child]] )
+                child++;
+            if ( m_expireTime[index] <= m_expireTime[m_heap[child]] )
+                break;
+            m_heap[position] = m_heap[child];
+            m_heapPosition[m_heap[position]] = position;
+            position = child;
+        }
+
+        m_heap[position] = index;
+        m_heapPosition[index] = position;
+    }
+
+    void EncryptionManager::FreeEncryptionMapping( int index )
+    {
+        assert( index >= 0 );
+        assert( index < m_maxEncryptionMappings );
+        assert( m_address[index].IsValid() );
+
+        // backward shift deletion from the hash table, so lookups never have to step over deleted entries
+
+        int slot = FindSlot( m_address[index] );
+
+        assert( m_hashTable[slot] == index );
+
+        int next = ( slot + 1 ) & m_hashMask;
+
+        while ( m_hashTable[next] >= 0 )
+        {
+            const int home = m_address[m_hashTable[next]].GetHash() & m_hashMask;
+
+            if ( ( ( next - home ) & m_hashMask ) >= ( ( next - slot ) & m_hashMask ) )
             {
-                m_lastAccessTime[i] = time;
-                m_timeout[i] = timeout;
-                memcpy( m_sendKey + i*KeyBytes, sendKey, KeyBytes );
-                memcpy( m_receiveKey + i*KeyBytes, receiveKey, KeyBytes );
-                return true;
+                m_hashTable[slot] = m_hashTable[next];
+                slot = next;
             }
+
+            next = ( next + 1 ) & m_hashMask;
         }
 
-        for ( int i = 0; i < MaxEncryptionMappings; ++i )
+        m_hashTable[slot] = -1;
+
+        // replace the heap entry with the last one and let it settle
+
+        const int position = m_heapPosition[index];
+
+        m_numEncryptionMappings--;
+
+        if ( position != m_numEncryptionMappings )
         {
-            if ( m_lastAccessTime[i] + m_timeout[i] < time )
+            const int moved = m_heap[m_numEncryptionMappings];
+            m_heap[position] = moved;
+            m_heapPosition[moved] = position;
+            HeapSiftUp( position );
+            if ( m_heapPosition[moved] == position )
+                HeapSiftDown( position );
+        }
+
+        m_address[index] = Address();
+        m_lastAccessTime[index] = -1000.0;
+        m_timeout[index] = 0.0;
+        m_expireTime[index] = -1000.0;
+        m_heapPosition[index] = -1;
+
+        memset( m_sendKey + index*KeyBytes, 0, KeyBytes );
+        memset( m_receiveKey + index*KeyBytes, 0, KeyBytes );
+        m_cipherSuite[index] = CIPHER_SUITE_CHACHA20_POLY1305;
+
+        if ( m_hasCipherState[index] )
+        {
+            memset( m_cipherState[index], 0, CipherStateBytes * 2 );
+            m_hasCipherState[index] = false;
+        }
+
+        m_freeMappings[m_numFreeMappings++] = index;
+    }
+
+    void EncryptionManager::InitializeCipherStates( int index )
+    {
+        assert( index >= 0 );
+        assert( index < m_maxEncryptionMappings );
+
+        if ( m_hasCipherState[index] )
+        {
+            memset( m_cipherState[index], 0, CipherStateBytes * 2 );
+            m_hasCipherState[index] = false;
+        }
+
+        // only AES-256-GCM has cipher state. don't allocate any for other cipher suites
+
+        if ( m_cipherSuite[index] != CIPHER_SUITE_AES256_GCM || !IsCipherSuiteAvailable( m_cipherSuite[index] ) )
+            return;
+
+        if ( !m_cipherState[index] )
+        {
+            // cipher state is expanded into aligned vector registers, so it must start on a 16 byte boundary
+
+            m_cipherStateData[index] = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, CipherStateBytes * 2 + 15 );
+
+            if ( !m_cipherStateData[index] )
+                return;
+
+            m_cipherState[index] = (uint8_t*) ( ( uintptr_t( m_cipherStateData[index] ) + 15 ) & ~uintptr_t( 15 ) );
+        }
+
+        const bool hasSendCipherState = InitializeCipherState( m_cipherState[index], m_sendKey + index*KeyBytes, m_cipherSuite[index] );
+        const bool hasReceiveCipherState = InitializeCipherState( m_cipherState[index] + CipherStateBytes, m_receiveKey + index*KeyBytes, m_cipherSuite[index] );
+
+        m_hasCipherState[index] = hasSendCipherState && hasReceiveCipherState;
+
+        if ( !m_hasCipherState[index] )
+        {
+            memset( m_cipherState[index], 0, CipherStateBytes * 2 );
+        }
+    }
+
+    void EncryptionManager::ExpireEncryptionMappings( double time )
+    {
+        while ( m_numEncryptionMappings > 0 )
+        {
+            const int index = m_heap[0];
+
+            if ( m_expireTime[index] >= time )
+                break;
+
+            const double expireTime = m_lastAccessTime[index] + m_timeout[index];
+
+            if ( expireTime >= time )
             {
-                m_address[i] = address;
-                m_lastAccessTime[i] = time;
-                m_timeout[i] = timeout;
-                memcpy( m_sendKey + i*KeyBytes, sendKey, KeyBytes );
-                memcpy( m_receiveKey + i*KeyBytes, receiveKey, KeyBytes );
-                if ( i + 1 > m_numEncryptionMappings )
-                    m_numEncryptionMappings = i + 1;
-                return true;
+                m_expireTime[index] = expireTime;
+                HeapSiftDown( 0 );
+                continue;
             }
+
+#if YOJIMBO_DEBUG_SPAM
+            char addressString[MaxAddressLength];
+            m_address[index].ToString( addressString, MaxAddressLength );
+            debug_printf( "encryption mapping timed out: %s (t=%f)\n", addressString, time );
+#endif // #if YOJIMBO_DEBUG_SPAM
+
+            FreeEncryptionMapping( index );
         }
+    }
 
+    bool EncryptionManager::AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double time, double timeout, int cipherSuite )
+    {
 #if YOJIMBO_DEBUG_SPAM
-        char addressString[MaxAddressLength];
-        address.ToString( addressString, MaxAddressLength );
-        debug_printf( "failed to add encryption mapping for %s\n", addressString );
+        {
+            char addressString[MaxAddressLength];
+            address.ToString( addressString, sizeof( addressString ) );
+            debug_printf( "add encryption mapping: %s (t=%f)\n", addressString, time );
+        }
 #endif // #if YOJIMBO_DEBUG_SPAM
 
-        return false;
+        assert( address.IsValid() );
+        assert( cipherSuite >= 0 );
+        assert( cipherSuite < CIPHER_SUITE_NUM_VALUES );
+
+        ExpireEncryptionMappings( time );
+
+        const int slot = FindSlot( address );
+
+        int index = m_hashTable[slot];
+
+        if ( index >= 0 )
+        {
+            // the new timeout may be shorter than the old one, so the heap key can move either way
+
+            m_lastAccessTime[index] = time;
+            m_timeout[index] = timeout;
+            m_expireTime[index] = time + timeout;
+            HeapSiftUp( m_heapPosition[index] );
+            HeapSiftDown( m_heapPosition[index] );
+            memcpy( m_sendKey + index*KeyBytes, sendKey, KeyBytes );
+            memcpy( m_receiveKey + index*KeyBytes, receiveKey, KeyBytes );
+            m_cipherSuite[index] = cipherSuite;
+            InitializeCipherStates( index );
+            return true;
+        }
+
+        if ( m_numFreeMappings == 0 )
+        {
+#if YOJIMBO_DEBUG_SPAM
+            char addressString[MaxAddressLength];
+            address.ToString( addressString, MaxAddressLength );
+            debug_printf( "failed to add encryption mapping for %s\n", addressString );
+#endif // #if YOJIMBO_DEBUG_SPAM
+
+            return false;
+        }
+
+        index = m_freeMappings[--m_numFreeMappings];
+
+        m_hashTable[slot] = index;
+
+        m_address[index] = address;
+        m_lastAccessTime[index] = time;
+        m_timeout[index] = timeout;
+        m_expireTime[index] = time + timeout;
+        memcpy( m_sendKey + index*KeyBytes, sendKey, KeyBytes );
+        memcpy( m_receiveKey + index*KeyBytes, receiveKey, KeyBytes );
+        m_cipherSuite[index] = cipherSuite;
+        InitializeCipherStates( index );
+
+        const int position = m_numEncryptionMappings++;
+        m_heap[position] = index;
+        HeapSiftUp( position );
+
+        return true;
     }
 
     bool EncryptionManager::RemoveEncryptionMapping( const Address & address, double time )
@@ -197,31 +565,14 @@ namespace yojimbo
         }
 #endif // #if YOJIMBO_DEBUG_SPAM
 
-        for ( int i = 0; i < m_numEncryptionMappings; ++i )
+        (void) time;
+
+        const int index = m_hashTable[FindSlot( address )];
+
+        if ( index >= 0 )
         {
-            if ( m_address[i] == address )
-            {
-                m_address[i] = Address();
-                m_lastAccessTime[i] = -1000.0;
-                m_timeout[i] = 0.0;
-                
-                memset( m_sendKey + i*KeyBytes, 0, KeyBytes );
-                memset( m_receiveKey + i*KeyBytes, 0, KeyBytes );
-
-                if ( i + 1 == m_numEncryptionMappings )
-                {
-                    int index = i - 1;
-                    while ( index >= 0 )
-                    {
-                        if ( m_lastAccessTime[index] + m_timeout[index] >= time )
-                            break;
-                        index--;
-                    }
-                    m_numEncryptionMappings = index + 1;
-                }
-
-                return true;
-            }
+            FreeEncryptionMapping( index );
+            return true;
         }
 
 #if YOJIMBO_DEBUG_SPAM
@@ -238,29 +589,53 @@ namespace yojimbo
         debug_printf( "reset encryption mappings\n" );
 
         m_numEncryptionMappings = 0;
-        
-        for ( int i = 0; i < MaxEncryptionMappings; ++i )
+        m_numFreeMappings = m_maxEncryptionMappings;
+
+        for ( int i = 0; i < m_maxEncryptionMappings; ++i )
         {
+            m_freeMappings[i] = m_maxEncryptionMappings - 1 - i;
+            m_heap[i] = -1;
+            m_heapPosition[i] = -1;
+            m_expireTime[i] = -1000.0;
             m_lastAccessTime[i] = -1000.0;
             m_timeout[i] = 0.0f;
             m_address[i] = Address();
+            m_cipherSuite[i] = CIPHER_SUITE_CHACHA20_POLY1305;
+
+            // cipher state is only left behind by mappings that have it, so only those need to be wiped
+
+            if ( m_hasCipherState[i] )
+            {
+                memset( m_cipherState[i], 0, CipherStateBytes * 2 );
+                m_hasCipherState[i] = false;
+            }
         }
+
+        memset( m_hashTable, -1, sizeof( int ) * ( m_hashMask + 1 ) );
         
-        memset( m_sendKey, 0, sizeof( m_sendKey ) );
-        memset( m_receiveKey, 0, sizeof( m_receiveKey ) );
+        memset( m_sendKey, 0, KeyBytes * m_maxEncryptionMappings );
+        memset( m_receiveKey, 0, KeyBytes * m_maxEncryptionMappings );
     }
 
     int EncryptionManager::FindEncryptionMapping( const Address & address, double time )
     {
-        for ( int i = 0; i < m_numEncryptionMappings; ++i )
-        {
-            if ( m_address[i] == address && m_lastAccessTime[i] + m_timeout[i] >= time )
-            {
-                m_lastAccessTime[i] = time;
-                return i;
-            }
-        }
-        return -1;
+        ExpireEncryptionMappings( time );
+
+        const int index = m_hashTable[FindSlot( address )];
+
+        if ( index >= 0 )
+            m_lastAccessTime[index] = time;
+
+        return index;
+    }
+
+    void EncryptionManager::TouchEncryptionMapping( int index, double time )
+    {
+        assert( index >= 0 );
+        assert( index < m_maxEncryptionMappings );
+
+        if ( m_heapPosition[index] >= 0 )
+            m_lastAccessTime[index] = time;
     }
 
     const uint8_t * EncryptionManager::GetSendKey( int index ) const
@@ -268,7 +643,7 @@ namespace yojimbo
         if ( index == -1 )
             return NULL;
         assert( index >= 0 );
-        assert( index < m_numEncryptionMappings );
+        assert( index < m_maxEncryptionMappings );
         return m_sendKey + index * KeyBytes;
     }
 
@@ -277,7 +652,34 @@ namespace yojimbo
         if ( index == -1 )
             return NULL;
         assert( index >= 0 );
-        assert( index < m_numEncryptionMappings );
+        assert( index < m_maxEncryptionMappings );
         return m_receiveKey + index * KeyBytes;
     }
+
+    int EncryptionManager::GetCipherSuite( int index ) const
+    {
+        if ( index == -1 )
+            return CIPHER_SUITE_CHACHA20_POLY1305;
+        assert( index >= 0 );
+        assert( index < m_maxEncryptionMappings );
+        return m_cipherSuite[index];
+    }
+
+    const uint8_t * EncryptionManager::GetSendCipherState( int index ) const
+    {
+        if ( index == -1 )
+            return NULL;
+        assert( index >= 0 );
+        assert( index < m_maxEncryptionMappings );
+        return m_hasCipherState[index] ? m_cipherState[index] : NULL;
+    }
+
+    const uint8_t * EncryptionManager::GetReceiveCipherState( int index ) const
+    {
+        if ( index == -1 )
+            return NULL;
+        assert( index >= 0 );
+        assert( index < m_maxEncryptionMappings );
+        return m_hasCipherState[index] ? m_cipherState[index] + CipherStateBytes : NULL;
+    }
 }
@@ -28,6 +28,7 @@
 #include "yojimbo_config.h"
 #include "yojimbo_network.h"
 #include "yojimbo_replay_protection.h"
+#include "yojimbo_allocator.h"
 
 #include <stdint.h>
 
@@ -56,11 +57,63 @@ namespace yojimbo
 
     extern void RandomBytes( uint8_t * data, int bytes );
 
+    /**
+        Is a cipher suite available on this computer?
+
+        ChaCha20-Poly1305 is always available. AES-256-GCM needs a CPU with AES-NI and PCLMUL, since libsodium only implements it with those instructions.
+
+        IMPORTANT: Call InitializeYojimbo first, so libsodium has detected the CPU features.
+
+        @param cipherSuite The cipher suite. See yojimbo::CipherSuite.
+
+        @returns True if packets can be encrypted and decrypted with this cipher suite.
+     */
+
+    extern bool IsCipherSuiteAvailable( int cipherSuite );
+
+    /**
+        Pick the cipher suite to encrypt packets with.
+
+        @param preferredCipherSuite The cipher suite you would like to use. See yojimbo::CipherSuite.
+
+        @returns The preferred cipher suite if it is available, otherwise yojimbo::CIPHER_SUITE_CHACHA20_POLY1305.
+
+        @see IsCipherSuiteAvailable
+     */
+
+    extern int SelectCipherSuite( int preferredCipherSuite );
+
+    /**
+        Get the name of a cipher suite.
+
+        @param cipherSuite The cipher suite. See yojimbo::CipherSuite.
+
+        @returns A string describing the cipher suite, eg. "AES-256-GCM".
+     */
+
+    extern const char * GetCipherSuiteName( int cipherSuite );
+
+    /**
+        Expand a key into precomputed cipher state.
+
+        AES-256-GCM expands its key schedule and GHASH tables here once, instead of on every packet. ChaCha20-Poly1305 has no key schedule worth caching, so nothing is written and packets are encrypted with the key directly.
+
+        @param cipherState Buffer where the cipher state will be written. Must be yojimbo::CipherStateBytes large and 16 byte aligned.
+        @param key The key to expand.
+        @param cipherSuite The cipher suite the key will be used with. See yojimbo::CipherSuite.
+
+        @returns True if the cipher state should be passed to yojimbo::Encrypt_InPlace and yojimbo::Decrypt_InPlace along with the key, false if there is nothing to cache for this cipher suite.
+     */
+
+    extern bool InitializeCipherState( uint8_t * cipherState, const uint8_t * key, int cipherSuite );
+
     /**
         Encrypt a message with a symmetric cipher.
 
         This is used for encrypted UDP packets sent between the client and server.
 
+        The encrypted message is the MAC followed by the encrypted message data. Both cipher suites produce the same layout and size.
+
         See https://download.libsodium.org/doc/ for implementation details.
 
         @param message The message to encrypt.
@@ -69,13 +122,14 @@ namespace yojimbo
         @param encryptedMessageLength The number of bytes of encrypted message data that was written [out]. Will be equal to messageLength + yojimbo::MacBytes on successful encryption.
         @param nonce The nonce to use to encrypt the message. This should be a sequence number that increases with each call to encrypt. Never pass in a nonce value that has already been used with this key!
         @param key The key used for encryption.
+        @param cipherSuite The cipher suite to encrypt with. See yojimbo::CipherSuite. Must be available. See yojimbo::IsCipherSuiteAvailable.
 
         @returns True if the message was encrypted successfully, false otherwise.
 
         @see Decrypt
      */
 
-    extern bool Encrypt( const uint8_t * message, int messageLength, uint8_t * encryptedMessage, int & encryptedMessageLength, const uint8_t * nonce, const uint8_t * key );
+    extern bool Encrypt( const uint8_t * message, int messageLength, uint8_t * encryptedMessage, int & encryptedMessageLength, const uint8_t * nonce, const uint8_t * key, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 );
  
     /**
         Decrypt a message that was encrypted with a symmetric cipher.
@@ -90,11 +144,50 @@ namespace yojimbo
         @param decryptedMessageLength The length of the decrypted message (bytes). On success will be equal to encryptedMessageLength - yojimbo::MacBytes.
         @param nonce The nonce used to encrypt the message.
         @param key The key used to encrypt the message.
+        @param cipherSuite The cipher suite the message was encrypted with. See yojimbo::CipherSuite.
+
+        @returns True if the message was successfully decrypted, false otherwise.
+     */
+
+    extern bool Decrypt( const uint8_t * encryptedMessage, int encryptedMessageLength, uint8_t * decryptedMessage, int & decryptedMessageLength, const uint8_t * nonce, const uint8_t * key, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 );
+
+    /**
+        Encrypt a message in place with a symmetric cipher.
+
+        Produces the same output as yojimbo::Encrypt, where the encrypted message is the MAC followed by the encrypted message data, but without copying the message. Place the message yojimbo::MacBytes after the start of the buffer and pass in the start of the buffer as the MAC, and the buffer ends up exactly as if yojimbo::Encrypt had written it.
+
+        @param message The message to encrypt. Overwritten with the encrypted message data.
+        @param messageLength The length of the message to encrypt (bytes).
+        @param mac Buffer where the MAC will be written. Must be yojimbo::MacBytes large.
+        @param nonce The nonce to use to encrypt the message. This should be a sequence number that increases with each call to encrypt. Never pass in a nonce value that has already been used with this key!
+        @param key The key used for encryption.
+        @param cipherSuite The cipher suite to encrypt with. See yojimbo::CipherSuite. Must be available. See yojimbo::IsCipherSuiteAvailable.
+        @param cipherState Optional cipher state expanded from the key with yojimbo::InitializeCipherState, so the key schedule isn't redone. Pass in NULL to use the key directly.
+
+        @returns True if the message was encrypted successfully, false otherwise.
+
+        @see Decrypt_InPlace
+     */
+
+    extern bool Encrypt_InPlace( uint8_t * message, int messageLength, uint8_t * mac, const uint8_t * nonce, const uint8_t * key, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305, const uint8_t * cipherState = NULL );
+
+    /**
+        Decrypt a message in place that was encrypted with a symmetric cipher.
+
+        Decrypts data written by yojimbo::Encrypt or yojimbo::Encrypt_InPlace without copying it. The MAC is the first yojimbo::MacBytes of the encrypted message, and the encrypted message data follows it.
+
+        @param message The encrypted message data, following the MAC. Overwritten with the decrypted message on success. The contents are undefined if decryption fails.
+        @param messageLength The length of the encrypted message data, not including the MAC (bytes).
+        @param mac The MAC written when the message was encrypted.
+        @param nonce The nonce used to encrypt the message.
+        @param key The key used to encrypt the message.
+        @param cipherSuite The cipher suite the message was encrypted with. See yojimbo::CipherSuite.
+        @param cipherState Optional cipher state expanded from the key with yojimbo::InitializeCipherState. Pass in NULL to use the key directly.
 
         @returns True if the message was successfully decrypted, false otherwise.
      */
 
-    extern bool Decrypt( const uint8_t * encryptedMessage, int encryptedMessageLength, uint8_t * decryptedMessage, int & decryptedMessageLength, const uint8_t * nonce, const uint8_t * key );
+    extern bool Decrypt_InPlace( uint8_t * message, int messageLength, const uint8_t * mac, const uint8_t * nonce, const uint8_t * key, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305, const uint8_t * cipherState = NULL );
 
     /**
         Encrypt a message with an AEAD primitive (authenticated encryption with associated data).
@@ -148,6 +241,8 @@ namespace yojimbo
         Separate keys are used for packets sent to an address vs. packets received from this address. 
 
         This was done to allow the client/server to use the sequence numbers of packets as a nonce in both directions. An alternative would have been to set the high bit of the packet sequence number in one of the directions, but I felt this was cleaner.
+
+        Encryption mappings are found by address through a hash table, free indices are kept on a free list, and expiry is driven by a min-heap ordered by expire time, so adding, removing and finding an encryption mapping doesn't depend on how many clients are negotiating a connection at once. Encryption mapping indices stay the same for as long as the mapping exists, so they can be cached.
      */
 
 
@@ -157,9 +252,20 @@ namespace yojimbo
 
         /**
             Encryption manager constructor.
+
+            @param allocator The allocator used to allocate the encryption mapping arrays and hash table.
+            @param maxEncryptionMappings The maximum number of encryption mappings that can exist at the same time.
          */
 
-        EncryptionManager();
+        EncryptionManager( Allocator & allocator, int maxEncryptionMappings = MaxEncryptionMappings );
+
+        /**
+            Encryption manager destructor.
+
+            Frees the encryption mapping arrays and hash table.
+         */
+
+        ~EncryptionManager();
 
         /**
             Associates an address with send and receive keys for packet encryption.
@@ -169,11 +275,12 @@ namespace yojimbo
             @param receiveKey The key used to decrypt packets received from this address.
             @param time The current time (seconds).
             @param timeout The timeout value in seconds for this encryption mapping (seconds). Encryption mapping times out if no packets are sent to or received from this address in the timeout period.
+            @param cipherSuite The cipher suite used to encrypt packets sent to and received from this address. See yojimbo::CipherSuite.
 
             @returns True if the encryption mapping was added successfully, false otherwise.
          */
 
-        bool AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double time, double timeout );
+        bool AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double time, double timeout, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 );
 
         /**
             Remove the encryption mapping for an address.
@@ -210,6 +317,17 @@ namespace yojimbo
 
         int FindEncryptionMapping( const Address & address, double time );
 
+        /**
+            Touch an encryption mapping (by index) so it doesn't time out.
+
+            Used when the encryption mapping index is cached in a transport context and EncryptionManager::FindEncryptionMapping isn't called per-packet. Does nothing if no encryption mapping exists at this index.
+
+            @param index The encryption mapping index. See EncryptionManager::FindEncryptionMapping.
+            @param time The current time (seconds).
+         */
+
+        void TouchEncryptionMapping( int index, double time );
+
         /**
             Get the send key for an encryption mapping (by index).
 
@@ -234,19 +352,130 @@ namespace yojimbo
 
         const uint8_t * GetReceiveKey( int index ) const;
 
+        /**
+            Get the cipher suite for an encryption mapping (by index).
+
+            @param index The encryption mapping index. See EncryptionMapping::FindEncryptionMapping
+
+            @returns The cipher suite used to encrypt and decrypt packets for this encryption mapping. See yojimbo::CipherSuite.
+         */
+
+        int GetCipherSuite( int index ) const;
+
+        /**
+            Get the precomputed cipher state for the send key of an encryption mapping (by index).
+
+            The cipher state is expanded once when the encryption mapping is added, so sending packets doesn't redo the key schedule each time.
+
+            @param index The encryption mapping index. See EncryptionMapping::FindEncryptionMapping
+
+            @returns The cipher state to pass in with the send key, or NULL if the cipher suite has no cipher state. See yojimbo::InitializeCipherState.
+         */
+
+        const uint8_t * GetSendCipherState( int index ) const;
+
+        /**
+            Get the precomputed cipher state for the receive key of an encryption mapping (by index).
+
+            @param index The encryption mapping index. See EncryptionMapping::FindEncryptionMapping
+
+            @returns The cipher state to pass in with the receive key, or NULL if the cipher suite has no cipher state. See yojimbo::InitializeCipherState.
+         */
+
+        const uint8_t * GetReceiveCipherState( int index ) const;
+
+        /**
+            Get the maximum number of encryption mappings.
+
+            @returns The maximum number of encryption mappings passed in to the constructor.
+         */
+
+        int GetMaxEncryptionMappings() const { return m_maxEncryptionMappings; }
+
     private:
 
-        int m_numEncryptionMappings;                                                    ///< The number of encryption mappings in the array. This is how far we search from left to right starting at index 0. It's updated as entries are removed from the right.
+        /**
+            Find the hash table slot for an address.
+
+            @param address The address to look for.
+            @returns The slot holding the encryption mapping index for the address, or the empty slot where it would be inserted.
+         */
+
+        int FindSlot( const Address & address ) const;
+
+        /**
+            Remove an encryption mapping from the hash table, heap and put its index back on the free list.
+
+            @param index The encryption mapping index to free.
+         */
+
+        void FreeEncryptionMapping( int index );
+
+        /**
+            Free all encryption mappings that have timed out.
+
+            Pops the heap while the earliest expire time has passed. Mappings touched since they were pushed get pushed back with their new expire time, so touching a mapping in EncryptionManager::FindEncryptionMapping doesn't need to update the heap.
+
+            @param time The current time (seconds).
+         */
+
+        void ExpireEncryptionMappings( double time );
+
+        /**
+            Expand the send and receive keys of an encryption mapping into precomputed cipher state.
+
+            Called whenever an encryption mapping is added or its keys are replaced. Cipher state is allocated the first time a mapping at this index needs it, so mappings for cipher suites with nothing to cache take no extra memory. See yojimbo::InitializeCipherState.
+
+            @param index The encryption mapping index.
+         */
+
+        void InitializeCipherStates( int index );
+
+        void HeapSiftUp( int position );                                                ///< Move a heap entry towards the root until its parent expires earlier.
+
+        void HeapSiftDown( int position );                                              ///< Move a heap entry towards the leaves until both children expire later.
+
+        Allocator * m_allocator;                                                        ///< The allocator passed in to the constructor. Used to free the arrays in the destructor.
+
+        int m_maxEncryptionMappings;                                                    ///< The maximum number of encryption mappings.
+
+        int m_hashMask;                                                                 ///< The hash table size minus one. The hash table size is a power of two at least twice the maximum number of encryption mappings, so probe sequences stay short.
+
+        int m_numEncryptionMappings;                                                    ///< The number of encryption mappings currently in use.
+
+        int m_numFreeMappings;                                                          ///< The number of encryption mapping indices on the free list.
+
+        int * m_freeMappings;                                                           ///< Stack of free encryption mapping indices.
+
+        int * m_hashTable;                                                              ///< Open addressing hash table keyed by Address::GetHash. Each slot is an encryption mapping index, or -1 if empty.
+
+        int * m_heap;                                                                   ///< Min-heap of encryption mapping indices ordered by m_expireTime. Has one entry for each encryption mapping in use.
+
+        int * m_heapPosition;                                                           ///< The position of each encryption mapping in the heap. Lets a mapping be removed from the middle of the heap.
+
+        double * m_expireTime;                                                          ///< Heap key for each encryption mapping. Never later than the actual expire time, which moves forward each time the mapping is touched.
+
+        double * m_lastAccessTime;                                                      ///< Array of last access times used to time out encryption mappings.
+
+        double * m_timeout;                                                             ///< Array of timeout values (seconds) for each encryption mapping. Allows each encryption mapping to potentially have its own timeout value.
+
+        Address * m_address;                                                            ///< The address associated with each encryption mapping index. If no encryption mapping exists at this index, this is set to an invalid address. See Address::IsValid.
+
+        uint8_t * m_sendKey;                                                            ///< Array containing all send keys. The send key for an encryption mapping index n starts at offset KeyBytes * n.
+
+        uint8_t * m_receiveKey;                                                         ///< Array containing all receive keys. The receive key for an encryption mapping index n starts at offset KeyBytes * n.
+
+        int * m_cipherSuite;                                                            ///< Array of cipher suites for each encryption mapping. See yojimbo::CipherSuite.
+
+        bool * m_hasCipherState;                                                        ///< True if the encryption mapping has precomputed cipher state for its keys. False when the cipher suite has nothing to cache.
+
+        uint8_t ** m_cipherStateData;                                                   ///< Per-mapping allocation backing the cipher state, padded so it can be 16 byte aligned. NULL until a mapping at that index first needs cipher state, then kept for reuse until the encryption manager is destroyed.
+
+        uint8_t ** m_cipherState;                                                       ///< Per-mapping cipher state, aligned within m_cipherStateData. The send cipher state is at offset 0 and the receive cipher state at offset CipherStateBytes. NULL if not allocated yet.
 
-        double m_lastAccessTime[MaxEncryptionMappings];                                 ///< Array of last access times used to time out encryption mappings.
+        EncryptionManager( const EncryptionManager & other );
 
-        double m_timeout[MaxEncryptionMappings];                                        ///< Array of timeout values (seconds) for each encryption mapping. Allows each encryption mapping to potentially have its own timeout value.
-        
-        Address m_address[MaxEncryptionMappings];                                       ///< The address associated with each encryption mapping index. If no encryption mapping exists at this index, this is set to an invalid address. See Address::IsValid.
-        
-        uint8_t m_sendKey[KeyBytes*MaxEncryptionMappings];                              ///< Array containing all send keys. The send key for an encryption mapping index n starts at offset KeyBytes * n.
-        
-        uint8_t m_receiveKey[KeyBytes*MaxEncryptionMappings];                           ///< Array containing all receive keys. The receive key for an encryption mapping index n starts at offset KeyBytes * n.
+        const EncryptionManager & operator = ( const EncryptionManager & other );
     };
 }
 
@@ -326,6 +326,18 @@ namespace yojimbo
         if ( base64_decode_data( serverToClientKeyBase64, matchResponse.serverToClientKey, KeyBytes ) != KeyBytes )
             return false;
 
+        // matchers that predate cipher suites don't send one, so their connect tokens only allow the fallback
+
+        matchResponse.cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
+
+        if ( exists_and_is_string( doc, "cipherSuite" ) )
+        {
+            matchResponse.cipherSuite = atoi( doc["cipherSuite"].GetString() );
+
+            if ( matchResponse.cipherSuite < 0 || matchResponse.cipherSuite >= CIPHER_SUITE_NUM_VALUES )
+                return false;
+        }
+
         return true;
     }
 }
@@ -66,6 +66,7 @@ namespace yojimbo
             memset( clientToServerKey, 0, sizeof( clientToServerKey ) );
             memset( serverToClientKey, 0, sizeof( serverToClientKey ) );
             connectTokenExpireTimestamp = 0;
+            cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
         }
 
         int numServerAddresses;                                             ///< The number of server addresses to connect to in [1,MaxServersPerConnect].
@@ -75,6 +76,7 @@ namespace yojimbo
         uint8_t clientToServerKey[KeyBytes];                                ///< The key for client to server encrypted packets.
         uint8_t serverToClientKey[KeyBytes];                                ///< The key for server to client encrypted packets.
         uint64_t connectTokenExpireTimestamp;                               ///< The timestamp at which this connect token expires.
+        int cipherSuite;                                                    ///< The cipher suite the connect token allows. See yojimbo::CipherSuite. Pass this to Client::Connect.
     };
 
     /**
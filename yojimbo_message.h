@@ -30,6 +30,7 @@
 #include "yojimbo_serialize.h"
 #include "yojimbo_allocator.h"
 #include "yojimbo_bit_array.h"
+#include "yojimbo_platform.h"
 
 #if YOJIMBO_DEBUG_MESSAGE_LEAKS
 #include <map>
@@ -39,6 +40,174 @@
 
 namespace yojimbo
 {
+    /**
+        An immutable, reference counted block of data that can be attached to many block messages at the same time.
+
+        Use this to send the same block to many clients (eg. a map chunk or a snapshot broadcast to every client) without allocating and copying the block once per-client. Each message it is attached to holds a reference, and the block is read in place when it is sent.
+
+        Shared blocks also hold the serialized payload of messages that are serialized once and sent many times. See Message::AttachSerializedPayload.
+
+        Reference counting is atomic, so messages holding a reference can be released on any thread. The block is never freed by releasing a reference though. Whoever created it frees it once the reference count has dropped to zero, on a thread where it is safe to use the allocator it came from. Server::CreateSharedBlock and Server::ReleaseSharedBlock do this for you.
+
+        @see BlockMessage::AttachSharedBlock
+     */
+
+    class SharedBlock
+    {
+    public:
+
+        /**
+            Shared block constructor.
+
+            Copies the block data. The shared block starts with one reference, owned by whoever created it.
+
+            Check SharedBlock::GetBlockData after construction. It is NULL if the block data could not be allocated.
+
+            @param allocator The allocator used to allocate the block data.
+            @param blockData The block data to copy.
+            @param blockSize The size of the block (bytes).
+         */
+
+        SharedBlock( Allocator & allocator, const uint8_t * blockData, int blockSize )
+        {
+            assert( blockData );
+            assert( blockSize > 0 );
+
+            m_allocator = &allocator;
+            m_blockSize = 0;
+            m_refCount = 1;
+            m_next = NULL;
+
+            m_blockData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, blockSize );
+            if ( m_blockData )
+            {
+                memcpy( m_blockData, blockData, blockSize );
+                m_blockSize = blockSize;
+            }
+        }
+
+        /**
+            Shared block constructor.
+
+            Allocates the block data without initializing it. Write the block data with SharedBlock::GetBlockData before attaching the block to any messages.
+
+            Check SharedBlock::GetBlockData after construction. It is NULL if the block data could not be allocated.
+
+            @param allocator The allocator used to allocate the block data.
+            @param blockSize The size of the block (bytes).
+         */
+
+        SharedBlock( Allocator & allocator, int blockSize )
+        {
+            assert( blockSize > 0 );
+
+            m_allocator = &allocator;
+            m_blockSize = 0;
+            m_refCount = 1;
+            m_next = NULL;
+
+            m_blockData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, blockSize );
+            if ( m_blockData )
+                m_blockSize = blockSize;
+        }
+
+        /**
+            Shared block destructor.
+
+            Frees the block data. No messages may still reference the block.
+         */
+
+        ~SharedBlock()
+        {
+            assert( m_refCount == 0 );
+            assert( m_allocator );
+
+            YOJIMBO_FREE( *m_allocator, m_blockData );
+
+            m_allocator = NULL;
+        }
+
+        /**
+            Get the block data.
+
+            @returns The block data. NULL if the block data could not be allocated.
+         */
+
+        const uint8_t * GetBlockData() const
+        {
+            return m_blockData;
+        }
+
+        /**
+            Get the block data.
+
+            @returns The block data. NULL if the block data could not be allocated.
+         */
+
+        uint8_t * GetBlockData()
+        {
+            return m_blockData;
+        }
+
+        /**
+            Get the size of the block.
+
+            @returns The size of the block (bytes).
+         */
+
+        int GetBlockSize() const
+        {
+            return m_blockSize;
+        }
+
+        /**
+            Get the number of references to the shared block.
+
+            @returns The reference count. Once this is zero, the block is no longer used and can be freed.
+         */
+
+        int GetRefCount() const
+        {
+            return (int) platform_atomic_load( &m_refCount );
+        }
+
+        /**
+            Add a reference to the shared block.
+         */
+
+        void AddRef()
+        {
+            assert( GetRefCount() > 0 );
+            platform_atomic_increment( &m_refCount );
+        }
+
+        /**
+            Remove a reference from the shared block.
+
+            This never frees the block. See SharedBlock for who does.
+         */
+
+        void Release()
+        {
+            assert( GetRefCount() > 0 );
+            platform_atomic_decrement( &m_refCount );
+        }
+
+    private:
+
+        friend class Server;
+
+        SharedBlock( const SharedBlock & other );
+
+        const SharedBlock & operator = ( const SharedBlock & other );
+
+        Allocator * m_allocator;                                                ///< The allocator used to allocate the block data.
+        uint8_t * m_blockData;                                                  ///< The block data. NULL if it could not be allocated.
+        int m_blockSize;                                                        ///< The size of the block (bytes).
+        volatile uint32_t m_refCount;                                           ///< The number of references to this block. Starts at 1 for whoever created it, plus one for each message it is attached to.
+        SharedBlock * m_next;                                                   ///< The next shared block created by the same server. Used to free shared blocks once they are no longer referenced.
+    };
+
     /**
         A reference counted object that can be serialized to a bitstream.
 
@@ -82,7 +251,7 @@ namespace yojimbo
             @see MessageFactory::Create
          */
 
-        Message( int blockMessage = 0 ) : m_refCount(1), m_id(0), m_type(0), m_blockMessage( blockMessage ) {}
+        Message( int blockMessage = 0 ) : m_refCount(1), m_id(0), m_type(0), m_blockMessage( blockMessage ), m_serializedPayload( NULL ), m_serializedPayloadBits( 0 ) {}
 
         /** 
             Set the message id.
@@ -140,6 +309,64 @@ namespace yojimbo
 
         bool IsBlockMessage() const { return m_blockMessage; }
 
+        /**
+            Attach a serialized payload to this message.
+
+            The payload is this message already written to a bitstream, starting at bit zero and flushed. When the message is sent, the payload bits are copied into the packet instead of serializing the message again, so a message sent to many clients only needs to be serialized once. Messages that align the stream (eg. serialize_bytes) can't be copied like this, because their alignment depends on where they land in the packet.
+
+            The message holds a reference to the payload until it is destroyed. The fields of the message are not used when it is sent, so they don't need to be set.
+
+            @param payload The serialized message.
+            @param payloadBits The number of bits in the serialized message.
+
+            @see Server::BroadcastMsg
+         */
+
+        void AttachSerializedPayload( SharedBlock * payload, int payloadBits )
+        {
+            assert( payload );
+            assert( payloadBits >= 0 );
+            assert( payloadBits <= payload->GetBlockSize() * 8 );
+            assert( !m_serializedPayload );
+
+            payload->AddRef();
+
+            m_serializedPayload = payload;
+            m_serializedPayloadBits = payloadBits;
+        }
+
+        /**
+            Detach the serialized payload from this message, and release the reference held on it.
+
+            The message is serialized from its fields the next time it is sent, so only detach payloads from messages that have their fields set. Does nothing if no payload is attached.
+         */
+
+        void DetachSerializedPayload()
+        {
+            if ( m_serializedPayload )
+            {
+                m_serializedPayload->Release();
+                m_serializedPayload = NULL;
+                m_serializedPayloadBits = 0;
+            }
+        }
+
+        /**
+            Get the serialized payload attached to this message.
+
+            @returns The serialized payload. NULL if no payload is attached, and the message is serialized when it is sent.
+         */
+
+        const SharedBlock * GetSerializedPayload() const { return m_serializedPayload; }
+
+        /**
+            Get the number of bits in the serialized payload attached to this message.
+
+            @returns The number of bits in the serialized payload. 0 if no payload is attached.
+         */
+
+        int GetSerializedPayloadBits() const { return m_serializedPayloadBits; }
+
         /**
             Virtual serialize function (read).
 
@@ -223,6 +450,12 @@ namespace yojimbo
         virtual ~Message()
         {
             assert( m_refCount == 0 );
+
+            if ( m_serializedPayload )
+            {
+                m_serializedPayload->Release();
+                m_serializedPayload = NULL;
+            }
         }
 
     private:
@@ -237,6 +470,8 @@ namespace yojimbo
         uint32_t m_id : 16;                                                 ///< The message id. For messages sent over reliable-ordered channels, this starts at 0 and increases with each message sent. For unreliable-unordered channels this is set to the sequence number of the packet the message was included in.
         uint32_t m_type : 15;                                               ///< The message type. Corresponds to the type integer used when the message was created though the message factory.
         uint32_t m_blockMessage : 1;                                        ///< 1 if this is a block message. 0 otherwise. If 1 then you can cast the Message* to BlockMessage*. In short, it's a lightweight RTTI.
+        SharedBlock * m_serializedPayload;                                  ///< The serialized payload written in place of serializing this message. NULL unless one is attached. The message holds a reference to it.
+        int m_serializedPayloadBits;                                        ///< The number of bits in the serialized payload.
     };
 
     /**
@@ -265,7 +500,7 @@ namespace yojimbo
             @see MessageFactory::Create
          */
 
-        explicit BlockMessage() : Message( 1 ), m_allocator(NULL), m_blockData(NULL), m_blockSize(0) {}
+        explicit BlockMessage() : Message( 1 ), m_allocator(NULL), m_blockData(NULL), m_blockSize(0), m_sharedBlock(NULL) {}
 
         /**
             Attach a block to this message.
@@ -284,10 +519,35 @@ namespace yojimbo
             m_blockSize = blockSize;
         }
 
+        /**
+            Attach a shared block to this message.
+
+            The message holds a reference to the shared block until it is destroyed, instead of owning a copy of the block. The same shared block can be attached to any number of messages, on any number of connections.
+
+            You can only attach one block. This method will assert if a block is already attached. The block data must not be modified once attached.
+
+            @param sharedBlock The shared block to attach.
+
+            @see Server::CreateSharedBlock
+         */
+
+        void AttachSharedBlock( SharedBlock * sharedBlock )
+        {
+            assert( sharedBlock );
+            assert( sharedBlock->GetBlockData() );
+            assert( !m_blockData );
+
+            sharedBlock->AddRef();
+
+            m_sharedBlock = sharedBlock;
+            m_blockData = (uint8_t*) sharedBlock->GetBlockData();
+            m_blockSize = sharedBlock->GetBlockSize();
+        }
+
         /** 
             Detach the block from this message.
 
-            By doing this you are responsible for copying the block pointer and allocator and making sure the block is freed.
+            By doing this you are responsible for copying the block pointer and allocator and making sure the block is freed. If the block is a shared block, you take over the reference the message held on it, and must release it.
 
             This could be used for example, if you wanted to copy off the block and store it somewhere, without the cost of copying it.
          */
@@ -297,12 +557,13 @@ namespace yojimbo
             m_allocator = NULL;
             m_blockData = NULL;
             m_blockSize = 0;
+            m_sharedBlock = NULL;
         }
 
         /**
             Get the allocator used to allocate the block.
 
-            @returns The allocator for the block. NULL if no block is attached to this message.
+            @returns The allocator for the block. NULL if no block is attached to this message, or the block is a shared block.
          */
 
         Allocator * GetAllocator()
@@ -332,6 +593,17 @@ namespace yojimbo
             return m_blockSize;
         }
 
+        /**
+            Get the shared block attached to this message.
+
+            @returns The shared block. NULL if no block is attached, or the block attached is owned by this message.
+         */
+
+        SharedBlock * GetSharedBlock()
+        {
+            return m_sharedBlock;
+        }
+
         /**
             Templated serialize function for the block message. Doesn't do anything. The block data is serialized elsewhere.
 
@@ -361,13 +633,20 @@ namespace yojimbo
                 m_blockSize = 0;
                 m_allocator = NULL;
             }
+
+            if ( m_sharedBlock )
+            {
+                m_sharedBlock->Release();
+                m_sharedBlock = NULL;
+            }
         }
 
     private:
 
-        Allocator * m_allocator;                                                ///< Allocator for the block attached to the message. NULL if no block is attached.
+        Allocator * m_allocator;                                                ///< Allocator for the block attached to the message. NULL if no block is attached, or the block is shared.
         uint8_t * m_blockData;                                                  ///< The block data. NULL if no block is attached.
         int m_blockSize;                                                        ///< The block size (bytes). 0 if no block is attached.
+        SharedBlock * m_sharedBlock;                                            ///< The shared block attached to the message. NULL unless a shared block is attached. The message holds a reference to it.
     };
 
     /**
@@ -390,10 +669,26 @@ namespace yojimbo
             YOJIMBO_MESSAGE_FACTORY_FINISH
 
         See tests/shared.h for an example showing how to use the macros.
+
+        By default each message is allocated when it is created and freed when its last reference is released. Call MessageFactory::EnablePooling to keep released messages on a free list per-type instead, so creating messages at a high rate doesn't go through the allocator at all once the pools are warm.
      */
 
     class MessageFactory
     {        
+        /**
+            A free list of released messages of one type.
+
+            Messages in the pool are carved out of chunks allocated from the message factory allocator, each holding a number of messages. Each message is aligned to a cache line.
+         */
+
+        struct MessagePool
+        {
+            int numMessages;                                                    ///< The number of messages allocated at a time when the free list is empty.
+            int messageBytes;                                                   ///< The size of each message in the pool, rounded up to a multiple of the cache line size (bytes). 0 until the first message of this type is created.
+            void * freeList;                                                    ///< The first free message. Free messages store a pointer to the next free message in their first bytes.
+            void * chunks;                                                      ///< The most recently allocated chunk. Each chunk stores a pointer to the previous chunk in its first bytes.
+        };
+
         #if YOJIMBO_DEBUG_MESSAGE_LEAKS
         std::map<void*,int> allocated_messages;                                 ///< The set of allocated messages for this factory. Used to track down message leaks.
         #endif // #if YOJIMBO_DEBUG_MESSAGE_LEAKS
@@ -404,6 +699,10 @@ namespace yojimbo
         
         int m_error;                                                            ///< The message factory error level.
 
+        MessagePool * m_pools;                                                  ///< The message pool for each type. NULL unless pooling is enabled.
+
+        uint64_t m_numAllocatorCalls;                                           ///< The number of allocations and frees made on the allocator to create and destroy messages.
+
     public:
 
         /**
@@ -420,6 +719,8 @@ namespace yojimbo
             m_allocator = &allocator;
             m_numTypes = numTypes;
             m_error = MESSAGE_FACTORY_ERROR_NONE;
+            m_pools = NULL;
+            m_numAllocatorCalls = 0;
         }
 
         /**
@@ -432,6 +733,22 @@ namespace yojimbo
         {
             assert( m_allocator );
 
+            if ( m_pools )
+            {
+                for ( int type = 0; type < m_numTypes; ++type )
+                {
+                    void * chunk = m_pools[type].chunks;
+                    while ( chunk )
+                    {
+                        void * previous = *( (void**) chunk );
+                        YOJIMBO_FREE( *m_allocator, chunk );
+                        chunk = previous;
+                    }
+                }
+
+                YOJIMBO_FREE( *m_allocator, m_pools );
+            }
+
             m_allocator = NULL;
 
             #if YOJIMBO_DEBUG_MESSAGE_LEAKS
@@ -527,13 +844,117 @@ namespace yojimbo
                 assert( allocated_messages.find( message ) != allocated_messages.end() );
                 allocated_messages.erase( message );
                 #endif // #if YOJIMBO_DEBUG_MESSAGE_LEAKS
-            
-                assert( m_allocator );
 
-                YOJIMBO_DELETE( *m_allocator, Message, message );
+                DestroyMessage( message );
             }
         }
 
+        /**
+            Keep released messages on a free list per-type, instead of freeing them back to the allocator.
+
+            Each time the free list for a type is empty, a chunk of messages of that type is allocated in one go, so message reuse costs no allocator calls once the pool has grown to the number of messages in flight. Pooled memory is only freed when the message factory is destroyed.
+
+            Must be called before any messages are created. Only messages created through MessageFactory::AllocateMessage are pooled, which is what YOJIMBO_DECLARE_MESSAGE_TYPE does. Message types created any other way still go through the allocator.
+
+            @param numMessages The number of messages allocated at a time for each type. Override this per-type with MessageFactory::SetPoolSize.
+
+            @see MessageFactory::PreallocateMessages
+         */
+
+        void EnablePooling( int numMessages )
+        {
+            assert( numMessages > 0 );
+            assert( !m_pools );
+            assert( m_allocator );
+
+            m_pools = (MessagePool*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( MessagePool ) * m_numTypes );
+            m_numAllocatorCalls++;
+
+            if ( !m_pools )
+                return;
+
+            for ( int type = 0; type < m_numTypes; ++type )
+            {
+                m_pools[type].numMessages = numMessages;
+                m_pools[type].messageBytes = 0;
+                m_pools[type].freeList = NULL;
+                m_pools[type].chunks = NULL;
+            }
+        }
+
+        /**
+            Set the number of messages allocated at a time for a message type.
+
+            Pooling must be enabled. Use this to give message types sent at a high rate a bigger pool than the rest.
+
+            @param type The message type in [0,numTypes-1].
+            @param numMessages The number of messages allocated at a time for this type.
+         */
+
+        void SetPoolSize( int type, int numMessages )
+        {
+            assert( m_pools );
+            assert( type >= 0 );
+            assert( type < m_numTypes );
+            assert( numMessages > 0 );
+
+            if ( m_pools )
+                m_pools[type].numMessages = numMessages;
+        }
+
+        /**
+            Allocate the first chunk of messages for each pooled message type up front.
+
+            Otherwise, the first chunk for each type is allocated the first time a message of that type is created. Does nothing if pooling is not enabled.
+         */
+
+        void PreallocateMessages()
+        {
+            if ( !m_pools )
+                return;
+
+            for ( int type = 0; type < m_numTypes; ++type )
+            {
+                if ( m_pools[type].chunks )
+                    continue;
+
+                // creating a message is the only way to find out how big messages of this type are
+
+                Message * message = CreateMessage( type );
+                if ( message )
+                {
+                    message->Release();
+                    DestroyMessage( message );
+                }
+            }
+        }
+
+        /**
+            Is message pooling enabled?
+
+            @returns True if pooling is enabled, false otherwise.
+
+            @see MessageFactory::EnablePooling
+         */
+
+        bool IsPoolingEnabled() const
+        {
+            return m_pools != NULL;
+        }
+
+        /**
+            Get the number of allocator calls made to create and destroy messages.
+
+            Counts both allocations and frees. With pooling enabled, this stops increasing once the pools have grown to the number of messages in flight. Sample it over time to get allocator calls per-second.
+
+            @returns The number of allocator calls made by this message factory.
+         */
+
+        uint64_t GetNumAllocatorCalls() const
+        {
+            return m_numAllocatorCalls;
+        }
+
         /**
             Get the number of message types supported by this message factory.
 
@@ -589,6 +1010,64 @@ namespace yojimbo
 
         virtual Message * CreateMessage( int type ) { (void) type; return NULL; }
 
+        /**
+            Allocate memory for a message.
+
+            Call this from an overridden MessageFactory::CreateMessage and construct the message in place, so messages can come from the pool for their type when pooling is enabled. YOJIMBO_DECLARE_MESSAGE_TYPE does this for you.
+
+            @param type The type of message being created.
+            @param bytes The size of the message object (bytes).
+
+            @returns The memory for the message, or NULL if the allocation failed.
+         */
+
+        void * AllocateMessage( int type, size_t bytes )
+        {
+            assert( type >= 0 );
+            assert( type < m_numTypes );
+            assert( m_allocator );
+
+            if ( !m_pools )
+            {
+                m_numAllocatorCalls++;
+                return YOJIMBO_ALLOCATE( *m_allocator, bytes );
+            }
+
+            MessagePool & pool = m_pools[type];
+
+            if ( !pool.messageBytes )
+                pool.messageBytes = int( ( bytes + CacheLineBytes - 1 ) / CacheLineBytes * CacheLineBytes );
+
+            assert( int( bytes ) <= pool.messageBytes );
+
+            if ( !pool.freeList )
+            {
+                // each chunk starts with a pointer to the previous chunk, followed by its messages starting on the next cache line
+
+                uint8_t * chunk = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( void* ) + CacheLineBytes - 1 + pool.numMessages * pool.messageBytes );
+                m_numAllocatorCalls++;
+
+                if ( !chunk )
+                    return NULL;
+
+                *( (void**) chunk ) = pool.chunks;
+                pool.chunks = chunk;
+
+                uint8_t * messages = (uint8_t*) ( ( uintptr_t( chunk ) + sizeof( void* ) + CacheLineBytes - 1 ) & ~uintptr_t( CacheLineBytes - 1 ) );
+
+                for ( int i = pool.numMessages - 1; i >= 0; --i )
+                {
+                    void * memory = messages + i * pool.messageBytes;
+                    *( (void**) memory ) = pool.freeList;
+                    pool.freeList = memory;
+                }
+            }
+
+            void * memory = pool.freeList;
+            pool.freeList = *( (void**) memory );
+            return memory;
+        }
+
         /**
             Set the message type of a message.
 
@@ -599,6 +1078,34 @@ namespace yojimbo
          */
 
         void SetMessageType( Message * message, int type ) { message->SetType( type ); }
+
+    private:
+
+        /**
+            Destroy a message and return its memory to the pool for its type, or free it back to the allocator if its type is not pooled.
+
+            @param message The message to destroy. Its reference count must be zero.
+         */
+
+        void DestroyMessage( Message * message )
+        {
+            assert( message );
+            assert( m_allocator );
+
+            const int type = message->GetType();
+
+            if ( m_pools && m_pools[type].messageBytes )
+            {
+                message->~Message();
+                *( (void**) message ) = m_pools[type].freeList;
+                m_pools[type].freeList = message;
+            }
+            else
+            {
+                m_numAllocatorCalls++;
+                YOJIMBO_DELETE( *m_allocator, Message, message );
+            }
+        }
     };
 }
 
@@ -628,6 +1135,8 @@ namespace yojimbo
                 return message;                                                                                                         \
             yojimbo::Allocator & allocator = GetAllocator();                                                                            \
             (void) allocator;                                                                                                           \
+            void * memory = NULL;                                                                                                       \
+            (void) memory;                                                                                                              \
             switch ( type )                                                                                                             \
             {                                                                                                                           \
 
@@ -645,9 +1154,10 @@ namespace yojimbo
 #define YOJIMBO_DECLARE_MESSAGE_TYPE( message_type, message_class )                                                                     \
                                                                                                                                         \
                 case message_type:                                                                                                      \
-                    message = YOJIMBO_NEW( allocator, message_class );                                                                  \
-                    if ( !message )                                                                                                     \
+                    memory = AllocateMessage( message_type, sizeof( message_class ) );                                                  \
+                    if ( !memory )                                                                                                      \
                         return NULL;                                                                                                    \
+                    message = new ( memory ) message_class();                                                                           \
                     SetMessageType( message, message_type );                                                                            \
                     return message;
 
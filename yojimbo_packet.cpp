@@ -106,9 +106,10 @@ namespace yojimbo
         if ( !info.rawFormat )
         {
             uint64_t network_protocolId = host_to_network( info.protocolId );
-            crc32 = calculate_crc32( (uint8_t*) &network_protocolId, 8 );
-            crc32 = calculate_crc32( buffer + info.prefixBytes, stream.GetBytesProcessed() - info.prefixBytes, crc32 );
-            *((uint32_t*)(buffer+info.prefixBytes)) = host_to_network( crc32 );
+            crc32 = calculate_checksum( info.checksumType, (uint8_t*) &network_protocolId, 8 );
+            crc32 = calculate_checksum( info.checksumType, buffer + info.prefixBytes, stream.GetBytesProcessed() - info.prefixBytes, crc32 );
+            const uint32_t network_crc32 = host_to_network( crc32 );
+            memcpy( buffer + info.prefixBytes, &network_crc32, 4 );
         }
 
         return stream.GetBytesProcessed();
@@ -154,10 +155,10 @@ namespace yojimbo
             }
 
             uint64_t network_protocolId = host_to_network( info.protocolId );
-            uint32_t crc32 = calculate_crc32( (const uint8_t*) &network_protocolId, 8 );
+            uint32_t crc32 = calculate_checksum( info.checksumType, (const uint8_t*) &network_protocolId, 8 );
             uint32_t zero = 0;
-            crc32 = calculate_crc32( (const uint8_t*) &zero, 4, crc32 );
-            crc32 = calculate_crc32( buffer + info.prefixBytes + 4, bufferSize - 4 - info.prefixBytes, crc32 );
+            crc32 = calculate_checksum( info.checksumType, (const uint8_t*) &zero, 4, crc32 );
+            crc32 = calculate_checksum( info.checksumType, buffer + info.prefixBytes + 4, bufferSize - 4 - info.prefixBytes, crc32 );
 
             if ( crc32 != read_crc32 )
             {
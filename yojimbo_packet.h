@@ -319,6 +319,8 @@ namespace yojimbo
     {
         bool rawFormat;                                                                 ///< If true then packets are written in "raw" format without crc32 (useful for encrypted packets which have packet signature elsewhere).
 
+        int checksumType;                                                               ///< The checksum prefixed to the packet, unless it is written in raw format. See yojimbo::ChecksumType.
+
         int prefixBytes;                                                                ///< Prefix this number of bytes when reading and writing packets. Used for the variable length sequence number at the start of encrypted packets.
 
         uint64_t protocolId;                                                            ///< Protocol id that distinguishes your protocol from other packets sent over UDP.
@@ -336,6 +338,7 @@ namespace yojimbo
         PacketReadWriteInfo()
         {
             rawFormat = false;
+            checksumType = CHECKSUM_CRC32;
             prefixBytes = 0;
             protocolId = 0;
             packetFactory = NULL;
@@ -349,7 +352,7 @@ namespace yojimbo
     /**
         Low-level function to write a packet to a byte buffer.
 
-        The packet is written to the byte buffer in wire format, with CRC32 prefixed to the packet, unless the packet is configured to write in raw format without CRC32.
+        The packet is written to the byte buffer in wire format, with a checksum prefixed to the packet, unless the packet is configured to write in raw format without a checksum. See PacketReadWriteInfo::checksumType.
 
         Packet encryption is done elsewhere. See PacketProcessor for details.
 
@@ -374,7 +377,7 @@ namespace yojimbo
     enum ReadPacketError
     {
         READ_PACKET_ERROR_NONE,                                     ///< Packet read OK.
-        READ_PACKET_ERROR_CRC32_MISMATCH,                           ///< Packet CRC32 check failed.
+        READ_PACKET_ERROR_CRC32_MISMATCH,                           ///< Packet checksum check failed. See PacketReadWriteInfo::checksumType.
         READ_PACKET_ERROR_CREATE_PACKET_FAILED,                     ///< Tried to create a packet but failed. The allocator backing the packet factory is probably out of memory.
         READ_PACKET_ERROR_PACKET_TYPE_NOT_ALLOWED,                  ///< Packet type is not one we are allowed to read. See PacketReadWriteInfo::allowedPacketTypes.
         READ_PACKET_ERROR_SERIALIZE_PACKET_HEADER,                  ///< Failed to serialize the packet header. One of the packet header elements returned false when serialized.
@@ -43,6 +43,8 @@ namespace yojimbo
 
         m_protocolId = protocolId;
 
+        m_checksumType = CHECKSUM_CRC32C;
+
         m_error = PACKET_PROCESSOR_ERROR_NONE;
 
         m_maxPacketSize = maxPacketSize + ( ( maxPacketSize % 4 ) ? ( 4 - ( maxPacketSize % 4 ) ) : 0 );
@@ -50,14 +52,18 @@ namespace yojimbo
         assert( m_maxPacketSize % 4 == 0 );
         assert( m_maxPacketSize >= maxPacketSize );
 
-        m_absoluteMaxPacketSize = maxPacketSize + MaxPrefixBytes + MacBytes;
+        m_absoluteMaxPacketSize = m_maxPacketSize + MaxPrefixBytes + MacBytes;
 
         m_context = NULL;
         m_userContext = NULL;
 
         m_packetBuffer = (uint8_t*) YOJIMBO_ALLOCATE( allocator, m_absoluteMaxPacketSize );
 
-        m_scratchBuffer = (uint8_t*) YOJIMBO_ALLOCATE( allocator, m_absoluteMaxPacketSize );
+        m_writeJobs = NULL;
+        m_numWriteJobs = 0;
+        m_readJobs = NULL;
+        m_numReadJobs = 0;
+        m_numJobShards = 0;
     }
 
     PacketProcessor::~PacketProcessor()
@@ -65,7 +71,6 @@ namespace yojimbo
         assert( m_allocator );
 
         YOJIMBO_FREE( *m_allocator, m_packetBuffer );
-        YOJIMBO_FREE( *m_allocator, m_scratchBuffer );
 
         m_allocator = NULL;
     }
@@ -80,100 +85,195 @@ namespace yojimbo
         m_userContext = context;
     }
 
+    void PacketProcessor::SetChecksumType( int checksumType )
+    {
+        assert( checksumType >= 0 );
+        assert( checksumType < CHECKSUM_NUM_VALUES );
+        m_checksumType = checksumType;
+    }
+
     static const int ENCRYPTED_PACKET_FLAG = (1<<7);
 
-    const uint8_t * PacketProcessor::WritePacket( Packet * packet, uint64_t sequence, int & packetBytes, bool encrypt, const uint8_t * key, Allocator & streamAllocator, PacketFactory & packetFactory )
+    static const int CRC32C_PACKET_FLAG = (1<<6);                    // only for unencrypted packets. encrypted packets use the low 7 bits of the prefix byte for the sequence
+
+    const uint8_t * PacketProcessor::WritePacket( Packet * packet, uint64_t sequence, int & packetBytes, bool encrypt, const uint8_t * key, int cipherSuite, const uint8_t * cipherState, Allocator & streamAllocator, PacketFactory & packetFactory )
     {
-        m_error = PACKET_PROCESSOR_ERROR_NONE;
+        m_error = WritePacketToBuffer( packet, sequence, encrypt, key, cipherSuite, cipherState, streamAllocator, packetFactory, m_context, m_userContext, m_packetBuffer, packetBytes );
+
+        return ( m_error == PACKET_PROCESSOR_ERROR_NONE ) ? m_packetBuffer : NULL;
+    }
 
+    int PacketProcessor::WritePacketToBuffer( Packet * packet, 
+                                              uint64_t sequence, 
+                                              bool encrypt, 
+                                              const uint8_t * key, 
+                                              int cipherSuite, 
+                                              const uint8_t * cipherState, 
+                                              Allocator & streamAllocator, 
+                                              PacketFactory & packetFactory, 
+                                              void * context, 
+                                              void * userContext, 
+                                              uint8_t * packetData, 
+                                              int & packetBytes ) const
+    {
         if ( encrypt )
         {
             if ( !key )
             {
                 debug_printf( "packet processor (write packet): key is null\n" );
-                m_error = PACKET_PROCESSOR_ERROR_KEY_IS_NULL;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_KEY_IS_NULL;
             }
 
             int prefixBytes;
-            compress_packet_sequence( sequence, m_scratchBuffer[0], prefixBytes, m_scratchBuffer+1 );
-            m_scratchBuffer[0] |= ENCRYPTED_PACKET_FLAG;
+            compress_packet_sequence( sequence, packetData[0], prefixBytes, packetData+1 );
+            packetData[0] |= ENCRYPTED_PACKET_FLAG;
             prefixBytes++;
 
             PacketReadWriteInfo info;
-            info.context = m_context;
-            info.userContext = m_userContext;
+            info.context = context;
+            info.userContext = userContext;
             info.protocolId = m_protocolId;
             info.packetFactory = &packetFactory;
             info.streamAllocator = &streamAllocator;
             info.rawFormat = 1;
 
-            packetBytes = yojimbo::WritePacket( info, packet, m_packetBuffer, m_maxPacketSize );
+            // serialize the packet after the prefix and the space for the MAC, then encrypt it where it is
+
+            uint8_t * mac = packetData + prefixBytes;
+
+            uint8_t * message = mac + MacBytes;
+
+            packetBytes = yojimbo::WritePacket( info, packet, message, m_maxPacketSize );
             if ( packetBytes <= 0 )
             {
                 debug_printf( "packet processor (write packet): write packet failed\n" );
-                m_error = PACKET_PROCESSOR_ERROR_WRITE_PACKET_FAILED;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_WRITE_PACKET_FAILED;
             }
 
             assert( packetBytes <= m_maxPacketSize );
 
-            int encryptedPacketSize;
-
-            if ( !Encrypt( m_packetBuffer,
-                           packetBytes,
-                           m_scratchBuffer + prefixBytes,
-                           encryptedPacketSize, 
-                           (uint8_t*) &sequence, key ) )
+            if ( !Encrypt_InPlace( message, packetBytes, mac, (uint8_t*) &sequence, key, cipherSuite, cipherState ) )
             {
                 debug_printf( "packet processor (write packet): encrypt packet failed\n" );
-                m_error = PACKET_PROCESSOR_ERROR_ENCRYPT_FAILED;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_ENCRYPT_FAILED;
             }
             
-            packetBytes = prefixBytes + encryptedPacketSize;
+            packetBytes += prefixBytes + MacBytes;
 
             assert( packetBytes <= m_absoluteMaxPacketSize );
-
-            return m_scratchBuffer;
         }
         else
         {
             PacketReadWriteInfo info;
-            info.context = m_context;
-            info.userContext = m_userContext;
+            info.context = context;
+            info.userContext = userContext;
             info.protocolId = m_protocolId;
             info.packetFactory = &packetFactory;
             info.streamAllocator = &streamAllocator;
             info.prefixBytes = 1;
+            info.checksumType = m_checksumType;
 
-            packetBytes = yojimbo::WritePacket( info, packet, m_packetBuffer, m_maxPacketSize );
+            packetBytes = yojimbo::WritePacket( info, packet, packetData, m_maxPacketSize );
 
             if ( packetBytes <= 0 )
             {
                 debug_printf( "packet processor (write packet): write packet failed (unencrypted)\n" );
-                m_error = PACKET_PROCESSOR_ERROR_WRITE_PACKET_FAILED;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_WRITE_PACKET_FAILED;
             }
 
+            if ( m_checksumType == CHECKSUM_CRC32C )
+                packetData[0] = CRC32C_PACKET_FLAG;
+
             assert( packetBytes <= m_maxPacketSize );
+        }
+
+        return PACKET_PROCESSOR_ERROR_NONE;
+    }
+
+    void PacketProcessor::WritePackets( PacketWriteJob * jobs, int numJobs, WorkerPool * workerPool )
+    {
+        assert( jobs || numJobs == 0 );
+
+        const int numWorkers = workerPool ? workerPool->GetNumWorkers() : 1;
+
+        m_writeJobs = jobs;
+        m_numWriteJobs = numJobs;
+        m_numJobShards = numWorkers;
+
+        // one item per-shard. each worker walks the job list and writes the jobs in its shards
+
+        if ( workerPool && numJobs > 1 )
+            workerPool->Run( WritePacketsWorker, this, numWorkers );
+        else
+            WritePacketsWorker( this, 0, 0, numWorkers );
+
+        m_writeJobs = NULL;
+        m_numWriteJobs = 0;
+        m_numJobShards = 0;
+    }
+
+    void PacketProcessor::WritePacketsWorker( void * data, int workerIndex, int begin, int end )
+    {
+        (void) workerIndex;
+
+        const PacketProcessor * processor = (const PacketProcessor*) data;
+
+        for ( int i = 0; i < processor->m_numWriteJobs; ++i )
+        {
+            PacketWriteJob & job = processor->m_writeJobs[i];
+
+            assert( job.shard >= 0 );
+
+            const int shard = job.shard % processor->m_numJobShards;
+
+            if ( shard < begin || shard >= end )
+                continue;
 
-            return m_packetBuffer;
+            assert( job.packet );
+            assert( job.streamAllocator );
+            assert( job.packetFactory );
+            assert( job.packetData );
+
+            job.error = processor->WritePacketToBuffer( job.packet, job.sequence, job.encrypt, job.key, job.cipherSuite, job.cipherState, *job.streamAllocator, *job.packetFactory, job.context, job.userContext, job.packetData, job.packetBytes );
         }
     }
 
-    Packet * PacketProcessor::ReadPacket( const uint8_t * packetData, 
+    Packet * PacketProcessor::ReadPacket( uint8_t * packetData, 
                                           uint64_t & sequence, 
                                           int packetBytes, 
                                           bool & encrypted,  
                                           const uint8_t * key, 
+                                          int cipherSuite, 
+                                          const uint8_t * cipherState, 
                                           const uint8_t * encryptedPacketTypes, 
                                           const uint8_t * unencryptedPacketTypes,
                                           Allocator & streamAllocator,
                                           PacketFactory & packetFactory,
                                           ReplayProtection * replayProtection )
     {
-        m_error = PACKET_PROCESSOR_ERROR_NONE;
+        Packet * packet = NULL;
+
+        m_error = ReadPacketFromBuffer( packetData, packetBytes, key, cipherSuite, cipherState, encryptedPacketTypes, unencryptedPacketTypes, streamAllocator, packetFactory, replayProtection, m_context, packet, sequence, encrypted );
+
+        return packet;
+    }
+
+    int PacketProcessor::ReadPacketFromBuffer( uint8_t * packetData, 
+                                               int packetBytes, 
+                                               const uint8_t * key, 
+                                               int cipherSuite, 
+                                               const uint8_t * cipherState, 
+                                               const uint8_t * encryptedPacketTypes, 
+                                               const uint8_t * unencryptedPacketTypes, 
+                                               Allocator & streamAllocator, 
+                                               PacketFactory & packetFactory, 
+                                               ReplayProtection * replayProtection, 
+                                               void * context, 
+                                               Packet * & packet, 
+                                               uint64_t & sequence, 
+                                               bool & encrypted ) const
+    {
+        packet = NULL;
 
         const uint8_t prefixByte = packetData[0];
 
@@ -184,8 +284,7 @@ namespace yojimbo
             if ( !key )
             {
                 debug_printf( "packet processor (read packet): key is null\n" );
-                m_error = PACKET_PROCESSOR_ERROR_KEY_IS_NULL;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_KEY_IS_NULL;
             }
 
             const int sequenceBytes = get_packet_sequence_bytes( prefixByte );
@@ -195,8 +294,7 @@ namespace yojimbo
             if ( packetBytes <= prefixBytes + MacBytes )
             {
                 debug_printf( "packet processor (read packet): packet is too small\n" );
-                m_error = PACKET_PROCESSOR_ERROR_PACKET_TOO_SMALL;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_PACKET_TOO_SMALL;
             }
 
             sequence = decompress_packet_sequence( prefixByte, packetData + 1 );
@@ -204,21 +302,25 @@ namespace yojimbo
             if ( replayProtection && replayProtection->PacketAlreadyReceived( sequence ) )
             {
                 debug_printf( "packet processor (read packet): packet already received - replay protection\n" );
-                m_error = PACKET_PROCESSOR_ERROR_PACKET_ALREADY_RECEIVED;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_PACKET_ALREADY_RECEIVED;
             }
 
-            int decryptedPacketBytes;
+            // decrypt in place and read the packet straight out of the packet data, just after the MAC
+
+            const uint8_t * mac = packetData + prefixBytes;
+
+            uint8_t * message = packetData + prefixBytes + MacBytes;
 
-            if ( !Decrypt( packetData + prefixBytes, packetBytes - prefixBytes, m_scratchBuffer, decryptedPacketBytes, (uint8_t*)&sequence, key ) )
+            const int decryptedPacketBytes = packetBytes - prefixBytes - MacBytes;
+
+            if ( !Decrypt_InPlace( message, decryptedPacketBytes, mac, (uint8_t*)&sequence, key, cipherSuite, cipherState ) )
             {
                 debug_printf( "packet processor (read packet): decrypt failed\n" );
-                m_error = PACKET_PROCESSOR_ERROR_DECRYPT_FAILED;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_DECRYPT_FAILED;
             }
 
             PacketReadWriteInfo info;
-            info.context = m_context;
+            info.context = context;
             info.protocolId = m_protocolId;
             info.packetFactory = &packetFactory;
             info.streamAllocator = &streamAllocator;
@@ -227,41 +329,86 @@ namespace yojimbo
 
             ReadPacketError readPacketError;
             
-            Packet * packet = yojimbo::ReadPacket( info, m_scratchBuffer, decryptedPacketBytes, &readPacketError );
+            packet = yojimbo::ReadPacket( info, message, decryptedPacketBytes, &readPacketError );
 
             if ( !packet )
             {
                 debug_printf( "packet processor (read packet): read packet failed - error code %d (encrypted)\n", readPacketError );
-                m_error = PACKET_PROCESSOR_ERROR_READ_PACKET_FAILED;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_READ_PACKET_FAILED;
             }
-
-            return packet;
         }
         else
         {
             PacketReadWriteInfo info;
-            info.context = m_context;
+            info.context = context;
             info.protocolId = m_protocolId;
             info.packetFactory = &packetFactory;
             info.streamAllocator = &streamAllocator;
             info.allowedPacketTypes = unencryptedPacketTypes;
             info.prefixBytes = 1;
+            info.checksumType = ( prefixByte & CRC32C_PACKET_FLAG ) ? CHECKSUM_CRC32C : CHECKSUM_CRC32;
 
             sequence = 0;
             
             ReadPacketError readPacketError;
 
-            Packet * packet = yojimbo::ReadPacket( info, packetData, packetBytes, &readPacketError );
+            packet = yojimbo::ReadPacket( info, packetData, packetBytes, &readPacketError );
 
             if ( !packet )
             {
                 debug_printf( "packet processor (read packet): read packet failed - error code = %d (unencrypted)\n", readPacketError );
-                m_error = PACKET_PROCESSOR_ERROR_READ_PACKET_FAILED;
-                return NULL;
+                return PACKET_PROCESSOR_ERROR_READ_PACKET_FAILED;
             }
-            
-            return packet;
+        }
+
+        return PACKET_PROCESSOR_ERROR_NONE;
+    }
+
+    void PacketProcessor::ReadPackets( PacketReadJob * jobs, int numJobs, WorkerPool * workerPool )
+    {
+        assert( jobs || numJobs == 0 );
+
+        const int numWorkers = workerPool ? workerPool->GetNumWorkers() : 1;
+
+        m_readJobs = jobs;
+        m_numReadJobs = numJobs;
+        m_numJobShards = numWorkers;
+
+        if ( workerPool && numJobs > 1 )
+            workerPool->Run( ReadPacketsWorker, this, numWorkers );
+        else
+            ReadPacketsWorker( this, 0, 0, numWorkers );
+
+        m_readJobs = NULL;
+        m_numReadJobs = 0;
+        m_numJobShards = 0;
+    }
+
+    void PacketProcessor::ReadPacketsWorker( void * data, int workerIndex, int begin, int end )
+    {
+        (void) workerIndex;
+
+        const PacketProcessor * processor = (const PacketProcessor*) data;
+
+        for ( int i = 0; i < processor->m_numReadJobs; ++i )
+        {
+            PacketReadJob & job = processor->m_readJobs[i];
+
+            assert( job.shard >= 0 );
+
+            const int shard = job.shard % processor->m_numJobShards;
+
+            if ( shard < begin || shard >= end )
+                continue;
+
+            assert( job.packetData );
+            assert( job.packetBytes > 0 );
+            assert( job.streamAllocator );
+            assert( job.packetFactory );
+
+            job.sequence = 0;
+
+            job.error = processor->ReadPacketFromBuffer( job.packetData, job.packetBytes, job.key, job.cipherSuite, job.cipherState, job.encryptedPacketTypes, job.unencryptedPacketTypes, *job.streamAllocator, *job.packetFactory, job.replayProtection, job.context, job.packet, job.sequence, job.encrypted );
         }
     }
 }
@@ -27,6 +27,7 @@
 
 #include "yojimbo_config.h"
 #include "yojimbo_packet.h"
+#include "yojimbo_worker_pool.h"
 
 /** @file */
 
@@ -50,6 +51,56 @@ namespace yojimbo
         PACKET_PROCESSOR_ERROR_DECRYPT_FAILED,                  ///< Decrypt packet failed.
     };
 
+    /**
+        A packet to write with PacketProcessor::WritePackets.
+
+        The caller fills in everything except packetBytes and error, which are set when the packet is written.
+     */
+
+    struct PacketWriteJob
+    {
+        Packet * packet;                                        ///< The packet to write.
+        uint64_t sequence;                                      ///< The sequence number of the packet. Used as the nonce for encrypted packets.
+        bool encrypt;                                           ///< Should this packet be encrypted?
+        const uint8_t * key;                                    ///< The key used for packet encryption.
+        int cipherSuite;                                        ///< The cipher suite used for packet encryption. See yojimbo::CipherSuite.
+        const uint8_t * cipherState;                            ///< Cipher state expanded from the key. Optional. NULL to use the key directly. See yojimbo::InitializeCipherState.
+        Allocator * streamAllocator;                            ///< The allocator to set on the stream. See BaseStream::GetAllocator.
+        PacketFactory * packetFactory;                          ///< The packet factory so we know the range of packet types supported.
+        void * context;                                         ///< Context to set on the stream. See BaseStream::SetContext.
+        void * userContext;                                     ///< User context to set on the stream. See BaseStream::SetUserContext.
+        int shard;                                              ///< Jobs with the same shard are always written on the same thread. Jobs that share a stream allocator or packet factory must have the same shard.
+        uint8_t * packetData;                                   ///< The buffer to write packet data to. Must be at least PacketProcessor::GetAbsoluteMaxPacketSize bytes.
+        int packetBytes;                                        ///< The number of bytes of packet data written [out].
+        int error;                                              ///< The packet processor error code for this packet [out]. PACKET_PROCESSOR_ERROR_NONE if the packet was written.
+    };
+
+    /**
+        A packet to read with PacketProcessor::ReadPackets.
+
+        The caller fills in everything except the output fields: packet, sequence, encrypted and error. These are set when the packet is read.
+     */
+
+    struct PacketReadJob
+    {
+        uint8_t * packetData;                                   ///< The packet data to read. Encrypted packets are decrypted in place, so this is modified.
+        int packetBytes;                                        ///< The number of bytes of packet data to read.
+        const uint8_t * key;                                    ///< The key used to decrypt the packet, if it is encrypted.
+        int cipherSuite;                                        ///< The cipher suite used to decrypt the packet, if it is encrypted. See yojimbo::CipherSuite.
+        const uint8_t * cipherState;                            ///< Cipher state expanded from the key. Optional. NULL to use the key directly. See yojimbo::InitializeCipherState.
+        const uint8_t * encryptedPacketTypes;                   ///< Entry n is 1 if packet type n is encrypted. See PacketProcessor::ReadPacket.
+        const uint8_t * unencryptedPacketTypes;                 ///< Entry n is 1 if packet type n is unencrypted. See PacketProcessor::ReadPacket.
+        Allocator * streamAllocator;                            ///< The allocator to set on the stream. See BaseStream::GetAllocator.
+        PacketFactory * packetFactory;                          ///< The packet factory used to create the packet.
+        ReplayProtection * replayProtection;                    ///< The replay protection buffer. Optional. NULL if not used.
+        void * context;                                         ///< Context to set on the stream. See BaseStream::SetContext.
+        int shard;                                              ///< Jobs with the same shard are always read on the same thread, in the order they appear in the job array. Jobs that share a stream allocator, packet factory or replay protection buffer must have the same shard.
+        Packet * packet;                                        ///< The packet object that was read [out]. NULL if the read failed. The caller is responsible for destroying it.
+        uint64_t sequence;                                      ///< The packet sequence number [out]. Set to 0 for unencrypted packets.
+        bool encrypted;                                         ///< Set to true if the packet is encrypted [out].
+        int error;                                              ///< The packet processor error code for this packet [out]. PACKET_PROCESSOR_ERROR_NONE if the packet was read.
+    };
+
     /**
         Adds packet encryption and decryption on top of low-level read and write packet functions.
 
@@ -93,6 +144,24 @@ namespace yojimbo
 
         void SetUserContext( void * context );
 
+        /**
+            Set the checksum written with unencrypted packets.
+
+            Each unencrypted packet records its checksum type in the prefix byte, so packets written with either checksum can be read, whatever this is set to. Defaults to yojimbo::CHECKSUM_CRC32C.
+
+            @param checksumType The checksum type. See yojimbo::ChecksumType.
+         */
+
+        void SetChecksumType( int checksumType );
+
+        /**
+            Get the checksum written with unencrypted packets.
+
+            @returns The checksum type. See yojimbo::ChecksumType.
+         */
+
+        int GetChecksumType() const { return m_checksumType; }
+
         /**
             Write a packet.
 
@@ -101,22 +170,40 @@ namespace yojimbo
             @param packetBytes The number of bytes of packet data written [out].
             @param encrypt Should this packet be encrypted?
             @param key The key used for packet encryption.
+            @param cipherSuite The cipher suite used for packet encryption. See yojimbo::CipherSuite.
+            @param cipherState Cipher state expanded from the key. Optional. Pass in NULL to use the key directly. See yojimbo::InitializeCipherState.
             @param streamAllocator The allocator to set on the stream. See BaseStream::GetAllocator.
             @param packetFactory The packet factory so we know the range of packet types supported.
 
             @returns A pointer to the packet data written. NULL if the packet write failed. This is an internal scratch buffer. Do not cache it and do not free it.
          */
 
-        const uint8_t * WritePacket( Packet * packet, uint64_t sequence, int & packetBytes, bool encrypt, const uint8_t * key, Allocator & streamAllocator, PacketFactory & packetFactory );
+        const uint8_t * WritePacket( Packet * packet, uint64_t sequence, int & packetBytes, bool encrypt, const uint8_t * key, int cipherSuite, const uint8_t * cipherState, Allocator & streamAllocator, PacketFactory & packetFactory );
+
+        /**
+            Write a batch of packets, splitting the work across a worker pool.
+
+            Each worker serializes and encrypts each packet in place, in the buffer in its job. Jobs are split across workers by shard, so jobs sharing a stream allocator are never written on two threads at the same time.
+
+            The packet processor error is not set. Check the error in each job instead.
+
+            @param jobs The array of packet write jobs.
+            @param numJobs The number of jobs in the array.
+            @param workerPool The worker pool to run on. Pass in NULL to write all packets on the calling thread.
+         */
+
+        void WritePackets( PacketWriteJob * jobs, int numJobs, WorkerPool * workerPool );
 
         /**
             Read a packet.
 
-            @param packetData The packet data to read.
+            @param packetData The packet data to read. Encrypted packets are decrypted in place, so this is modified.
             @param sequence The packet sequence number [out]. Only set for encrypted packets. Set to 0 for unencrypted packets.
             @param packetBytes The number of bytes of packet data to read.
             @param encrypted Set to true if the packet is encrypted [out].
             @param key The key used to decrypt the packet, if it is encrypted.
+            @param cipherSuite The cipher suite used to decrypt the packet, if it is encrypted. See yojimbo::CipherSuite.
+            @param cipherState Cipher state expanded from the key. Optional. Pass in NULL to use the key directly. See yojimbo::InitializeCipherState.
             @param encryptedPacketTypes Entry n is 1 if packet type n is encrypted. Passed into the low-level packet read as the set of allowed packet types, if the packet is encrypted.
             @param unencryptedPacketTypes Entry n is 1 if packet type n is unencrypted. Passed into the low-level packet read as the set of allowed packet types, if the packet is not encrypted.
             @param streamAllocator The allocator to set on the stream. See BaseStream::GetAllocator.
@@ -126,7 +213,21 @@ namespace yojimbo
             @returns The packet object if it was successfully read, NULL otherwise. You are responsible for destroying the packet created by this function.
          */
 
-        Packet * ReadPacket( const uint8_t * packetData, uint64_t & sequence, int packetBytes, bool & encrypted, const uint8_t * key, const uint8_t * encryptedPacketTypes, const uint8_t * unencryptedPacketTypes, Allocator & streamAllocator, PacketFactory & packetFactory, ReplayProtection * replayProtection );
+        Packet * ReadPacket( uint8_t * packetData, uint64_t & sequence, int packetBytes, bool & encrypted, const uint8_t * key, int cipherSuite, const uint8_t * cipherState, const uint8_t * encryptedPacketTypes, const uint8_t * unencryptedPacketTypes, Allocator & streamAllocator, PacketFactory & packetFactory, ReplayProtection * replayProtection );
+
+        /**
+            Read a batch of packets, splitting the work across a worker pool.
+
+            Each worker decrypts each packet in place, in the packet data in its job, then deserializes it from there. Jobs are split across workers by shard, and each worker reads the jobs in its shards in array order, so replay protection sees packets in the same order as it would reading them one at a time.
+
+            The packet processor error is not set. Check the error in each job instead.
+
+            @param jobs The array of packet read jobs.
+            @param numJobs The number of jobs in the array.
+            @param workerPool The worker pool to run on. Pass in NULL to read all packets on the calling thread.
+         */
+
+        void ReadPackets( PacketReadJob * jobs, int numJobs, WorkerPool * workerPool );
 
         /**
             Gets the maximum packet size to be generated.
@@ -136,6 +237,14 @@ namespace yojimbo
 
         int GetMaxPacketSize() const { return m_maxPacketSize; }
 
+        /**
+            Gets the absolute maximum size of a packet written by this packet processor, including header and encryption overhead.
+
+            @returns The absolute maximum packet size in bytes. Packet data returned by PacketProcessor::WritePacket is never larger than this.
+         */
+
+        int GetAbsoluteMaxPacketSize() const { return m_absoluteMaxPacketSize; }
+
         /**
             Get the packet processor error level.
 
@@ -149,11 +258,23 @@ namespace yojimbo
 
         int GetError() const { return m_error; }
 
+    protected:
+
+        int WritePacketToBuffer( Packet * packet, uint64_t sequence, bool encrypt, const uint8_t * key, int cipherSuite, const uint8_t * cipherState, Allocator & streamAllocator, PacketFactory & packetFactory, void * context, void * userContext, uint8_t * packetData, int & packetBytes ) const;
+
+        static void WritePacketsWorker( void * data, int workerIndex, int begin, int end );
+
+        int ReadPacketFromBuffer( uint8_t * packetData, int packetBytes, const uint8_t * key, int cipherSuite, const uint8_t * cipherState, const uint8_t * encryptedPacketTypes, const uint8_t * unencryptedPacketTypes, Allocator & streamAllocator, PacketFactory & packetFactory, ReplayProtection * replayProtection, void * context, Packet * & packet, uint64_t & sequence, bool & encrypted ) const;
+
+        static void ReadPacketsWorker( void * data, int workerIndex, int begin, int end );
+
     private:
 
         Allocator * m_allocator;                            ///< The allocator passed in to the constructor.
 
-        uint64_t m_protocolId;                              ///< The protocol id. This is used as part of the CRC32 for unencrypted packets.
+        uint64_t m_protocolId;                              ///< The protocol id. This is used as part of the checksum for unencrypted packets.
+
+        int m_checksumType;                                 ///< The checksum written with unencrypted packets. See yojimbo::ChecksumType.
 
         int m_error;                                        ///< The error level. 
 
@@ -161,9 +282,17 @@ namespace yojimbo
 
         int m_absoluteMaxPacketSize;                        ///< The absolute maximum packet size, considering header and encryption overhead.
         
-        uint8_t * m_packetBuffer;                           ///< The packet buffer for reading and writing packets.
-        
-        uint8_t * m_scratchBuffer;                          ///< Scratch buffer used when one packet buffer is just not enough.
+        uint8_t * m_packetBuffer;                           ///< The buffer packets are written to by PacketProcessor::WritePacket. Packets are serialized and encrypted in place, so this is the only buffer needed.
+
+        PacketWriteJob * m_writeJobs;                       ///< The jobs passed in to the current call to PacketProcessor::WritePackets.
+
+        int m_numWriteJobs;                                 ///< The number of jobs passed in to the current call to PacketProcessor::WritePackets.
+
+        PacketReadJob * m_readJobs;                         ///< The jobs passed in to the current call to PacketProcessor::ReadPackets.
+
+        int m_numReadJobs;                                  ///< The number of jobs passed in to the current call to PacketProcessor::ReadPackets.
+
+        int m_numJobShards;                                 ///< The number of shards jobs are split into for the current call to PacketProcessor::WritePackets or PacketProcessor::ReadPackets.
 
         void * m_context;                                   ///< Context to set on stream.
 
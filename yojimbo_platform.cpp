@@ -24,6 +24,7 @@
 
 #include "yojimbo_config.h"
 #include "yojimbo_platform.h"
+#include "yojimbo_allocator.h"
 #include <assert.h>
 
 #if __APPLE__
@@ -62,6 +63,12 @@ namespace yojimbo
 
         return ( double( current - start ) * double( timebase_info.numer ) / double( timebase_info.denom ) ) / 1000000000.0;
     }
+
+    int platform_num_cores()
+    {
+        const long numCores = sysconf( _SC_NPROCESSORS_ONLN );
+        return numCores > 0 ? int( numCores ) : 1;
+    }
 }
 
 #elif __linux
@@ -97,6 +104,12 @@ namespace yojimbo
         double current = ts.tv_sec + double( ts.tv_nsec ) / 1000000000.0;
         return current - start;
     }
+
+    int platform_num_cores()
+    {
+        const long numCores = sysconf( _SC_NPROCESSORS_ONLN );
+        return numCores > 0 ? int( numCores ) : 1;
+    }
 }
 
 #elif defined(_WIN32)
@@ -132,6 +145,13 @@ namespace yojimbo
         QueryPerformanceCounter( &now );
         return double( now.QuadPart - timer_start.QuadPart ) / double( timer_frequency.QuadPart );
     }
+
+    int platform_num_cores()
+    {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo( &systemInfo );
+        return systemInfo.dwNumberOfProcessors > 0 ? int( systemInfo.dwNumberOfProcessors ) : 1;
+    }
 }
 
 #else
@@ -139,3 +159,296 @@ namespace yojimbo
 #error unsupported platform!
 
 #endif
+
+#if defined(_WIN32)
+
+// ===============================
+//        Windows threads
+// ===============================
+
+namespace yojimbo
+{
+    struct PlatformThread
+    {
+        HANDLE handle;
+        PlatformThreadFunction function;
+        void * data;
+    };
+
+    struct PlatformMutex
+    {
+        CRITICAL_SECTION handle;
+    };
+
+    struct PlatformSemaphore
+    {
+        HANDLE handle;
+    };
+
+    static DWORD WINAPI platform_thread_function( LPVOID data )
+    {
+        PlatformThread * thread = (PlatformThread*) data;
+        thread->function( thread->data );
+        return 0;
+    }
+
+    PlatformThread * platform_thread_create( Allocator & allocator, PlatformThreadFunction function, void * data )
+    {
+        assert( function );
+
+        PlatformThread * thread = YOJIMBO_NEW( allocator, PlatformThread );
+        if ( !thread )
+            return NULL;
+
+        thread->function = function;
+        thread->data = data;
+        thread->handle = CreateThread( NULL, 0, platform_thread_function, thread, 0, NULL );
+
+        if ( thread->handle == NULL )
+        {
+            YOJIMBO_DELETE( allocator, PlatformThread, thread );
+            return NULL;
+        }
+
+        return thread;
+    }
+
+    void platform_thread_join( PlatformThread * thread )
+    {
+        assert( thread );
+        WaitForSingleObject( thread->handle, INFINITE );
+    }
+
+    void platform_thread_destroy( Allocator & allocator, PlatformThread * thread )
+    {
+        assert( thread );
+        CloseHandle( thread->handle );
+        YOJIMBO_DELETE( allocator, PlatformThread, thread );
+    }
+
+    PlatformMutex * platform_mutex_create( Allocator & allocator )
+    {
+        PlatformMutex * mutex = YOJIMBO_NEW( allocator, PlatformMutex );
+        if ( !mutex )
+            return NULL;
+        InitializeCriticalSectionAndSpinCount( &mutex->handle, 0xFF );
+        return mutex;
+    }
+
+    void platform_mutex_acquire( PlatformMutex * mutex )
+    {
+        assert( mutex );
+        EnterCriticalSection( &mutex->handle );
+    }
+
+    void platform_mutex_release( PlatformMutex * mutex )
+    {
+        assert( mutex );
+        LeaveCriticalSection( &mutex->handle );
+    }
+
+    void platform_mutex_destroy( Allocator & allocator, PlatformMutex * mutex )
+    {
+        assert( mutex );
+        DeleteCriticalSection( &mutex->handle );
+        YOJIMBO_DELETE( allocator, PlatformMutex, mutex );
+    }
+
+    PlatformSemaphore * platform_semaphore_create( Allocator & allocator, int initialCount )
+    {
+        assert( initialCount >= 0 );
+
+        PlatformSemaphore * semaphore = YOJIMBO_NEW( allocator, PlatformSemaphore );
+        if ( !semaphore )
+            return NULL;
+
+        semaphore->handle = CreateSemaphore( NULL, initialCount, 0x7FFFFFFF, NULL );
+
+        if ( semaphore->handle == NULL )
+        {
+            YOJIMBO_DELETE( allocator, PlatformSemaphore, semaphore );
+            return NULL;
+        }
+
+        return semaphore;
+    }
+
+    void platform_semaphore_signal( PlatformSemaphore * semaphore )
+    {
+        assert( semaphore );
+        ReleaseSemaphore( semaphore->handle, 1, NULL );
+    }
+
+    void platform_semaphore_wait( PlatformSemaphore * semaphore )
+    {
+        assert( semaphore );
+        WaitForSingleObject( semaphore->handle, INFINITE );
+    }
+
+    void platform_semaphore_destroy( Allocator & allocator, PlatformSemaphore * semaphore )
+    {
+        assert( semaphore );
+        CloseHandle( semaphore->handle );
+        YOJIMBO_DELETE( allocator, PlatformSemaphore, semaphore );
+    }
+}
+
+#else // #if defined(_WIN32)
+
+// ===============================
+//     MacOS and Linux threads
+// ===============================
+
+#include <pthread.h>
+
+namespace yojimbo
+{
+    struct PlatformThread
+    {
+        pthread_t handle;
+        PlatformThreadFunction function;
+        void * data;
+    };
+
+    struct PlatformMutex
+    {
+        pthread_mutex_t handle;
+    };
+
+    // unnamed posix semaphores are not supported on MacOS, so build one from a mutex and condition variable
+
+    struct PlatformSemaphore
+    {
+        pthread_mutex_t mutex;
+        pthread_cond_t condition;
+        int count;
+    };
+
+    static void * platform_thread_function( void * data )
+    {
+        PlatformThread * thread = (PlatformThread*) data;
+        thread->function( thread->data );
+        return NULL;
+    }
+
+    PlatformThread * platform_thread_create( Allocator & allocator, PlatformThreadFunction function, void * data )
+    {
+        assert( function );
+
+        PlatformThread * thread = YOJIMBO_NEW( allocator, PlatformThread );
+        if ( !thread )
+            return NULL;
+
+        thread->function = function;
+        thread->data = data;
+
+        if ( pthread_create( &thread->handle, NULL, platform_thread_function, thread ) != 0 )
+        {
+            YOJIMBO_DELETE( allocator, PlatformThread, thread );
+            return NULL;
+        }
+
+        return thread;
+    }
+
+    void platform_thread_join( PlatformThread * thread )
+    {
+        assert( thread );
+        pthread_join( thread->handle, NULL );
+    }
+
+    void platform_thread_destroy( Allocator & allocator, PlatformThread * thread )
+    {
+        assert( thread );
+        YOJIMBO_DELETE( allocator, PlatformThread, thread );
+    }
+
+    PlatformMutex * platform_mutex_create( Allocator & allocator )
+    {
+        PlatformMutex * mutex = YOJIMBO_NEW( allocator, PlatformMutex );
+        if ( !mutex )
+            return NULL;
+
+        if ( pthread_mutex_init( &mutex->handle, NULL ) != 0 )
+        {
+            YOJIMBO_DELETE( allocator, PlatformMutex, mutex );
+            return NULL;
+        }
+
+        return mutex;
+    }
+
+    void platform_mutex_acquire( PlatformMutex * mutex )
+    {
+        assert( mutex );
+        pthread_mutex_lock( &mutex->handle );
+    }
+
+    void platform_mutex_release( PlatformMutex * mutex )
+    {
+        assert( mutex );
+        pthread_mutex_unlock( &mutex->handle );
+    }
+
+    void platform_mutex_destroy( Allocator & allocator, PlatformMutex * mutex )
+    {
+        assert( mutex );
+        pthread_mutex_destroy( &mutex->handle );
+        YOJIMBO_DELETE( allocator, PlatformMutex, mutex );
+    }
+
+    PlatformSemaphore * platform_semaphore_create( Allocator & allocator, int initialCount )
+    {
+        assert( initialCount >= 0 );
+
+        PlatformSemaphore * semaphore = YOJIMBO_NEW( allocator, PlatformSemaphore );
+        if ( !semaphore )
+            return NULL;
+
+        if ( pthread_mutex_init( &semaphore->mutex, NULL ) != 0 )
+        {
+            YOJIMBO_DELETE( allocator, PlatformSemaphore, semaphore );
+            return NULL;
+        }
+
+        if ( pthread_cond_init( &semaphore->condition, NULL ) != 0 )
+        {
+            pthread_mutex_destroy( &semaphore->mutex );
+            YOJIMBO_DELETE( allocator, PlatformSemaphore, semaphore );
+            return NULL;
+        }
+
+        semaphore->count = initialCount;
+
+        return semaphore;
+    }
+
+    void platform_semaphore_signal( PlatformSemaphore * semaphore )
+    {
+        assert( semaphore );
+        pthread_mutex_lock( &semaphore->mutex );
+        semaphore->count++;
+        pthread_cond_signal( &semaphore->condition );
+        pthread_mutex_unlock( &semaphore->mutex );
+    }
+
+    void platform_semaphore_wait( PlatformSemaphore * semaphore )
+    {
+        assert( semaphore );
+        pthread_mutex_lock( &semaphore->mutex );
+        while ( semaphore->count == 0 )
+            pthread_cond_wait( &semaphore->condition, &semaphore->mutex );
+        semaphore->count--;
+        pthread_mutex_unlock( &semaphore->mutex );
+    }
+
+    void platform_semaphore_destroy( Allocator & allocator, PlatformSemaphore * semaphore )
+    {
+        assert( semaphore );
+        pthread_cond_destroy( &semaphore->condition );
+        pthread_mutex_destroy( &semaphore->mutex );
+        YOJIMBO_DELETE( allocator, PlatformSemaphore, semaphore );
+    }
+}
+
+#endif // #if defined(_WIN32)
@@ -27,6 +27,10 @@
 
 #include "yojimbo_config.h"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif // #if defined(_MSC_VER)
+
 /** @file */
 
 namespace yojimbo
@@ -48,6 +52,263 @@ namespace yojimbo
      */
 
     double platform_time();
+
+    /**
+        Get the number of logical processor cores available.
+
+        Use this to decide how many worker threads to create, eg. ClientServerConfig::serverWorkerThreads.
+
+        @returns The number of logical cores. Always at least 1.
+     */
+
+    int platform_num_cores();
+
+    class Allocator;
+
+    /// Opaque platform thread handle. See platform_thread_create.
+
+    struct PlatformThread;
+
+    /// Opaque platform mutex handle. See platform_mutex_create.
+
+    struct PlatformMutex;
+
+    /// Opaque platform semaphore handle. See platform_semaphore_create.
+
+    struct PlatformSemaphore;
+
+    /// Thread entry point function. Takes the data pointer passed in to platform_thread_create.
+
+    typedef void (*PlatformThreadFunction)( void * data );
+
+    /**
+        Create a thread and start running it.
+
+        @param allocator The allocator used to allocate the thread handle.
+        @param function The function to run on the thread.
+        @param data The data passed in to the thread function.
+
+        @returns The thread handle, or NULL if the thread could not be created. You must call platform_thread_join and then platform_thread_destroy on the thread when you are done with it.
+     */
+
+    PlatformThread * platform_thread_create( Allocator & allocator, PlatformThreadFunction function, void * data );
+
+    /**
+        Wait for a thread to finish running.
+
+        @param thread The thread to wait for.
+     */
+
+    void platform_thread_join( PlatformThread * thread );
+
+    /**
+        Destroy a thread handle.
+
+        IMPORTANT: The thread must have finished running. See platform_thread_join.
+
+        @param allocator The allocator that was passed in to platform_thread_create.
+        @param thread The thread handle to destroy.
+     */
+
+    void platform_thread_destroy( Allocator & allocator, PlatformThread * thread );
+
+    /**
+        Create a mutex.
+
+        @param allocator The allocator used to allocate the mutex.
+
+        @returns The mutex, or NULL if the mutex could not be created.
+     */
+
+    PlatformMutex * platform_mutex_create( Allocator & allocator );
+
+    /**
+        Acquire a mutex. Blocks until the mutex is available.
+
+        @param mutex The mutex to acquire.
+     */
+
+    void platform_mutex_acquire( PlatformMutex * mutex );
+
+    /**
+        Release a mutex.
+
+        @param mutex The mutex to release. Must have been acquired by the calling thread.
+     */
+
+    void platform_mutex_release( PlatformMutex * mutex );
+
+    /**
+        Destroy a mutex.
+
+        @param allocator The allocator that was passed in to platform_mutex_create.
+        @param mutex The mutex to destroy.
+     */
+
+    void platform_mutex_destroy( Allocator & allocator, PlatformMutex * mutex );
+
+    /**
+        Create a semaphore.
+
+        @param allocator The allocator used to allocate the semaphore.
+        @param initialCount The initial count of the semaphore.
+
+        @returns The semaphore, or NULL if the semaphore could not be created.
+     */
+
+    PlatformSemaphore * platform_semaphore_create( Allocator & allocator, int initialCount );
+
+    /**
+        Increment the semaphore count, waking up a thread waiting on the semaphore if there is one.
+
+        @param semaphore The semaphore to signal.
+     */
+
+    void platform_semaphore_signal( PlatformSemaphore * semaphore );
+
+    /**
+        Wait until the semaphore count is greater than zero, then decrement it.
+
+        @param semaphore The semaphore to wait on.
+     */
+
+    void platform_semaphore_wait( PlatformSemaphore * semaphore );
+
+    /**
+        Destroy a semaphore.
+
+        @param allocator The allocator that was passed in to platform_semaphore_create.
+        @param semaphore The semaphore to destroy. No threads may be waiting on it.
+     */
+
+    void platform_semaphore_destroy( Allocator & allocator, PlatformSemaphore * semaphore );
+
+    /**
+        Load a 32 bit value shared between threads, with acquire semantics.
+
+        Writes made by another thread before its matching platform_atomic_store are visible after this returns.
+
+        @param value Pointer to the value to load.
+
+        @returns The value.
+     */
+
+    inline uint32_t platform_atomic_load( const volatile uint32_t * value )
+    {
+#if defined(_MSC_VER)
+        const uint32_t result = *value;
+        _ReadWriteBarrier();
+        return result;
+#else // #if defined(_MSC_VER)
+        return __atomic_load_n( value, __ATOMIC_ACQUIRE );
+#endif // #if defined(_MSC_VER)
+    }
+
+    /**
+        Store a 32 bit value shared between threads, with release semantics.
+
+        @param value Pointer to the value to store to.
+        @param newValue The value to store.
+     */
+
+    inline void platform_atomic_store( volatile uint32_t * value, uint32_t newValue )
+    {
+#if defined(_MSC_VER)
+        _ReadWriteBarrier();
+        *value = newValue;
+#else // #if defined(_MSC_VER)
+        __atomic_store_n( value, newValue, __ATOMIC_RELEASE );
+#endif // #if defined(_MSC_VER)
+    }
+
+    /**
+        Atomically replace a 32 bit value shared between threads, if it still has the expected value.
+
+        @param value Pointer to the value to replace.
+        @param expectedValue The value it must have for the replacement to happen.
+        @param newValue The new value.
+
+        @returns True if the value was replaced, false if another thread changed it first.
+     */
+
+    inline bool platform_atomic_compare_exchange( volatile uint32_t * value, uint32_t expectedValue, uint32_t newValue )
+    {
+#if defined(_MSC_VER)
+        return (uint32_t) _InterlockedCompareExchange( (volatile long*) value, (long) newValue, (long) expectedValue ) == expectedValue;
+#else // #if defined(_MSC_VER)
+        return __atomic_compare_exchange_n( value, &expectedValue, newValue, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+#endif // #if defined(_MSC_VER)
+    }
+
+    /**
+        Atomically increment a 32 bit value shared between threads.
+
+        @param value Pointer to the value to increment.
+
+        @returns The value after it was incremented.
+     */
+
+    inline uint32_t platform_atomic_increment( volatile uint32_t * value )
+    {
+#if defined(_MSC_VER)
+        return (uint32_t) _InterlockedIncrement( (volatile long*) value );
+#else // #if defined(_MSC_VER)
+        return __atomic_add_fetch( value, 1, __ATOMIC_RELAXED );
+#endif // #if defined(_MSC_VER)
+    }
+
+    /**
+        Atomically decrement a 32 bit value shared between threads.
+
+        Writes made by other threads before their own decrement are visible after this returns, so whoever sees the value reach zero can safely free what it counts references to.
+
+        @param value Pointer to the value to decrement.
+
+        @returns The value after it was decremented.
+     */
+
+    inline uint32_t platform_atomic_decrement( volatile uint32_t * value )
+    {
+#if defined(_MSC_VER)
+        return (uint32_t) _InterlockedDecrement( (volatile long*) value );
+#else // #if defined(_MSC_VER)
+        return __atomic_sub_fetch( value, 1, __ATOMIC_ACQ_REL );
+#endif // #if defined(_MSC_VER)
+    }
+
+    /**
+        Atomically add to a 64 bit value shared between threads.
+
+        @param value Pointer to the value to add to.
+        @param amount The amount to add.
+     */
+
+    inline void platform_atomic_add( volatile uint64_t * value, uint64_t amount )
+    {
+#if defined(_MSC_VER)
+        _InterlockedExchangeAdd64( (volatile __int64*) value, (__int64) amount );
+#else // #if defined(_MSC_VER)
+        __atomic_fetch_add( value, amount, __ATOMIC_RELAXED );
+#endif // #if defined(_MSC_VER)
+    }
+
+    /**
+        Atomically replace a 64 bit value shared between threads.
+
+        @param value Pointer to the value to replace.
+        @param newValue The new value.
+
+        @returns The previous value.
+     */
+
+    inline uint64_t platform_atomic_exchange( volatile uint64_t * value, uint64_t newValue )
+    {
+#if defined(_MSC_VER)
+        return (uint64_t) _InterlockedExchange64( (volatile __int64*) value, (__int64) newValue );
+#else // #if defined(_MSC_VER)
+        return __atomic_exchange_n( value, newValue, __ATOMIC_ACQ_REL );
+#endif // #if defined(_MSC_VER)
+    }
 }
 
 #endif // #ifndef YOJIMBO_PLATFORM_H
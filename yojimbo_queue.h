@@ -27,6 +27,7 @@
 
 #include "yojimbo_config.h"
 #include "yojimbo_allocator.h"
+#include "yojimbo_platform.h"
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
@@ -214,6 +215,385 @@ namespace yojimbo
 
         int m_numEntries;                               ///< The number of entries currently stored in the queue.
     };
+
+    /**
+        A lock-free, bounded, single-producer/single-consumer FIFO queue.
+
+        One thread pushes entries, and another thread pops them, without taking a lock. Neither thread ever blocks: pushing to a full queue and popping from an empty queue fail instead.
+
+        The read and write indices are on separate cache lines, and each side keeps a cached copy of the other side's index, so the two threads only touch shared cache lines when the cached index runs out.
+
+        Entries can be filled and drained in place with SPSCQueue::GetPushEntry/SPSCQueue::CommitPush and SPSCQueue::GetPopEntry/SPSCQueue::CommitPop. This avoids copying large entries, like batches of packets.
+
+        IMPORTANT: Only one thread may push, and only one thread may pop. Use Queue if the queue is only accessed from one thread.
+     */
+
+    template <typename T> class SPSCQueue
+    {
+    public:
+
+        /**
+            SPSC queue constructor.
+
+            @param allocator The allocator to use.
+            @param size The minimum number of entries in the queue. Rounded up to the next power of two.
+         */
+
+        SPSCQueue( Allocator & allocator, int size )
+        {
+            assert( size > 0 );
+            int arraySize = 1;
+            while ( arraySize < size )
+                arraySize *= 2;
+            m_allocator = &allocator;
+            m_indexMask = arraySize - 1;
+            m_entries = (T*) YOJIMBO_ALLOCATE( allocator, sizeof(T) * arraySize );
+            memset( m_entries, 0, sizeof(T) * arraySize );
+            m_readIndex = 0;
+            m_cachedWriteIndex = 0;
+            m_writeIndex = 0;
+            m_cachedReadIndex = 0;
+        }
+
+        /**
+            SPSC queue destructor.
+
+            IMPORTANT: Make sure the producer and consumer threads are no longer using the queue before destroying it.
+         */
+
+        ~SPSCQueue()
+        {
+            assert( m_allocator );
+            YOJIMBO_FREE( *m_allocator, m_entries );
+            m_allocator = NULL;
+        }
+
+        /**
+            Push a value on to the queue. Producer thread only.
+
+            @param value The value to push onto the queue.
+
+            @returns True if the value was pushed, false if the queue is full.
+         */
+
+        bool Push( const T & value )
+        {
+            T * entry = GetPushEntry();
+            if ( !entry )
+                return false;
+            *entry = value;
+            CommitPush();
+            return true;
+        }
+
+        /**
+            Pop a value off the queue. Consumer thread only.
+
+            @param value The value popped off the queue [out].
+
+            @returns True if a value was popped, false if the queue is empty.
+         */
+
+        bool Pop( T & value )
+        {
+            T * entry = GetPopEntry();
+            if ( !entry )
+                return false;
+            value = *entry;
+            CommitPop();
+            return true;
+        }
+
+        /**
+            Get the entry the next push will write to, so it can be filled in place. Producer thread only.
+
+            The entry is not visible to the consumer until SPSCQueue::CommitPush is called.
+
+            @returns The entry to fill, or NULL if the queue is full.
+         */
+
+        T * GetPushEntry()
+        {
+            if ( m_writeIndex - m_cachedReadIndex > m_indexMask )
+            {
+                m_cachedReadIndex = platform_atomic_load( &m_readIndex );
+                if ( m_writeIndex - m_cachedReadIndex > m_indexMask )
+                    return NULL;
+            }
+            return &m_entries[m_writeIndex & m_indexMask];
+        }
+
+        /**
+            Publish the entry returned by SPSCQueue::GetPushEntry to the consumer. Producer thread only.
+         */
+
+        void CommitPush()
+        {
+            assert( m_writeIndex - m_cachedReadIndex <= m_indexMask );
+            platform_atomic_store( &m_writeIndex, m_writeIndex + 1 );
+        }
+
+        /**
+            Get the oldest entry in the queue without popping it. Consumer thread only.
+
+            @returns The oldest entry, or NULL if the queue is empty.
+         */
+
+        T * GetPopEntry()
+        {
+            if ( m_readIndex == m_cachedWriteIndex )
+            {
+                m_cachedWriteIndex = platform_atomic_load( &m_writeIndex );
+                if ( m_readIndex == m_cachedWriteIndex )
+                    return NULL;
+            }
+            return &m_entries[m_readIndex & m_indexMask];
+        }
+
+        /**
+            Pop the entry returned by SPSCQueue::GetPopEntry, handing its slot back to the producer. Consumer thread only.
+         */
+
+        void CommitPop()
+        {
+            assert( m_readIndex != m_cachedWriteIndex );
+            platform_atomic_store( &m_readIndex, m_readIndex + 1 );
+        }
+
+        /**
+            Access an entry by its slot in the ring, whether or not it is in the queue.
+
+            Use this to set up per-slot data, like pointers to packet buffers, before the queue is shared between threads.
+
+            @param index The slot index in [0,GetSize()-1].
+
+            @returns The entry in that slot.
+         */
+
+        T & GetSlot( int index )
+        {
+            assert( index >= 0 );
+            assert( index <= int( m_indexMask ) );
+            return m_entries[index];
+        }
+
+        /**
+            Get the size of the queue.
+
+            @returns The maximum number of entries in the queue. This is the size passed to the constructor, rounded up to a power of two.
+         */
+
+        int GetSize() const
+        {
+            return int( m_indexMask + 1 );
+        }
+
+        /**
+            Is the queue currently empty? Consumer thread only.
+
+            @returns True if there are no entries to pop.
+         */
+
+        bool IsEmpty()
+        {
+            return GetPopEntry() == NULL;
+        }
+
+    private:
+
+        SPSCQueue( const SPSCQueue & other );
+
+        const SPSCQueue & operator = ( const SPSCQueue & other );
+
+        Allocator * m_allocator;                        ///< The allocator passed in to the constructor.
+
+        T * m_entries;                                  ///< Array of entries backing the queue (circular buffer).
+
+        uint32_t m_indexMask;                           ///< The size of the array minus one. Read and write indices wrap around freely, and are masked to get the slot.
+
+        uint8_t m_pad0[CacheLineBytes];                 ///< Keeps the consumer's indices off the cache line with the read-only fields above.
+
+        volatile uint32_t m_readIndex;                  ///< Index of the next entry to pop. Written by the consumer.
+
+        uint32_t m_cachedWriteIndex;                    ///< Consumer's copy of the write index. Refreshed only when the queue looks empty.
+
+        uint8_t m_pad1[CacheLineBytes];                 ///< Keeps the producer's indices off the consumer's cache line.
+
+        volatile uint32_t m_writeIndex;                 ///< Index of the next entry to push. Written by the producer.
+
+        uint32_t m_cachedReadIndex;                     ///< Producer's copy of the read index. Refreshed only when the queue looks full.
+
+        uint8_t m_pad2[CacheLineBytes];                 ///< Keeps the producer's indices off whatever is allocated after the queue.
+    };
+
+    /**
+        A lock-free, bounded, multi-producer/single-consumer FIFO queue.
+
+        Any number of threads may push entries, while one thread pops them, without taking a lock. Producers claim a slot by advancing the write index with a compare and swap, then publish the entry by updating a sequence number stored with it. This means a producer that is slow to fill its entry only holds up the consumer at that entry, never the other producers.
+
+        Entries from the same producer are popped in the order they were pushed. Entries from different producers are interleaved in the order they claimed their slots.
+
+        IMPORTANT: Only one thread may pop. If there is only one producer, SPSCQueue is cheaper.
+     */
+
+    template <typename T> class MPSCQueue
+    {
+    public:
+
+        /**
+            MPSC queue constructor.
+
+            @param allocator The allocator to use.
+            @param size The minimum number of entries in the queue. Rounded up to the next power of two.
+         */
+
+        MPSCQueue( Allocator & allocator, int size )
+        {
+            assert( size > 0 );
+            int arraySize = 1;
+            while ( arraySize < size )
+                arraySize *= 2;
+            m_allocator = &allocator;
+            m_indexMask = arraySize - 1;
+            m_entries = (Entry*) YOJIMBO_ALLOCATE( allocator, sizeof(Entry) * arraySize );
+            memset( m_entries, 0, sizeof(Entry) * arraySize );
+            for ( int i = 0; i < arraySize; ++i )
+                m_entries[i].sequence = i;
+            m_readIndex = 0;
+            m_writeIndex = 0;
+        }
+
+        /**
+            MPSC queue destructor.
+
+            IMPORTANT: Make sure the producer and consumer threads are no longer using the queue before destroying it.
+         */
+
+        ~MPSCQueue()
+        {
+            assert( m_allocator );
+            YOJIMBO_FREE( *m_allocator, m_entries );
+            m_allocator = NULL;
+        }
+
+        /**
+            Push a value on to the queue. May be called from any thread.
+
+            @param value The value to push onto the queue.
+
+            @returns True if the value was pushed, false if the queue is full.
+         */
+
+        bool Push( const T & value )
+        {
+            uint32_t index = platform_atomic_load( &m_writeIndex );
+
+            Entry * entry;
+
+            while ( true )
+            {
+                entry = &m_entries[index & m_indexMask];
+
+                // the sequence number of a free slot equals the write index that claims it. it is one ahead once the slot is filled, and a whole lap ahead once the consumer has popped it
+
+                const int32_t difference = int32_t( platform_atomic_load( &entry->sequence ) - index );
+
+                if ( difference == 0 )
+                {
+                    if ( platform_atomic_compare_exchange( &m_writeIndex, index, index + 1 ) )
+                        break;
+                }
+                else if ( difference < 0 )
+                {
+                    return false;
+                }
+
+                index = platform_atomic_load( &m_writeIndex );
+            }
+
+            entry->value = value;
+
+            platform_atomic_store( &entry->sequence, index + 1 );
+
+            return true;
+        }
+
+        /**
+            Pop a value off the queue. Consumer thread only.
+
+            @param value The value popped off the queue [out].
+
+            @returns True if a value was popped, false if the queue is empty, or the oldest entry has been claimed but not yet filled by its producer.
+         */
+
+        bool Pop( T & value )
+        {
+            Entry & entry = m_entries[m_readIndex & m_indexMask];
+
+            if ( platform_atomic_load( &entry.sequence ) != m_readIndex + 1 )
+                return false;
+
+            value = entry.value;
+
+            platform_atomic_store( &entry.sequence, m_readIndex + m_indexMask + 1 );
+
+            m_readIndex++;
+
+            return true;
+        }
+
+        /**
+            Get the size of the queue.
+
+            @returns The maximum number of entries in the queue. This is the size passed to the constructor, rounded up to a power of two.
+         */
+
+        int GetSize() const
+        {
+            return int( m_indexMask + 1 );
+        }
+
+        /**
+            Is the queue currently empty? Consumer thread only.
+
+            @returns True if there is no entry ready to pop.
+         */
+
+        bool IsEmpty() const
+        {
+            return platform_atomic_load( &m_entries[m_readIndex & m_indexMask].sequence ) != m_readIndex + 1;
+        }
+
+    private:
+
+        /// An entry in the queue, with the sequence number used to hand it between producers and the consumer.
+
+        struct Entry
+        {
+            volatile uint32_t sequence;                 ///< Equal to the write index that may claim this slot when free, one more than that once filled.
+            T value;                                    ///< The value stored in this slot.
+        };
+
+        MPSCQueue( const MPSCQueue & other );
+
+        const MPSCQueue & operator = ( const MPSCQueue & other );
+
+        Allocator * m_allocator;                        ///< The allocator passed in to the constructor.
+
+        Entry * m_entries;                              ///< Array of entries backing the queue (circular buffer).
+
+        uint32_t m_indexMask;                           ///< The size of the array minus one. Read and write indices wrap around freely, and are masked to get the slot.
+
+        uint8_t m_pad0[CacheLineBytes];                 ///< Keeps the consumer's index off the cache line with the read-only fields above.
+
+        uint32_t m_readIndex;                           ///< Index of the next entry to pop. Only accessed by the consumer.
+
+        uint8_t m_pad1[CacheLineBytes];                 ///< Keeps the write index, which all producers contend on, off the consumer's cache line.
+
+        volatile uint32_t m_writeIndex;                 ///< Index of the next slot to be claimed by a producer.
+
+        uint8_t m_pad2[CacheLineBytes];                 ///< Keeps the write index off whatever is allocated after the queue.
+    };
 }
 
 #endif // #ifndef YOJIMBO_BITPACK_H
@@ -31,6 +31,153 @@
 
 namespace yojimbo
 {
+    ConnectTokenFilter::ConnectTokenFilter( Allocator & allocator, int maxEntries )
+    {
+        assert( maxEntries > 0 );
+
+        m_allocator = &allocator;
+        m_maxEntries = maxEntries;
+
+        int hashSize = 1;
+        while ( hashSize < maxEntries * 2 )
+            hashSize *= 2;
+
+        m_hashMask = hashSize - 1;
+        m_hashTable = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * hashSize );
+        m_entries = (ConnectTokenEntry*) YOJIMBO_ALLOCATE( allocator, sizeof( ConnectTokenEntry ) * maxEntries );
+
+        for ( int i = 0; i < maxEntries; ++i )
+            m_entries[i] = ConnectTokenEntry();
+
+        Reset();
+    }
+
+    ConnectTokenFilter::~ConnectTokenFilter()
+    {
+        YOJIMBO_FREE( *m_allocator, m_hashTable );
+        YOJIMBO_FREE( *m_allocator, m_entries );
+    }
+
+    void ConnectTokenFilter::Reset()
+    {
+        m_numEntries = 0;
+        m_oldestEntry = 0;
+
+        RandomBytes( (uint8_t*) &m_hashSeed, sizeof( m_hashSeed ) );
+
+        memset( m_hashTable, -1, sizeof( int ) * ( m_hashMask + 1 ) );
+    }
+
+    uint32_t ConnectTokenFilter::HashMac( const uint8_t * mac ) const
+    {
+        return uint32_t( murmur_hash_64( mac, MacBytes, m_hashSeed ) );
+    }
+
+    int ConnectTokenFilter::FindSlot( const uint8_t * mac ) const
+    {
+        int slot = HashMac( mac ) & m_hashMask;
+
+        while ( true )
+        {
+            const int index = m_hashTable[slot];
+            if ( index < 0 || memcmp( m_entries[index].mac, mac, MacBytes ) == 0 )
+                return slot;
+            slot = ( slot + 1 ) & m_hashMask;
+        }
+    }
+
+    bool ConnectTokenFilter::Find( const uint8_t * mac ) const
+    {
+        assert( mac );
+
+        return m_hashTable[FindSlot( mac )] >= 0;
+    }
+
+    bool ConnectTokenFilter::FindOrAdd( const Address & address, const uint8_t * mac, double time, uint64_t expireTimestamp, uint64_t timestamp )
+    {
+        assert( address.IsValid() );
+        assert( mac );
+
+        while ( m_numEntries > 0 && m_entries[m_oldestEntry].expireTimestamp <= timestamp )
+            RemoveOldestEntry();
+
+        int slot = FindSlot( mac );
+
+        // if an entry exists with the same mac, the connect token is only valid if it comes from the same address
+
+        if ( m_hashTable[slot] >= 0 )
+            return m_entries[m_hashTable[slot]].address == address;
+
+        if ( m_numEntries == m_maxEntries )
+        {
+            RemoveOldestEntry();
+            slot = FindSlot( mac );
+        }
+
+        const int index = ( m_oldestEntry + m_numEntries ) % m_maxEntries;
+
+        m_entries[index].time = time;
+        m_entries[index].expireTimestamp = expireTimestamp;
+        m_entries[index].address = address;
+        memcpy( m_entries[index].mac, mac, MacBytes );
+
+        m_hashTable[slot] = index;
+
+        m_numEntries++;
+
+        return true;
+    }
+
+    void ConnectTokenFilter::RemoveOldestEntry()
+    {
+        assert( m_numEntries > 0 );
+
+        int slot = FindSlot( m_entries[m_oldestEntry].mac );
+
+        assert( m_hashTable[slot] == m_oldestEntry );
+
+        // backward shift deletion. move entries after the removed slot back, unless that would put them before their home slot
+
+        int next = ( slot + 1 ) & m_hashMask;
+        while ( m_hashTable[next] >= 0 )
+        {
+            const int home = HashMac( m_entries[m_hashTable[next]].mac ) & m_hashMask;
+            if ( ( ( next - home ) & m_hashMask ) >= ( ( next - slot ) & m_hashMask ) )
+            {
+                m_hashTable[slot] = m_hashTable[next];
+                slot = next;
+            }
+            next = ( next + 1 ) & m_hashMask;
+        }
+        m_hashTable[slot] = -1;
+
+        m_oldestEntry = ( m_oldestEntry + 1 ) % m_maxEntries;
+        m_numEntries--;
+    }
+
+    int ConnectTokenFilter::GetNumEntries() const
+    {
+        return m_numEntries;
+    }
+
+    int ConnectTokenFilter::GetMaxEntries() const
+    {
+        return m_maxEntries;
+    }
+
+    static uint32_t HashClientId( uint64_t clientId )
+    {
+        // client ids are often sequential, so mix all bits before masking
+
+        clientId ^= clientId >> 33;
+        clientId *= 0xFF51AFD7ED558CCDULL;
+        clientId ^= clientId >> 33;
+        clientId *= 0xC4CEB9FE1A85EC53ULL;
+        clientId ^= clientId >> 33;
+
+        return uint32_t( clientId );
+    }
+
     void Server::Defaults()
     {
         m_allocator = NULL;
@@ -46,20 +193,38 @@ namespace yojimbo
         m_challengeTokenNonce = 0;
         m_globalSequence = 1ULL<<63;
         m_globalPacketFactory = NULL;
+        m_globalMessageFactory = NULL;
+
+        m_clientMemory = NULL;
+        m_clientAllocator = NULL;
+        m_clientTransportContext = NULL;
+        m_clientConnectionContext = NULL;
+        m_clientPacketFactory = NULL;
+        m_clientMessageFactory = NULL;
+        m_clientReplayProtection = NULL;
+        m_clientConnected = NULL;
+        m_clientId = NULL;
+        m_clientSequence = NULL;
+        m_clientAddress = NULL;
+        m_clientData = NULL;
+        m_clientConnection = NULL;
+        m_connectedClients = NULL;
+        m_connectedClientPosition = NULL;
+        m_freeClients = NULL;
+        m_clientLookupMask = 0;
+        m_clientAddressLookup = NULL;
+        m_clientIdLookup = NULL;
+        m_keepAliveTimers = NULL;
+        m_timeOutTimers = NULL;
+        m_workerPool = NULL;
+        m_clientGeneratedPacket = NULL;
+        m_connectTokenFilter = NULL;
+        m_sharedBlocks = NULL;
+        m_numSharedBlocks = 0;
 
         memset( m_privateKey, 0, KeyBytes );
         memset( m_challengeKey, 0, KeyBytes );
-        memset( m_clientMemory, 0, sizeof( m_clientMemory ) );
-        memset( m_clientAllocator, 0, sizeof( m_clientAllocator ) );
-        memset( m_clientMessageFactory, 0, sizeof( m_clientMessageFactory ) );
-        memset( m_clientPacketFactory, 0, sizeof( m_clientPacketFactory ) );
-        memset( m_clientReplayProtection, 0, sizeof( m_clientReplayProtection ) );
-        memset( m_clientConnection, 0, sizeof( m_clientConnection ) );
-        memset( m_clientSequence, 0, sizeof( m_clientSequence ) );
         memset( m_counters, 0, sizeof( m_counters ) );
-
-        for ( int i = 0; i < MaxClients; ++i )
-            ResetClientState( i );
     }
 
     Server::Server( Allocator & allocator, Transport & transport, const ClientServerConfig & config, double time )
@@ -101,15 +266,31 @@ namespace yojimbo
 
     void Server::Start( int maxClients )
     {
+        if ( maxClients < 0 )
+            maxClients = m_config.maxClients;
+
         assert( maxClients > 0 );
-        assert( maxClients <= MaxClients );
+        assert( maxClients <= MaxServerClients );
 
         Stop();
 
         m_maxClients = maxClients;
 
+        CreateClientArrays();
+
         CreateAllocators();
 
+        // the transport needs a context mapping for each client slot, and encryption mappings for clients negotiating connection as well
+
+        m_transport->SetMaxMappings( maxClients, maxClients * EncryptionMappingsPerClient );
+
+        if ( m_config.serverWorkerThreads > 0 )
+        {
+            m_workerPool = YOJIMBO_NEW( *m_allocator, WorkerPool, *m_allocator, m_config.serverWorkerThreads );
+
+            m_transport->SetWorkerPool( m_workerPool );
+        }
+
         // roll a new challenge key. security measure because multiple servers are generating challenge tokens and otherwise we risk using the same nonce multiple times and exposing the private key.
 
         GenerateKey( m_challengeKey );
@@ -127,6 +308,13 @@ namespace yojimbo
             assert( m_globalPacketFactory );
         }
 
+        if ( m_allocateConnections )
+        {
+            m_globalMessageFactory = CreateMessageFactory( globalAllocator, SERVER_RESOURCE_GLOBAL );
+
+            assert( m_globalMessageFactory );
+        }
+
         m_globalTransportContext = TransportContext( *m_globalAllocator, *m_globalPacketFactory );;
 
         m_globalTransportContext.userContext = m_userContext;
@@ -158,6 +346,12 @@ namespace yojimbo
                 
                 assert( m_clientMessageFactory[clientIndex] );
 
+                if ( m_config.messagePoolSize > 0 )
+                {
+                    m_clientMessageFactory[clientIndex]->EnablePooling( m_config.messagePoolSize );
+                    m_clientMessageFactory[clientIndex]->PreallocateMessages();
+                }
+
                 m_clientConnection[clientIndex] = YOJIMBO_NEW( clientAllocator, Connection, clientAllocator, *m_clientPacketFactory[clientIndex], *m_clientMessageFactory[clientIndex], m_config.connectionConfig );
                
                 m_clientConnection[clientIndex]->SetListener( this );
@@ -178,6 +372,9 @@ namespace yojimbo
                 m_clientConnectionContext[clientIndex].messageFactory = m_clientMessageFactory[clientIndex];
                 m_clientConnectionContext[clientIndex].connectionConfig = &m_config.connectionConfig;
 				m_clientTransportContext[clientIndex].connectionContext = &m_clientConnectionContext[clientIndex];
+
+                if ( m_clientConnection[clientIndex] )
+                    m_clientConnection[clientIndex]->SetContext( &m_clientConnectionContext[clientIndex], m_userContext );
             }
         }     
 
@@ -212,12 +409,25 @@ namespace yojimbo
             YOJIMBO_DELETE( clientAllocator, ReplayProtection, m_clientReplayProtection[clientIndex] );
         }
 
+        FreeSharedBlocks( true );
+
         Allocator & globalAllocator = GetAllocator( SERVER_RESOURCE_GLOBAL );
 
+        YOJIMBO_DELETE( globalAllocator, MessageFactory, m_globalMessageFactory );
+
         YOJIMBO_DELETE( globalAllocator, PacketFactory, m_globalPacketFactory );
 
         DestroyAllocators();
 
+        DestroyClientArrays();
+
+        if ( m_workerPool )
+        {
+            m_transport->SetWorkerPool( NULL );
+
+            YOJIMBO_DELETE( *m_allocator, WorkerPool, m_workerPool );
+        }
+
         m_maxClients = -1;
     }
 
@@ -256,18 +466,26 @@ namespace yojimbo
 
         m_counters[SERVER_COUNTER_CLIENT_DISCONNECTS]++;
 
+        // move the last connected client into the hole, and put the client index back on the free stack
+
+        const int position = m_connectedClientPosition[clientIndex];
+        const int lastClientIndex = m_connectedClients[m_numConnectedClients - 1];
+
+        m_connectedClients[position] = lastClientIndex;
+        m_connectedClientPosition[lastClientIndex] = position;
+        m_connectedClientPosition[clientIndex] = -1;
+
         m_numConnectedClients--;
+
+        m_freeClients[m_maxClients - m_numConnectedClients - 1] = clientIndex;
     }
 
     void Server::DisconnectAllClients( bool sendDisconnectPacket )
     {
         assert( IsRunning() );
 
-        for ( int i = 0; i < m_maxClients; ++i )
-        {
-            if ( m_clientConnected[i] )
-                DisconnectClient( i, sendDisconnectPacket );
-        }
+        while ( m_numConnectedClients > 0 )
+            DisconnectClient( m_connectedClients[m_numConnectedClients - 1], sendDisconnectPacket );
     }
 
     Message * Server::CreateMsg( int clientIndex, int type )
@@ -310,6 +528,121 @@ namespace yojimbo
         m_clientConnection[clientIndex]->SendMsg( message, channelId );
     }
 
+    Message * Server::CreateBroadcastMsg( int type )
+    {
+        assert( m_globalMessageFactory );
+        return m_globalMessageFactory->Create( type );
+    }
+
+    void Server::BroadcastMsg( Message * message, int channelId )
+    {
+        assert( message );
+        assert( m_globalMessageFactory );
+
+        if ( m_numConnectedClients == 0 )
+        {
+            m_globalMessageFactory->Release( message );
+            return;
+        }
+
+        int payloadBits = 0;
+        bool aligned = false;
+
+        // the payload is written once with the first client's context. only the connection config is safe to use, because it is the same for every client
+
+        const ConnectionContext * connectionContext = &m_clientConnectionContext[m_connectedClients[0]];
+
+        SharedBlock * payload = WriteBroadcastPayload( message, connectionContext, payloadBits, aligned );
+
+        SharedBlock * sharedBlock = NULL;
+
+        if ( payload && message->IsBlockMessage() )
+        {
+            BlockMessage * blockMessage = (BlockMessage*) message;
+
+            if ( blockMessage->GetSharedBlock() )
+            {
+                sharedBlock = blockMessage->GetSharedBlock();
+                sharedBlock->AddRef();
+            }
+            else if ( blockMessage->GetBlockData() )
+            {
+                sharedBlock = CreateSharedBlock( blockMessage->GetBlockData(), blockMessage->GetBlockSize() );
+
+                if ( !sharedBlock )
+                {
+                    ReleaseSharedBlock( payload );
+                    payload = NULL;
+                }
+            }
+        }
+
+        const int messageType = message->GetType();
+
+        m_globalMessageFactory->Release( message );
+
+        if ( !payload )
+        {
+            debug_printf( "failed to write broadcast message payload (type %d)\n", messageType );
+            return;
+        }
+
+        for ( int i = 0; i < m_numConnectedClients; ++i )
+        {
+            const int clientIndex = m_connectedClients[i];
+
+            assert( m_clientConnectionContext[clientIndex].magic == connectionContext->magic );
+            assert( m_clientConnectionContext[clientIndex].connectionConfig == connectionContext->connectionConfig );
+
+            // failing to create the message puts the message factory in error state, which disconnects the client
+
+            Message * clientMessage = m_clientMessageFactory[clientIndex]->Create( messageType );
+            if ( !clientMessage )
+                continue;
+
+            if ( !aligned )
+            {
+                clientMessage->AttachSerializedPayload( payload, payloadBits );
+            }
+            else
+            {
+                ReadStream stream( payload->GetBlockData(), payload->GetBlockSize(), GetAllocator( SERVER_RESOURCE_PER_CLIENT, clientIndex ) );
+                stream.SetContext( &m_clientConnectionContext[clientIndex] );
+                stream.SetUserContext( m_userContext );
+
+                if ( !clientMessage->SerializeInternal( stream ) )
+                {
+                    debug_printf( "failed to read broadcast message payload (type %d)\n", messageType );
+                    m_clientMessageFactory[clientIndex]->Release( clientMessage );
+                    continue;
+                }
+            }
+
+            if ( sharedBlock )
+                ( (BlockMessage*) clientMessage )->AttachSharedBlock( sharedBlock );
+
+            SendMsg( clientIndex, clientMessage, channelId );
+        }
+
+        ReleaseSharedBlock( payload );
+
+        if ( sharedBlock )
+            ReleaseSharedBlock( sharedBlock );
+    }
+
+    SharedBlock * Server::WriteBroadcastPayload( Message * message, const ConnectionContext * connectionContext, int & payloadBits, bool & aligned )
+    {
+        Allocator & globalAllocator = GetAllocator( SERVER_RESOURCE_GLOBAL );
+
+        SharedBlock * payload = SerializeMessagePayload( globalAllocator, message, (void*) connectionContext, m_userContext, payloadBits, aligned );
+        if ( !payload )
+            return NULL;
+
+        AddSharedBlock( payload );
+
+        return payload;
+    }
+
     Message * Server::ReceiveMsg( int clientIndex, int channelId )
     {
         assert( m_clientMessageFactory );
@@ -339,6 +672,79 @@ namespace yojimbo
         return *m_clientMessageFactory[clientIndex];
     }
 
+    SharedBlock * Server::CreateSharedBlock( const uint8_t * blockData, int blockSize )
+    {
+        assert( IsRunning() );
+        assert( blockData );
+        assert( blockSize > 0 );
+
+        Allocator & globalAllocator = GetAllocator( SERVER_RESOURCE_GLOBAL );
+
+        SharedBlock * sharedBlock = YOJIMBO_NEW( globalAllocator, SharedBlock, globalAllocator, blockData, blockSize );
+        if ( !sharedBlock )
+            return NULL;
+
+        if ( !sharedBlock->GetBlockData() )
+        {
+            sharedBlock->Release();
+            YOJIMBO_DELETE( globalAllocator, SharedBlock, sharedBlock );
+            return NULL;
+        }
+
+        AddSharedBlock( sharedBlock );
+
+        return sharedBlock;
+    }
+
+    void Server::AddSharedBlock( SharedBlock * sharedBlock )
+    {
+        assert( sharedBlock );
+        assert( sharedBlock->GetBlockData() );
+
+        sharedBlock->m_next = m_sharedBlocks;
+        m_sharedBlocks = sharedBlock;
+        m_numSharedBlocks++;
+    }
+
+    void Server::ReleaseSharedBlock( SharedBlock * sharedBlock )
+    {
+        assert( sharedBlock );
+        sharedBlock->Release();
+    }
+
+    int Server::GetNumSharedBlocks() const
+    {
+        return m_numSharedBlocks;
+    }
+
+    void Server::FreeSharedBlocks( bool freeAll )
+    {
+        // shared blocks are only freed here, on the thread calling into the server. worker threads release messages, but only ever decrement the reference count
+
+        Allocator & globalAllocator = GetAllocator( SERVER_RESOURCE_GLOBAL );
+
+        SharedBlock ** previous = &m_sharedBlocks;
+
+        while ( *previous )
+        {
+            SharedBlock * sharedBlock = *previous;
+
+            if ( !freeAll && sharedBlock->GetRefCount() > 0 )
+            {
+                previous = &sharedBlock->m_next;
+                continue;
+            }
+
+            *previous = sharedBlock->m_next;
+
+            sharedBlock->m_refCount = 0;
+
+            YOJIMBO_DELETE( globalAllocator, SharedBlock, sharedBlock );
+
+            m_numSharedBlocks--;
+        }
+    }
+
     Packet * Server::CreateGlobalPacket( int type )
     {
         return m_globalPacketFactory->Create( type );
@@ -359,14 +765,35 @@ namespace yojimbo
 
         const double time = GetTime();
 
-        for ( int clientIndex = 0; clientIndex < m_maxClients; ++clientIndex )
+        if ( m_allocateConnections && m_workerPool )
         {
-            if ( !m_clientConnected[clientIndex] )
-                continue;
+            // generate connection packets across the worker pool, then send them in connected client order so the send queue is deterministic
 
-            if ( m_clientData[clientIndex].fullyConnected )
+            m_workerPool->Run( GeneratePacketsWorker, this, m_numConnectedClients );
+
+            for ( int i = 0; i < m_numConnectedClients; ++i )
             {
-                if ( m_clientConnection[clientIndex] )
+                const int clientIndex = m_connectedClients[i];
+
+                ConnectionPacket * packet = m_clientGeneratedPacket[clientIndex];
+
+                if ( packet )
+                {
+                    m_clientGeneratedPacket[clientIndex] = NULL;
+
+                    SendPacketToConnectedClient( clientIndex, packet );
+                }
+            }
+        }
+        else if ( m_allocateConnections )
+        {
+            for ( int i = 0; i < m_numConnectedClients; ++i )
+            {
+                const int clientIndex = m_connectedClients[i];
+
+                assert( m_clientConnected[clientIndex] );
+
+                if ( m_clientData[clientIndex].fullyConnected )
                 {
                     ConnectionPacket * packet = m_clientConnection[clientIndex]->GeneratePacket();
 
@@ -376,8 +803,24 @@ namespace yojimbo
                     }
                 }
             }
+        }
 
-            if ( m_clientData[clientIndex].lastPacketSendTime + ( 1.0f / m_config.connectionKeepAliveSendRate ) <= time )
+        // only clients whose keep-alive timer fired are visited. sending any packet pushes back the next keep-alive, so check the send time and reschedule if it moved
+
+        const double keepAliveInterval = 1.0 / m_config.connectionKeepAliveSendRate;
+
+        const int numFiredTimers = m_keepAliveTimers->AdvanceTime( time );
+
+        m_counters[SERVER_COUNTER_TIMER_EVENTS_FIRED] += numFiredTimers;
+
+        for ( int i = 0; i < numFiredTimers; ++i )
+        {
+            const int clientIndex = m_keepAliveTimers->GetFiredTimer( i );
+
+            if ( !m_clientConnected[clientIndex] )
+                continue;
+
+            if ( m_clientData[clientIndex].lastPacketSendTime + keepAliveInterval <= time )
             {
                 KeepAlivePacket * packet = CreateKeepAlivePacket( clientIndex );
 
@@ -394,6 +837,8 @@ namespace yojimbo
 #endif // #if !YOJIMBO_SECURE_MODE
                 }
             }
+
+            m_keepAliveTimers->Schedule( clientIndex, m_clientData[clientIndex].lastPacketSendTime + keepAliveInterval );
         }
     }
 
@@ -422,8 +867,16 @@ namespace yojimbo
 
         const double time = GetTime();
 
-        for ( int clientIndex = 0; clientIndex < m_maxClients; ++clientIndex )
+        // packets received from a client push back its time out without touching the timer. when the timer fires, either time out the client or reschedule for the real time out
+
+        const int numFiredTimers = m_timeOutTimers->AdvanceTime( time );
+
+        m_counters[SERVER_COUNTER_TIMER_EVENTS_FIRED] += numFiredTimers;
+
+        for ( int i = 0; i < numFiredTimers; ++i )
         {
+            const int clientIndex = m_timeOutTimers->GetFiredTimer( i );
+
             if ( !m_clientConnected[clientIndex] )
                 continue;
 
@@ -435,6 +888,10 @@ namespace yojimbo
 
                 DisconnectClient( clientIndex, false );
             }
+            else
+            {
+                m_timeOutTimers->Schedule( clientIndex, m_clientData[clientIndex].lastPacketReceiveTime + m_config.connectionTimeOut );
+            }
         }
     }
 
@@ -462,9 +919,17 @@ namespace yojimbo
             m_globalPacketFactory->ClearError();
         }
 
-        for ( int clientIndex = 0; clientIndex < m_maxClients; ++clientIndex )
+        // each connection only touches its own channels and per-client allocator, so connections can be updated in parallel. errors are handled below on this thread
+
+        const bool connectionsAdvanced = m_allocateConnections && m_workerPool;
+
+        if ( connectionsAdvanced )
+            m_workerPool->Run( AdvanceConnectionsWorker, this, m_numConnectedClients );
+
+        for ( int i = m_numConnectedClients - 1; i >= 0; --i )
         {
-            if ( IsClientConnected( clientIndex ) )
+            const int clientIndex = m_connectedClients[i];
+
             {
                 // check for allocator error
 
@@ -512,7 +977,8 @@ namespace yojimbo
 
                 if ( m_clientConnection[clientIndex] )
                 {
-                    m_clientConnection[clientIndex]->AdvanceTime( time );
+                    if ( !connectionsAdvanced )
+                        m_clientConnection[clientIndex]->AdvanceTime( time );
 
                     if ( m_clientConnection[clientIndex]->GetError() )
                     {
@@ -527,6 +993,9 @@ namespace yojimbo
                 }
             }
         }
+
+        if ( m_sharedBlocks )
+            FreeSharedBlocks( false );
     }
 
     void Server::SetFlags( uint64_t flags )
@@ -558,27 +1027,34 @@ namespace yojimbo
 
     int Server::FindClientIndex( uint64_t clientId ) const
     {
-        for ( int i = 0; i < m_maxClients; ++i )
-        {   
-            if ( m_clientConnected[i] && m_clientId[i] == clientId )
-                return i;
-        }
+        if ( !IsRunning() )
+            return -1;
 
-        return -1;
+        int slot = HashClientId( clientId ) & m_clientLookupMask;
+
+        while ( true )
+        {
+            const int clientIndex = m_clientIdLookup[slot];
+            if ( clientIndex < 0 || m_clientId[clientIndex] == clientId )
+                return clientIndex;
+            slot = ( slot + 1 ) & m_clientLookupMask;
+        }
     }
 
     int Server::FindClientIndex( const Address & address ) const
     {
-        if ( !address.IsValid() )
+        if ( !address.IsValid() || !IsRunning() )
             return -1;
 
-        for ( int i = 0; i < m_maxClients; ++i )
-        {   
-            if ( m_clientConnected[i] && m_clientAddress[i] == address )
-                return i;
-        }
+        int slot = address.GetHash() & m_clientLookupMask;
 
-        return -1;
+        while ( true )
+        {
+            const int clientIndex = m_clientAddressLookup[slot];
+            if ( clientIndex < 0 || m_clientAddress[clientIndex] == address )
+                return clientIndex;
+            slot = ( slot + 1 ) & m_clientLookupMask;
+        }
     }
 
     uint64_t Server::GetClientId( int clientIndex ) const
@@ -698,7 +1174,15 @@ namespace yojimbo
     void Server::ResetClientState( int clientIndex )
     {
         assert( clientIndex >= 0 );
-        assert( clientIndex < MaxClients );
+        assert( clientIndex < m_maxClients );
+
+        if ( m_clientConnected[clientIndex] )
+        {
+            RemoveClientLookup( clientIndex );
+
+            m_keepAliveTimers->Cancel( clientIndex );
+            m_timeOutTimers->Cancel( clientIndex );
+        }
 
         m_clientConnected[clientIndex] = false;
         m_clientId[clientIndex] = 0;
@@ -724,75 +1208,209 @@ namespace yojimbo
 
     int Server::FindFreeClientIndex() const
     {
+        if ( m_numConnectedClients == m_maxClients )
+            return -1;
+
+        return m_freeClients[m_maxClients - m_numConnectedClients - 1];
+    }
+
+    void Server::CreateClientArrays()
+    {
+        assert( m_maxClients > 0 );
+
+        m_clientMemory = (uint8_t**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( uint8_t* ) * m_maxClients );
+        m_clientAllocator = (Allocator**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( Allocator* ) * m_maxClients );
+        m_clientTransportContext = (TransportContext*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( TransportContext ) * m_maxClients );
+        m_clientConnectionContext = (ConnectionContext*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( ConnectionContext ) * m_maxClients );
+        m_clientPacketFactory = (PacketFactory**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( PacketFactory* ) * m_maxClients );
+        m_clientMessageFactory = (MessageFactory**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( MessageFactory* ) * m_maxClients );
+        m_clientReplayProtection = (ReplayProtection**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( ReplayProtection* ) * m_maxClients );
+        m_clientConnected = (bool*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( bool ) * m_maxClients );
+        m_clientId = (uint64_t*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( uint64_t ) * m_maxClients );
+        m_clientSequence = (uint64_t*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( uint64_t ) * m_maxClients );
+        m_clientAddress = (Address*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( Address ) * m_maxClients );
+        m_clientData = (ServerClientData*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( ServerClientData ) * m_maxClients );
+        m_clientConnection = (Connection**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( Connection* ) * m_maxClients );
+        m_connectedClients = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( int ) * m_maxClients );
+        m_connectedClientPosition = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( int ) * m_maxClients );
+        m_freeClients = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( int ) * m_maxClients );
+
+        int lookupSize = 1;
+        while ( lookupSize < m_maxClients * 2 )
+            lookupSize *= 2;
+
+        m_clientLookupMask = lookupSize - 1;
+        m_clientAddressLookup = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( int ) * lookupSize );
+        m_clientIdLookup = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( int ) * lookupSize );
+
+        m_clientGeneratedPacket = (ConnectionPacket**) YOJIMBO_ALLOCATE( *m_allocator, sizeof( ConnectionPacket* ) * m_maxClients );
+
+        memset( m_clientAddressLookup, -1, sizeof( int ) * lookupSize );
+        memset( m_clientIdLookup, -1, sizeof( int ) * lookupSize );
+
+        m_connectTokenFilter = YOJIMBO_NEW( *m_allocator, ConnectTokenFilter, *m_allocator, m_maxClients * ConnectTokenEntriesPerClient );
+
+        m_keepAliveTimers = YOJIMBO_NEW( *m_allocator, TimerWheel, *m_allocator, m_maxClients, ServerTimerResolution, GetTime() );
+        m_timeOutTimers = YOJIMBO_NEW( *m_allocator, TimerWheel, *m_allocator, m_maxClients, ServerTimerResolution, GetTime() );
+
+        memset( m_clientMemory, 0, sizeof( uint8_t* ) * m_maxClients );
+        memset( m_clientAllocator, 0, sizeof( Allocator* ) * m_maxClients );
+        memset( m_clientPacketFactory, 0, sizeof( PacketFactory* ) * m_maxClients );
+        memset( m_clientMessageFactory, 0, sizeof( MessageFactory* ) * m_maxClients );
+        memset( m_clientReplayProtection, 0, sizeof( ReplayProtection* ) * m_maxClients );
+        memset( m_clientConnection, 0, sizeof( Connection* ) * m_maxClients );
+        memset( m_clientConnected, 0, sizeof( bool ) * m_maxClients );
+        memset( m_clientGeneratedPacket, 0, sizeof( ConnectionPacket* ) * m_maxClients );
+
         for ( int i = 0; i < m_maxClients; ++i )
         {
-            if ( !m_clientConnected[i] )
-                return i;
+            m_clientTransportContext[i] = TransportContext();
+            m_clientConnectionContext[i] = ConnectionContext();
+            m_connectedClientPosition[i] = -1;
+
+            // the free stack pops from the end, so lower client indices are handed out first
+
+            m_freeClients[i] = m_maxClients - 1 - i;
+
+            ResetClientState( i );
         }
-        return -1;
+
+        m_numConnectedClients = 0;
     }
 
-    bool Server::FindConnectTokenEntry( const uint8_t * mac )
+    void Server::DestroyClientArrays()
     {
-        for ( int i = 0; i < MaxConnectTokenEntries; ++i )
+        YOJIMBO_FREE( *m_allocator, m_clientMemory );
+        YOJIMBO_FREE( *m_allocator, m_clientAllocator );
+        YOJIMBO_FREE( *m_allocator, m_clientTransportContext );
+        YOJIMBO_FREE( *m_allocator, m_clientConnectionContext );
+        YOJIMBO_FREE( *m_allocator, m_clientPacketFactory );
+        YOJIMBO_FREE( *m_allocator, m_clientMessageFactory );
+        YOJIMBO_FREE( *m_allocator, m_clientReplayProtection );
+        YOJIMBO_FREE( *m_allocator, m_clientConnected );
+        YOJIMBO_FREE( *m_allocator, m_clientId );
+        YOJIMBO_FREE( *m_allocator, m_clientSequence );
+        YOJIMBO_FREE( *m_allocator, m_clientAddress );
+        YOJIMBO_FREE( *m_allocator, m_clientData );
+        YOJIMBO_FREE( *m_allocator, m_clientConnection );
+        YOJIMBO_FREE( *m_allocator, m_connectedClients );
+        YOJIMBO_FREE( *m_allocator, m_connectedClientPosition );
+        YOJIMBO_FREE( *m_allocator, m_freeClients );
+        YOJIMBO_FREE( *m_allocator, m_clientAddressLookup );
+        YOJIMBO_FREE( *m_allocator, m_clientIdLookup );
+        YOJIMBO_FREE( *m_allocator, m_clientGeneratedPacket );
+
+        YOJIMBO_DELETE( *m_allocator, ConnectTokenFilter, m_connectTokenFilter );
+
+        YOJIMBO_DELETE( *m_allocator, TimerWheel, m_keepAliveTimers );
+        YOJIMBO_DELETE( *m_allocator, TimerWheel, m_timeOutTimers );
+
+        m_clientLookupMask = 0;
+    }
+
+    void Server::AdvanceConnectionsWorker( void * data, int workerIndex, int begin, int end )
+    {
+        (void) workerIndex;
+
+        Server * server = (Server*) data;
+
+        for ( int i = begin; i < end; ++i )
         {
-            if ( memcmp( mac, m_connectTokenEntries[i].mac, MacBytes ) == 0 )
-                return true;
-        }
+            const int clientIndex = server->m_connectedClients[i];
+
+            assert( server->m_clientConnection[clientIndex] );
 
-        return false;
+            server->m_clientConnection[clientIndex]->AdvanceTime( server->m_time );
+        }
     }
 
-    bool Server::FindOrAddConnectTokenEntry( const Address & address, const uint8_t * mac )
+    void Server::GeneratePacketsWorker( void * data, int workerIndex, int begin, int end )
     {
-        // find the matching entry for the token mac, and the oldest token. constant time worst case. This is intentional!
+        (void) workerIndex;
 
-        const double time = GetTime();
+        Server * server = (Server*) data;
 
-        assert( address.IsValid() );
+        for ( int i = begin; i < end; ++i )
+        {
+            const int clientIndex = server->m_connectedClients[i];
 
-        assert( mac );
+            assert( server->m_clientConnected[clientIndex] );
+
+            if ( server->m_clientData[clientIndex].fullyConnected )
+                server->m_clientGeneratedPacket[clientIndex] = server->m_clientConnection[clientIndex]->GeneratePacket();
+        }
+    }
+
+    void Server::AddClientLookup( int clientIndex )
+    {
+        int slot = m_clientAddress[clientIndex].GetHash() & m_clientLookupMask;
+        while ( m_clientAddressLookup[slot] >= 0 )
+            slot = ( slot + 1 ) & m_clientLookupMask;
+        m_clientAddressLookup[slot] = clientIndex;
+
+        slot = HashClientId( m_clientId[clientIndex] ) & m_clientLookupMask;
+        while ( m_clientIdLookup[slot] >= 0 )
+            slot = ( slot + 1 ) & m_clientLookupMask;
+        m_clientIdLookup[slot] = clientIndex;
+    }
+
+    void Server::RemoveClientLookup( int clientIndex )
+    {
+        // find the slot holding this client index, then backward shift entries after it so probe chains stay unbroken
 
-        int matchingTokenIndex = -1;
-        int oldestTokenIndex = -1;
-        double oldestTokenTime = 0.0;
-        for ( int i = 0; i < MaxConnectTokenEntries; ++i )
+        int slot = m_clientAddress[clientIndex].GetHash() & m_clientLookupMask;
+        while ( m_clientAddressLookup[slot] != clientIndex )
         {
-            if ( memcmp( mac, m_connectTokenEntries[i].mac, MacBytes ) == 0 )
-            {
-                matchingTokenIndex = i;
-            }
+            assert( m_clientAddressLookup[slot] >= 0 );
+            slot = ( slot + 1 ) & m_clientLookupMask;
+        }
 
-            if ( oldestTokenIndex == -1 || m_connectTokenEntries[i].time < oldestTokenTime )
+        int next = ( slot + 1 ) & m_clientLookupMask;
+        while ( m_clientAddressLookup[next] >= 0 )
+        {
+            const int home = m_clientAddress[m_clientAddressLookup[next]].GetHash() & m_clientLookupMask;
+            if ( ( ( next - home ) & m_clientLookupMask ) >= ( ( next - slot ) & m_clientLookupMask ) )
             {
-                oldestTokenTime = m_connectTokenEntries[i].time;
-                oldestTokenIndex = i;
+                m_clientAddressLookup[slot] = m_clientAddressLookup[next];
+                slot = next;
             }
+            next = ( next + 1 ) & m_clientLookupMask;
         }
+        m_clientAddressLookup[slot] = -1;
 
-        // if no entry is found with the mac, replace the oldest entry with this (mac,address,time) and return true
-
-        assert( oldestTokenIndex != -1 );
-
-        if ( matchingTokenIndex == -1 )
+        slot = HashClientId( m_clientId[clientIndex] ) & m_clientLookupMask;
+        while ( m_clientIdLookup[slot] != clientIndex )
         {
-            m_connectTokenEntries[oldestTokenIndex].time = time;
-            m_connectTokenEntries[oldestTokenIndex].address = address;
-            memcpy( m_connectTokenEntries[oldestTokenIndex].mac, mac, MacBytes );
-            return true;
+            assert( m_clientIdLookup[slot] >= 0 );
+            slot = ( slot + 1 ) & m_clientLookupMask;
         }
 
-        // if an entry is found with the same mac *and* it has the same address, return true
+        next = ( slot + 1 ) & m_clientLookupMask;
+        while ( m_clientIdLookup[next] >= 0 )
+        {
+            const int home = HashClientId( m_clientId[m_clientIdLookup[next]] ) & m_clientLookupMask;
+            if ( ( ( next - home ) & m_clientLookupMask ) >= ( ( next - slot ) & m_clientLookupMask ) )
+            {
+                m_clientIdLookup[slot] = m_clientIdLookup[next];
+                slot = next;
+            }
+            next = ( next + 1 ) & m_clientLookupMask;
+        }
+        m_clientIdLookup[slot] = -1;
+    }
 
-        assert( matchingTokenIndex >= 0 );
-        assert( matchingTokenIndex < MaxConnectTokenEntries );
+    bool Server::FindConnectTokenEntry( const uint8_t * mac )
+    {
+        return m_connectTokenFilter->Find( mac );
+    }
 
-        if ( m_connectTokenEntries[matchingTokenIndex].address == address )
-            return true;
+    bool Server::FindOrAddConnectTokenEntry( const Address & address, const uint8_t * mac, uint64_t expireTimestamp, uint64_t timestamp )
+    {
+        assert( address.IsValid() );
 
-        // otherwise an entry exists with the same mac but a different address, somebody is trying to reuse this connect token in a replay attack!
+        assert( mac );
 
-        return false;
+        return m_connectTokenFilter->FindOrAdd( address, mac, GetTime(), expireTimestamp, timestamp );
     }
 
     void Server::ConnectClient( int clientIndex, const Address & clientAddress, uint64_t clientId )
@@ -808,12 +1426,21 @@ namespace yojimbo
 
         m_counters[SERVER_COUNTER_CLIENT_CONNECTS]++;
 
+        // take the client index off the free stack. it must be the one FindFreeClientIndex returned
+
+        assert( m_freeClients[m_maxClients - m_numConnectedClients - 1] == clientIndex );
+
+        m_connectedClients[m_numConnectedClients] = clientIndex;
+        m_connectedClientPosition[clientIndex] = m_numConnectedClients;
+
         m_numConnectedClients++;
 
         m_clientConnected[clientIndex] = true;
         m_clientId[clientIndex] = clientId;
         m_clientAddress[clientIndex] = clientAddress;
 
+        AddClientLookup( clientIndex );
+
         m_clientData[clientIndex].address = clientAddress;
         m_clientData[clientIndex].clientId = clientId;
         m_clientData[clientIndex].connectTime = time;
@@ -828,6 +1455,9 @@ namespace yojimbo
 
         m_transport->AddContextMapping( clientAddress, m_clientTransportContext[clientIndex] );
 
+        m_keepAliveTimers->Schedule( clientIndex, time + 1.0 / m_config.connectionKeepAliveSendRate );
+        m_timeOutTimers->Schedule( clientIndex, time + m_config.connectionTimeOut );
+
         OnClientConnect( clientIndex );
 
         KeepAlivePacket * keepAlivePacket = CreateKeepAlivePacket( clientIndex );
@@ -948,9 +1578,22 @@ namespace yojimbo
             return;
         }
 
-        if ( !FindConnectTokenEntry( packet.connectTokenData ) )
+        // the client may use the cipher suite in the connect token, or fall back to chacha20-poly1305 if it can't
+
+        if ( ( packet.cipherSuite != connectToken.cipherSuite && packet.cipherSuite != CIPHER_SUITE_CHACHA20_POLY1305 ) || !CanUseCipherSuite( packet.cipherSuite ) )
+        {
+            debug_printf( "ignored connection request: cipher suite not allowed\n" );
+            OnConnectionRequest( SERVER_CONNECTION_REQUEST_IGNORED_CIPHER_SUITE_NOT_ALLOWED, packet, address, connectToken );
+            m_counters[SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_CIPHER_SUITE_NOT_ALLOWED]++;
+            return;
+        }
+
+        // the client may have fallen back to chacha20-poly1305 since its first request, so refresh the mapping if this address already has one.
+        // a connect token seen before never adds a new mapping, so tokens replayed from other addresses can't use up mapping slots
+
+        if ( !FindConnectTokenEntry( packet.connectTokenData ) || m_transport->FindEncryptionMapping( address ) >= 0 )
         {
-            if ( !m_transport->AddEncryptionMapping( address, connectToken.serverToClientKey, connectToken.clientToServerKey, m_config.connectionTimeOut ) )
+            if ( !m_transport->AddEncryptionMapping( address, connectToken.serverToClientKey, connectToken.clientToServerKey, m_config.connectionTimeOut, packet.cipherSuite ) )
             {
                 debug_printf( "ignored connection request: failed to add encryption mapping\n" );
                 OnConnectionRequest( SERVER_CONNECTION_REQUEST_IGNORED_FAILED_TO_ADD_ENCRYPTION_MAPPING, packet, address, connectToken );
@@ -975,7 +1618,7 @@ namespace yojimbo
             return;
         }
 
-        if ( !FindOrAddConnectTokenEntry( address, packet.connectTokenData ) )
+        if ( !FindOrAddConnectTokenEntry( address, packet.connectTokenData, packet.connectTokenExpireTimestamp, timestamp ) )
         {
             debug_printf( "ignored connection request: connect token already used\n" );
             OnConnectionRequest( SERVER_CONNECTION_REQUEST_IGNORED_CONNECT_TOKEN_ALREADY_USED, packet, address, connectToken );
@@ -1349,4 +1992,9 @@ namespace yojimbo
         (void) packet;
         return false; 
     }
+
+    bool Server::CanUseCipherSuite( int cipherSuite ) const
+    {
+        return IsCipherSuiteAvailable( cipherSuite );
+    }
 }
@@ -34,6 +34,8 @@
 #include "yojimbo_packet_processor.h"
 #include "yojimbo_client_server_packets.h"
 #include "yojimbo_tokens.h"
+#include "yojimbo_timer_wheel.h"
+#include "yojimbo_worker_pool.h"
 
 /** @file */
 
@@ -99,17 +101,127 @@ namespace yojimbo
 
     struct ConnectTokenEntry
     {
-        double time;                                                ///< The time for this entry. Used to replace the oldest entries once the connect token array fills up.
+        double time;                                                ///< The time this entry was added.
+        uint64_t expireTimestamp;                                   ///< The timestamp when the connect token expires. Once it has expired the server rejects the token anyway, so the entry can be evicted.
         Address address;                                            ///< Address of the client that sent this connect token. Binds a connect token to a particular address so it can't be exploited.
         uint8_t mac[MacBytes];                                      ///< HMAC of connect token. We use this to avoid replay attacks where the same token is sent repeatedly for different addresses.
 
         ConnectTokenEntry()
         {
             time = -1000.0;
+            expireTimestamp = 0;
             memset( mac, 0, MacBytes );
         }
     };
 
+    /**
+        Remembers recently used connect tokens, so the server can reject the same connect token being used from a different address.
+
+        Entries are kept in a ring buffer in the order they were added, and indexed by a hash table keyed on the connect token mac.
+
+        Connect tokens are issued with a fixed lifetime, so the order entries are added is close to the order they expire. Expired entries are evicted from the oldest end of the ring, and if the ring is full the oldest entry is evicted to make room.
+
+        The hash is seeded with random bytes, so a client sending made up connect tokens can't pick macs that collide and degrade lookups to a linear search.
+     */
+
+    class ConnectTokenFilter
+    {
+    public:
+
+        /**
+            Connect token filter constructor.
+
+            @param allocator The allocator used to allocate the entry ring buffer and hash table.
+            @param maxEntries The maximum number of connect token entries to remember.
+         */
+
+        ConnectTokenFilter( Allocator & allocator, int maxEntries );
+
+        /**
+            Connect token filter destructor.
+         */
+
+        ~ConnectTokenFilter();
+
+        /**
+            Forget all connect token entries.
+         */
+
+        void Reset();
+
+        /**
+            Is there an entry for this connect token mac?
+
+            @param mac The connect token mac (MacBytes).
+
+            @returns True if an entry exists for the mac, false otherwise.
+         */
+
+        bool Find( const uint8_t * mac ) const;
+
+        /**
+            Find the entry for a connect token mac, or add one if it does not exist.
+
+            Evicts entries for connect tokens that have expired before searching.
+
+            @param address The address of the client that sent the connect token.
+            @param mac The connect token mac (MacBytes).
+            @param time The current time (seconds).
+            @param expireTimestamp The timestamp when the connect token expires.
+            @param timestamp The current timestamp. Entries with expire timestamp at or before this are evicted.
+
+            @returns True if the connect token was added, or an entry already exists with the same address. False if an entry exists for a different address, which means somebody is trying to reuse this connect token in a replay attack.
+         */
+
+        bool FindOrAdd( const Address & address, const uint8_t * mac, double time, uint64_t expireTimestamp, uint64_t timestamp );
+
+        /**
+            Get the number of connect token entries currently stored.
+
+            @returns The number of entries in [0,maxEntries].
+         */
+
+        int GetNumEntries() const;
+
+        /**
+            Get the maximum number of connect token entries.
+
+            @returns The maximum number of entries passed in to the constructor.
+         */
+
+        int GetMaxEntries() const;
+
+    protected:
+
+        uint32_t HashMac( const uint8_t * mac ) const;
+
+        int FindSlot( const uint8_t * mac ) const;
+
+        void RemoveOldestEntry();
+
+    private:
+
+        Allocator * m_allocator;                                    ///< The allocator passed in to the constructor.
+
+        int m_maxEntries;                                           ///< The maximum number of entries in the ring buffer.
+
+        int m_numEntries;                                           ///< The number of entries in the ring buffer.
+
+        int m_oldestEntry;                                          ///< Index of the oldest entry in the ring buffer. Entries are added at ( m_oldestEntry + m_numEntries ) % m_maxEntries.
+
+        int m_hashMask;                                             ///< Mask for hash table slots. The hash table is sized to a power of two at least twice m_maxEntries.
+
+        uint64_t m_hashSeed;                                        ///< Random seed for the mac hash.
+
+        int * m_hashTable;                                          ///< Open addressed hash table of entry indices keyed on connect token mac. Empty slots are -1.
+
+        ConnectTokenEntry * m_entries;                              ///< Ring buffer of connect token entries.
+
+        ConnectTokenFilter( const ConnectTokenFilter & other );
+
+        const ConnectTokenFilter & operator = ( const ConnectTokenFilter & other );
+    };
+
     /**
         Server counters provide insight into the number of times an action was performed by the server.
 
@@ -136,6 +248,7 @@ namespace yojimbo
         SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_FAILED_TO_ALLOCATE_CHALLENGE_PACKET,          ///< Number of times the server ignored a connection request because it could not allocate a challenge packet to send back to the client. This would indicate that the server has insufficient global resources (packet factory, allocator) to handle the connection negotiation load. @see ClientServerConfig::serverGlobalMemory.
         SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_FAILED_TO_GENERATE_CHALLENGE_TOKEN,           ///< Number of times the server ignored a connection request because it could not generate a challenge token to send back to the client. Something is probably wrong with libsodium.
         SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_FAILED_TO_ENCRYPT_CHALLENGE_TOKEN,            ///< Number of times the server ignored a connection request because it could not encrypt a challenge token to send back to the client. Something is probably wrong with libsodium.
+        SERVER_COUNTER_CONNECTION_REQUEST_IGNORED_CIPHER_SUITE_NOT_ALLOWED,                     ///< Number of times the server ignored a connection request because the client asked for a cipher suite that the connect token doesn't allow, or that isn't available on the server.
 
         SERVER_COUNTER_CHALLENGE_RESPONSE_PACKETS_RECEIVED,                                     ///< Number of challenge response packets received by the server.
         SERVER_COUNTER_CHALLENGE_RESPONSE_ACCEPTED,                                             ///< Number of times the server accepted a challenge response and transitioned that client to connected.
@@ -155,6 +268,8 @@ namespace yojimbo
         SERVER_COUNTER_CLIENT_PACKET_FACTORY_ERRORS,                                            ///< Number of times a client was disconnected from the server because their message factory went into an error state. This indicates that the client tried to create a message but failed to do so.
         SERVER_COUNTER_GLOBAL_PACKET_FACTORY_ERRORS,                                            ///< Number of times the global packet factory entered into an error state because it could not allocate a packet. This probably indicates insufficient global memory for the connection negotiation process on the server. See ClientServerConfig::serverGlobalMemory.
         SERVER_COUNTER_GLOBAL_ALLOCATOR_ERRORS,                                                 ///< Number of times the global allocator went into error state because it could not perform an allocation. This probably indicates insufficient global memory for the connection negotiation process on the server. See ClientServerConfig::serverGlobalMemory.
+
+        SERVER_COUNTER_TIMER_EVENTS_FIRED,                                                      ///< Number of keep-alive and timeout events fired by the server timer wheels. Sample this each tick to see how many clients were visited for keep-alives and timeouts, instead of every connected client.
         
         NUM_SERVER_COUNTERS                                                                     ///< The number of server counters.
     };
@@ -177,6 +292,7 @@ namespace yojimbo
         SERVER_CONNECTION_REQUEST_IGNORED_CLIENT_ID_IS_ZERO,                                    ///< The server ignored the connection request because the client id is zero.
         SERVER_CONNECTION_REQUEST_IGNORED_ADDRESS_ALREADY_CONNECTED,                            ///< The server ignored the connection request because a client with that address is already connected.
         SERVER_CONNECTION_REQUEST_IGNORED_CLIENT_ID_ALREADY_CONNECTED,                          ///< The server ignored the connection request because a client with that client id is already connected.
+        SERVER_CONNECTION_REQUEST_IGNORED_CIPHER_SUITE_NOT_ALLOWED,                             ///< The server ignored the connection request because the client asked for a cipher suite that the connect token doesn't allow, or that isn't available on the server.
         SERVER_CONNECTION_REQUEST_IGNORED_FAILED_TO_ADD_ENCRYPTION_MAPPING,                     ///< The server ignored the connection request because it could not add an encryption mapping for that client. This is bad.
         SERVER_CONNECTION_REQUEST_IGNORED_CONNECT_TOKEN_ALREADY_USED,                           ///< The server ignored the connection request because another client has already used that connect token to connect to this server. This is bad.
         SERVER_CONNECTION_REQUEST_IGNORED_FAILED_TO_GENERATE_CHALLENGE_TOKEN,                   ///< The server ignored the connection request because it couldn't generate a challenge token. This is bad.
@@ -281,12 +397,14 @@ namespace yojimbo
             
             Each client that connects to this server occupies one of the client slots allocated by this function.
 
-            @param maxClients The number of client slots to allocate. Must be in range [1,MaxClients]
+            Per-client arrays are allocated here, and the transport is resized to hold a context mapping per-client slot. See Transport::SetMaxMappings.
+
+            @param maxClients The number of client slots to allocate. Must be in range [1,MaxServerClients]. Pass in -1 to use ClientServerConfig::maxClients.
 
             @see Server::Stop
          */
 
-        void Start( int maxClients = MaxClients );
+        void Start( int maxClients = -1 );
 
         /**
             Stop the server and free client slots.
@@ -552,6 +670,41 @@ namespace yojimbo
 
         void SendMsg( int clientIndex, Message * message, int channelId = 0 );
 
+        /**
+            Create a message to broadcast to all connected clients.
+
+            The message is allocated from a message factory in global server memory. Pass it to Server::BroadcastMsg when you are done filling it in.
+
+            IMPORTANT: Check the message pointer returned by this call. It can be NULL if there is no memory to create a message!
+
+            @param type The type of message to create. The message types corresponds to the message factory created by the Server::CreateMessageFactory method.
+
+            @returns The message created. Its reference count is 1.
+
+            @see Server::BroadcastMsg
+         */
+
+        Message * CreateBroadcastMsg( int type );
+
+        /**
+            Queue a message to be sent to all connected clients.
+
+            The message is serialized once, and each client is sent a message of the same type with the serialized payload attached, so each connection copies the payload bits into its packets instead of serializing the message again. Block messages share one copy of their block between all clients. See Message::AttachSerializedPayload and BlockMessage::AttachSharedBlock.
+
+            Messages that align the stream while serializing (eg. serialize_bytes) can't have their bits copied like that. For these, the payload is read back into a separate message for each client, and that message is serialized again when it is written into the client's packets. So aligned messages pay a read and a write per-client, and broadcasting them saves much less than broadcasting unaligned messages.
+
+            IMPORTANT: The payload is written with the connection context of the first connected client, and reused for every client. The message must serialize the same way whatever connection it is sent on. It can use ConnectionContext::connectionConfig, which is shared by all clients, but must not depend on ConnectionContext::messageFactory or anything else specific to a client.
+
+            IMPORTANT: This function takes ownership of the message. If there isn't enough global server memory to serialize the message, it is dropped, and that shows up as SERVER_COUNTER_GLOBAL_ALLOCATOR_ERRORS.
+
+            @param message The message to be sent. It must be created with Server::CreateBroadcastMsg.
+            @param channelId The id of the channel to send the message across in [0,numChannels-1].
+
+            @see Server::SendMsg
+         */
+
+        void BroadcastMsg( Message * message, int channelId = 0 );
+
         /** 
             Poll this method to receive messages sent from a client.
 
@@ -594,6 +747,43 @@ namespace yojimbo
 
         MessageFactory & GetMsgFactory( int clientIndex );
 
+        /**
+            Create a shared block to attach to messages sent to many clients.
+
+            The block data is copied once into global server memory, instead of once per-client. Attach it to block messages for as many clients as you like with BlockMessage::AttachSharedBlock, then release your reference with Server::ReleaseSharedBlock.
+
+            Shared blocks are freed inside Server::AdvanceTime once they have been released and no messages reference them anymore, so messages referencing them can be released on worker threads without touching the global allocator there. Any shared blocks left are freed by Server::Stop.
+
+            The amount of memory backing shared blocks is specified by ClientServerConfig::serverGlobalMemory.
+
+            @param blockData The block data to copy.
+            @param blockSize The size of the block (bytes).
+
+            @returns The shared block, with one reference held by the caller. NULL if it could not be allocated.
+
+            @see Server::ReleaseSharedBlock
+         */
+
+        SharedBlock * CreateSharedBlock( const uint8_t * blockData, int blockSize );
+
+        /**
+            Release the reference to a shared block returned by Server::CreateSharedBlock.
+
+            Messages the block is attached to keep it alive until they are destroyed. Don't attach the block to any more messages after this.
+
+            @param sharedBlock The shared block to release.
+         */
+
+        void ReleaseSharedBlock( SharedBlock * sharedBlock );
+
+        /**
+            Get the number of shared blocks that have not been freed yet.
+
+            @returns The number of shared blocks, including blocks that have been released but are still referenced by messages.
+         */
+
+        int GetNumSharedBlocks() const;
+
         /**
             Get the allocator used for global allocations.
 
@@ -740,6 +930,8 @@ namespace yojimbo
 
             Connection packets are carrier packets that transmit messages between the client and server. They are only generated if you enabled messages in the ClientServerConfig (true by default).
 
+            IMPORTANT: If ClientServerConfig::serverWorkerThreads is non-zero, this is called from worker threads, concurrently for different clients.
+
             @param connection The connection that the packet belongs to. To get the client index call Connection::GetClientIndex.
             @param sequence The sequence number of the connection packet being sent.
 
@@ -811,6 +1003,18 @@ namespace yojimbo
 
         virtual bool ProcessUserPacket( int clientIndex, Packet * packet );
 
+        /**
+            Override this method to control which cipher suites the server accepts in connection requests.
+
+            Connection requests asking for a cipher suite the server can't use are ignored. Clients then retry with ChaCha20-Poly1305 after ClientServerConfig::cipherSuiteFallbackTime.
+
+            @param cipherSuite The cipher suite requested by the client. See yojimbo::CipherSuite.
+
+            @returns True if the server can encrypt packets with this cipher suite. By default, this is yojimbo::IsCipherSuiteAvailable.
+         */
+
+        virtual bool CanUseCipherSuite( int cipherSuite ) const;
+
     protected:
 
         virtual void SetEncryptedPacketTypes();
@@ -831,9 +1035,27 @@ namespace yojimbo
 
         int FindFreeClientIndex() const;
 
+        void CreateClientArrays();
+
+        void DestroyClientArrays();
+
+        void AddClientLookup( int clientIndex );
+
+        void RemoveClientLookup( int clientIndex );
+
+        void AddSharedBlock( SharedBlock * sharedBlock );
+
+        void FreeSharedBlocks( bool freeAll );
+
+        SharedBlock * WriteBroadcastPayload( Message * message, const ConnectionContext * connectionContext, int & payloadBits, bool & aligned );
+
+        static void AdvanceConnectionsWorker( void * data, int workerIndex, int begin, int end );
+
+        static void GeneratePacketsWorker( void * data, int workerIndex, int begin, int end );
+
         bool FindConnectTokenEntry( const uint8_t * mac );
         
-        bool FindOrAddConnectTokenEntry( const Address & address, const uint8_t * mac );
+        bool FindOrAddConnectTokenEntry( const Address & address, const uint8_t * mac, uint64_t expireTimestamp, uint64_t timestamp );
 
         void ConnectClient( int clientIndex, const Address & clientAddress, uint64_t clientId );
 
@@ -871,11 +1093,11 @@ namespace yojimbo
 
         uint8_t * m_globalMemory;                                           ///< The block of memory backing the global allocator. Allocated with m_allocator.
 
-        uint8_t * m_clientMemory[MaxClients];                               ///< The block of memory backing the per-client allocators. Allocated with m_allocator.
+        uint8_t ** m_clientMemory;                                          ///< Per-client blocks of memory backing the per-client allocators. Allocated with m_allocator.
 
         Allocator * m_globalAllocator;                                      ///< The global allocator. This is used for allocations related to connection negotiation.
 
-        Allocator * m_clientAllocator[MaxClients];                          ///< Array of per-client allocator. These are used for allocations related to connected clients.
+        Allocator ** m_clientAllocator;                                     ///< Array of per-client allocator. These are used for allocations related to connected clients.
 
         Transport * m_transport;                                            ///< Transport interface for sending and receiving packets.
 
@@ -883,17 +1105,19 @@ namespace yojimbo
 
         TransportContext m_globalTransportContext;                          ///< Global transport context for reading and writing packets. Used for packets that don't belong to a connected client. eg. connection negotiation packets.
 
-        TransportContext m_clientTransportContext[MaxClients];              ///< Array of per-client transport contexts for reading and writing packets that belong to connected clients.
+        TransportContext * m_clientTransportContext;                        ///< Array of per-client transport contexts for reading and writing packets that belong to connected clients.
 
-        ConnectionContext m_clientConnectionContext[MaxClients];            ///< Connection context for reading and writing connection packets to connected clients. These packets contain messages sent between the client and server.
+        ConnectionContext * m_clientConnectionContext;                      ///< Connection context for reading and writing connection packets to connected clients. These packets contain messages sent between the client and server.
 
         PacketFactory * m_globalPacketFactory;                              ///< Global packet factory for creating global packets such as connection request packets and challenge response packets sent during connection negotiation.
 
-        PacketFactory * m_clientPacketFactory[MaxClients];                  ///< Per-client packet factory for creating and destroying packets sent to and received from connected clients.
+        MessageFactory * m_globalMessageFactory;                            ///< Global message factory for creating messages broadcast to all clients. NULL if messages are disabled.
+
+        PacketFactory ** m_clientPacketFactory;                             ///< Per-client packet factory for creating and destroying packets sent to and received from connected clients.
 
-        MessageFactory * m_clientMessageFactory[MaxClients];                ///< Per-client message factory for creating and destroying messages. These are only allocated if ClientServerConfig::enableMessages is true.
+        MessageFactory ** m_clientMessageFactory;                           ///< Per-client message factory for creating and destroying messages. These are only allocated if ClientServerConfig::enableMessages is true.
 
-        ReplayProtection * m_clientReplayProtection[MaxClients];            ///< Per-client protection against packet replay attacks. Discards old and already received packets.
+        ReplayProtection ** m_clientReplayProtection;                       ///< Per-client protection against packet replay attacks. Discards old and already received packets.
 
         uint8_t m_privateKey[KeyBytes];                                     ///< Private key used for encrypting and decrypting connect and challenge tokens. Must be the same between the matcher and the server and not know to clients.
 
@@ -908,26 +1132,50 @@ namespace yojimbo
         int m_maxClients;                                                   ///< The maximum number of clients supported by this server. Corresponds to maxClients passed in to the last Server::Start call.
 
         int m_numConnectedClients;                                          ///< The number of clients that are currently connected to the server.
+
+        int * m_connectedClients;                                           ///< Packed array of the client indices that are connected. Only the first m_numConnectedClients entries are valid. Per-tick loops walk this instead of every client slot.
+
+        int * m_connectedClientPosition;                                    ///< The position of each connected client index in m_connectedClients, so a client can be removed from it in constant time.
+
+        int * m_freeClients;                                                ///< Stack of free client indices. The first m_maxClients - m_numConnectedClients entries are valid.
+
+        int m_clientLookupMask;                                             ///< Mask for slots in the client lookup hash tables. The tables are sized to a power of two at least twice m_maxClients.
+
+        int * m_clientAddressLookup;                                        ///< Open addressed hash table mapping connected client address to client index. Empty slots are -1.
+
+        int * m_clientIdLookup;                                             ///< Open addressed hash table mapping connected client id to client index. Empty slots are -1.
         
-        bool m_clientConnected[MaxClients];                                 ///< Array of connected flags per-client. Provides quick testing if a client is connected by client index.
+        bool * m_clientConnected;                                           ///< Array of connected flags per-client. Provides quick testing if a client is connected by client index.
         
-        uint64_t m_clientId[MaxClients];                                    ///< Array of client id values per-client. Provides quick access to client id by client index.
+        uint64_t * m_clientId;                                              ///< Array of client id values per-client. Provides quick access to client id by client index.
 
         Address m_serverAddress;                                            ///< The address of this server (the address that clients will be connecting to).
 
         uint64_t m_globalSequence;                                          ///< The global sequence number for packets sent not corresponding to any particular connected client, eg. packets sent as part of connection negotiation.
 
-        uint64_t m_clientSequence[MaxClients];                              ///< Per-client sequence number for packets sent to this client. Resets to zero each time the client slot is reset.
+        uint64_t * m_clientSequence;                                        ///< Per-client sequence number for packets sent to this client. Resets to zero each time the client slot is reset.
 
-        Address m_clientAddress[MaxClients];                                ///< Array of client addresses. Provides quick access to client address by client index.
+        Address * m_clientAddress;                                          ///< Array of client addresses. Provides quick access to client address by client index.
         
-        ServerClientData m_clientData[MaxClients];                          ///< Per-client data. This is the bulk of the data, and contains duplicates of data used for fast access.
+        ServerClientData * m_clientData;                                    ///< Per-client data. This is the bulk of the data, and contains duplicates of data used for fast access.
 
         bool m_allocateConnections;                                         ///< True if we should allocate connection objects in start. This is true if ClientServerConfig::enableMessages is true.
 
-        Connection * m_clientConnection[MaxClients];                        ///< Per-client connection object. The connect object manages the set of channels and sending and receiving messages between client and server. Allocated in Server::Start according to maxClients and freed in Server::Stop.
+        Connection ** m_clientConnection;                                   ///< Per-client connection object. The connect object manages the set of channels and sending and receiving messages between client and server. Allocated in Server::Start according to maxClients and freed in Server::Stop.
+
+        TimerWheel * m_keepAliveTimers;                                     ///< Schedules when to send a keep-alive packet to each connected client. Indexed by client index.
+
+        TimerWheel * m_timeOutTimers;                                       ///< Schedules when to check each connected client for time out. Indexed by client index.
+
+        WorkerPool * m_workerPool;                                          ///< Worker pool for processing connected clients in parallel. Created in Server::Start if ClientServerConfig::serverWorkerThreads is non-zero, otherwise NULL.
+
+        ConnectionPacket ** m_clientGeneratedPacket;                        ///< Connection packets generated by worker threads, waiting to be sent in connected client order. Indexed by client index.
+
+        ConnectTokenFilter * m_connectTokenFilter;                          ///< Remembers recently used connect tokens. Used to avoid replay attacks of the same connect token for different addresses. Holds ConnectTokenEntriesPerClient for each client slot.
+
+        SharedBlock * m_sharedBlocks;                                       ///< Linked list of shared blocks that have not been freed yet. Allocated from the global allocator.
 
-        ConnectTokenEntry m_connectTokenEntries[MaxConnectTokenEntries];    ///< Array of connect tokens entries. Used to avoid replay attacks of the same connect token for different addresses.
+        int m_numSharedBlocks;                                              ///< The number of shared blocks in the linked list.
 
         uint64_t m_counters[NUM_SERVER_COUNTERS];                           ///< Array of server counters. Used for debugging, testing and telemetry in production environments.
 
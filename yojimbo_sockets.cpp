@@ -58,6 +58,28 @@
     #include <arpa/inet.h>
     #include <unistd.h>
     #include <errno.h>
+    #include <poll.h>
+
+    #if YOJIMBO_SOCKET_BATCHING
+    #include <sys/uio.h>
+    #include <netinet/udp.h>
+    #include <alloca.h>
+    #ifndef SOL_UDP
+    #define SOL_UDP 17
+    #endif // #ifndef SOL_UDP
+    #ifndef UDP_SEGMENT
+    #define UDP_SEGMENT 103
+    #endif // #ifndef UDP_SEGMENT
+    #ifndef UDP_GRO
+    #define UDP_GRO 104
+    #endif // #ifndef UDP_GRO
+    #endif // #if YOJIMBO_SOCKET_BATCHING
+
+    #if YOJIMBO_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #endif // #if YOJIMBO_IO_URING
     
 #else
 
@@ -70,7 +92,7 @@
 
 namespace yojimbo
 {
-    Socket::Socket( const Address & address, int sendBufferSize, int receiveBufferSize )
+    Socket::Socket( const Address & address, int sendBufferSize, int receiveBufferSize, bool reusePort )
     {
         assert( IsNetworkInitialized() );
 
@@ -78,6 +100,9 @@ namespace yojimbo
 
         m_error = SOCKET_ERROR_NONE;
 
+        m_sendSegmentationOffload = false;
+        m_receiveSegmentationOffload = false;
+
         // create socket
 
         m_socket = socket( ( address.GetType() == ADDRESS_IPV6 ) ? AF_INET6 : AF_INET, SOCK_DGRAM, IPPROTO_UDP );
@@ -118,6 +143,23 @@ namespace yojimbo
             return;
         }
 
+        // allow multiple sockets to bind to the same port
+
+        if ( reusePort )
+        {
+#if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_WINDOWS
+            m_error = SOCKET_ERROR_SOCKOPT_REUSEPORT_FAILED;
+            return;
+#else // #if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_WINDOWS
+            int yes = 1;
+            if ( setsockopt( m_socket, SOL_SOCKET, SO_REUSEPORT, (char*)&yes, sizeof(yes) ) != 0 )
+            {
+                m_error = SOCKET_ERROR_SOCKOPT_REUSEPORT_FAILED;
+                return;
+            }
+#endif // #if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_WINDOWS
+        }
+
         // bind to port
 
         if ( address.GetType() == ADDRESS_IPV6 )
@@ -260,6 +302,223 @@ namespace yojimbo
         }
     }
 
+#if YOJIMBO_SOCKET_BATCHING
+
+    static socklen_t socket_address_from( const Address & address, sockaddr_storage * socket_address )
+    {
+        memset( socket_address, 0, sizeof( sockaddr_storage ) );
+
+        if ( address.GetType() == ADDRESS_IPV6 )
+        {
+            sockaddr_in6 * socket_address6 = (sockaddr_in6*) socket_address;
+            socket_address6->sin6_family = AF_INET6;
+            socket_address6->sin6_port = htons( address.GetPort() );
+            memcpy( &socket_address6->sin6_addr, address.GetAddress6(), sizeof( socket_address6->sin6_addr ) );
+            return sizeof( sockaddr_in6 );
+        }
+        else if ( address.GetType() == ADDRESS_IPV4 )
+        {
+            sockaddr_in * socket_address4 = (sockaddr_in*) socket_address;
+            socket_address4->sin_family = AF_INET;
+            socket_address4->sin_addr.s_addr = address.GetAddress4();
+            socket_address4->sin_port = htons( (unsigned short) address.GetPort() );
+            return sizeof( sockaddr_in );
+        }
+
+        return 0;
+    }
+
+#endif // #if YOJIMBO_SOCKET_BATCHING
+
+    int Socket::SendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride, int * numSegmentedPackets, int * numFailedPackets )
+    {
+        assert( numPackets >= 0 );
+        assert( to );
+        assert( packetData );
+        assert( packetBytes );
+        assert( packetStride > 0 );
+        assert( m_socket );
+        assert( !IsError() );
+
+        if ( numSegmentedPackets )
+            *numSegmentedPackets = 0;
+
+        if ( numFailedPackets )
+            *numFailedPackets = 0;
+
+#if YOJIMBO_SOCKET_BATCHING
+
+        if ( numPackets == 0 )
+            return 0;
+
+        // build one message per-packet, or with send segmentation offload, one message per-group of consecutive 
+        // packets to the same address where each packet is the same size (the last packet in a group may be smaller).
+
+        mmsghdr * messages = (mmsghdr*) alloca( sizeof( mmsghdr ) * numPackets );
+        iovec * buffers = (iovec*) alloca( sizeof( iovec ) * numPackets );
+        sockaddr_storage * addresses = (sockaddr_storage*) alloca( sizeof( sockaddr_storage ) * numPackets );
+        int * messageFirstPacket = (int*) alloca( sizeof( int ) * numPackets );
+        int * messageNumPackets = (int*) alloca( sizeof( int ) * numPackets );
+
+        const int ControlBytes = CMSG_SPACE( sizeof( uint16_t ) );
+        uint8_t * control = m_sendSegmentationOffload ? (uint8_t*) alloca( ControlBytes * numPackets ) : NULL;
+
+        memset( messages, 0, sizeof( mmsghdr ) * numPackets );
+
+        int numMessages = 0;
+        int index = 0;
+
+        while ( index < numPackets )
+        {
+            assert( to[index].IsValid() );
+            assert( packetBytes[index] > 0 );
+            assert( packetBytes[index] <= packetStride );
+
+            const socklen_t addressLength = socket_address_from( to[index], &addresses[numMessages] );
+            if ( addressLength == 0 )
+            {
+                if ( numFailedPackets )
+                    (*numFailedPackets)++;
+                index++;
+                continue;
+            }
+
+            const int segmentBytes = packetBytes[index];
+
+            int groupPackets = 1;
+            int groupBytes = segmentBytes;
+
+            if ( m_sendSegmentationOffload )
+            {
+                while ( index + groupPackets < numPackets && groupPackets < MaxSocketSegments )
+                {
+                    const int next = index + groupPackets;
+                    if ( packetBytes[next-1] != segmentBytes || packetBytes[next] > segmentBytes )
+                        break;
+                    if ( groupBytes + packetBytes[next] > MaxSocketSegmentBytes )
+                        break;
+                    if ( to[next] != to[index] )
+                        break;
+                    groupBytes += packetBytes[next];
+                    groupPackets++;
+                }
+            }
+
+            for ( int i = 0; i < groupPackets; ++i )
+            {
+                buffers[index+i].iov_base = (void*) ( packetData + ( index + i ) * packetStride );
+                buffers[index+i].iov_len = packetBytes[index+i];
+            }
+
+            msghdr & header = messages[numMessages].msg_hdr;
+            header.msg_name = &addresses[numMessages];
+            header.msg_namelen = addressLength;
+            header.msg_iov = &buffers[index];
+            header.msg_iovlen = groupPackets;
+
+            if ( groupPackets > 1 )
+            {
+                header.msg_control = control + numMessages * ControlBytes;
+                header.msg_controllen = ControlBytes;
+                memset( header.msg_control, 0, ControlBytes );
+                cmsghdr * cmsg = CMSG_FIRSTHDR( &header );
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN( sizeof( uint16_t ) );
+                const uint16_t segmentSize = (uint16_t) segmentBytes;
+                memcpy( CMSG_DATA( cmsg ), &segmentSize, sizeof( uint16_t ) );
+            }
+
+            messageFirstPacket[numMessages] = index;
+            messageNumPackets[numMessages] = groupPackets;
+
+            numMessages++;
+            index += groupPackets;
+        }
+
+        // sendmmsg may send only part of the batch. keep going until the whole batch is sent. 
+        // if the socket send buffer is full, stop and drop the rest of the batch, instead of retrying it one message at a time.
+        // if a send fails for any other reason, skip over the message that failed, just like a failed sendto would drop the packet.
+        // if the kernel rejects a segmented send, disable send segmentation offload and send those packets individually.
+
+        int numSystemCalls = 0;
+        int messageIndex = 0;
+
+        while ( messageIndex < numMessages )
+        {
+            const int result = sendmmsg( m_socket, messages + messageIndex, numMessages - messageIndex, 0 );
+
+            numSystemCalls++;
+
+            if ( result > 0 )
+            {
+                if ( numSegmentedPackets )
+                {
+                    for ( int i = messageIndex; i < messageIndex + result; ++i )
+                    {
+                        if ( messageNumPackets[i] > 1 )
+                            *numSegmentedPackets += messageNumPackets[i];
+                    }
+                }
+
+                messageIndex += result;
+                continue;
+            }
+
+            const int error = errno;
+
+            if ( error == EAGAIN || error == EWOULDBLOCK )
+            {
+                debug_printf( "sendmmsg would block. dropping the rest of the batch\n" );
+
+                if ( numFailedPackets )
+                {
+                    for ( int i = messageIndex; i < numMessages; ++i )
+                        *numFailedPackets += messageNumPackets[i];
+                }
+
+                break;
+            }
+
+            if ( messageNumPackets[messageIndex] > 1 && ( error == EIO || error == EINVAL ) )
+            {
+                debug_printf( "send segmentation offload failed with error %d. disabling it\n", error );
+
+                m_sendSegmentationOffload = false;
+
+                const int first = messageFirstPacket[messageIndex];
+
+                for ( int i = first; i < first + messageNumPackets[messageIndex]; ++i )
+                {
+                    SendPacket( to[i], packetData + i * packetStride, packetBytes[i] );
+                    numSystemCalls++;
+                }
+            }
+            else
+            {
+                debug_printf( "sendmmsg failed with error %d\n", error );
+
+                if ( numFailedPackets )
+                    *numFailedPackets += messageNumPackets[messageIndex];
+            }
+
+            messageIndex++;
+        }
+
+        return numSystemCalls;
+
+#else // #if YOJIMBO_SOCKET_BATCHING
+
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            SendPacket( to[i], packetData + i * packetStride, packetBytes[i] );
+        }
+
+        return numPackets;
+
+#endif // #if YOJIMBO_SOCKET_BATCHING
+    }
+
     int Socket::ReceivePacket( Address & from, void * packetData, int maxPacketSize )
     {
         assert( m_socket );
@@ -308,10 +567,783 @@ namespace yojimbo
         return bytesRead;
     }
 
+    int Socket::ReceivePackets( int maxPackets, Address * from, uint8_t * packetData, int * packetBytes, int maxPacketSize, int * numSystemCalls )
+    {
+        assert( m_socket );
+        assert( maxPackets > 0 );
+        assert( from );
+        assert( packetData );
+        assert( packetBytes );
+        assert( maxPacketSize > 0 );
+
+        if ( numSystemCalls )
+            *numSystemCalls = 0;
+
+#if YOJIMBO_SOCKET_BATCHING
+
+        mmsghdr * messages = (mmsghdr*) alloca( sizeof( mmsghdr ) * maxPackets );
+        iovec * buffers = (iovec*) alloca( sizeof( iovec ) * maxPackets );
+        sockaddr_storage * addresses = (sockaddr_storage*) alloca( sizeof( sockaddr_storage ) * maxPackets );
+
+        memset( messages, 0, sizeof( mmsghdr ) * maxPackets );
+
+        for ( int i = 0; i < maxPackets; ++i )
+        {
+            buffers[i].iov_base = packetData + i * maxPacketSize;
+            buffers[i].iov_len = maxPacketSize;
+            messages[i].msg_hdr.msg_name = &addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof( sockaddr_storage );
+            messages[i].msg_hdr.msg_iov = &buffers[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int result = recvmmsg( m_socket, messages, maxPackets, MSG_DONTWAIT, NULL );
+
+        if ( numSystemCalls )
+            *numSystemCalls = 1;
+
+        if ( result <= 0 )
+        {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                return 0;
+
+            debug_printf( "recvmmsg failed with error %d\n", errno );
+
+            return 0;
+        }
+
+        // discard empty and truncated packets. compact the rest to the front of the batch
+
+        int numPackets = 0;
+
+        for ( int i = 0; i < result; ++i )
+        {
+            if ( messages[i].msg_len == 0 || ( messages[i].msg_hdr.msg_flags & MSG_TRUNC ) )
+                continue;
+
+            if ( numPackets != i )
+                memcpy( packetData + numPackets * maxPacketSize, packetData + i * maxPacketSize, messages[i].msg_len );
+
+            from[numPackets] = Address( &addresses[i] );
+            packetBytes[numPackets] = (int) messages[i].msg_len;
+            numPackets++;
+        }
+
+        return numPackets;
+
+#else // #if YOJIMBO_SOCKET_BATCHING
+
+        int numPackets = 0;
+
+        while ( numPackets < maxPackets )
+        {
+            const int bytesRead = ReceivePacket( from[numPackets], packetData + numPackets * maxPacketSize, maxPacketSize );
+
+            if ( numSystemCalls )
+                (*numSystemCalls)++;
+
+            if ( !bytesRead )
+                break;
+
+            packetBytes[numPackets] = bytesRead;
+            numPackets++;
+        }
+
+        return numPackets;
+
+#endif // #if YOJIMBO_SOCKET_BATCHING
+    }
+
+    bool Socket::WaitForPackets( double timeout )
+    {
+        assert( m_socket );
+        assert( timeout >= 0.0 );
+
+#if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_WINDOWS
+
+        // fd_set on windows is an array of socket handles, so select works for any socket value
+
+        fd_set readSet;
+        FD_ZERO( &readSet );
+        FD_SET( m_socket, &readSet );
+
+        timeval tv;
+        tv.tv_sec = (long) timeout;
+        tv.tv_usec = (long) ( ( timeout - tv.tv_sec ) * 1000000.0 );
+
+        return select( (int) m_socket + 1, &readSet, NULL, NULL, &tv ) > 0;
+
+#else // #if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_WINDOWS
+
+        // poll instead of select, since FD_SET is undefined for file descriptors >= FD_SETSIZE, and servers with many sockets open can go past that
+
+        pollfd fd;
+        fd.fd = m_socket;
+        fd.events = POLLIN;
+        fd.revents = 0;
+
+        // round up to the next millisecond, so short timeouts still wait instead of spinning
+
+        const int timeoutMilliseconds = (int) ceil( timeout * 1000.0 );
+
+        return poll( &fd, 1, timeoutMilliseconds ) > 0;
+
+#endif // #if YOJIMBO_PLATFORM == YOJIMBO_PLATFORM_WINDOWS
+    }
+
+    void Socket::EnableSegmentationOffload()
+    {
+        assert( m_socket );
+        assert( !IsError() );
+
+#if YOJIMBO_SOCKET_BATCHING
+
+        // setting the segment size to zero on the socket has no effect, other than telling us if the kernel supports UDP_SEGMENT
+
+        int segmentSize = 0;
+        m_sendSegmentationOffload = setsockopt( m_socket, SOL_UDP, UDP_SEGMENT, &segmentSize, sizeof( segmentSize ) ) == 0;
+
+        int enable = 1;
+        m_receiveSegmentationOffload = setsockopt( m_socket, SOL_UDP, UDP_GRO, &enable, sizeof( enable ) ) == 0;
+
+#endif // #if YOJIMBO_SOCKET_BATCHING
+    }
+
+    bool Socket::IsSendSegmentationOffloadEnabled() const
+    {
+        return m_sendSegmentationOffload;
+    }
+
+    bool Socket::IsReceiveSegmentationOffloadEnabled() const
+    {
+        return m_receiveSegmentationOffload;
+    }
+
+    int Socket::ReceiveSegments( int maxDatagrams, Address * from, uint8_t * buffer, int * datagramBytes, int * segmentBytes, int datagramStride, int * numSystemCalls )
+    {
+        assert( m_socket );
+        assert( maxDatagrams > 0 );
+        assert( from );
+        assert( buffer );
+        assert( datagramBytes );
+        assert( segmentBytes );
+        assert( datagramStride > 0 );
+
+        if ( numSystemCalls )
+            *numSystemCalls = 0;
+
+#if YOJIMBO_SOCKET_BATCHING
+
+        // each datagram gets its own control message buffer, so the segment size reported by UDP_GRO is per-datagram
+
+        const int controlBytes = CMSG_SPACE( sizeof( int ) );
+
+        mmsghdr * messages = (mmsghdr*) alloca( sizeof( mmsghdr ) * maxDatagrams );
+        iovec * buffers = (iovec*) alloca( sizeof( iovec ) * maxDatagrams );
+        sockaddr_storage * addresses = (sockaddr_storage*) alloca( sizeof( sockaddr_storage ) * maxDatagrams );
+        uint8_t * control = (uint8_t*) alloca( controlBytes * maxDatagrams );
+
+        memset( messages, 0, sizeof( mmsghdr ) * maxDatagrams );
+        memset( control, 0, controlBytes * maxDatagrams );
+
+        for ( int i = 0; i < maxDatagrams; ++i )
+        {
+            buffers[i].iov_base = buffer + i * datagramStride;
+            buffers[i].iov_len = datagramStride;
+            messages[i].msg_hdr.msg_name = &addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof( sockaddr_storage );
+            messages[i].msg_hdr.msg_iov = &buffers[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = control + i * controlBytes;
+            messages[i].msg_hdr.msg_controllen = controlBytes;
+        }
+
+        const int result = recvmmsg( m_socket, messages, maxDatagrams, MSG_DONTWAIT, NULL );
+
+        if ( numSystemCalls )
+            *numSystemCalls = 1;
+
+        if ( result <= 0 )
+        {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK )
+                return 0;
+
+            debug_printf( "recvmmsg failed with error %d\n", errno );
+
+            return 0;
+        }
+
+        // discard empty and truncated datagrams. compact the rest to the front of the batch
+
+        int numDatagrams = 0;
+
+        for ( int i = 0; i < result; ++i )
+        {
+            const int bytes = (int) messages[i].msg_len;
+
+            if ( bytes == 0 || ( messages[i].msg_hdr.msg_flags & MSG_TRUNC ) )
+                continue;
+
+            int segmentSize = bytes;
+
+            for ( cmsghdr * cmsg = CMSG_FIRSTHDR( &messages[i].msg_hdr ); cmsg; cmsg = CMSG_NXTHDR( &messages[i].msg_hdr, cmsg ) )
+            {
+                if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO )
+                {
+                    int value = 0;
+                    memcpy( &value, CMSG_DATA( cmsg ), sizeof( int ) );
+                    if ( value > 0 && value < bytes )
+                        segmentSize = value;
+                }
+            }
+
+            if ( numDatagrams != i )
+                memcpy( buffer + numDatagrams * datagramStride, buffer + i * datagramStride, bytes );
+
+            from[numDatagrams] = Address( &addresses[i] );
+            datagramBytes[numDatagrams] = bytes;
+            segmentBytes[numDatagrams] = segmentSize;
+            numDatagrams++;
+        }
+
+        return numDatagrams;
+
+#else // #if YOJIMBO_SOCKET_BATCHING
+
+        int numDatagrams = 0;
+
+        while ( numDatagrams < maxDatagrams )
+        {
+            const int bytesRead = ReceivePacket( from[numDatagrams], buffer + numDatagrams * datagramStride, datagramStride );
+
+            if ( numSystemCalls )
+                (*numSystemCalls)++;
+
+            if ( !bytesRead )
+                break;
+
+            datagramBytes[numDatagrams] = bytesRead;
+            segmentBytes[numDatagrams] = bytesRead;
+            numDatagrams++;
+        }
+
+        return numDatagrams;
+
+#endif // #if YOJIMBO_SOCKET_BATCHING
+    }
+
     const Address & Socket::GetAddress() const
     {
         return m_address;
     }
 
+#if YOJIMBO_IO_URING
+
+    static const uint64_t IOUringReceiveTag = 1;
+    static const uint64_t IOUringSendTag = 2;
+    static const uint64_t IOUringCancelTag = 3;
+
+    struct IOUringState
+    {
+        int ring;                                                   ///< The io_uring file descriptor. -1 if not created.
+        SocketHandle socket;                                        ///< The socket file descriptor to do IO on.
+        bool error;                                                 ///< True if io_uring is in an error state.
+
+        uint8_t * rings;                                            ///< Mapped submission and completion queue rings (IORING_FEAT_SINGLE_MMAP).
+        size_t ringsBytes;
+        io_uring_sqe * sqes;                                        ///< Mapped submission queue entries.
+        size_t sqesBytes;
+
+        unsigned * sqHead;
+        unsigned * sqTail;
+        unsigned * sqArray;
+        unsigned sqMask;
+        unsigned sqEntries;
+        int numUnsubmitted;                                         ///< Number of submission queue entries added since the last call to io_uring_enter.
+
+        unsigned * cqHead;
+        unsigned * cqTail;
+        io_uring_cqe * cqes;
+        unsigned cqMask;
+
+        io_uring_buf_ring * bufferRing;                             ///< Mapped ring of provided receive buffers.
+        size_t bufferRingBytes;
+        uint16_t bufferRingTail;
+        uint8_t * bufferData;                                       ///< Receive buffer data. Buffer n is at offset n * bufferSize.
+        int numBuffers;
+        int bufferSize;
+
+        msghdr receiveHeader;                                       ///< Template message header for multishot recvmsg. Must stay valid while the receive is armed.
+        bool receiveArmed;                                          ///< True while the multishot recvmsg is outstanding.
+
+        int * pendingBuffer;                                        ///< Ring of completed receive buffer ids that have not been read yet.
+        int * pendingBytes;                                         ///< Number of bytes written to each pending receive buffer.
+        int pendingHead;
+        int numPending;
+
+        int maxSendPackets;
+        int numSendsInFlight;
+        msghdr * sendHeaders;
+        iovec * sendBuffers;
+        sockaddr_storage * sendAddresses;
+    };
+
+    static int io_uring_enter_syscall( int ring, unsigned toSubmit, unsigned minComplete, unsigned flags )
+    {
+        return (int) syscall( __NR_io_uring_enter, ring, toSubmit, minComplete, flags, NULL, 0 );
+    }
+
+    static io_uring_sqe * io_uring_get_sqe( IOUringState & state )
+    {
+        const unsigned head = __atomic_load_n( state.sqHead, __ATOMIC_ACQUIRE );
+        const unsigned tail = *state.sqTail;
+        if ( tail - head >= state.sqEntries )
+            return NULL;
+        const unsigned index = tail & state.sqMask;
+        state.sqArray[index] = index;
+        io_uring_sqe * sqe = &state.sqes[index];
+        memset( sqe, 0, sizeof( io_uring_sqe ) );
+        __atomic_store_n( state.sqTail, tail + 1, __ATOMIC_RELEASE );
+        state.numUnsubmitted++;
+        return sqe;
+    }
+
+    static bool io_uring_submit( IOUringState & state, unsigned minComplete )
+    {
+        while ( true )
+        {
+            const unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+            const int result = io_uring_enter_syscall( state.ring, state.numUnsubmitted, minComplete, flags );
+            if ( result >= 0 )
+            {
+                state.numUnsubmitted -= ( result < state.numUnsubmitted ) ? result : state.numUnsubmitted;
+                return true;
+            }
+            if ( errno != EINTR )
+            {
+                debug_printf( "io_uring_enter failed with error %d\n", errno );
+                state.error = true;
+                return false;
+            }
+        }
+    }
+
+    static void io_uring_return_buffer( IOUringState & state, int bufferId )
+    {
+        // index from the start of the ring rather than through io_uring_buf_ring::bufs. older kernel headers declare bufs with a
+        // flexible array wrapper that lands at the wrong offset when compiled as C++. the first entry overlaps the ring tail
+
+        io_uring_buf * buffers = (io_uring_buf*) state.bufferRing;
+        io_uring_buf & buffer = buffers[state.bufferRingTail & ( state.numBuffers - 1 )];
+        buffer.addr = (uint64_t) ( state.bufferData + bufferId * state.bufferSize );
+        buffer.len = state.bufferSize;
+        buffer.bid = (uint16_t) bufferId;
+        state.bufferRingTail++;
+    }
+
+    static void io_uring_publish_buffers( IOUringState & state )
+    {
+        __atomic_store_n( &state.bufferRing->tail, state.bufferRingTail, __ATOMIC_RELEASE );
+    }
+
+    static bool io_uring_arm_receive( IOUringState & state )
+    {
+        assert( !state.receiveArmed );
+
+        io_uring_sqe * sqe = io_uring_get_sqe( state );
+        if ( !sqe )
+            return false;
+
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = state.socket;
+        sqe->addr = (uint64_t) &state.receiveHeader;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->user_data = IOUringReceiveTag;
+
+        state.receiveArmed = true;
+
+        return true;
+    }
+
+    static void io_uring_reap_completions( IOUringState & state )
+    {
+        unsigned head = *state.cqHead;
+        const unsigned tail = __atomic_load_n( state.cqTail, __ATOMIC_ACQUIRE );
+
+        while ( head != tail )
+        {
+            const io_uring_cqe & cqe = state.cqes[head & state.cqMask];
+
+            if ( cqe.user_data == IOUringSendTag )
+            {
+                if ( cqe.res < 0 )
+                {
+                    debug_printf( "io_uring sendmsg failed with error %d\n", -cqe.res );
+                }
+
+                assert( state.numSendsInFlight > 0 );
+                state.numSendsInFlight--;
+            }
+            else if ( cqe.user_data == IOUringReceiveTag )
+            {
+                if ( cqe.res >= 0 && ( cqe.flags & IORING_CQE_F_BUFFER ) )
+                {
+                    assert( state.numPending < state.numBuffers );
+                    const int index = ( state.pendingHead + state.numPending ) % state.numBuffers;
+                    state.pendingBuffer[index] = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                    state.pendingBytes[index] = cqe.res;
+                    state.numPending++;
+                }
+                else if ( cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED )
+                {
+                    // multishot recvmsg is not supported by this kernel, or something else has gone badly wrong
+
+                    debug_printf( "io_uring recvmsg failed with error %d\n", -cqe.res );
+                    state.error = true;
+                }
+
+                if ( !( cqe.flags & IORING_CQE_F_MORE ) )
+                    state.receiveArmed = false;
+            }
+
+            head++;
+        }
+
+        __atomic_store_n( state.cqHead, head, __ATOMIC_RELEASE );
+    }
+
+    IOUringSocket::IOUringSocket( Allocator & allocator, Socket & socket, int maxPacketSize, int numReceiveBuffers, int maxSendPackets )
+    {
+        assert( !socket.IsError() );
+        assert( maxPacketSize > 0 );
+        assert( numReceiveBuffers > 0 );
+        assert( ( numReceiveBuffers & ( numReceiveBuffers - 1 ) ) == 0 );
+        assert( numReceiveBuffers <= 32768 );
+        assert( maxSendPackets > 0 );
+
+        m_allocator = &allocator;
+
+        m_state = YOJIMBO_NEW( allocator, IOUringState );
+
+        IOUringState & state = *m_state;
+
+        memset( &state, 0, sizeof( IOUringState ) );
+
+        state.ring = -1;
+        state.socket = socket.m_socket;
+        state.numBuffers = numReceiveBuffers;
+        state.bufferSize = sizeof( io_uring_recvmsg_out ) + sizeof( sockaddr_storage ) + maxPacketSize;
+        state.maxSendPackets = maxSendPackets;
+
+        state.pendingBuffer = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * numReceiveBuffers );
+        state.pendingBytes = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * numReceiveBuffers );
+        state.bufferData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, numReceiveBuffers * state.bufferSize );
+        state.sendHeaders = (msghdr*) YOJIMBO_ALLOCATE( allocator, sizeof( msghdr ) * maxSendPackets );
+        state.sendBuffers = (iovec*) YOJIMBO_ALLOCATE( allocator, sizeof( iovec ) * maxSendPackets );
+        state.sendAddresses = (sockaddr_storage*) YOJIMBO_ALLOCATE( allocator, sizeof( sockaddr_storage ) * maxSendPackets );
+
+        // create the ring. the completion queue must be large enough for a full set of receive buffers plus a send batch
+
+        io_uring_params params;
+        memset( &params, 0, sizeof( params ) );
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = numReceiveBuffers * 2 + maxSendPackets;
+
+        state.ring = (int) syscall( __NR_io_uring_setup, maxSendPackets + 1, &params );
+
+        if ( state.ring < 0 || !( params.features & IORING_FEAT_SINGLE_MMAP ) )
+        {
+            debug_printf( "io_uring_setup failed\n" );
+            state.error = true;
+            return;
+        }
+
+        const size_t sqRingBytes = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+        const size_t cqRingBytes = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+
+        state.ringsBytes = ( sqRingBytes > cqRingBytes ) ? sqRingBytes : cqRingBytes;
+        state.rings = (uint8_t*) mmap( NULL, state.ringsBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state.ring, IORING_OFF_SQ_RING );
+        if ( state.rings == MAP_FAILED )
+        {
+            state.rings = NULL;
+            state.error = true;
+            return;
+        }
+
+        state.sqesBytes = params.sq_entries * sizeof( io_uring_sqe );
+        state.sqes = (io_uring_sqe*) mmap( NULL, state.sqesBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state.ring, IORING_OFF_SQES );
+        if ( state.sqes == MAP_FAILED )
+        {
+            state.sqes = NULL;
+            state.error = true;
+            return;
+        }
+
+        state.sqHead = (unsigned*) ( state.rings + params.sq_off.head );
+        state.sqTail = (unsigned*) ( state.rings + params.sq_off.tail );
+        state.sqArray = (unsigned*) ( state.rings + params.sq_off.array );
+        state.sqMask = *(unsigned*) ( state.rings + params.sq_off.ring_mask );
+        state.sqEntries = params.sq_entries;
+
+        state.cqHead = (unsigned*) ( state.rings + params.cq_off.head );
+        state.cqTail = (unsigned*) ( state.rings + params.cq_off.tail );
+        state.cqes = (io_uring_cqe*) ( state.rings + params.cq_off.cqes );
+        state.cqMask = *(unsigned*) ( state.rings + params.cq_off.ring_mask );
+
+        // register the ring of provided receive buffers. the ring itself must be page aligned, so map it
+
+        state.bufferRingBytes = numReceiveBuffers * sizeof( io_uring_buf );
+        state.bufferRing = (io_uring_buf_ring*) mmap( NULL, state.bufferRingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( state.bufferRing == MAP_FAILED )
+        {
+            state.bufferRing = NULL;
+            state.error = true;
+            return;
+        }
+
+        io_uring_buf_reg bufferRegister;
+        memset( &bufferRegister, 0, sizeof( bufferRegister ) );
+        bufferRegister.ring_addr = (uint64_t) state.bufferRing;
+        bufferRegister.ring_entries = numReceiveBuffers;
+        bufferRegister.bgid = 0;
+
+        if ( syscall( __NR_io_uring_register, state.ring, IORING_REGISTER_PBUF_RING, &bufferRegister, 1 ) != 0 )
+        {
+            debug_printf( "io_uring failed to register receive buffers\n" );
+            state.error = true;
+            return;
+        }
+
+        for ( int i = 0; i < numReceiveBuffers; ++i )
+            io_uring_return_buffer( state, i );
+
+        io_uring_publish_buffers( state );
+
+        // arm the multishot recvmsg. the kernel reserves space for the sender address at the start of each buffer
+
+        state.receiveHeader.msg_namelen = sizeof( sockaddr_storage );
+
+        if ( !io_uring_arm_receive( state ) || !io_uring_submit( state, 0 ) )
+        {
+            state.error = true;
+            return;
+        }
+    }
+
+    IOUringSocket::~IOUringSocket()
+    {
+        assert( m_state );
+        assert( m_allocator );
+
+        IOUringState & state = *m_state;
+
+        // cancel the multishot recvmsg and wait for it to finish, so the kernel stops writing to receive buffers before they are freed
+
+        if ( state.ring >= 0 && state.receiveArmed && !state.error )
+        {
+            io_uring_sqe * sqe = io_uring_get_sqe( state );
+            if ( sqe )
+            {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = IOUringReceiveTag;
+                sqe->user_data = IOUringCancelTag;
+
+                io_uring_submit( state, 0 );
+
+                while ( state.receiveArmed && !state.error )
+                {
+                    io_uring_reap_completions( state );
+                    if ( state.receiveArmed )
+                        io_uring_submit( state, 1 );
+                }
+            }
+        }
+
+        if ( state.sqes )
+            munmap( state.sqes, state.sqesBytes );
+
+        if ( state.rings )
+            munmap( state.rings, state.ringsBytes );
+
+        if ( state.ring >= 0 )
+            close( state.ring );
+
+        if ( state.bufferRing )
+            munmap( state.bufferRing, state.bufferRingBytes );
+
+        YOJIMBO_FREE( *m_allocator, state.pendingBuffer );
+        YOJIMBO_FREE( *m_allocator, state.pendingBytes );
+        YOJIMBO_FREE( *m_allocator, state.bufferData );
+        YOJIMBO_FREE( *m_allocator, state.sendHeaders );
+        YOJIMBO_FREE( *m_allocator, state.sendBuffers );
+        YOJIMBO_FREE( *m_allocator, state.sendAddresses );
+
+        YOJIMBO_DELETE( *m_allocator, IOUringState, m_state );
+    }
+
+    bool IOUringSocket::IsError() const
+    {
+        return m_state->error;
+    }
+
+    int IOUringSocket::SendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride )
+    {
+        assert( numPackets >= 0 );
+        assert( to );
+        assert( packetData );
+        assert( packetBytes );
+        assert( packetStride > 0 );
+
+        IOUringState & state = *m_state;
+
+        if ( state.error )
+            return 0;
+
+        int numSystemCalls = 0;
+
+        int index = 0;
+
+        while ( index < numPackets )
+        {
+            const int remaining = numPackets - index;
+            const int batchSize = ( remaining < state.maxSendPackets ) ? remaining : state.maxSendPackets;
+
+            int numQueued = 0;
+
+            for ( int i = 0; i < batchSize; ++i )
+            {
+                const int packetIndex = index + i;
+
+                assert( packetBytes[packetIndex] > 0 );
+                assert( packetBytes[packetIndex] <= packetStride );
+
+                const socklen_t addressLength = socket_address_from( to[packetIndex], &state.sendAddresses[numQueued] );
+                if ( addressLength == 0 )
+                    continue;
+
+                state.sendBuffers[numQueued].iov_base = (void*) ( packetData + packetIndex * packetStride );
+                state.sendBuffers[numQueued].iov_len = packetBytes[packetIndex];
+
+                msghdr & header = state.sendHeaders[numQueued];
+                memset( &header, 0, sizeof( msghdr ) );
+                header.msg_name = &state.sendAddresses[numQueued];
+                header.msg_namelen = addressLength;
+                header.msg_iov = &state.sendBuffers[numQueued];
+                header.msg_iovlen = 1;
+
+                io_uring_sqe * sqe = io_uring_get_sqe( state );
+                assert( sqe );
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->fd = state.socket;
+                sqe->addr = (uint64_t) &header;
+                sqe->len = 1;
+                sqe->user_data = IOUringSendTag;
+
+                numQueued++;
+            }
+
+            state.numSendsInFlight += numQueued;
+
+            // submit and wait for the sends to complete, so the send headers and packet data can be reused
+
+            if ( numQueued > 0 )
+            {
+                if ( !io_uring_submit( state, numQueued ) )
+                    return numSystemCalls;
+
+                numSystemCalls++;
+
+                io_uring_reap_completions( state );
+
+                while ( state.numSendsInFlight > 0 && !state.error )
+                {
+                    if ( !io_uring_submit( state, 1 ) )
+                        return numSystemCalls;
+
+                    numSystemCalls++;
+
+                    io_uring_reap_completions( state );
+                }
+            }
+
+            index += batchSize;
+        }
+
+        return numSystemCalls;
+    }
+
+    int IOUringSocket::ReceivePackets( int maxPackets, Address * from, uint8_t * packetData, int * packetBytes, int maxPacketSize, int & numSystemCalls )
+    {
+        assert( maxPackets > 0 );
+        assert( from );
+        assert( packetData );
+        assert( packetBytes );
+        assert( maxPacketSize > 0 );
+
+        IOUringState & state = *m_state;
+
+        numSystemCalls = 0;
+
+        if ( state.error )
+            return 0;
+
+        // completions are posted to shared memory by the kernel, so no system call is needed to check for received packets
+
+        io_uring_reap_completions( state );
+
+        int numPackets = 0;
+
+        while ( state.numPending > 0 && numPackets < maxPackets )
+        {
+            const int bufferId = state.pendingBuffer[state.pendingHead];
+            const int bufferBytes = state.pendingBytes[state.pendingHead];
+
+            state.pendingHead = ( state.pendingHead + 1 ) % state.numBuffers;
+            state.numPending--;
+
+            const uint8_t * buffer = state.bufferData + bufferId * state.bufferSize;
+            const io_uring_recvmsg_out * out = (const io_uring_recvmsg_out*) buffer;
+            const uint8_t * name = buffer + sizeof( io_uring_recvmsg_out );
+            const uint8_t * payload = name + state.receiveHeader.msg_namelen + state.receiveHeader.msg_controllen;
+            const int payloadBytes = (int) out->payloadlen;
+
+            const bool valid = bufferBytes >= (int) sizeof( io_uring_recvmsg_out ) && 
+                               !( out->flags & MSG_TRUNC ) && 
+                               payloadBytes > 0 && 
+                               payloadBytes <= maxPacketSize;
+
+            if ( valid )
+            {
+                sockaddr_storage address;
+                memset( &address, 0, sizeof( address ) );
+                memcpy( &address, name, ( out->namelen < sizeof( address ) ) ? out->namelen : sizeof( address ) );
+
+                memcpy( packetData + numPackets * maxPacketSize, payload, payloadBytes );
+                from[numPackets] = Address( &address );
+                packetBytes[numPackets] = payloadBytes;
+                numPackets++;
+            }
+
+            io_uring_return_buffer( state, bufferId );
+        }
+
+        io_uring_publish_buffers( state );
+
+        // the multishot recvmsg stops when it runs out of buffers, or if the kernel decides to stop it. re-arm it once buffers are available
+
+        if ( !state.receiveArmed && !state.error && state.numPending == 0 )
+        {
+            if ( io_uring_arm_receive( state ) && io_uring_submit( state, 0 ) )
+                numSystemCalls++;
+        }
+
+        return numPackets;
+    }
+
+#endif // #if YOJIMBO_IO_URING
+
 #endif // #if YOJIMBO_SOCKETS
 }
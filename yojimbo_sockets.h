@@ -28,6 +28,7 @@
 #include "yojimbo_config.h"
 #include "yojimbo_address.h"
 #include "yojimbo_transport.h"
+#include "yojimbo_allocator.h"
 
 #include <stdint.h>
 #include <assert.h>
@@ -52,6 +53,7 @@ namespace yojimbo
         SOCKET_ERROR_SOCKOPT_IPV6_ONLY_FAILED,                              ///< Setting the socket as IPv6 only failed.
         SOCKET_ERROR_SOCKOPT_RCVBUF_FAILED,                                 ///< Setting the socket receive buffer size failed.
         SOCKET_ERROR_SOCKOPT_SNDBUF_FAILED,                                 ///< Setting the socket send buffer size failed.
+        SOCKET_ERROR_SOCKOPT_REUSEPORT_FAILED,                              ///< Setting the socket to reuse the port failed (SO_REUSEPORT). Not supported on Windows.
         SOCKET_ERROR_BIND_IPV4_FAILED,                                      ///< Failed to bind the socket (IPv4).
         SOCKET_ERROR_BIND_IPV6_FAILED,                                      ///< Failed to bind the socket (IPv6).
         SOCKET_ERROR_GET_SOCKNAME_IPV4_FAILED,                              ///< Call to getsockname failed on the socket (IPv4).
@@ -88,9 +90,10 @@ namespace yojimbo
             @param address The address to bind the socket to.
             @param sendBufferSize The size of the send buffer to set on the socket (SO_SNDBUF).
             @param receiveBufferSize The size of the receive buffer to set on the socket (SO_RCVBUF).
+            @param reusePort If true, set SO_REUSEPORT so multiple sockets can bind to the same address and port. On Linux, the kernel spreads incoming packets across these sockets by source address.
          */
 
-        explicit Socket( const Address & address, int sendBufferSize = 1024*1024, int receiveBufferSize = 1024*1024 );
+        explicit Socket( const Address & address, int sendBufferSize = 1024*1024, int receiveBufferSize = 1024*1024, bool reusePort = false );
 
         /**
             Socket destructor.
@@ -133,6 +136,29 @@ namespace yojimbo
          */
 
         void SendPacket( const Address & to, const void * packetData, size_t packetBytes );
+
+        /**
+            Send a batch of packets using this socket.
+
+            With YOJIMBO_SOCKET_BATCHING the batch is sent with sendmmsg, which usually sends the whole batch with one system call. Otherwise, it falls back to calling Socket::SendPacket for each packet.
+
+            If send segmentation offload is enabled, consecutive packets to the same address with the same size are sent as a single UDP_SEGMENT datagram, which the kernel (or network card) splits back into individual packets. The last packet in each group may be smaller than the others.
+
+            Packets are sent unreliably over UDP, just like Socket::SendPacket.
+
+            @param numPackets The number of packets to send.
+            @param to Array of addresses to send each packet to.
+            @param packetData Contiguous buffer of packet data. Packet n is read from offset n * packetStride.
+            @param packetBytes Array of packet sizes in bytes.
+            @param packetStride The distance in bytes between the start of consecutive packets in the packet data buffer.
+
+            @param numSegmentedPackets The number of packets that were sent as part of a larger datagram with UDP segmentation offload [out]. Optional. Pass in NULL if not needed.
+            @param numFailedPackets The number of packets that could not be sent [out]. When the socket send buffer is full, the rest of the batch is dropped and counted here. Optional. Pass in NULL if not needed.
+
+            @returns The number of system calls made to send the batch.
+         */
+
+        int SendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride, int * numSegmentedPackets = NULL, int * numFailedPackets = NULL );
     
         /**
             Receive a packet from the network (non-blocking).
@@ -146,6 +172,88 @@ namespace yojimbo
 
         int ReceivePacket( Address & from, void * packetData, int maxPacketSize );
 
+        /**
+            Receive a batch of packets from the network (non-blocking).
+
+            With YOJIMBO_SOCKET_BATCHING this reads up to maxPackets packets with a single call to recvmmsg. Otherwise, it falls back to calling Socket::ReceivePacket until the batch is full or no more packets are available.
+
+            @param maxPackets The maximum number of packets to receive.
+            @param from Array of addresses that sent each packet [out]. Must have at least maxPackets entries.
+            @param packetData Contiguous buffer where packet data will be copied to. Packet n is written at offset n * maxPacketSize. Must be at least maxPackets * maxPacketSize large in bytes.
+            @param packetBytes Array of packet sizes in bytes [out]. Must have at least maxPackets entries.
+            @param maxPacketSize The maximum packet size to read in bytes. Any packets received larger than this are discarded.
+            @param numSystemCalls The number of system calls made to receive the batch [out]. Optional. Pass in NULL if not needed.
+
+            @returns The number of packets received in [0,maxPackets].
+         */
+
+        int ReceivePackets( int maxPackets, Address * from, uint8_t * packetData, int * packetBytes, int maxPacketSize, int * numSystemCalls = NULL );
+
+        /**
+            Wait until there are packets available to read on this socket, or until the timeout expires.
+
+            This is the only blocking socket function. It is intended for use on dedicated receive threads.
+
+            @param timeout The maximum time to wait in seconds.
+
+            @returns True if there are packets available to read, false if the timeout expired.
+         */
+
+        bool WaitForPackets( double timeout );
+
+        /**
+            Enable UDP segmentation offload on this socket.
+
+            Send segmentation offload (GSO) lets Socket::SendPackets pass multiple packets to the kernel as one datagram. Receive segmentation offload (GRO) lets the kernel coalesce multiple packets from the same address into one datagram, which must then be read with Socket::ReceiveSegments.
+
+            Each is enabled independently, and only if supported by the kernel. Requires Linux with YOJIMBO_SOCKET_BATCHING. On other platforms this does nothing.
+
+            Send segmentation offload is automatically disabled if the kernel later rejects a segmented send, and those packets are sent individually instead.
+
+            @see Socket::IsSendSegmentationOffloadEnabled
+            @see Socket::IsReceiveSegmentationOffloadEnabled
+         */
+
+        void EnableSegmentationOffload();
+
+        /**
+            Is send segmentation offload (GSO) enabled?
+
+            @returns True if send segmentation offload is enabled and supported by the kernel, false otherwise.
+         */
+
+        bool IsSendSegmentationOffloadEnabled() const;
+
+        /**
+            Is receive segmentation offload (GRO) enabled?
+
+            IMPORTANT: When this is enabled, read packets with Socket::ReceiveSegments, otherwise coalesced datagrams will be truncated and discarded.
+
+            @returns True if receive segmentation offload is enabled and supported by the kernel, false otherwise.
+         */
+
+        bool IsReceiveSegmentationOffloadEnabled() const;
+
+        /**
+            Receive a batch of datagrams that may each contain multiple coalesced packets (non-blocking).
+
+            Use this instead of Socket::ReceivePackets when receive segmentation offload is enabled. With YOJIMBO_SOCKET_BATCHING the whole batch is read with a single call to recvmmsg, with a separate control message buffer per-datagram so each datagram reports its own segment size. Otherwise, it falls back to calling Socket::ReceivePacket until the batch is full or no more datagrams are available.
+
+            Datagram n starts at offset n * datagramStride in the buffer. Packet m in datagram n starts at offset m * segmentBytes[n] from the start of that datagram. The last packet in each datagram may be smaller than segmentBytes[n].
+
+            @param maxDatagrams The maximum number of datagrams to receive.
+            @param from Array of addresses that sent each datagram [out]. Must have at least maxDatagrams entries.
+            @param buffer Contiguous buffer where datagram data will be copied to. Must be at least maxDatagrams * datagramStride large in bytes.
+            @param datagramBytes Array of datagram sizes in bytes [out]. Must have at least maxDatagrams entries.
+            @param segmentBytes Array of packet sizes in bytes for each datagram [out]. Equal to the datagram size if the datagram was not coalesced. Must have at least maxDatagrams entries.
+            @param datagramStride The maximum datagram size to read in bytes. Should be MaxSocketSegmentBytes, so coalesced datagrams are not truncated. Datagrams larger than this are discarded.
+            @param numSystemCalls The number of system calls made to receive the batch [out]. Optional. Pass in NULL if not needed.
+
+            @returns The number of datagrams received in [0,maxDatagrams].
+         */
+
+        int ReceiveSegments( int maxDatagrams, Address * from, uint8_t * buffer, int * datagramBytes, int * segmentBytes, int datagramStride, int * numSystemCalls = NULL );
+
         /**
             Get the socket address including the dynamically assigned port # for sockets bound to port 0.
 
@@ -156,13 +264,94 @@ namespace yojimbo
 
     private:
 
+        friend class IOUringSocket;
+
         SocketError m_error;										///< The socket error level.
 
         Address m_address;                                          ///< The address the socket is bound on. If the socket was bound to 0, the port number is resolved to the actual port number assigned by the system.
         
         SocketHandle m_socket;                                      ///< The socket handle in a platform independent form.
+
+        bool m_sendSegmentationOffload;                             ///< True if send segmentation offload (UDP_SEGMENT) is enabled on this socket.
+
+        bool m_receiveSegmentationOffload;                          ///< True if receive segmentation offload (UDP_GRO) is enabled on this socket.
+    };
+
+#if YOJIMBO_IO_URING
+
+    /**
+        Performs socket IO through io_uring, for a socket created with the regular Socket class.
+
+        Receives are done with a multishot recvmsg that stays outstanding against a ring of registered receive buffers, so packets are read without any system calls while they keep arriving. Sends are submitted as a batch of sendmsg operations with a single system call.
+
+        Requires Linux kernel 6.0 or later. Check IOUringSocket::IsError after creating it, and fall back to regular socket IO if it is in an error state.
+
+        @see YOJIMBO_IO_URING
+     */
+
+    class IOUringSocket
+    {
+    public:
+
+        /**
+            Set up io_uring for a socket.
+
+            @param allocator The allocator used for io_uring state and receive buffers.
+            @param socket The socket to perform IO on. Must outlive this object.
+            @param maxPacketSize The maximum packet size that can be received, in bytes.
+            @param numReceiveBuffers The number of receive buffers to register. Must be a power of two. This is the maximum number of packets that can be received but not yet read.
+            @param maxSendPackets The maximum number of send operations submitted in one system call. Larger batches passed in to IOUringSocket::SendPackets are split up.
+         */
+
+        IOUringSocket( Allocator & allocator, Socket & socket, int maxPacketSize, int numReceiveBuffers = DefaultIOUringReceiveBuffers, int maxSendPackets = DefaultSocketSendBatchSize );
+
+        /**
+            Cancels any outstanding operations and tears down the io_uring.
+         */
+
+        ~IOUringSocket();
+
+        /**
+            Is io_uring in an error state?
+
+            This is set if io_uring could not be set up (for example, on older kernels), or if a later io_uring operation failed in a way that can't be recovered from.
+
+            @returns True if io_uring is in an error state. Switch to regular socket IO if this is true.
+         */
+
+        bool IsError() const;
+
+        /**
+            Send a batch of packets. Same interface as Socket::SendPackets.
+
+            Waits for the send operations to complete before returning, so the packet data can be reused afterwards.
+
+            @returns The number of system calls made to send the batch.
+         */
+
+        int SendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride );
+
+        /**
+            Receive a batch of packets (non-blocking). Same interface as Socket::ReceivePackets.
+
+            Copies packets out of completed receive buffers. This only makes a system call when the multishot recvmsg needs to be re-armed.
+
+            @param numSystemCalls The number of system calls made [out].
+
+            @returns The number of packets received in [0,maxPackets].
+         */
+
+        int ReceivePackets( int maxPackets, Address * from, uint8_t * packetData, int * packetBytes, int maxPacketSize, int & numSystemCalls );
+
+    private:
+
+        struct IOUringState * m_state;                              ///< io_uring rings, registered buffers and in flight operation state. Defined in yojimbo_sockets.cpp.
+
+        Allocator * m_allocator;                                    ///< The allocator passed in to the constructor.
     };
 
+#endif // #if YOJIMBO_IO_URING
+
 #endif // #if YOJIMBO_SOCKETS
 }
 
@@ -157,7 +157,7 @@ namespace yojimbo
             @param allocator The allocator to use for stream allocations. This lets you dynamically allocate memory as you read and write packets.
          */
 
-		WriteStream( uint8_t * buffer, int bytes, Allocator & allocator = GetDefaultAllocator() ) : BaseStream( allocator ), m_writer( buffer, bytes ) {}
+		WriteStream( uint8_t * buffer, int bytes, Allocator & allocator = GetDefaultAllocator() ) : BaseStream( allocator ), m_writer( buffer, bytes ), m_numAligns( 0 ) {}
 
         /**
             Serialize an integer (write).
@@ -215,6 +215,25 @@ namespace yojimbo
             return true;
         }
 
+        /**
+            Serialize bits previously written by another write stream (write).
+
+            Lets data that was serialized once be written to many streams, without serializing it again. No alignment is written, so the bits are written exactly as they were originally.
+
+            @param data The data written by the other write stream. Must be readable up to the next dword boundary after the last bit.
+            @param bits The number of bits to write.
+
+            @returns Always returns true. All checking is performed by debug asserts on write.
+         */
+
+        bool SerializeBitsFromBuffer( const uint8_t * data, int bits )
+        {
+            assert( data );
+            assert( bits >= 0 );
+            m_writer.WriteBitsFromBuffer( data, bits );
+            return true;
+        }
+
         /**
             Serialize an align (write).
 
@@ -224,6 +243,7 @@ namespace yojimbo
         bool SerializeAlign()
         {
             m_writer.WriteAlign();
+            m_numAligns++;
             return true;
         }
 
@@ -305,9 +325,23 @@ namespace yojimbo
             return m_writer.GetBitsWritten();
         }
 
+        /**
+            How many times has the stream been aligned?
+
+            Counts every align, including the aligns before byte arrays and serialize checks, even when no padding bits were needed. If this is non-zero, the bits written depend on where in the stream they started.
+
+            @returns The number of aligns.
+         */
+
+        int GetNumAligns() const
+        {
+            return m_numAligns;
+        }
+
     private:
 
         BitWriter m_writer;                                 ///< The bit writer used for all bitpacked write operations.
+        int m_numAligns;                                    ///< The number of times the stream has been aligned. See WriteStream::GetNumAligns.
     };
 
     /**
@@ -565,6 +599,23 @@ namespace yojimbo
             return true;
         }
 
+        /**
+            Serialize bits previously written by a write stream (measure).
+
+            @param data The data written by the write stream. Not actually used.
+            @param bits The number of bits to 'write'.
+
+            @returns Always returns true. All checking is performed by debug asserts on write.
+         */
+
+        bool SerializeBitsFromBuffer( const uint8_t * data, int bits )
+        {
+            (void) data;
+            assert( bits >= 0 );
+            m_bitsWritten += bits;
+            return true;
+        }
+
         /**
             Serialize an align (measure).
 
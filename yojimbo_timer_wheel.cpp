@@ -0,0 +1,236 @@
+/*
+    Yojimbo Client/Server Network Protocol Library.
+    
+    Copyright © 2016, The Network Protocol Company, Inc.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "yojimbo_timer_wheel.h"
+#include <string.h>
+#include <math.h>
+
+namespace yojimbo
+{
+    TimerWheel::TimerWheel( Allocator & allocator, int numTimers, double tickTime, double time )
+    {
+        assert( numTimers > 0 );
+        assert( tickTime > 0.0 );
+
+        m_allocator = &allocator;
+        m_numTimers = numTimers;
+        m_tickTime = tickTime;
+
+        m_expireTick = (uint64_t*) YOJIMBO_ALLOCATE( allocator, sizeof( uint64_t ) * numTimers );
+        m_next = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * numTimers );
+        m_prev = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * numTimers );
+        m_slot = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * numTimers );
+        m_firedTimers = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * numTimers );
+
+        Reset( time );
+    }
+
+    TimerWheel::~TimerWheel()
+    {
+        YOJIMBO_FREE( *m_allocator, m_expireTick );
+        YOJIMBO_FREE( *m_allocator, m_next );
+        YOJIMBO_FREE( *m_allocator, m_prev );
+        YOJIMBO_FREE( *m_allocator, m_slot );
+        YOJIMBO_FREE( *m_allocator, m_firedTimers );
+    }
+
+    void TimerWheel::Reset( double time )
+    {
+        assert( time >= 0.0 );
+
+        m_tick = uint64_t( time / m_tickTime );
+        m_numScheduledTimers = 0;
+        m_numFiredTimers = 0;
+
+        memset( m_slot, -1, sizeof( int ) * m_numTimers );
+        memset( m_slotHead, -1, sizeof( m_slotHead ) );
+    }
+
+    void TimerWheel::Schedule( int timerIndex, double expireTime )
+    {
+        assert( timerIndex >= 0 );
+        assert( timerIndex < m_numTimers );
+
+        if ( m_slot[timerIndex] >= 0 )
+            Remove( timerIndex );
+
+        // round up, so timers never fire before their expire time. anything due now goes in the next tick
+
+        const double expireTick = ceil( expireTime / m_tickTime );
+
+        m_expireTick[timerIndex] = expireTick > double( m_tick ) ? uint64_t( expireTick ) : m_tick + 1;
+
+        Insert( timerIndex );
+
+        m_numScheduledTimers++;
+    }
+
+    void TimerWheel::Cancel( int timerIndex )
+    {
+        assert( timerIndex >= 0 );
+        assert( timerIndex < m_numTimers );
+
+        if ( m_slot[timerIndex] < 0 )
+            return;
+
+        Remove( timerIndex );
+
+        m_numScheduledTimers--;
+    }
+
+    bool TimerWheel::IsScheduled( int timerIndex ) const
+    {
+        assert( timerIndex >= 0 );
+        assert( timerIndex < m_numTimers );
+
+        return m_slot[timerIndex] >= 0;
+    }
+
+    int TimerWheel::AdvanceTime( double time )
+    {
+        const uint64_t tick = uint64_t( time / m_tickTime );
+
+        m_numFiredTimers = 0;
+
+        // with nothing scheduled there is nothing to cascade or fire, so jump straight to the new tick
+
+        if ( m_numScheduledTimers == 0 && tick > m_tick )
+            m_tick = tick;
+
+        while ( m_tick < tick )
+        {
+            m_tick++;
+
+            // when the low bits of the tick wrap around, pull timers in the next level's slot down
+
+            for ( int level = 1; level < TimerWheelNumLevels; ++level )
+            {
+                if ( ( m_tick & ( ( uint64_t( 1 ) << ( TimerWheelLevelBits * level ) ) - 1 ) ) != 0 )
+                    break;
+
+                Cascade( level );
+            }
+
+            const int slot = int( m_tick & ( TimerWheelLevelSize - 1 ) );
+
+            while ( m_slotHead[slot] >= 0 )
+            {
+                const int timerIndex = m_slotHead[slot];
+
+                assert( m_expireTick[timerIndex] == m_tick );
+
+                Remove( timerIndex );
+
+                m_numScheduledTimers--;
+
+                m_firedTimers[m_numFiredTimers++] = timerIndex;
+            }
+
+            if ( m_numScheduledTimers == 0 )
+                m_tick = tick;
+        }
+
+        return m_numFiredTimers;
+    }
+
+    int TimerWheel::GetFiredTimer( int index ) const
+    {
+        assert( index >= 0 );
+        assert( index < m_numFiredTimers );
+
+        return m_firedTimers[index];
+    }
+
+    int TimerWheel::GetNumFiredTimers() const
+    {
+        return m_numFiredTimers;
+    }
+
+    int TimerWheel::GetNumScheduledTimers() const
+    {
+        return m_numScheduledTimers;
+    }
+
+    void TimerWheel::Insert( int timerIndex )
+    {
+        // pick the lowest level whose range covers the expire tick. timers beyond the top level wait in its furthest slot and are reinserted when they cascade
+
+        const uint64_t delta = m_expireTick[timerIndex] - m_tick;
+
+        int level = 0;
+        while ( level < TimerWheelNumLevels - 1 && delta >= ( uint64_t( 1 ) << ( TimerWheelLevelBits * ( level + 1 ) ) ) )
+            level++;
+
+        uint64_t expireTick = m_expireTick[timerIndex];
+
+        const uint64_t maxTick = m_tick + ( uint64_t( TimerWheelLevelSize - 1 ) << ( TimerWheelLevelBits * level ) );
+
+        if ( expireTick > maxTick )
+            expireTick = maxTick;
+
+        const int slot = level * TimerWheelLevelSize + int( ( expireTick >> ( TimerWheelLevelBits * level ) ) & ( TimerWheelLevelSize - 1 ) );
+
+        m_slot[timerIndex] = slot;
+        m_prev[timerIndex] = -1;
+        m_next[timerIndex] = m_slotHead[slot];
+
+        if ( m_slotHead[slot] >= 0 )
+            m_prev[m_slotHead[slot]] = timerIndex;
+
+        m_slotHead[slot] = timerIndex;
+    }
+
+    void TimerWheel::Remove( int timerIndex )
+    {
+        const int slot = m_slot[timerIndex];
+
+        assert( slot >= 0 );
+
+        if ( m_prev[timerIndex] >= 0 )
+            m_next[m_prev[timerIndex]] = m_next[timerIndex];
+        else
+            m_slotHead[slot] = m_next[timerIndex];
+
+        if ( m_next[timerIndex] >= 0 )
+            m_prev[m_next[timerIndex]] = m_prev[timerIndex];
+
+        m_slot[timerIndex] = -1;
+    }
+
+    void TimerWheel::Cascade( int level )
+    {
+        const int slot = level * TimerWheelLevelSize + int( ( m_tick >> ( TimerWheelLevelBits * level ) ) & ( TimerWheelLevelSize - 1 ) );
+
+        int timerIndex = m_slotHead[slot];
+
+        m_slotHead[slot] = -1;
+
+        while ( timerIndex >= 0 )
+        {
+            const int next = m_next[timerIndex];
+            Insert( timerIndex );
+            timerIndex = next;
+        }
+    }
+}
@@ -0,0 +1,191 @@
+/*
+    Yojimbo Client/Server Network Protocol Library.
+    
+    Copyright © 2016, The Network Protocol Company, Inc.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef YOJIMBO_TIMER_WHEEL_H
+#define YOJIMBO_TIMER_WHEEL_H
+
+#include "yojimbo_config.h"
+#include "yojimbo_allocator.h"
+#include <stdint.h>
+#include <assert.h>
+
+/** @file */
+
+namespace yojimbo
+{
+    const int TimerWheelNumLevels = 4;                                  ///< The number of levels in the timer wheel hierarchy.
+    const int TimerWheelLevelBits = 6;                                  ///< Each level of the timer wheel has 2^TimerWheelLevelBits slots.
+    const int TimerWheelLevelSize = 1 << TimerWheelLevelBits;           ///< The number of slots in each level of the timer wheel.
+
+    /**
+        A hierarchical timer wheel.
+
+        Schedules a fixed set of timers, identified by index in [0,numTimers-1], to fire at some time in the future. Each timer is either scheduled once or not at all.
+
+        Time is quantized into ticks. The first level of the wheel has one slot per-tick, and each level above covers TimerWheelLevelSize times the range of the level below it. Timers far in the future sit in the upper levels and cascade down as their time approaches.
+
+        Scheduling and cancelling a timer is constant time, and advancing time only touches slots for ticks that have passed, plus the timers that fire. This lets the server schedule keep-alive and timeout events for thousands of clients without checking every client each tick.
+
+        Timers never fire early. They fire on the first call to AdvanceTime at or after their expire time, rounded up to the next tick.
+     */
+
+    class TimerWheel
+    {
+    public:
+
+        /**
+            Timer wheel constructor.
+
+            @param allocator The allocator used to allocate timer state.
+            @param numTimers The number of timers. Timer indices are in [0,numTimers-1].
+            @param tickTime The length of a tick (seconds). This is the resolution of the timer wheel.
+            @param time The current time (seconds).
+         */
+
+        TimerWheel( Allocator & allocator, int numTimers, double tickTime, double time );
+
+        /**
+            Timer wheel destructor.
+         */
+
+        ~TimerWheel();
+
+        /**
+            Cancel all timers and reset the wheel to the time passed in.
+
+            @param time The current time (seconds).
+         */
+
+        void Reset( double time );
+
+        /**
+            Schedule a timer to fire.
+
+            If the timer is already scheduled, it is moved to the new expire time.
+
+            Expire times in the past fire on the next tick.
+
+            @param timerIndex The index of the timer in [0,numTimers-1].
+            @param expireTime The time the timer should fire (seconds).
+         */
+
+        void Schedule( int timerIndex, double expireTime );
+
+        /**
+            Cancel a timer. Does nothing if the timer is not scheduled.
+
+            @param timerIndex The index of the timer in [0,numTimers-1].
+         */
+
+        void Cancel( int timerIndex );
+
+        /**
+            Is a timer scheduled?
+
+            @param timerIndex The index of the timer in [0,numTimers-1].
+
+            @returns True if the timer is scheduled and has not fired yet.
+         */
+
+        bool IsScheduled( int timerIndex ) const;
+
+        /**
+            Advance time and collect timers that have fired.
+
+            Fired timers are no longer scheduled. Reschedule them if they should fire again.
+
+            @param time The current time (seconds).
+
+            @returns The number of timers that fired. Get them with TimerWheel::GetFiredTimer.
+         */
+
+        int AdvanceTime( double time );
+
+        /**
+            Get a timer that fired in the last call to TimerWheel::AdvanceTime.
+
+            @param index The index of the fired timer in [0,numFiredTimers-1].
+
+            @returns The timer index.
+         */
+
+        int GetFiredTimer( int index ) const;
+
+        /**
+            Get the number of timers that fired in the last call to TimerWheel::AdvanceTime.
+
+            @returns The number of fired timers.
+         */
+
+        int GetNumFiredTimers() const;
+
+        /**
+            Get the number of timers currently scheduled.
+
+            @returns The number of scheduled timers in [0,numTimers].
+         */
+
+        int GetNumScheduledTimers() const;
+
+    protected:
+
+        void Insert( int timerIndex );
+
+        void Remove( int timerIndex );
+
+        void Cascade( int level );
+
+    private:
+
+        Allocator * m_allocator;                                        ///< The allocator passed in to the constructor.
+
+        int m_numTimers;                                                ///< The number of timers.
+
+        int m_numScheduledTimers;                                       ///< The number of timers currently scheduled.
+
+        int m_numFiredTimers;                                           ///< The number of timers that fired in the last call to AdvanceTime.
+
+        double m_tickTime;                                              ///< The length of a tick (seconds).
+
+        uint64_t m_tick;                                                ///< The current tick. All timers expiring at or before this tick have fired.
+
+        uint64_t * m_expireTick;                                        ///< The tick each timer expires on.
+
+        int * m_next;                                                   ///< The next timer in the same slot, or -1.
+
+        int * m_prev;                                                   ///< The previous timer in the same slot, or -1 if this timer is at the head of the slot.
+
+        int * m_slot;                                                   ///< The slot each timer is in, or -1 if the timer isn't scheduled. Slots are numbered level * TimerWheelLevelSize + slot in level.
+
+        int * m_firedTimers;                                            ///< Timers fired by the last call to AdvanceTime.
+
+        int m_slotHead[TimerWheelNumLevels*TimerWheelLevelSize];        ///< The first timer in each slot, or -1 if the slot is empty.
+
+        TimerWheel( const TimerWheel & other );
+
+        const TimerWheel & operator = ( const TimerWheel & other );
+    };
+}
+
+#endif // #ifndef YOJIMBO_TIMER_WHEEL_H
@@ -65,6 +65,9 @@ namespace yojimbo
         if ( memcmp( serverToClientKey, other.serverToClientKey, KeyBytes ) != 0 )
             return false;
 
+        if ( cipherSuite != other.cipherSuite )
+            return false;
+
         return true;
     }
 
@@ -73,8 +76,11 @@ namespace yojimbo
         return ! ( (*this) == other );
     }
 
-    void GenerateConnectToken( ConnectToken & token, uint64_t clientId, int numServerAddresses, const Address * serverAddresses, uint64_t protocolId, int expireSeconds )
+    void GenerateConnectToken( ConnectToken & token, uint64_t clientId, int numServerAddresses, const Address * serverAddresses, uint64_t protocolId, int expireSeconds, int cipherSuite )
     {
+        assert( cipherSuite >= 0 );
+        assert( cipherSuite < CIPHER_SUITE_NUM_VALUES );
+
         uint64_t timestamp = (uint64_t) time( NULL );
         
         token.protocolId = protocolId;
@@ -90,6 +96,8 @@ namespace yojimbo
         GenerateKey( token.clientToServerKey );    
 
         GenerateKey( token.serverToClientKey );
+
+        token.cipherSuite = cipherSuite;
     }
 
     bool EncryptConnectToken( const ConnectToken & token, uint8_t * encryptedMessage, const uint8_t * nonce, const uint8_t * key )
@@ -179,6 +187,8 @@ namespace yojimbo
 
         insert_data_as_base64_string( writer, "serverToClientKey", connectToken.serverToClientKey, KeyBytes );
 
+        insert_number_as_string( writer, "cipherSuite", connectToken.cipherSuite );
+
         writer.EndObject();
 
         const char * json_output = s.GetString();
@@ -297,6 +307,19 @@ namespace yojimbo
 
         if ( !read_data_from_base64_string( doc, "serverToClientKey", connectToken.serverToClientKey, KeyBytes ) )
             return false;
+
+        // connect tokens from matchers that predate cipher suites only allow the fallback
+
+        connectToken.cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
+
+        if ( doc.HasMember( "cipherSuite" ) )
+        {
+            if ( !read_int_from_string( doc, "cipherSuite", connectToken.cipherSuite ) )
+                return false;
+
+            if ( connectToken.cipherSuite < 0 || connectToken.cipherSuite >= CIPHER_SUITE_NUM_VALUES )
+                return false;
+        }
         
         return true;
     }
@@ -67,12 +67,15 @@ namespace yojimbo
      
         uint8_t serverToClientKey[KeyBytes];                                ///< The key for encrypted communication from server -> client.
 
+        int cipherSuite;                                                    ///< The cipher suite this connect token allows packets to be encrypted with. See yojimbo::CipherSuite. Clients that can't use it fall back to yojimbo::CIPHER_SUITE_CHACHA20_POLY1305, which is always allowed.
+
         ConnectToken()
         {
             protocolId = 0;
             clientId = 0;
             expireTimestamp = 0;
             numServerAddresses = 0;
+            cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305;
             memset( clientToServerKey, 0, KeyBytes );
             memset( serverToClientKey, 0, KeyBytes );
         }
@@ -139,12 +142,13 @@ namespace yojimbo
         @param serverAddresses Array of server addresses to store in the connect token. The client can only use the connect token to connect to these addresses.
         @param protocolId The protocol id of the connection to be established. The server will reject any connections from clients with a different protocol id.
         @param expirySeconds The number of seconds in the future until this connect token expires. This should long enough for a client to try all servers in the list in turn if they are busy. I recommend 45 seconds. 
+        @param cipherSuite The cipher suite the connection may encrypt packets with. See yojimbo::CipherSuite. Pass the suite the servers in the list prefer. Clients that can't use it fall back to yojimbo::CIPHER_SUITE_CHACHA20_POLY1305.
 
         @see EncryptConnectToken
         @see DecryptConnectToken
      */
 
-    void GenerateConnectToken( ConnectToken & token, uint64_t clientId, int numServerAddresses, const Address * serverAddresses, uint64_t protocolId, int expirySeconds );
+    void GenerateConnectToken( ConnectToken & token, uint64_t clientId, int numServerAddresses, const Address * serverAddresses, uint64_t protocolId, int expirySeconds, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 );
 
     /**
         Encrypt a connect token. 
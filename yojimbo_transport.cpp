@@ -32,11 +32,47 @@
 
 namespace yojimbo
 {
-    TransportContextManager::TransportContextManager()
+    TransportContextManager::TransportContextManager( Allocator & allocator, int maxContextMappings )
     {
+        assert( maxContextMappings > 0 );
+
+        m_allocator = &allocator;
+        m_maxContextMappings = maxContextMappings;
+
+        int hashSize = 1;
+        while ( hashSize < maxContextMappings * 2 )
+            hashSize *= 2;
+
+        m_hashMask = hashSize - 1;
+        m_hashTable = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * hashSize );
+        m_address = (Address*) YOJIMBO_ALLOCATE( allocator, sizeof( Address ) * maxContextMappings );
+        m_context = (TransportContext*) YOJIMBO_ALLOCATE( allocator, sizeof( TransportContext ) * maxContextMappings );
+
         ResetContextMappings();
     }
 
+    TransportContextManager::~TransportContextManager()
+    {
+        assert( m_allocator );
+
+        YOJIMBO_FREE( *m_allocator, m_hashTable );
+        YOJIMBO_FREE( *m_allocator, m_address );
+        YOJIMBO_FREE( *m_allocator, m_context );
+    }
+
+    int TransportContextManager::FindSlot( const Address & address ) const
+    {
+        int slot = address.GetHash() & m_hashMask;
+
+        while ( true )
+        {
+            const int index = m_hashTable[slot];
+            if ( index < 0 || m_address[index] == address )
+                return slot;
+            slot = ( slot + 1 ) & m_hashMask;
+        }
+    }
+
     bool TransportContextManager::AddContextMapping( const Address & address, const TransportContext & context )
     {
         assert( address.IsValid() );
@@ -44,26 +80,21 @@ namespace yojimbo
         assert( context.allocator );
         assert( context.packetFactory );
 
-        for ( int i = 0; i < m_numContextMappings; ++i )
+        const int slot = FindSlot( address );
+
+        if ( m_hashTable[slot] >= 0 )
         {
-            if ( m_allocated[i] && m_address[i] == address )
-            {
-                m_context[i] = context;
-                return true;
-            }
+            m_context[m_hashTable[slot]] = context;
+            return true;
         }
 
-        for ( int i = 0; i < MaxContextMappings; ++i )
+        if ( m_numContextMappings < m_maxContextMappings )
         {
-            if ( !m_allocated[i] )
-            {
-                m_allocated[i] = true;
-                m_context[i] = context;
-                m_address[i] = address;
-                if ( i + 1 > m_numContextMappings )
-                    m_numContextMappings = i + 1;
-                return true;
-            }
+            const int index = m_numContextMappings++;
+            m_hashTable[slot] = index;
+            m_address[index] = address;
+            m_context[index] = context;
+            return true;
         }
 
 #if YOJIMBO_DEBUG_SPAM
@@ -77,61 +108,87 @@ namespace yojimbo
 
     bool TransportContextManager::RemoveContextMapping( const Address & address )
     {
-        for ( int i = 0; i < m_numContextMappings; ++i )
+        int slot = FindSlot( address );
+
+        const int index = m_hashTable[slot];
+
+        if ( index < 0 )
         {
-            if ( m_allocated[i] && m_address[i] == address )
-            {
-                m_allocated[i] = false;
-                m_address[i] = Address();
-                m_context[i] = TransportContext();
+#if YOJIMBO_DEBUG_SPAM
+            char addressString[MaxAddressLength];
+            address.ToString( addressString, MaxAddressLength );
+            debug_printf( "failed to remove context mapping for %s\n", addressString );
+#endif // #if YOJIMBO_DEBUG_SPAM
 
-                if ( i + 1 == m_numContextMappings )
-                {
-                    int index = i - 1;
-                    while ( index >= 0 )
-                    {
-                        if ( m_allocated[index] )
-                            break;
-                        index--;
-                    }
-                    m_numContextMappings = index + 1;
-                }
+            return false;
+        }
 
-                return true;
+        // backward shift deletion: pull later entries in the probe sequence back into the hole, so lookups never need tombstones
+
+        int next = ( slot + 1 ) & m_hashMask;
+
+        while ( m_hashTable[next] >= 0 )
+        {
+            const int home = m_address[m_hashTable[next]].GetHash() & m_hashMask;
+
+            if ( ( ( next - home ) & m_hashMask ) >= ( ( next - slot ) & m_hashMask ) )
+            {
+                m_hashTable[slot] = m_hashTable[next];
+                slot = next;
             }
+
+            next = ( next + 1 ) & m_hashMask;
         }
 
-#if YOJIMBO_DEBUG_SPAM
-        char addressString[MaxAddressLength];
-        address.ToString( addressString, MaxAddressLength );
-        debug_printf( "failed to remove context mapping for %s\n", addressString );
-#endif // #if YOJIMBO_DEBUG_SPAM
+        m_hashTable[slot] = -1;
 
-        return false;
+        // keep the context mappings packed by moving the last one into the removed entry
+
+        const int last = m_numContextMappings - 1;
+
+        if ( index != last )
+        {
+            m_hashTable[FindSlot( m_address[last] )] = index;
+            m_address[index] = m_address[last];
+            m_context[index] = m_context[last];
+        }
+
+        m_address[last] = Address();
+        m_context[last] = TransportContext();
+
+        m_numContextMappings--;
+
+        return true;
     }
 
     void TransportContextManager::ResetContextMappings()
     {
         m_numContextMappings = 0;
         
-        for ( int i = 0; i < MaxContextMappings; ++i )
+        for ( int i = 0; i < m_maxContextMappings; ++i )
         {
             m_address[i] = Address();
         }
 
-        memset( m_context, 0, sizeof( m_context ) );        
+        memset( m_context, 0, sizeof( TransportContext ) * m_maxContextMappings );
 
-        memset( m_allocated, 0, sizeof( m_allocated ) );
+        memset( m_hashTable, -1, sizeof( int ) * ( m_hashMask + 1 ) );
     }
 
     const TransportContext * TransportContextManager::GetContext( const Address & address ) const
     {
-        for ( int i = 0; i < m_numContextMappings; ++i )
-        {
-            if ( m_allocated[i] && m_address[i] == address )
-                return &m_context[i];
-        }
-        return NULL;
+        const int index = m_hashTable[FindSlot( address )];
+        return ( index >= 0 ) ? &m_context[index] : NULL;
+    }
+
+    int TransportContextManager::GetNumContextMappings() const
+    {
+        return m_numContextMappings;
+    }
+
+    int TransportContextManager::GetMaxContextMappings() const
+    {
+        return m_maxContextMappings;
     }
 
     // =================================================================
@@ -143,7 +200,8 @@ namespace yojimbo
                                   int maxPacketSize, 
                                   int sendQueueSize, 
                                   int receiveQueueSize,
-                                  bool allocateNetworkSimulator )
+                                  bool allocateNetworkSimulator,
+                                  int sendBatchSize )
     
         : m_sendQueue( allocator, sendQueueSize ),
           m_receiveQueue( allocator, receiveQueueSize )
@@ -172,9 +230,9 @@ namespace yojimbo
         m_packetTypeIsEncrypted = NULL;
         m_packetTypeIsUnencrypted = NULL;
 
-		m_contextManager = YOJIMBO_NEW( allocator, TransportContextManager );
+		m_contextManager = YOJIMBO_NEW( allocator, TransportContextManager, allocator );
 
-		m_encryptionManager = YOJIMBO_NEW( allocator, EncryptionManager );
+		m_encryptionManager = YOJIMBO_NEW( allocator, EncryptionManager, allocator );
 
         (void) allocateNetworkSimulator;
 
@@ -188,6 +246,29 @@ namespace yojimbo
         {
             m_networkSimulator = NULL;
         }
+
+        assert( sendBatchSize > 0 );
+
+        m_sendBatchSize = sendBatchSize;
+        m_numSendPackets = 0;
+        m_sendPacketStride = m_packetProcessor->GetAbsoluteMaxPacketSize();
+        m_sendPacketData = NULL;
+        m_sendPacketBytes = NULL;
+        m_sendTo = NULL;
+
+        m_workerPool = NULL;
+        m_writeJobs = NULL;
+        m_writePacketData = NULL;
+        m_readJobs = NULL;
+        m_readPacketData = NULL;
+        m_readFrom = NULL;
+
+        if ( m_sendBatchSize > 1 )
+        {
+            m_sendPacketData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, m_sendBatchSize * m_sendPacketStride );
+            m_sendPacketBytes = (int*) YOJIMBO_ALLOCATE( allocator, sizeof(int) * m_sendBatchSize );
+            m_sendTo = (Address*) YOJIMBO_ALLOCATE( allocator, sizeof(Address) * m_sendBatchSize );
+        }
 	}
 
     BaseTransport::~BaseTransport()
@@ -208,6 +289,12 @@ namespace yojimbo
             YOJIMBO_DELETE( *m_allocator, NetworkSimulator, m_networkSimulator );
         }
 
+        YOJIMBO_FREE( *m_allocator, m_sendPacketData );
+        YOJIMBO_FREE( *m_allocator, m_sendPacketBytes );
+        YOJIMBO_FREE( *m_allocator, m_sendTo );
+
+        SetWorkerPool( NULL );
+
         m_allocator = NULL;
     }
 
@@ -378,6 +465,12 @@ namespace yojimbo
 
         bool useSimulator = ShouldPacketsGoThroughSimulator();
 
+        if ( m_workerPool && m_sendQueue.GetNumEntries() > 1 )
+        {
+            WritePacketsInParallel( useSimulator );
+            return;
+        }
+
         while ( !m_sendQueue.IsEmpty() )
         {
             PacketEntry entry = m_sendQueue.Pop();
@@ -390,6 +483,10 @@ namespace yojimbo
             {
                 WritePacketToSimulator( entry.address, entry.packet, entry.sequence );
             }
+            else if ( m_sendBatchSize > 1 )
+            {
+                WritePacketToSendBatch( entry.address, entry.packet, entry.sequence );
+            }
             else
             {
                 WriteAndFlushPacket( entry.address, entry.packet, entry.sequence );
@@ -397,9 +494,34 @@ namespace yojimbo
 
             entry.packet->Destroy();
         }
+
+        FlushSendBatch();
+    }
+
+    static int GetContextShard( const TransportContext * context )
+    {
+        return int( ( uintptr_t( context ) / sizeof( TransportContext ) ) & 0x7FFFFFFF );
     }
 
     const uint8_t * BaseTransport::WritePacket( const Address & address, Packet * packet, uint64_t sequence, int & packetBytes )
+    {
+        PacketWriteJob job;
+
+        PrepareWritePacket( address, packet, sequence, job );
+
+        m_packetProcessor->SetContext( job.context );
+
+        m_packetProcessor->SetUserContext( job.userContext );
+
+        const uint8_t * packetData = m_packetProcessor->WritePacket( packet, sequence, packetBytes, job.encrypt, job.key, job.cipherSuite, job.cipherState, *job.streamAllocator, *job.packetFactory );
+
+        if ( !CompleteWritePacket( m_packetProcessor->GetError(), job.encrypt ) )
+            return NULL;
+
+        return packetData;
+    }
+
+    void BaseTransport::PrepareWritePacket( const Address & address, Packet * packet, uint64_t sequence, PacketWriteJob & job )
     {
         assert( m_context.allocator );
         assert( m_context.packetFactory );
@@ -418,59 +540,72 @@ namespace yojimbo
         if ( !context )
             context = &m_context;
 
-        const int encryptionIndex = ( context->encryptionIndex != -1 ) ? context->encryptionIndex : m_encryptionManager->FindEncryptionMapping( address, GetTime() );
+        int encryptionIndex = context->encryptionIndex;
 
-        const uint8_t * key = m_encryptionManager->GetSendKey( encryptionIndex );
+        if ( encryptionIndex != -1 )
+            m_encryptionManager->TouchEncryptionMapping( encryptionIndex, GetTime() );
+        else
+            encryptionIndex = m_encryptionManager->FindEncryptionMapping( address, GetTime() );
 
-#if !YOJIMBO_SECURE_MODE
-        const bool encrypt = ( GetFlags() & TRANSPORT_FLAG_INSECURE_MODE ) ? IsEncryptedPacketType( packetType ) && key : IsEncryptedPacketType( packetType );
-#else // #if !YOJIMBO_SECURE_MODE
-        const bool encrypt = IsEncryptedPacketType( packetType );
-#endif // #if !YOJIMBO_SECURE_MODE
+        const uint8_t * key = m_encryptionManager->GetSendKey( encryptionIndex );
 
         assert( context->allocator );
         assert( context->packetFactory );
 
-        Allocator & allocator = *context->allocator;
-
-        PacketFactory & packetFactory = *(context->packetFactory);
+        job.packet = packet;
+        job.sequence = sequence;
+#if !YOJIMBO_SECURE_MODE
+        job.encrypt = ( GetFlags() & TRANSPORT_FLAG_INSECURE_MODE ) ? IsEncryptedPacketType( packetType ) && key : IsEncryptedPacketType( packetType );
+#else // #if !YOJIMBO_SECURE_MODE
+        job.encrypt = IsEncryptedPacketType( packetType );
+#endif // #if !YOJIMBO_SECURE_MODE
+        job.key = key;
+        job.cipherSuite = m_encryptionManager->GetCipherSuite( encryptionIndex );
+        job.cipherState = m_encryptionManager->GetSendCipherState( encryptionIndex );
+        job.streamAllocator = context->allocator;
+        job.packetFactory = context->packetFactory;
+        job.context = context->connectionContext;
+        job.userContext = context->userContext;
 
-        m_packetProcessor->SetContext( context->connectionContext );
+        // packets for the same context share an allocator and packet factory, so they must be written on the same thread
 
-        m_packetProcessor->SetUserContext( context->userContext );
+        job.shard = GetContextShard( context );
 
-        const uint8_t * packetData = m_packetProcessor->WritePacket( packet, sequence, packetBytes, encrypt, key, allocator, packetFactory );
+        job.packetData = NULL;
+        job.packetBytes = 0;
+        job.error = PACKET_PROCESSOR_ERROR_NONE;
+    }
 
-        if ( !packetData )
+    bool BaseTransport::CompleteWritePacket( int error, bool encrypt )
+    {
+        switch ( error )
         {
-            switch ( m_packetProcessor->GetError() )
-            {
-                case PACKET_PROCESSOR_ERROR_KEY_IS_NULL:                
-                {
-                    debug_printf( "base transport packet processor key is null (write packet)\n" );
-                    m_counters[TRANSPORT_COUNTER_ENCRYPTION_MAPPING_FAILURES]++;         
-                }
+            case PACKET_PROCESSOR_ERROR_NONE:
                 break;
 
-                case PACKET_PROCESSOR_ERROR_ENCRYPT_FAILED:
-                {
-                    debug_printf( "base transport encrypt failed (write packet)\n" );
-                    m_counters[TRANSPORT_COUNTER_ENCRYPT_PACKET_FAILURES]++;
-                }
-                break;
+            case PACKET_PROCESSOR_ERROR_KEY_IS_NULL:                
+            {
+                debug_printf( "base transport packet processor key is null (write packet)\n" );
+                m_counters[TRANSPORT_COUNTER_ENCRYPTION_MAPPING_FAILURES]++;         
+                return false;
+            }
 
-                case PACKET_PROCESSOR_ERROR_WRITE_PACKET_FAILED:
-                {
-                    debug_printf( "base transport write packet failed (write packet)\n" );
-                    m_counters[TRANSPORT_COUNTER_WRITE_PACKET_FAILURES]++;               
-                }
-                break;
+            case PACKET_PROCESSOR_ERROR_ENCRYPT_FAILED:
+            {
+                debug_printf( "base transport encrypt failed (write packet)\n" );
+                m_counters[TRANSPORT_COUNTER_ENCRYPT_PACKET_FAILURES]++;
+                return false;
+            }
 
-                default:
-                    break;
+            case PACKET_PROCESSOR_ERROR_WRITE_PACKET_FAILED:
+            {
+                debug_printf( "base transport write packet failed (write packet)\n" );
+                m_counters[TRANSPORT_COUNTER_WRITE_PACKET_FAILURES]++;               
+                return false;
             }
 
-            return NULL;
+            default:
+                return false;
         }
 
         m_counters[TRANSPORT_COUNTER_PACKETS_WRITTEN]++;
@@ -480,7 +615,54 @@ namespace yojimbo
         else
             m_counters[TRANSPORT_COUNTER_UNENCRYPTED_PACKETS_WRITTEN]++;
 
-        return packetData;
+        return true;
+    }
+
+    void BaseTransport::WritePacketsInParallel( bool useSimulator )
+    {
+        assert( m_workerPool );
+        assert( m_writeJobs );
+        assert( m_writePacketData );
+
+        const int numPackets = m_sendQueue.GetNumEntries();
+
+        // context lookups and encryption mappings are not thread safe, so resolve them up front on this thread
+
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            PacketEntry & entry = m_sendQueue[i];
+
+            PrepareWritePacket( entry.address, entry.packet, entry.sequence, m_writeJobs[i] );
+
+            m_writeJobs[i].packetData = m_writePacketData + i * m_sendPacketStride;
+        }
+
+        m_packetProcessor->WritePackets( m_writeJobs, numPackets, m_workerPool );
+
+        // send in queue order, so packets go out on the wire in the same order as they would when written serially
+
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            PacketEntry & entry = m_sendQueue[i];
+
+            const PacketWriteJob & job = m_writeJobs[i];
+
+            if ( CompleteWritePacket( job.error, job.encrypt ) )
+            {
+                if ( useSimulator )
+                    SendPacketToSimulator( entry.address, job.packetData, job.packetBytes );
+                else if ( m_sendBatchSize > 1 )
+                    AddPacketToSendBatch( entry.address, job.packetData, job.packetBytes );
+                else
+                    InternalSendPacket( entry.address, job.packetData, job.packetBytes );
+            }
+
+            entry.packet->Destroy();
+        }
+
+        m_sendQueue.Clear();
+
+        FlushSendBatch();
     }
 
     void BaseTransport::WritePacketToSimulator( const Address & address, Packet * packet, uint64_t sequence )
@@ -496,6 +678,11 @@ namespace yojimbo
         if ( !packetData )
             return;
 
+        SendPacketToSimulator( address, packetData, packetBytes );
+    }
+
+    void BaseTransport::SendPacketToSimulator( const Address & address, const uint8_t * packetData, int packetBytes )
+    {
         assert( m_networkSimulator );
 
         Allocator & allocator = m_networkSimulator->GetAllocator();
@@ -521,10 +708,82 @@ namespace yojimbo
         InternalSendPacket( address, packetData, packetBytes );
     }
 
+    void BaseTransport::WritePacketToSendBatch( const Address & address, Packet * packet, uint64_t sequence )
+    {
+        int packetBytes = 0;
+
+        const uint8_t * packetData = WritePacket( address, packet, sequence, packetBytes );
+
+        if ( !packetData )
+            return;
+
+        AddPacketToSendBatch( address, packetData, packetBytes );
+    }
+
+    void BaseTransport::AddPacketToSendBatch( const Address & address, const uint8_t * packetData, int packetBytes )
+    {
+        assert( m_sendBatchSize > 1 );
+        assert( m_sendPacketData );
+        assert( m_numSendPackets < m_sendBatchSize );
+        assert( packetBytes > 0 );
+        assert( packetBytes <= m_sendPacketStride );
+
+        const int index = m_numSendPackets++;
+
+        memcpy( m_sendPacketData + index * m_sendPacketStride, packetData, packetBytes );
+        m_sendPacketBytes[index] = packetBytes;
+        m_sendTo[index] = address;
+
+        if ( m_numSendPackets == m_sendBatchSize )
+            FlushSendBatch();
+    }
+
+    void BaseTransport::FlushSendBatch()
+    {
+        if ( m_numSendPackets == 0 )
+            return;
+
+        const int numSystemCalls = InternalSendPackets( m_numSendPackets, m_sendTo, m_sendPacketData, m_sendPacketBytes, m_sendPacketStride );
+
+        m_counters[TRANSPORT_COUNTER_SEND_BATCHES]++;
+        m_counters[TRANSPORT_COUNTER_SEND_BATCH_PACKETS] += m_numSendPackets;
+        m_counters[TRANSPORT_COUNTER_SEND_SYSTEM_CALLS] += numSystemCalls;
+
+        m_numSendPackets = 0;
+    }
+
+    int BaseTransport::InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride )
+    {
+        for ( int i = 0; i < numPackets; ++i )
+        {
+            InternalSendPacket( to[i], packetData + i * packetStride, packetBytes[i] );
+        }
+
+        return numPackets;
+    }
+
     Packet * BaseTransport::ReadPacket( const Address & address, uint8_t * packetBuffer, int packetBytes, uint64_t & sequence )
     {
+        PacketReadJob job;
+
+        const TransportContext * context = PrepareReadPacket( address, packetBuffer, packetBytes, job );
+
+        m_packetProcessor->SetContext( job.context );
+
+        m_packetProcessor->SetUserContext( context->userContext );
+
         bool encrypted = false;
 
+        Packet * packet = m_packetProcessor->ReadPacket( packetBuffer, sequence, packetBytes, encrypted, job.key, job.cipherSuite, job.cipherState, job.encryptedPacketTypes, job.unencryptedPacketTypes, *job.streamAllocator, *job.packetFactory, job.replayProtection );
+
+        if ( !CompleteReadPacket( m_packetProcessor->GetError(), encrypted ) )
+            return NULL;
+
+        return packet;
+    }
+
+    const TransportContext * BaseTransport::PrepareReadPacket( const Address & address, uint8_t * packetData, int packetBytes, PacketReadJob & job )
+    {
         const uint8_t * encryptedPacketTypes = m_packetTypeIsEncrypted;
         const uint8_t * unencryptedPacketTypes = m_packetTypeIsUnencrypted;
 
@@ -541,62 +800,77 @@ namespace yojimbo
         if ( !context )
             context = &m_context;
 
-        const int encryptionIndex = ( context->encryptionIndex != -1 ) ? context->encryptionIndex : m_encryptionManager->FindEncryptionMapping( address, GetTime() );
+        int encryptionIndex = context->encryptionIndex;
+
+        if ( encryptionIndex != -1 )
+            m_encryptionManager->TouchEncryptionMapping( encryptionIndex, GetTime() );
+        else
+            encryptionIndex = m_encryptionManager->FindEncryptionMapping( address, GetTime() );
 
-        const uint8_t * key = m_encryptionManager->GetReceiveKey( encryptionIndex );
-       
         assert( context->allocator );
         assert( context->packetFactory );
 
-        Allocator & allocator = *(context->allocator);
-        
-        PacketFactory & packetFactory = *(context->packetFactory);
+        job.packetData = packetData;
+        job.packetBytes = packetBytes;
+        job.key = m_encryptionManager->GetReceiveKey( encryptionIndex );
+        job.cipherSuite = m_encryptionManager->GetCipherSuite( encryptionIndex );
+        job.cipherState = m_encryptionManager->GetReceiveCipherState( encryptionIndex );
+        job.encryptedPacketTypes = encryptedPacketTypes;
+        job.unencryptedPacketTypes = unencryptedPacketTypes;
+        job.streamAllocator = context->allocator;
+        job.packetFactory = context->packetFactory;
+        job.replayProtection = context->replayProtection;
+        job.context = context->connectionContext;
 
-        ReplayProtection * replayProtection = context->replayProtection;
+        // packets for the same context share an allocator, packet factory and replay protection, so they must be read on the same thread, in order
 
-        m_packetProcessor->SetContext( context->connectionContext );
+        job.shard = GetContextShard( context );
 
-        m_packetProcessor->SetUserContext( context->userContext );
+        job.packet = NULL;
+        job.sequence = 0;
+        job.encrypted = false;
+        job.error = PACKET_PROCESSOR_ERROR_NONE;
 
-        Packet * packet = m_packetProcessor->ReadPacket( packetBuffer, sequence, packetBytes, encrypted, key, encryptedPacketTypes, unencryptedPacketTypes, allocator, packetFactory, replayProtection );
+        return context;
+    }
 
-        if ( !packet )
+    bool BaseTransport::CompleteReadPacket( int error, bool encrypted )
+    {
+        switch ( error )
         {
-            switch ( m_packetProcessor->GetError() )
-            {
-                case PACKET_PROCESSOR_ERROR_KEY_IS_NULL:
-                {
-                    debug_printf( "base transport key is null (read packet)\n" );
-                    m_counters[TRANSPORT_COUNTER_ENCRYPTION_MAPPING_FAILURES]++;
-                }
+            case PACKET_PROCESSOR_ERROR_NONE:
                 break;
 
-                case PACKET_PROCESSOR_ERROR_DECRYPT_FAILED:
-                {
-                    debug_printf( "base transport decrypt failed (read packet)\n" );
-                    m_counters[TRANSPORT_COUNTER_ENCRYPT_PACKET_FAILURES]++;
-                }
-                break;
+            case PACKET_PROCESSOR_ERROR_KEY_IS_NULL:
+            {
+                debug_printf( "base transport key is null (read packet)\n" );
+                m_counters[TRANSPORT_COUNTER_ENCRYPTION_MAPPING_FAILURES]++;
+                return false;
+            }
 
-                case PACKET_PROCESSOR_ERROR_PACKET_TOO_SMALL:
-                {
-                    debug_printf( "base transport packet too small (read packet)\n" );
-                    m_counters[TRANSPORT_COUNTER_DECRYPT_PACKET_FAILURES]++;
-                }
-                break;
+            case PACKET_PROCESSOR_ERROR_DECRYPT_FAILED:
+            {
+                debug_printf( "base transport decrypt failed (read packet)\n" );
+                m_counters[TRANSPORT_COUNTER_ENCRYPT_PACKET_FAILURES]++;
+                return false;
+            }
 
-                case PACKET_PROCESSOR_ERROR_READ_PACKET_FAILED:
-                {
-                    debug_printf( "base transport read packet failed (read packet)\n" );
-                    m_counters[TRANSPORT_COUNTER_READ_PACKET_FAILURES]++;
-                }
-                break;
+            case PACKET_PROCESSOR_ERROR_PACKET_TOO_SMALL:
+            {
+                debug_printf( "base transport packet too small (read packet)\n" );
+                m_counters[TRANSPORT_COUNTER_DECRYPT_PACKET_FAILURES]++;
+                return false;
+            }
 
-                default:
-                    break;
+            case PACKET_PROCESSOR_ERROR_READ_PACKET_FAILED:
+            {
+                debug_printf( "base transport read packet failed (read packet)\n" );
+                m_counters[TRANSPORT_COUNTER_READ_PACKET_FAILURES]++;
+                return false;
             }
 
-            return NULL;
+            default:
+                return false;
         }
 
         m_counters[TRANSPORT_COUNTER_PACKETS_READ]++;
@@ -606,7 +880,7 @@ namespace yojimbo
         else
             m_counters[TRANSPORT_COUNTER_UNENCRYPTED_PACKETS_READ]++;
 
-        return packet;
+        return true;
     }
 
     void BaseTransport::ReadPackets()
@@ -648,6 +922,12 @@ namespace yojimbo
             }
         }
 
+        if ( m_workerPool )
+        {
+            ReadPacketsInParallel();
+            return;
+        }
+
         uint8_t * packetData = (uint8_t*) alloca( maxPacketSize );
 
         while ( true )
@@ -677,43 +957,111 @@ namespace yojimbo
         }
     }
 
-    int BaseTransport::GetMaxPacketSize() const 
+    void BaseTransport::ReadPacketsInParallel()
     {
-        return m_packetProcessor->GetMaxPacketSize();
-    }
+        assert( m_workerPool );
+        assert( m_readJobs );
+        assert( m_readPacketData );
+        assert( m_readFrom );
 
-    void BaseTransport::SetNetworkConditions( float latency, float jitter, float packetLoss, float duplicate )
-    {
-        if ( m_networkSimulator )
-        {
-            m_networkSimulator->SetLatency( latency );
-            m_networkSimulator->SetJitter( jitter );
-            m_networkSimulator->SetPacketLoss( packetLoss );
-            m_networkSimulator->SetDuplicate( duplicate );
-        }
-    }
+        const int maxPacketSize = GetMaxPacketSize();
 
-    void BaseTransport::ClearNetworkConditions()
-    {
-        if ( m_networkSimulator )
+        while ( true )
         {
-            m_networkSimulator->SetLatency( 0.0f );
-            m_networkSimulator->SetJitter( 0.0f );
-            m_networkSimulator->SetPacketLoss( 0.0f );
-            m_networkSimulator->SetDuplicate( 0.0f );
-        }
-    }
+            // only receive as many packets as the receive queue has room for. context lookups and encryption mappings are not thread safe, so resolve them here as each packet comes in
 
-    bool BaseTransport::ShouldPacketsGoThroughSimulator()
-    {
-        return m_allocateNetworkSimulator && m_networkSimulator->IsActive();
-    }
+            const int maxPackets = m_receiveQueue.GetSize() - m_receiveQueue.GetNumEntries();
 
-    void BaseTransport::EnablePacketEncryption()
-    {
-        assert( m_context.packetFactory );
-        memset( m_packetTypeIsEncrypted, 1, m_context.packetFactory->GetNumPacketTypes() );
-        memset( m_packetTypeIsUnencrypted, 0, m_context.packetFactory->GetNumPacketTypes() );
+            if ( maxPackets == 0 )
+            {
+                Address address;
+                if ( InternalReceivePacket( address, m_readPacketData, maxPacketSize ) )
+                {
+                    debug_printf( "base transport receive queue overflow (recv packet)\n" );
+                    m_counters[TRANSPORT_COUNTER_RECEIVE_QUEUE_OVERFLOW]++;
+                }
+                break;
+            }
+
+            int numPackets = 0;
+
+            while ( numPackets < maxPackets )
+            {
+                uint8_t * packetData = m_readPacketData + numPackets * maxPacketSize;
+
+                const int packetBytes = InternalReceivePacket( m_readFrom[numPackets], packetData, maxPacketSize );
+                if ( !packetBytes )
+                    break;
+
+                assert( packetBytes > 0 );
+                assert( packetBytes <= maxPacketSize );
+
+                PrepareReadPacket( m_readFrom[numPackets], packetData, packetBytes, m_readJobs[numPackets] );
+
+                numPackets++;
+            }
+
+            m_packetProcessor->ReadPackets( m_readJobs, numPackets, m_workerPool );
+
+            // queue in the order packets were received, so they come out of Transport::ReceivePacket in the same order as they would when read serially
+
+            for ( int i = 0; i < numPackets; ++i )
+            {
+                const PacketReadJob & job = m_readJobs[i];
+
+                if ( !CompleteReadPacket( job.error, job.encrypted ) )
+                    continue;
+
+                PacketEntry entry;
+                entry.address = m_readFrom[i];
+                entry.packet = job.packet;
+                entry.sequence = job.sequence;
+
+                m_receiveQueue.Push( entry );
+            }
+
+            if ( numPackets < maxPackets )
+                break;
+        }
+    }
+
+    int BaseTransport::GetMaxPacketSize() const 
+    {
+        return m_packetProcessor->GetMaxPacketSize();
+    }
+
+    void BaseTransport::SetNetworkConditions( float latency, float jitter, float packetLoss, float duplicate )
+    {
+        if ( m_networkSimulator )
+        {
+            m_networkSimulator->SetLatency( latency );
+            m_networkSimulator->SetJitter( jitter );
+            m_networkSimulator->SetPacketLoss( packetLoss );
+            m_networkSimulator->SetDuplicate( duplicate );
+        }
+    }
+
+    void BaseTransport::ClearNetworkConditions()
+    {
+        if ( m_networkSimulator )
+        {
+            m_networkSimulator->SetLatency( 0.0f );
+            m_networkSimulator->SetJitter( 0.0f );
+            m_networkSimulator->SetPacketLoss( 0.0f );
+            m_networkSimulator->SetDuplicate( 0.0f );
+        }
+    }
+
+    bool BaseTransport::ShouldPacketsGoThroughSimulator()
+    {
+        return m_allocateNetworkSimulator && m_networkSimulator->IsActive();
+    }
+
+    void BaseTransport::EnablePacketEncryption()
+    {
+        assert( m_context.packetFactory );
+        memset( m_packetTypeIsEncrypted, 1, m_context.packetFactory->GetNumPacketTypes() );
+        memset( m_packetTypeIsUnencrypted, 0, m_context.packetFactory->GetNumPacketTypes() );
     }
 
     void BaseTransport::DisablePacketEncryption()
@@ -740,9 +1088,9 @@ namespace yojimbo
         return m_packetTypeIsEncrypted[type] != 0;
     }
 
-    bool BaseTransport::AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double timeout )
+    bool BaseTransport::AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double timeout, int cipherSuite )
     {
-        return m_encryptionManager->AddEncryptionMapping( address, sendKey, receiveKey, GetTime(), timeout );
+        return m_encryptionManager->AddEncryptionMapping( address, sendKey, receiveKey, GetTime(), timeout, cipherSuite );
     }
 
     bool BaseTransport::RemoveEncryptionMapping( const Address & address )
@@ -781,6 +1129,47 @@ namespace yojimbo
         m_contextManager->ResetContextMappings();
     }
 
+    void BaseTransport::SetMaxMappings( int maxContextMappings, int maxEncryptionMappings )
+    {
+        assert( maxContextMappings > 0 );
+        assert( maxEncryptionMappings > 0 );
+
+        if ( m_contextManager->GetMaxContextMappings() != maxContextMappings )
+        {
+            YOJIMBO_DELETE( *m_allocator, TransportContextManager, m_contextManager );
+            m_contextManager = YOJIMBO_NEW( *m_allocator, TransportContextManager, *m_allocator, maxContextMappings );
+        }
+
+        if ( m_encryptionManager->GetMaxEncryptionMappings() != maxEncryptionMappings )
+        {
+            YOJIMBO_DELETE( *m_allocator, EncryptionManager, m_encryptionManager );
+            m_encryptionManager = YOJIMBO_NEW( *m_allocator, EncryptionManager, *m_allocator, maxEncryptionMappings );
+        }
+    }
+
+    void BaseTransport::SetWorkerPool( WorkerPool * workerPool )
+    {
+        m_workerPool = workerPool;
+
+        YOJIMBO_FREE( *m_allocator, m_writeJobs );
+        YOJIMBO_FREE( *m_allocator, m_writePacketData );
+        YOJIMBO_FREE( *m_allocator, m_readJobs );
+        YOJIMBO_FREE( *m_allocator, m_readPacketData );
+        YOJIMBO_FREE( *m_allocator, m_readFrom );
+
+        if ( workerPool )
+        {
+            const int sendQueueSize = m_sendQueue.GetSize();
+            m_writeJobs = (PacketWriteJob*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( PacketWriteJob ) * sendQueueSize );
+            m_writePacketData = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, sendQueueSize * m_sendPacketStride );
+
+            const int receiveQueueSize = m_receiveQueue.GetSize();
+            m_readJobs = (PacketReadJob*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( PacketReadJob ) * receiveQueueSize );
+            m_readPacketData = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, receiveQueueSize * GetMaxPacketSize() );
+            m_readFrom = (Address*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( Address ) * receiveQueueSize );
+        }
+    }
+
     void BaseTransport::AdvanceTime( double time )
     {
         assert( time >= m_time );
@@ -813,6 +1202,7 @@ namespace yojimbo
     void BaseTransport::SetFlags( uint64_t flags )
     {
         m_flags = flags;
+        m_packetProcessor->SetChecksumType( ( flags & TRANSPORT_FLAG_CRC32_CHECKSUM ) ? CHECKSUM_CRC32 : CHECKSUM_CRC32C );
     }
 
     uint64_t BaseTransport::GetFlags() const
@@ -952,14 +1342,18 @@ namespace yojimbo
                                         int sendQueueSize, 
                                         int receiveQueueSize,
                                         int socketSendBufferSize,
-										int socketReceiveBufferSize )
+										int socketReceiveBufferSize,
+                                        int receiveBatchSize,
+                                        int sendBatchSize )
         : BaseTransport( allocator, 
                          address,
                          protocolId,
                          time,
                          maxPacketSize,
                          sendQueueSize,
-                         receiveQueueSize )
+                         receiveQueueSize,
+                         true,
+                         sendBatchSize )
     {
         m_socket = YOJIMBO_NEW( allocator, Socket, address, socketSendBufferSize, socketReceiveBufferSize );
 
@@ -967,13 +1361,96 @@ namespace yojimbo
         {
             m_address.SetPort( m_socket->GetAddress().GetPort() );
         }
+
+        assert( receiveBatchSize > 0 );
+
+        m_receiveBatchSize = receiveBatchSize;
+        m_receivePacketIndex = 0;
+        m_numReceivePackets = 0;
+        m_receivePacketData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, m_receiveBatchSize * GetMaxPacketSize() );
+        m_receivePacketBytes = (int*) YOJIMBO_ALLOCATE( allocator, sizeof(int) * m_receiveBatchSize );
+        m_receiveFrom = (Address*) YOJIMBO_ALLOCATE( allocator, sizeof(Address) * m_receiveBatchSize );
+
+        m_receiveSegmentBatchSize = ( receiveBatchSize < MaxSocketSegmentBatchSize ) ? receiveBatchSize : MaxSocketSegmentBatchSize;
+        m_receiveSegmentIndex = 0;
+        m_numReceiveSegmentDatagrams = 0;
+        m_receiveSegmentOffset = 0;
+        m_receiveSegmentData = NULL;
+        m_receiveSegmentTotalBytes = NULL;
+        m_receiveSegmentBytes = NULL;
+        m_receiveSegmentFrom = NULL;
+
+#if YOJIMBO_IO_URING
+        m_uring = NULL;
+
+        if ( !m_socket->IsError() )
+        {
+            m_uring = YOJIMBO_NEW( allocator, IOUringSocket, allocator, *m_socket, GetMaxPacketSize(), DefaultIOUringReceiveBuffers, sendBatchSize );
+
+            if ( m_uring->IsError() )
+            {
+                debug_printf( "io_uring not available. falling back to regular socket IO\n" );
+                YOJIMBO_DELETE( allocator, IOUringSocket, m_uring );
+            }
+        }
+#endif // #if YOJIMBO_IO_URING
     }
 
     NetworkTransport::~NetworkTransport()
     {
 		assert( m_socket );
 		assert( m_allocator );
+#if YOJIMBO_IO_URING
+        YOJIMBO_DELETE( *m_allocator, IOUringSocket, m_uring );
+#endif // #if YOJIMBO_IO_URING
 		YOJIMBO_DELETE( *m_allocator, Socket, m_socket );
+        YOJIMBO_FREE( *m_allocator, m_receivePacketData );
+        YOJIMBO_FREE( *m_allocator, m_receivePacketBytes );
+        YOJIMBO_FREE( *m_allocator, m_receiveFrom );
+        YOJIMBO_FREE( *m_allocator, m_receiveSegmentData );
+        YOJIMBO_FREE( *m_allocator, m_receiveSegmentTotalBytes );
+        YOJIMBO_FREE( *m_allocator, m_receiveSegmentBytes );
+        YOJIMBO_FREE( *m_allocator, m_receiveSegmentFrom );
+    }
+
+    bool NetworkTransport::EnableSegmentationOffload()
+    {
+        assert( m_socket );
+
+        if ( m_socket->IsError() || IsUsingIOUring() )
+            return false;
+
+        m_socket->EnableSegmentationOffload();
+
+        if ( m_socket->IsReceiveSegmentationOffloadEnabled() && !m_receiveSegmentData )
+        {
+            m_receiveSegmentData = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, m_receiveSegmentBatchSize * MaxSocketSegmentBytes );
+            m_receiveSegmentTotalBytes = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof(int) * m_receiveSegmentBatchSize );
+            m_receiveSegmentBytes = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof(int) * m_receiveSegmentBatchSize );
+            m_receiveSegmentFrom = (Address*) YOJIMBO_ALLOCATE( *m_allocator, sizeof(Address) * m_receiveSegmentBatchSize );
+        }
+
+        return m_socket->IsSendSegmentationOffloadEnabled() || m_socket->IsReceiveSegmentationOffloadEnabled();
+    }
+
+    bool NetworkTransport::IsUsingIOUring() const
+    {
+#if YOJIMBO_IO_URING
+        return m_uring != NULL;
+#else // #if YOJIMBO_IO_URING
+        return false;
+#endif // #if YOJIMBO_IO_URING
+    }
+
+    void NetworkTransport::Reset()
+    {
+        m_numReceivePackets = 0;
+        m_receivePacketIndex = 0;
+        m_numReceiveSegmentDatagrams = 0;
+        m_receiveSegmentIndex = 0;
+        m_receiveSegmentOffset = 0;
+
+        BaseTransport::Reset();
     }
 
     bool NetworkTransport::IsError() const
@@ -991,9 +1468,759 @@ namespace yojimbo
         m_socket->SendPacket( to, packetData, packetBytes );
     }
 
+    int NetworkTransport::InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride )
+    {
+#if YOJIMBO_IO_URING
+        if ( m_uring )
+        {
+            const int numSystemCalls = m_uring->SendPackets( numPackets, to, packetData, packetBytes, packetStride );
+
+            if ( m_uring->IsError() )
+            {
+                debug_printf( "io_uring send failed. falling back to regular socket IO\n" );
+                YOJIMBO_DELETE( *m_allocator, IOUringSocket, m_uring );
+            }
+
+            return numSystemCalls;
+        }
+#endif // #if YOJIMBO_IO_URING
+
+        int numSegmentedPackets = 0;
+        int numFailedPackets = 0;
+
+        const int numSystemCalls = m_socket->SendPackets( numPackets, to, packetData, packetBytes, packetStride, &numSegmentedPackets, &numFailedPackets );
+
+        m_counters[TRANSPORT_COUNTER_SEND_SEGMENTED_PACKETS] += numSegmentedPackets;
+        m_counters[TRANSPORT_COUNTER_SEND_PACKET_FAILURES] += numFailedPackets;
+
+        return numSystemCalls;
+    }
+
     int NetworkTransport::InternalReceivePacket( Address & from, void * packetData, int maxPacketSize )
     {
-        return m_socket->ReceivePacket( from, packetData, maxPacketSize );
+        assert( maxPacketSize == GetMaxPacketSize() );
+
+        if ( m_receiveSegmentData && m_receivePacketIndex >= m_numReceivePackets )
+        {
+            // receive segmentation offload: read a batch of coalesced datagrams and split them back into packets
+
+            while ( true )
+            {
+                if ( m_receiveSegmentIndex < m_numReceiveSegmentDatagrams && m_receiveSegmentOffset >= m_receiveSegmentTotalBytes[m_receiveSegmentIndex] )
+                {
+                    m_receiveSegmentIndex++;
+                    m_receiveSegmentOffset = 0;
+                }
+
+                if ( m_receiveSegmentIndex >= m_numReceiveSegmentDatagrams )
+                {
+                    m_receiveSegmentIndex = 0;
+                    m_receiveSegmentOffset = 0;
+
+                    int numSystemCalls = 0;
+
+                    m_numReceiveSegmentDatagrams = m_socket->ReceiveSegments( m_receiveSegmentBatchSize, m_receiveSegmentFrom, m_receiveSegmentData, m_receiveSegmentTotalBytes, m_receiveSegmentBytes, MaxSocketSegmentBytes, &numSystemCalls );
+
+                    m_counters[TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS] += numSystemCalls;
+
+                    if ( m_numReceiveSegmentDatagrams == 0 )
+                        return 0;
+
+                    int numPackets = 0;
+
+                    for ( int i = 0; i < m_numReceiveSegmentDatagrams; ++i )
+                    {
+                        assert( m_receiveSegmentTotalBytes[i] > 0 );
+                        assert( m_receiveSegmentBytes[i] > 0 );
+
+                        const int numSegments = ( m_receiveSegmentTotalBytes[i] + m_receiveSegmentBytes[i] - 1 ) / m_receiveSegmentBytes[i];
+
+                        numPackets += numSegments;
+
+                        if ( numSegments > 1 )
+                            m_counters[TRANSPORT_COUNTER_RECEIVE_COALESCED_PACKETS] += numSegments;
+                    }
+
+                    m_counters[TRANSPORT_COUNTER_RECEIVE_BATCHES]++;
+                    m_counters[TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS] += numPackets;
+                    if ( m_numReceiveSegmentDatagrams == m_receiveSegmentBatchSize )
+                        m_counters[TRANSPORT_COUNTER_RECEIVE_BATCHES_FULL]++;
+
+                    continue;
+                }
+
+                const int index = m_receiveSegmentIndex;
+                const int offset = m_receiveSegmentOffset;
+                const int remainingBytes = m_receiveSegmentTotalBytes[index] - offset;
+                const int packetBytes = ( remainingBytes < m_receiveSegmentBytes[index] ) ? remainingBytes : m_receiveSegmentBytes[index];
+
+                m_receiveSegmentOffset += m_receiveSegmentBytes[index];
+
+                if ( packetBytes > maxPacketSize )
+                    continue;
+
+                memcpy( packetData, m_receiveSegmentData + index * MaxSocketSegmentBytes + offset, packetBytes );
+
+                from = m_receiveSegmentFrom[index];
+
+                return packetBytes;
+            }
+        }
+
+        if ( m_receivePacketIndex >= m_numReceivePackets )
+        {
+            m_receivePacketIndex = 0;
+            m_numReceivePackets = 0;
+
+            int numSystemCalls = 0;
+
+#if YOJIMBO_IO_URING
+            if ( m_uring )
+            {
+                m_numReceivePackets = m_uring->ReceivePackets( m_receiveBatchSize, m_receiveFrom, m_receivePacketData, m_receivePacketBytes, maxPacketSize, numSystemCalls );
+
+                if ( m_uring->IsError() )
+                {
+                    debug_printf( "io_uring receive failed. falling back to regular socket IO\n" );
+                    YOJIMBO_DELETE( *m_allocator, IOUringSocket, m_uring );
+                }
+            }
+            else
+#endif // #if YOJIMBO_IO_URING
+            {
+                m_numReceivePackets = m_socket->ReceivePackets( m_receiveBatchSize, m_receiveFrom, m_receivePacketData, m_receivePacketBytes, maxPacketSize, &numSystemCalls );
+            }
+
+            m_counters[TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS] += numSystemCalls;
+
+            if ( m_numReceivePackets == 0 )
+                return 0;
+
+            m_counters[TRANSPORT_COUNTER_RECEIVE_BATCHES]++;
+            m_counters[TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS] += m_numReceivePackets;
+            if ( m_numReceivePackets == m_receiveBatchSize )
+                m_counters[TRANSPORT_COUNTER_RECEIVE_BATCHES_FULL]++;
+        }
+
+        const int index = m_receivePacketIndex++;
+
+        assert( m_receivePacketBytes[index] > 0 );
+        assert( m_receivePacketBytes[index] <= maxPacketSize );
+
+        memcpy( packetData, m_receivePacketData + index * maxPacketSize, m_receivePacketBytes[index] );
+
+        from = m_receiveFrom[index];
+
+        return m_receivePacketBytes[index];
+    }
+
+    // =====================================================
+
+    MultiSocketNetworkTransport::MultiSocketNetworkTransport( Allocator & allocator, 
+                                                              const Address & address,
+                                                              uint64_t protocolId,
+                                                              double time,
+                                                              int numSockets,
+                                                              int maxPacketSize, 
+                                                              int sendQueueSize, 
+                                                              int receiveQueueSize,
+                                                              int socketSendBufferSize,
+                                                              int socketReceiveBufferSize,
+                                                              int receiveBatchSize,
+                                                              int sendBatchSize )
+        : BaseTransport( allocator, 
+                         address,
+                         protocolId,
+                         time,
+                         maxPacketSize,
+                         sendQueueSize,
+                         receiveQueueSize,
+                         true,
+                         sendBatchSize )
+    {
+        assert( numSockets > 0 );
+        assert( receiveBatchSize > 0 );
+
+        m_numSockets = numSockets;
+        m_receiveBatchSize = receiveBatchSize;
+        m_quit = 0;
+        memset( &m_readSpan, 0, sizeof( m_readSpan ) );
+        m_readIndex = 0;
+
+        // double buffer receiveQueueSize / numSockets packets per-shard, and always fit at least one full batch
+
+        int numSlots = 2 * ( receiveQueueSize / numSockets );
+        if ( numSlots < receiveBatchSize )
+            numSlots = receiveBatchSize;
+
+        m_numSlotsPerShard = 1;
+        while ( m_numSlotsPerShard < numSlots )
+            m_numSlotsPerShard *= 2;
+
+        for ( int i = 0; i < TRANSPORT_COUNTER_NUM_COUNTERS; ++i )
+            m_receiveCounters[i] = 0;
+
+        m_receivedSpans = YOJIMBO_NEW( allocator, MPSCQueue<ReceiveSpan>, allocator, m_numSockets * m_numSlotsPerShard );
+
+        m_receiveShards = (ReceiveShard*) YOJIMBO_ALLOCATE( allocator, sizeof( ReceiveShard ) * m_numSockets );
+
+        for ( int i = 0; i < m_numSockets; ++i )
+        {
+            ReceiveShard & shard = m_receiveShards[i];
+
+            memset( &shard, 0, sizeof( ReceiveShard ) );
+
+            shard.transport = this;
+
+            // the first socket resolves the port if bound to port 0. the rest bind to the same port.
+
+            shard.socket = YOJIMBO_NEW( allocator, Socket, m_address, socketSendBufferSize, socketReceiveBufferSize, true );
+
+            if ( i == 0 && m_address.GetPort() == 0 && !shard.socket->IsError() )
+            {
+                m_address.SetPort( shard.socket->GetAddress().GetPort() );
+            }
+
+            shard.packetData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, m_numSlotsPerShard * GetMaxPacketSize() );
+            shard.packetBytes = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * m_numSlotsPerShard );
+            shard.from = (Address*) YOJIMBO_ALLOCATE( allocator, sizeof( Address ) * m_numSlotsPerShard );
+
+            shard.discardPacketData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, m_receiveBatchSize * GetMaxPacketSize() );
+            shard.discardPacketBytes = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * m_receiveBatchSize );
+            shard.discardFrom = (Address*) YOJIMBO_ALLOCATE( allocator, sizeof( Address ) * m_receiveBatchSize );
+        }
+
+        // start receive threads only once all sockets are bound, so each thread sees the final shard array
+
+        for ( int i = 0; i < m_numSockets; ++i )
+        {
+            ReceiveShard & shard = m_receiveShards[i];
+
+            if ( !shard.socket->IsError() )
+            {
+                shard.thread = platform_thread_create( allocator, ReceiveThreadFunction, &shard );
+            }
+        }
+    }
+
+    MultiSocketNetworkTransport::~MultiSocketNetworkTransport()
+    {
+        assert( m_allocator );
+        assert( m_receiveShards );
+
+        platform_atomic_store( &m_quit, 1 );
+
+        for ( int i = 0; i < m_numSockets; ++i )
+        {
+            ReceiveShard & shard = m_receiveShards[i];
+
+            if ( shard.thread )
+            {
+                platform_thread_join( shard.thread );
+                platform_thread_destroy( *m_allocator, shard.thread );
+            }
+
+            YOJIMBO_FREE( *m_allocator, shard.packetData );
+            YOJIMBO_FREE( *m_allocator, shard.packetBytes );
+            YOJIMBO_FREE( *m_allocator, shard.from );
+
+            YOJIMBO_FREE( *m_allocator, shard.discardPacketData );
+            YOJIMBO_FREE( *m_allocator, shard.discardPacketBytes );
+            YOJIMBO_FREE( *m_allocator, shard.discardFrom );
+
+            YOJIMBO_DELETE( *m_allocator, Socket, shard.socket );
+        }
+
+        YOJIMBO_FREE( *m_allocator, m_receiveShards );
+
+        YOJIMBO_DELETE( *m_allocator, MPSCQueue<ReceiveSpan>, m_receivedSpans );
+    }
+
+    bool MultiSocketNetworkTransport::IsError() const
+    {
+        for ( int i = 0; i < m_numSockets; ++i )
+        {
+            if ( m_receiveShards[i].socket->IsError() || !m_receiveShards[i].thread )
+                return true;
+        }
+
+        return false;
+    }
+
+    int MultiSocketNetworkTransport::GetError() const
+    {
+        for ( int i = 0; i < m_numSockets; ++i )
+        {
+            if ( m_receiveShards[i].socket->IsError() )
+                return m_receiveShards[i].socket->GetError();
+        }
+
+        return SOCKET_ERROR_NONE;
+    }
+
+    int MultiSocketNetworkTransport::GetNumSockets() const
+    {
+        return m_numSockets;
+    }
+
+    void MultiSocketNetworkTransport::Reset()
+    {
+        // this thread is the only consumer, so it can hand every filled span straight back while the receive threads keep running
+
+        ReleaseReadSpan();
+
+        while ( m_receivedSpans->Pop( m_readSpan ) )
+            ReleaseReadSpan();
+
+        BaseTransport::Reset();
+    }
+
+    void MultiSocketNetworkTransport::InternalSendPacket( const Address & to, const void * packetData, int packetBytes )
+    {
+        m_receiveShards[0].socket->SendPacket( to, packetData, packetBytes );
+    }
+
+    int MultiSocketNetworkTransport::InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride )
+    {
+        int numSegmentedPackets = 0;
+        int numFailedPackets = 0;
+
+        const int numSystemCalls = m_receiveShards[0].socket->SendPackets( numPackets, to, packetData, packetBytes, packetStride, &numSegmentedPackets, &numFailedPackets );
+
+        m_counters[TRANSPORT_COUNTER_SEND_SEGMENTED_PACKETS] += numSegmentedPackets;
+        m_counters[TRANSPORT_COUNTER_SEND_PACKET_FAILURES] += numFailedPackets;
+
+        return numSystemCalls;
+    }
+
+    int MultiSocketNetworkTransport::InternalReceivePacket( Address & from, void * packetData, int maxPacketSize )
+    {
+        assert( maxPacketSize == GetMaxPacketSize() );
+
+        while ( true )
+        {
+            if ( m_readSpan.shard && m_readIndex < m_readSpan.numPackets )
+            {
+                const ReceiveShard & shard = *m_readSpan.shard;
+
+                const int slot = ( m_readSpan.start + m_readIndex++ ) & ( m_numSlotsPerShard - 1 );
+
+                assert( shard.packetBytes[slot] > 0 );
+                assert( shard.packetBytes[slot] <= maxPacketSize );
+
+                memcpy( packetData, shard.packetData + slot * maxPacketSize, shard.packetBytes[slot] );
+
+                from = shard.from[slot];
+
+                return shard.packetBytes[slot];
+            }
+
+            ReleaseReadSpan();
+
+            if ( !m_receivedSpans->Pop( m_readSpan ) )
+                break;
+        }
+
+        CollectReceiveCounters();
+
+        return 0;
+    }
+
+    void MultiSocketNetworkTransport::ReceiveThreadFunction( void * data )
+    {
+        ReceiveShard * shard = (ReceiveShard*) data;
+        assert( shard );
+        assert( shard->transport );
+        shard->transport->ReceiveThread( *shard );
+    }
+
+    void MultiSocketNetworkTransport::ReceiveThread( ReceiveShard & shard )
+    {
+        assert( shard.socket );
+
+        const int maxPacketSize = GetMaxPacketSize();
+
+        const uint32_t numSlots = m_numSlotsPerShard;
+
+        while ( !platform_atomic_load( &m_quit ) )
+        {
+            if ( !shard.socket->WaitForPackets( 0.01 ) )
+                continue;
+
+            const uint32_t numFreeSlots = numSlots - ( shard.writeIndex - platform_atomic_load( &shard.readIndex ) );
+
+            int numSystemCalls = 0;
+
+            if ( numFreeSlots == 0 )
+            {
+                const int numDiscarded = shard.socket->ReceivePackets( m_receiveBatchSize, shard.discardFrom, shard.discardPacketData, shard.discardPacketBytes, maxPacketSize, &numSystemCalls );
+
+                platform_atomic_add( &m_receiveCounters[TRANSPORT_COUNTER_RECEIVE_QUEUE_OVERFLOW], numDiscarded );
+                platform_atomic_add( &m_receiveCounters[TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS], numSystemCalls );
+
+                continue;
+            }
+
+            // read into consecutive slots only, so a batch stops short at the end of the ring and the next one starts over at slot zero
+
+            const uint32_t slot = shard.writeIndex & ( numSlots - 1 );
+
+            int maxPackets = m_receiveBatchSize;
+            if ( (uint32_t) maxPackets > numFreeSlots )
+                maxPackets = (int) numFreeSlots;
+            if ( (uint32_t) maxPackets > numSlots - slot )
+                maxPackets = (int) ( numSlots - slot );
+
+            const int numPackets = shard.socket->ReceivePackets( maxPackets, shard.from + slot, shard.packetData + slot * maxPacketSize, shard.packetBytes + slot, maxPacketSize, &numSystemCalls );
+
+            platform_atomic_add( &m_receiveCounters[TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS], numSystemCalls );
+
+            if ( numPackets == 0 )
+                continue;
+
+            platform_atomic_add( &m_receiveCounters[TRANSPORT_COUNTER_RECEIVE_BATCHES], 1 );
+            platform_atomic_add( &m_receiveCounters[TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS], numPackets );
+            if ( numPackets == m_receiveBatchSize )
+                platform_atomic_add( &m_receiveCounters[TRANSPORT_COUNTER_RECEIVE_BATCHES_FULL], 1 );
+
+            ReceiveSpan span;
+            span.shard = &shard;
+            span.start = shard.writeIndex;
+            span.numPackets = numPackets;
+
+            shard.writeIndex += numPackets;
+
+            // the received queue has room for one span per-slot, so this can't fail
+
+            const bool pushed = m_receivedSpans->Push( span );
+            (void) pushed;
+            assert( pushed );
+        }
+    }
+
+    void MultiSocketNetworkTransport::ReleaseReadSpan()
+    {
+        if ( !m_readSpan.shard )
+            return;
+
+        // spans from a shard are popped in the order they were filled, so this span always starts at the shard's read index
+
+        ReceiveShard & shard = *m_readSpan.shard;
+
+        assert( shard.readIndex == m_readSpan.start );
+
+        platform_atomic_store( &shard.readIndex, m_readSpan.start + m_readSpan.numPackets );
+
+        memset( &m_readSpan, 0, sizeof( m_readSpan ) );
+        m_readIndex = 0;
+    }
+
+    void MultiSocketNetworkTransport::CollectReceiveCounters()
+    {
+        for ( int i = 0; i < TRANSPORT_COUNTER_NUM_COUNTERS; ++i )
+        {
+            if ( m_receiveCounters[i] )
+                m_counters[i] += platform_atomic_exchange( &m_receiveCounters[i], 0 );
+        }
+    }
+
+    // =====================================================
+
+    ThreadedNetworkTransport::ThreadedNetworkTransport( Allocator & allocator, 
+                                                        const Address & address,
+                                                        uint64_t protocolId,
+                                                        double time,
+                                                        int maxPacketSize, 
+                                                        int sendQueueSize, 
+                                                        int receiveQueueSize,
+                                                        int socketSendBufferSize,
+                                                        int socketReceiveBufferSize,
+                                                        int receiveBatchSize,
+                                                        int sendBatchSize )
+        : BaseTransport( allocator, 
+                         address,
+                         protocolId,
+                         time,
+                         maxPacketSize,
+                         sendQueueSize,
+                         receiveQueueSize,
+                         true,
+                         sendBatchSize )
+    {
+        assert( receiveBatchSize > 0 );
+        assert( sendBatchSize > 0 );
+
+        m_socket = YOJIMBO_NEW( allocator, Socket, address, socketSendBufferSize, socketReceiveBufferSize );
+
+        if ( m_address.GetPort() == 0 && !m_socket->IsError() )
+        {
+            m_address.SetPort( m_socket->GetAddress().GetPort() );
+        }
+
+        m_thread = NULL;
+        m_quit = 0;
+        m_receiveBatchSize = receiveBatchSize;
+        m_sendRingBatchSize = sendBatchSize;
+        m_receiveIndex = 0;
+
+        // at least two batches each way, so one side can fill a batch while the other drains one
+
+        const int numReceiveBatches = receiveQueueSize / receiveBatchSize;
+        const int numSendBatches = sendQueueSize / sendBatchSize;
+
+        m_receiveRing = YOJIMBO_NEW( allocator, SPSCQueue<PacketBatch>, allocator, numReceiveBatches > 2 ? numReceiveBatches : 2 );
+        m_sendRing = YOJIMBO_NEW( allocator, SPSCQueue<PacketBatch>, allocator, numSendBatches > 2 ? numSendBatches : 2 );
+
+        // packets are sent after the packet processor has written them, so send slots must fit the encryption prefix and MAC as well
+
+        AllocatePacketBatches( *m_receiveRing, m_receiveBatchSize, GetMaxPacketSize() );
+        AllocatePacketBatches( *m_sendRing, m_sendRingBatchSize, m_sendPacketStride );
+
+        m_discardBatch.numPackets = 0;
+        m_discardBatch.packetData = (uint8_t*) YOJIMBO_ALLOCATE( allocator, m_receiveBatchSize * GetMaxPacketSize() );
+        m_discardBatch.packetBytes = (int*) YOJIMBO_ALLOCATE( allocator, sizeof( int ) * m_receiveBatchSize );
+        m_discardBatch.address = (Address*) YOJIMBO_ALLOCATE( allocator, sizeof( Address ) * m_receiveBatchSize );
+
+        for ( int i = 0; i < TRANSPORT_COUNTER_NUM_COUNTERS; ++i )
+            m_ioCounters[i] = 0;
+
+        if ( !m_socket->IsError() )
+        {
+            m_thread = platform_thread_create( allocator, IOThreadFunction, this );
+        }
+    }
+
+    ThreadedNetworkTransport::~ThreadedNetworkTransport()
+    {
+        assert( m_allocator );
+        assert( m_socket );
+
+        if ( m_thread )
+        {
+            platform_atomic_store( &m_quit, 1 );
+            platform_thread_join( m_thread );
+            platform_thread_destroy( *m_allocator, m_thread );
+        }
+
+        FreePacketBatches( *m_receiveRing );
+        FreePacketBatches( *m_sendRing );
+
+        YOJIMBO_DELETE( *m_allocator, SPSCQueue<PacketBatch>, m_receiveRing );
+        YOJIMBO_DELETE( *m_allocator, SPSCQueue<PacketBatch>, m_sendRing );
+
+        YOJIMBO_FREE( *m_allocator, m_discardBatch.packetData );
+        YOJIMBO_FREE( *m_allocator, m_discardBatch.packetBytes );
+        YOJIMBO_FREE( *m_allocator, m_discardBatch.address );
+
+        YOJIMBO_DELETE( *m_allocator, Socket, m_socket );
+    }
+
+    bool ThreadedNetworkTransport::IsError() const
+    {
+        return m_socket->IsError() || !m_thread;
+    }
+
+    int ThreadedNetworkTransport::GetError() const
+    {
+        return m_socket->GetError();
+    }
+
+    void ThreadedNetworkTransport::Reset()
+    {
+        // this thread is the only consumer of the receive ring, so it can drain it while the IO thread keeps running
+
+        while ( m_receiveRing->GetPopEntry() )
+            m_receiveRing->CommitPop();
+
+        m_receiveIndex = 0;
+
+        BaseTransport::Reset();
+    }
+
+    void ThreadedNetworkTransport::InternalSendPacket( const Address & to, const void * packetData, int packetBytes )
+    {
+        InternalSendPackets( 1, &to, (const uint8_t*) packetData, &packetBytes, packetBytes );
+    }
+
+    int ThreadedNetworkTransport::InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride )
+    {
+        assert( numPackets > 0 );
+        assert( numPackets <= m_sendRingBatchSize );
+
+        PacketBatch * batch = m_sendRing->GetPushEntry();
+
+        if ( !batch )
+        {
+            debug_printf( "threaded network transport send ring overflow\n" );
+            m_counters[TRANSPORT_COUNTER_SEND_QUEUE_OVERFLOW] += numPackets;
+            return 0;
+        }
+
+        if ( packetStride == m_sendPacketStride )
+        {
+            memcpy( batch->packetData, packetData, numPackets * m_sendPacketStride );
+        }
+        else
+        {
+            for ( int i = 0; i < numPackets; ++i )
+            {
+                assert( packetBytes[i] <= m_sendPacketStride );
+                memcpy( batch->packetData + i * m_sendPacketStride, packetData + i * packetStride, packetBytes[i] );
+            }
+        }
+
+        memcpy( batch->packetBytes, packetBytes, sizeof( int ) * numPackets );
+        memcpy( batch->address, to, sizeof( Address ) * numPackets );
+
+        batch->numPackets = numPackets;
+
+        m_sendRing->CommitPush();
+
+        // system calls are made on the IO thread, and counted there
+
+        return 0;
+    }
+
+    int ThreadedNetworkTransport::InternalReceivePacket( Address & from, void * packetData, int maxPacketSize )
+    {
+        assert( maxPacketSize == GetMaxPacketSize() );
+
+        while ( PacketBatch * batch = m_receiveRing->GetPopEntry() )
+        {
+            if ( m_receiveIndex < batch->numPackets )
+            {
+                const int index = m_receiveIndex++;
+
+                assert( batch->packetBytes[index] > 0 );
+                assert( batch->packetBytes[index] <= maxPacketSize );
+
+                memcpy( packetData, batch->packetData + index * maxPacketSize, batch->packetBytes[index] );
+
+                from = batch->address[index];
+
+                return batch->packetBytes[index];
+            }
+
+            m_receiveRing->CommitPop();
+
+            m_receiveIndex = 0;
+        }
+
+        CollectIOCounters();
+
+        return 0;
+    }
+
+    void ThreadedNetworkTransport::IOThreadFunction( void * data )
+    {
+        ThreadedNetworkTransport * transport = (ThreadedNetworkTransport*) data;
+        assert( transport );
+        transport->IOThread();
+    }
+
+    void ThreadedNetworkTransport::IOThread()
+    {
+        while ( !platform_atomic_load( &m_quit ) )
+        {
+            SendPacketsFromRing();
+
+            if ( m_socket->WaitForPackets( IOThreadWaitTime ) )
+                ReceivePacketsToRing();
+        }
+
+        // flush anything sent right before the transport was destroyed, eg. disconnect packets
+
+        SendPacketsFromRing();
+    }
+
+    void ThreadedNetworkTransport::SendPacketsFromRing()
+    {
+        while ( PacketBatch * batch = m_sendRing->GetPopEntry() )
+        {
+            int numSegmentedPackets = 0;
+            int numFailedPackets = 0;
+
+            const int numSystemCalls = m_socket->SendPackets( batch->numPackets, batch->address, batch->packetData, batch->packetBytes, m_sendPacketStride, &numSegmentedPackets, &numFailedPackets );
+
+            platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_SEND_SYSTEM_CALLS], numSystemCalls );
+            platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_SEND_SEGMENTED_PACKETS], numSegmentedPackets );
+            platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_SEND_PACKET_FAILURES], numFailedPackets );
+
+            m_sendRing->CommitPop();
+        }
+    }
+
+    void ThreadedNetworkTransport::ReceivePacketsToRing()
+    {
+        const int maxPacketSize = GetMaxPacketSize();
+
+        PacketBatch * batch = m_receiveRing->GetPushEntry();
+
+        int numSystemCalls = 0;
+
+        if ( !batch )
+        {
+            const int numPackets = m_socket->ReceivePackets( m_receiveBatchSize, m_discardBatch.address, m_discardBatch.packetData, m_discardBatch.packetBytes, maxPacketSize, &numSystemCalls );
+
+            platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS], numSystemCalls );
+            platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_RECEIVE_QUEUE_OVERFLOW], numPackets );
+
+            return;
+        }
+
+        const int numPackets = m_socket->ReceivePackets( m_receiveBatchSize, batch->address, batch->packetData, batch->packetBytes, maxPacketSize, &numSystemCalls );
+
+        platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS], numSystemCalls );
+
+        if ( numPackets == 0 )
+            return;
+
+        platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_RECEIVE_BATCHES], 1 );
+        platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS], numPackets );
+        if ( numPackets == m_receiveBatchSize )
+            platform_atomic_add( &m_ioCounters[TRANSPORT_COUNTER_RECEIVE_BATCHES_FULL], 1 );
+
+        batch->numPackets = numPackets;
+
+        m_receiveRing->CommitPush();
+    }
+
+    void ThreadedNetworkTransport::CollectIOCounters()
+    {
+        for ( int i = 0; i < TRANSPORT_COUNTER_NUM_COUNTERS; ++i )
+        {
+            if ( m_ioCounters[i] )
+                m_counters[i] += platform_atomic_exchange( &m_ioCounters[i], 0 );
+        }
+    }
+
+    void ThreadedNetworkTransport::AllocatePacketBatches( SPSCQueue<PacketBatch> & ring, int batchSize, int packetStride )
+    {
+        // the rings are not shared with the IO thread yet, so each slot can be pointed at its own buffers up front
+
+        const int numBatches = ring.GetSize();
+
+        uint8_t * packetData = (uint8_t*) YOJIMBO_ALLOCATE( *m_allocator, numBatches * batchSize * packetStride );
+        int * packetBytes = (int*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( int ) * numBatches * batchSize );
+        Address * address = (Address*) YOJIMBO_ALLOCATE( *m_allocator, sizeof( Address ) * numBatches * batchSize );
+
+        for ( int i = 0; i < numBatches; ++i )
+        {
+            PacketBatch & batch = ring.GetSlot( i );
+            batch.numPackets = 0;
+            batch.packetData = packetData + i * batchSize * packetStride;
+            batch.packetBytes = packetBytes + i * batchSize;
+            batch.address = address + i * batchSize;
+        }
+    }
+
+    void ThreadedNetworkTransport::FreePacketBatches( SPSCQueue<PacketBatch> & ring )
+    {
+        PacketBatch & batch = ring.GetSlot( 0 );
+
+        YOJIMBO_FREE( *m_allocator, batch.packetData );
+        YOJIMBO_FREE( *m_allocator, batch.packetBytes );
+        YOJIMBO_FREE( *m_allocator, batch.address );
     }
 
 #endif // #if YOJIMBO_SOCKETS
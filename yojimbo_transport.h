@@ -33,6 +33,7 @@
 #include "yojimbo_allocator.h"
 #include "yojimbo_encryption.h"
 #include "yojimbo_packet_processor.h"
+#include "yojimbo_platform.h"
 
 /** @file */
 
@@ -42,6 +43,7 @@ namespace yojimbo
 
     enum TransportFlags
     {
+        TRANSPORT_FLAG_CRC32_CHECKSUM = (1<<1),                                     ///< Write unencrypted packets with the original CRC32 checksum instead of CRC32C. Packets written with either checksum are always accepted, so only set this to talk to older versions that only understand CRC32. See PacketProcessor::SetChecksumType.
 #if !YOJIMBO_SECURE_MODE
         TRANSPORT_FLAG_INSECURE_MODE = (1<<0)                                       ///< When insecure secure mode is enabled on a transport, it supports receiving unencrypted packets that would normally be rejected if they weren't encrypted. This allows a mix of secure and insecure clients on the same server. Don't turn this on in production!
 #endif // #if !YOJIMBO_SECURE_MODE
@@ -72,6 +74,16 @@ namespace yojimbo
         TRANSPORT_COUNTER_UNENCRYPTED_PACKETS_READ,                                 ///< Number of unencrypted packets read from the network.
         TRANSPORT_COUNTER_UNENCRYPTED_PACKETS_WRITTEN,                              ///< Number of unencrypted packets written to the network.
         TRANSPORT_COUNTER_ENCRYPTION_MAPPING_FAILURES,                              ///< Number of encryption mapping failures. This is when an encrypted packet is sent to us, but we don't can't find any key to decrypt that packet corresponding to it's source address. See Transport::AddEncryptionMapping.
+        TRANSPORT_COUNTER_RECEIVE_BATCHES,                                          ///< Number of non-empty batches of packets read from the socket. With YOJIMBO_SOCKET_BATCHING each batch corresponds to one system call.
+        TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS,                                    ///< Number of packets read from the socket in batches. Divide by TRANSPORT_COUNTER_RECEIVE_BATCHES to get the average number of packets read per-batch.
+        TRANSPORT_COUNTER_RECEIVE_BATCHES_FULL,                                     ///< Number of batches read from the socket that filled the whole batch. If this is high relative to TRANSPORT_COUNTER_RECEIVE_BATCHES, consider increasing the receive batch size.
+        TRANSPORT_COUNTER_SEND_BATCHES,                                             ///< Number of batches of packets flushed to the network from Transport::WritePackets.
+        TRANSPORT_COUNTER_SEND_BATCH_PACKETS,                                       ///< Number of packets flushed to the network in batches.
+        TRANSPORT_COUNTER_SEND_SYSTEM_CALLS,                                        ///< Number of system calls made to flush send batches. Divide TRANSPORT_COUNTER_SEND_BATCH_PACKETS by this to get the average number of packets sent per-system call.
+        TRANSPORT_COUNTER_SEND_SEGMENTED_PACKETS,                                   ///< Number of packets sent as part of a larger datagram with send segmentation offload (GSO). See NetworkTransport::EnableSegmentationOffload.
+        TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS,                                     ///< Number of system calls made to read packets from the network. Compare with TRANSPORT_COUNTER_RECEIVE_BATCH_PACKETS to get the average number of packets read per-system call.
+        TRANSPORT_COUNTER_RECEIVE_COALESCED_PACKETS,                                ///< Number of packets received as part of a larger datagram coalesced by receive segmentation offload (GRO). See NetworkTransport::EnableSegmentationOffload.
+        TRANSPORT_COUNTER_SEND_PACKET_FAILURES,                                     ///< Number of packets in send batches that could not be sent, for example because the socket send buffer was full. When this is non-zero, consider increasing the socket send buffer size.
         TRANSPORT_COUNTER_NUM_COUNTERS                                              ///< The number of transport counters.
     };
 
@@ -143,7 +155,22 @@ namespace yojimbo
     {
     public:
 
-        TransportContextManager();
+        /**
+            Transport context manager constructor.
+
+            @param allocator The allocator used to allocate the context mapping arrays and hash table.
+            @param maxContextMappings The maximum number of context mappings that can be added at the same time.
+         */
+
+        TransportContextManager( Allocator & allocator, int maxContextMappings = MaxContextMappings );
+
+        /**
+            Transport context manager destructor.
+
+            Frees the context mapping arrays and hash table.
+         */
+
+        ~TransportContextManager();
 
         /**
             Add a context mapping.
@@ -154,7 +181,7 @@ namespace yojimbo
 
             @param address The address that maps to the context.
             @param context A reference to the context data to be copied across.
-            @returns True if the context mapping was added successfully. False if the context is already added context mapping slots are available. See yojimbo::MaxContextMappings.
+            @returns True if the context mapping was added successfully. False if no context mapping slots are available. See yojimbo::MaxContextMappings.
          */
 
         bool AddContextMapping( const Address & address, const TransportContext & context );
@@ -190,12 +217,42 @@ namespace yojimbo
 
         const TransportContext * GetContext( const Address & address ) const;
 
+        /**
+            Get the number of context mappings.
+
+            @returns The number of context mappings currently added, in [0,maxContextMappings].
+         */
+
+        int GetNumContextMappings() const;
+
+        /**
+            Get the maximum number of context mappings.
+
+            @returns The maximum number of context mappings passed in to the constructor.
+         */
+
+        int GetMaxContextMappings() const;
+
     private:
 
-        int m_numContextMappings;                                                   ///< The current number of context mappings in [0,MaxContextMappings-1]
-        int m_allocated[MaxContextMappings];                                        ///< Array of allocated flags per-context entry. True if a context mapping is allocated at this index.
-        Address m_address[MaxContextMappings];                                      ///< Array of addresses. Used by the O(n) for a context by address. OK because n is typically small.
-        TransportContext m_context[MaxContextMappings];                             ///< Array of context data corresponding to the address at the same index in the address array.
+        /**
+            Find the hash table slot for an address.
+
+            Linear probes from the slot the address hashes to.
+
+            @param address The address to look for.
+            @returns The slot holding the context mapping for the address, or the empty slot where it would be inserted.
+         */
+
+        int FindSlot( const Address & address ) const;
+
+        Allocator * m_allocator;                                                    ///< The allocator passed in to the constructor. Used to free the arrays in the destructor.
+        int m_maxContextMappings;                                                   ///< The maximum number of context mappings.
+        int m_numContextMappings;                                                   ///< The current number of context mappings in [0,m_maxContextMappings]. Context mappings are packed at the start of the address and context arrays.
+        int m_hashMask;                                                             ///< The hash table size minus one. The hash table size is a power of two at least twice the maximum number of context mappings, so probe sequences stay short.
+        int * m_hashTable;                                                          ///< Open addressing hash table keyed by Address::GetHash. Each slot is an index into the address and context arrays, or -1 if empty.
+        Address * m_address;                                                        ///< Array of addresses for each context mapping.
+        TransportContext * m_context;                                               ///< Array of context data corresponding to the address at the same index in the address array.
     };
 
     /** 
@@ -409,11 +466,12 @@ namespace yojimbo
             @param sendKey The key used to encrypt packets sent to this address.
             @param receiveKey The key used to decrypt packets received from this address.
 			@param timeout The timeout value in seconds for this encryption mapping (seconds). Encryption mapping times out if no packets are sent to or received from this address in the timeout period.
+            @param cipherSuite The cipher suite used to encrypt packets sent to and received from this address. See yojimbo::CipherSuite.
 
             @returns True if the encryption mapping was added successfully, false otherwise.
          */
 
-        virtual bool AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double timeout ) = 0;
+        virtual bool AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double timeout, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 ) = 0;
 
         /**
             Remove the encryption mapping for an address.
@@ -480,6 +538,33 @@ namespace yojimbo
 
         virtual void ResetContextMappings() = 0;
 
+        /**
+            Set the maximum number of context and encryption mappings.
+
+            The server calls this in Server::Start so the transport can hold a context mapping per-client slot, and enough encryption mappings for clients negotiating connection.
+
+            IMPORTANT: If the maximum number of context mappings changes, all context mappings are removed. The same goes for encryption mappings.
+
+            @param maxContextMappings The maximum number of context mappings.
+            @param maxEncryptionMappings The maximum number of encryption mappings.
+         */
+
+        virtual void SetMaxMappings( int maxContextMappings, int maxEncryptionMappings ) = 0;
+
+        /**
+            Set a worker pool to serialize, encrypt, decrypt and deserialize packets in parallel.
+
+            When a worker pool is set, Transport::WritePackets serializes and encrypts all queued packets across the workers, then flushes them to the network in the order they were sent on the calling thread.
+
+            Transport::ReadPackets likewise receives a batch of packets on the calling thread, decrypts and deserializes them across the workers, then adds them to the receive queue in the order they were received.
+
+            The server sets its worker pool on the transport in Server::Start if ClientServerConfig::serverWorkerThreads is non-zero, and clears it in Server::Stop.
+
+            @param workerPool The worker pool. Pass in NULL to read and write packets on the calling thread. The worker pool must outlive the transport, or be cleared before it is destroyed.
+         */
+
+        virtual void SetWorkerPool( WorkerPool * workerPool ) = 0;
+
         /**
             Advance transport time.
 
@@ -578,6 +663,7 @@ namespace yojimbo
             @param sendQueueSize The size of the packet send queue (number of packets).
             @param receiveQueueSize The size of the packet receive queue (number of packets).
             @param allocateNetworkSimulator If true then a network simulator is allocated, otherwise a network simulator is not allocated. You can use this to disable the network simulator if you are not using it, to save memory.
+            @param sendBatchSize The number of packets staged in Transport::WritePackets before they are flushed together via BaseTransport::InternalSendPackets. Pass in 1 to write and flush each packet individually.
          */
 
         BaseTransport( Allocator & allocator,
@@ -587,7 +673,8 @@ namespace yojimbo
                        int maxPacketSize = DefaultMaxPacketSize,
                        int sendQueueSize = DefaultPacketSendQueueSize,
                        int receiveQueueSize = DefaultPacketReceiveQueueSize,
-                       bool allocateNetworkSimulator = true );
+                       bool allocateNetworkSimulator = true,
+                       int sendBatchSize = 1 );
 
         ~BaseTransport();
 
@@ -619,7 +706,7 @@ namespace yojimbo
 
         bool IsEncryptedPacketType( int type ) const;
 
-        bool AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double timeout );
+        bool AddEncryptionMapping( const Address & address, const uint8_t * sendKey, const uint8_t * receiveKey, double timeout, int cipherSuite = CIPHER_SUITE_CHACHA20_POLY1305 );
 
         bool RemoveEncryptionMapping( const Address & address );
 
@@ -633,6 +720,10 @@ namespace yojimbo
 
         void ResetContextMappings();
 
+        void SetMaxMappings( int maxContextMappings, int maxEncryptionMappings );
+
+        void SetWorkerPool( WorkerPool * workerPool );
+
         void AdvanceTime( double time );
 
         double GetTime() const;
@@ -674,6 +765,58 @@ namespace yojimbo
 
         const uint8_t * WritePacket( const Address & address, Packet * packet, uint64_t sequence, int & packetBytes );
 
+        /**
+            Look up the context and encryption key for a packet and fill in a packet write job.
+
+            This touches the encryption manager, so it must be called on the thread calling Transport::WritePackets.
+
+            @param address The address the packet is being sent to.
+            @param packet The packet object to be serialized (written).
+            @param sequence The sequence number of the packet being written.
+            @param job The packet write job to fill in [out]. The packet data buffer is not set.
+         */
+
+        void PrepareWritePacket( const Address & address, Packet * packet, uint64_t sequence, PacketWriteJob & job );
+
+        /**
+            Update transport counters after a packet is written.
+
+            @param error The packet processor error from writing the packet.
+            @param encrypt True if the packet was encrypted.
+
+            @returns True if the packet was written successfully and should be sent.
+         */
+
+        bool CompleteWritePacket( int error, bool encrypt );
+
+        /**
+            Serialize and encrypt all packets in the send queue across the worker pool, then send them in order.
+
+            @param useSimulator True if packets should be sent through the network simulator.
+         */
+
+        void WritePacketsInParallel( bool useSimulator );
+
+        /**
+            Copy packet data into the network simulator.
+
+            @param address The address the packet is being sent to.
+            @param packetData The packet data written by BaseTransport::WritePacket.
+            @param packetBytes The size of the packet data (bytes).
+         */
+
+        void SendPacketToSimulator( const Address & address, const uint8_t * packetData, int packetBytes );
+
+        /**
+            Copy packet data into the send batch, flushing the send batch if it is full.
+
+            @param address The address the packet is being sent to.
+            @param packetData The packet data written by BaseTransport::WritePacket.
+            @param packetBytes The size of the packet data (bytes).
+         */
+
+        void AddPacketToSendBatch( const Address & address, const uint8_t * packetData, int packetBytes );
+
         /**
             Write a packet and queue it up in the network simulator.
 
@@ -707,6 +850,26 @@ namespace yojimbo
 
         void WriteAndFlushPacket( const Address & address, Packet * packet, uint64_t sequence );
 
+        /**
+            Write a packet and stage it in the send batch.
+
+            This codepath is used instead of BaseTransport::WriteAndFlushPacket when network simulation is disabled and the send batch size is greater than one. The send batch is flushed automatically when it is full.
+
+            @param address The address the packet is being sent to.
+            @param packet The packet object to be serialized (written).
+            @param sequence The sequence number of the packet being written. If this is an encrypted packet, this serves as the nonce, and it is the users responsibility to increase this value with each packet sent per-encryption context. Not used for unencrypted packets (pass in zero).
+
+            @see BaseTransport::FlushSendBatch
+         */
+
+        void WritePacketToSendBatch( const Address & address, Packet * packet, uint64_t sequence );
+
+        /**
+            Flush any packets staged in the send batch to the network via BaseTransport::InternalSendPackets.
+         */
+
+        void FlushSendBatch();
+
         /**
             Read a packet buffer that arrived from the network and deserialize it into a newly created packet object.
 
@@ -720,6 +883,38 @@ namespace yojimbo
 
         Packet * ReadPacket( const Address & address, uint8_t * packetBuffer, int packetBytes, uint64_t & sequence );
 
+        /**
+            Look up the context and decryption key for a packet and fill in a packet read job.
+
+            This touches the encryption manager, so it must be called on the thread calling Transport::ReadPackets.
+
+            @param address The address that sent the packet.
+            @param packetData The packet data received from the network.
+            @param packetBytes The size of the packet data (bytes).
+            @param job The packet read job to fill in [out].
+
+            @returns The transport context the packet will be read with.
+         */
+
+        const TransportContext * PrepareReadPacket( const Address & address, uint8_t * packetData, int packetBytes, PacketReadJob & job );
+
+        /**
+            Update transport counters after a packet is read.
+
+            @param error The packet processor error from reading the packet.
+            @param encrypted True if the packet was encrypted.
+
+            @returns True if the packet was read successfully and should be added to the receive queue.
+         */
+
+        bool CompleteReadPacket( int error, bool encrypted );
+
+        /**
+            Receive packets from the network, then decrypt and deserialize them across the worker pool and add them to the receive queue in order.
+         */
+
+        void ReadPacketsInParallel();
+
         /**
             Should sent packets go through the simulator first before they are flushed to the network?
 
@@ -746,6 +941,22 @@ namespace yojimbo
 
         virtual void InternalSendPacket( const Address & to, const void * packetData, int packetBytes ) = 0;
 
+        /**
+            Internal function to send a batch of packets over the network.
+
+            The default implementation calls BaseTransport::InternalSendPacket for each packet. Override this if your transport can send multiple packets more efficiently than one at a time.
+
+            @param numPackets The number of packets to send.
+            @param to Array of addresses to send each packet to.
+            @param packetData Contiguous buffer of packet data. Packet n starts at offset n * packetStride.
+            @param packetBytes Array of packet sizes in bytes.
+            @param packetStride The distance in bytes between the start of consecutive packets in the packet data buffer.
+
+            @returns The number of system calls (or equivalent) made to send the batch. Used for stats only.
+         */
+
+        virtual int InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride );
+
         /**
             Internal function to receive a packet from the network.
 
@@ -812,6 +1023,30 @@ namespace yojimbo
         class NetworkSimulator * m_networkSimulator;                    ///< The network simulator. May be NULL.
 
         uint64_t m_counters[TRANSPORT_COUNTER_NUM_COUNTERS];            ///< The array of transport counters. Used for stats, debugging and telemetry.
+
+        int m_sendBatchSize;                                            ///< The maximum number of packets in a send batch. When this is 1, packets are written and flushed individually and no send batch is allocated.
+
+        int m_numSendPackets;                                           ///< The number of packets currently staged in the send batch.
+
+        int m_sendPacketStride;                                         ///< The size of each packet slot in the send batch. Matches the absolute maximum packet size of the packet processor.
+
+        uint8_t * m_sendPacketData;                                     ///< Send batch packet data. Packet n is stored at offset n * m_sendPacketStride. NULL if the send batch size is 1.
+
+        int * m_sendPacketBytes;                                        ///< Array of packet sizes in bytes for the send batch.
+
+        Address * m_sendTo;                                             ///< Array of addresses to send each packet in the send batch to.
+
+        WorkerPool * m_workerPool;                                      ///< The worker pool for writing packets in parallel. NULL if packets are written on the calling thread. See Transport::SetWorkerPool.
+
+        PacketWriteJob * m_writeJobs;                                   ///< Packet write jobs, one per-entry in the send queue. Only allocated while a worker pool is set.
+
+        uint8_t * m_writePacketData;                                    ///< Packet data written in parallel. Job n writes to offset n * m_sendPacketStride. Only allocated while a worker pool is set.
+
+        PacketReadJob * m_readJobs;                                     ///< Packet read jobs, one per-entry in the receive queue. Only allocated while a worker pool is set.
+
+        uint8_t * m_readPacketData;                                     ///< Packet data received for reading in parallel. Packet n is stored at offset n * GetMaxPacketSize(). Only allocated while a worker pool is set.
+
+        Address * m_readFrom;                                           ///< The address each packet received for reading in parallel came from. Only allocated while a worker pool is set.
     };
 
     /**
@@ -885,6 +1120,10 @@ namespace yojimbo
 
     /**
         Implements a network transport built on top of non-blocking sendto and recvfrom socket APIs.
+
+        Packets are read from the socket in batches via Socket::ReceivePackets, and written in batches via Socket::SendPackets. On Linux with YOJIMBO_SOCKET_BATCHING, these map to the recvmmsg and sendmmsg system calls.
+
+        With YOJIMBO_IO_URING, socket IO goes through io_uring instead (see IOUringSocket), falling back to regular socket IO if io_uring is not available at runtime.
      */
 
     class NetworkTransport : public BaseTransport
@@ -903,6 +1142,8 @@ namespace yojimbo
             @param receiveQueueSize The size of the packet receive queue (number of packets).
             @param socketSendBufferSize The size of the send buffers to set on the socket (SO_SNDBUF).
             @param socketReceiveBufferSize The size of the send buffers to set on the socket (SO_RCVBUF).
+            @param receiveBatchSize The maximum number of packets to read from the socket in each batch.
+            @param sendBatchSize The maximum number of packets to flush to the socket in each batch.
          */
 
         NetworkTransport( Allocator & allocator,
@@ -913,7 +1154,9 @@ namespace yojimbo
                           int sendQueueSize = DefaultPacketSendQueueSize,
                           int receiveQueueSize = DefaultPacketReceiveQueueSize,
                           int socketSendBufferSize = DefaultSocketSendBufferSize,
-						  int socketReceiveBufferSize = DefaultSocketReceiveBufferSize );
+						  int socketReceiveBufferSize = DefaultSocketReceiveBufferSize,
+                          int receiveBatchSize = DefaultSocketReceiveBatchSize,
+                          int sendBatchSize = DefaultSocketSendBatchSize );
 
         ~NetworkTransport();
 
@@ -939,19 +1182,367 @@ namespace yojimbo
 
         int GetError() const;
 
+        /**
+            Enable UDP segmentation offload (GSO/GRO) on the transport socket.
+
+            With send segmentation offload, packets in the same send batch going to the same address with the same size are passed to the kernel as one datagram. This cuts the per-packet cost of sending for fragment heavy traffic, like blocks sent over reliable-ordered channels.
+
+            With receive segmentation offload, the kernel may coalesce packets from the same address into one datagram, which the transport splits back into packets as they are read. Coalesced datagrams are still read in batches with one system call, up to MaxSocketSegmentBatchSize datagrams at a time.
+
+            Each is only enabled if supported by the kernel. If not supported, the transport falls back to sending and receiving packets individually. Only supported on Linux with YOJIMBO_SOCKET_BATCHING, and not supported while the transport is using io_uring.
+
+            @returns True if either send or receive segmentation offload was enabled, false otherwise.
+
+            @see Socket::EnableSegmentationOffload
+         */
+
+        bool EnableSegmentationOffload();
+
+        /**
+            Is the transport doing socket IO through io_uring?
+
+            @returns True if built with YOJIMBO_IO_URING and io_uring is working on this system. False otherwise.
+         */
+
+        bool IsUsingIOUring() const;
+
+        /// Discards any packets remaining in the current receive batch, so they are not delivered across the reset boundary.
+
+        void Reset();
+
     protected:
 
         /// Overridden internal packet send function. Effectively just calls through to sendto.
 
         virtual void InternalSendPacket( const Address & to, const void * packetData, int packetBytes );
+
+        /// Overridden internal batch send function. Flushes the whole batch to the socket, with sendmmsg where supported.
+
+        virtual int InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride );
     
-        /// Overridden internal packet receive function. Effectively just wraps recvfrom.
+        /// Overridden internal packet receive function. Returns the next packet in the receive batch, reading a new batch from the socket when the current batch is exhausted.
 
         virtual int InternalReceivePacket( Address & from, void * packetData, int maxPacketSize );
 
     private:
 
         class Socket * m_socket;                                ///< The socket used for sending and receiving UDP packets.
+
+        int m_receiveBatchSize;                                 ///< The maximum number of packets read from the socket per-batch.
+
+        int m_receivePacketIndex;                               ///< Index of the next packet to return from the current receive batch (for InternalReceivePacket).
+
+        int m_numReceivePackets;                                ///< Number of packets in the current receive batch.
+
+        uint8_t * m_receivePacketData;                          ///< Receive batch packet data. Packet n is stored at offset n * GetMaxPacketSize().
+
+        int * m_receivePacketBytes;                             ///< Array of packet sizes in bytes for the current receive batch.
+
+        Address * m_receiveFrom;                                ///< Array of packet from addresses for the current receive batch.
+
+        int m_receiveSegmentBatchSize;                          ///< The maximum number of coalesced datagrams read from the socket per-batch with receive segmentation offload.
+
+        int m_receiveSegmentIndex;                              ///< Index of the datagram in the current segment batch that the next packet is split from.
+
+        int m_numReceiveSegmentDatagrams;                       ///< Number of datagrams in the current segment batch.
+
+        int m_receiveSegmentOffset;                             ///< Byte offset of the next packet to return from the current datagram.
+
+        uint8_t * m_receiveSegmentData;                         ///< Segment batch datagram data. Datagram n is stored at offset n * MaxSocketSegmentBytes. NULL unless receive segmentation offload is enabled.
+
+        int * m_receiveSegmentTotalBytes;                       ///< Array of datagram sizes in bytes for the current segment batch.
+
+        int * m_receiveSegmentBytes;                            ///< Array of packet sizes in bytes for each datagram in the current segment batch. The last packet in each datagram may be smaller.
+
+        Address * m_receiveSegmentFrom;                         ///< Array of addresses that sent each datagram in the current segment batch.
+
+#if YOJIMBO_IO_URING
+        class IOUringSocket * m_uring;                          ///< Does socket IO through io_uring. NULL if io_uring is not available, in which case the socket is used directly.
+#endif // #if YOJIMBO_IO_URING
+    };
+
+    /**
+        Implements a network transport that receives packets on multiple sockets bound to the same port, each with its own receive thread.
+
+        The sockets are created with SO_REUSEPORT, so on Linux the kernel spreads incoming packets across them by source address. This moves the cost of reading packets from the network off the main thread and across multiple cores, which matters for servers with a large number of clients.
+
+        Receive threads only read raw packet data from their socket. Packets are still decrypted and deserialized on the thread that calls Transport::ReadPackets, since packet factories, allocators and encryption mappings are not thread safe.
+
+        Each receive thread reads into a ring of packet slots owned by its socket, and hands each batch to the thread calling Transport::ReadPackets as a span of slots through a shared MPSCQueue. Slots are handed back by advancing the ring's read index once the span has been drained, so no locks are taken on the receive path, and a shard buffers the same number of packets whether they arrive in full batches or one at a time.
+
+        Packets are sent from the first socket, in batches via Socket::SendPackets, not from the socket the peer's packets arrive on. Every socket is bound to the same address and port, so peers see the same source address either way, but all send traffic shares the first socket's send buffer. Size socketSendBufferSize for the whole server, not one shard.
+
+        IMPORTANT: Not supported on Windows, which does not have SO_REUSEPORT.
+     */
+
+    class MultiSocketNetworkTransport : public BaseTransport
+    {
+    public:
+
+        /**
+            Multi-socket network transport constructor.
+
+            @param allocator The allocator used for transport allocations.
+            @param address The address to send packets to that would be received by this transport.
+            @param protocolId The protocol id for this transport. Protocol id is included in the packet header, packets received with a different protocol id are discarded. This allows multiple versions of your protocol to exist on the same network.
+            @param time The current time value in seconds.
+            @param numSockets The number of sockets (and receive threads) to create. Typically, the number of cores you want to dedicate to receiving packets.
+            @param maxPacketSize The maximum packet size that can be sent across this transport.
+            @param sendQueueSize The size of the packet send queue (number of packets).
+            @param receiveQueueSize The size of the packet receive queue (number of packets). Each receive thread buffers up to 2 * receiveQueueSize / numSockets packets between calls to Transport::ReadPackets.
+            @param socketSendBufferSize The size of the send buffers to set on each socket (SO_SNDBUF). All packets are sent from the first socket, so this needs to cover send traffic to every client.
+            @param socketReceiveBufferSize The size of the receive buffers to set on each socket (SO_RCVBUF).
+            @param receiveBatchSize The maximum number of packets each receive thread reads from its socket in each batch.
+            @param sendBatchSize The maximum number of packets to flush to the socket in each batch.
+         */
+
+        MultiSocketNetworkTransport( Allocator & allocator,
+                                     const Address & address,
+                                     uint64_t protocolId,
+                                     double time,
+                                     int numSockets,
+                                     int maxPacketSize = DefaultMaxPacketSize,
+                                     int sendQueueSize = DefaultPacketSendQueueSize,
+                                     int receiveQueueSize = DefaultPacketReceiveQueueSize,
+                                     int socketSendBufferSize = DefaultSocketSendBufferSize,
+                                     int socketReceiveBufferSize = DefaultSocketReceiveBufferSize,
+                                     int receiveBatchSize = DefaultSocketReceiveBatchSize,
+                                     int sendBatchSize = DefaultSocketSendBatchSize );
+
+        ~MultiSocketNetworkTransport();
+
+        /**
+            You should call this after creating a multi-socket network transport, to make sure all sockets and receive threads were created successfully.
+
+            @returns True if any socket is in error state, or a receive thread could not be created.
+
+            @see MultiSocketNetworkTransport::GetError
+         */
+
+        bool IsError() const;
+
+        /** 
+            Get the socket error code. 
+
+            @returns The error code of the first socket in an error state. One of the values in yojimbo::SocketError enum.
+
+            @see yojimbo::SocketError
+         */
+
+        int GetError() const;
+
+        /**
+            Get the number of sockets (and receive threads) in this transport.
+
+            @returns The number of sockets.
+         */
+
+        int GetNumSockets() const;
+
+        /// Discards any packets buffered by the receive threads, so they are not delivered across the reset boundary.
+
+        void Reset();
+
+    protected:
+
+        /// Overridden internal packet send function. Sends the packet from the first socket, whichever socket the peer's packets arrive on.
+
+        virtual void InternalSendPacket( const Address & to, const void * packetData, int packetBytes );
+
+        /// Overridden internal batch send function. Sends the whole batch from the first socket, whichever sockets the peers' packets arrive on.
+
+        virtual int InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride );
+    
+        /// Overridden internal packet receive function. Returns packets buffered by the receive threads, one span at a time in the order the batches were read.
+
+        virtual int InternalReceivePacket( Address & from, void * packetData, int maxPacketSize );
+
+    private:
+
+        /// Per-socket state for a receive thread.
+
+        struct ReceiveShard
+        {
+            MultiSocketNetworkTransport * transport;            ///< The transport that owns this shard.
+            class Socket * socket;                              ///< The socket read by this shard's receive thread.
+            PlatformThread * thread;                            ///< The receive thread. NULL if the thread could not be created.
+            uint8_t * packetData;                               ///< Ring of packet slots. Packet in slot n is stored at offset n * GetMaxPacketSize().
+            int * packetBytes;                                  ///< Ring of packet sizes in bytes.
+            Address * from;                                     ///< Ring of packet from addresses.
+            uint32_t writeIndex;                                ///< Sequence of the next slot the receive thread writes to. Only touched by the receive thread.
+            volatile uint32_t readIndex;                        ///< Sequence of the oldest slot not yet drained. Advanced by InternalReceivePacket once a span has been drained.
+            uint8_t * discardPacketData;                        ///< Packets are read here and dropped when the ring is full.
+            int * discardPacketBytes;                           ///< Packet sizes for discarded packets.
+            Address * discardFrom;                              ///< From addresses for discarded packets.
+        };
+
+        /// A run of consecutive slots in a shard's ring, filled by one receive batch.
+
+        struct ReceiveSpan
+        {
+            ReceiveShard * shard;                               ///< The shard that owns the slots. NULL if this span is empty.
+            uint32_t start;                                     ///< Sequence of the first slot in the span.
+            int numPackets;                                     ///< The number of packets in the span.
+        };
+
+        static void ReceiveThreadFunction( void * data );
+
+        void ReceiveThread( ReceiveShard & shard );
+
+        void ReleaseReadSpan();
+
+        void CollectReceiveCounters();
+
+        int m_numSockets;                                       ///< The number of sockets and receive threads.
+
+        int m_receiveBatchSize;                                 ///< The maximum number of packets read from a socket per-batch.
+
+        int m_numSlotsPerShard;                                 ///< The number of packet slots in each shard's ring. Always a power of two.
+
+        volatile uint32_t m_quit;                               ///< Set to 1 to tell the receive threads to exit.
+
+        ReceiveShard * m_receiveShards;                         ///< Array of receive shards. One per-socket.
+
+        MPSCQueue<ReceiveSpan> * m_receivedSpans;               ///< Spans filled by the receive threads, in the order they were filled. Every span holds at least one packet, so this has room for every slot and pushing never fails.
+
+        ReceiveSpan m_readSpan;                                 ///< The span currently being drained by InternalReceivePacket.
+
+        int m_readIndex;                                        ///< Index of the next packet to return from the read span.
+
+        volatile uint64_t m_receiveCounters[TRANSPORT_COUNTER_NUM_COUNTERS];    ///< Counters updated by the receive threads since they were last collected.
+    };
+
+    /**
+        Implements a network transport that does all socket IO on a dedicated thread.
+
+        The IO thread continuously reads packets from the socket and pushes them into a receive ring, so packets are taken off the socket as they arrive instead of in a burst each time Transport::ReadPackets is called. Packets flushed by Transport::WritePackets go the other way, through a send ring, and the IO thread sends them to the socket. Neither ring takes a lock. See SPSCQueue.
+
+        This takes system calls off the thread running the game loop, so slow or bursty socket IO doesn't add jitter to the tick.
+
+        The rings carry raw packet data in batches. Packets are still encrypted, decrypted, serialized and deserialized on the thread calling Transport::WritePackets and Transport::ReadPackets, since packet factories, allocators and encryption mappings are not thread safe.
+
+        Socket counters such as TRANSPORT_COUNTER_RECEIVE_SYSTEM_CALLS are accumulated by the IO thread, and folded into the transport counters each time Transport::ReadPackets is called.
+     */
+
+    class ThreadedNetworkTransport : public BaseTransport
+    {
+    public:
+
+        /**
+            Threaded network transport constructor.
+
+            @param allocator The allocator used for transport allocations.
+            @param address The address to send packets to that would be received by this transport.
+            @param protocolId The protocol id for this transport. Protocol id is included in the packet header, packets received with a different protocol id are discarded. This allows multiple versions of your protocol to exist on the same network.
+            @param time The current time value in seconds.
+            @param maxPacketSize The maximum packet size that can be sent across this transport.
+            @param sendQueueSize The size of the packet send queue (number of packets). The send ring holds sendQueueSize / sendBatchSize batches.
+            @param receiveQueueSize The size of the packet receive queue (number of packets). The receive ring holds receiveQueueSize / receiveBatchSize batches.
+            @param socketSendBufferSize The size of the send buffers to set on the socket (SO_SNDBUF).
+            @param socketReceiveBufferSize The size of the receive buffers to set on the socket (SO_RCVBUF).
+            @param receiveBatchSize The maximum number of packets the IO thread reads from the socket in each batch.
+            @param sendBatchSize The maximum number of packets in each batch passed to the IO thread to send.
+         */
+
+        ThreadedNetworkTransport( Allocator & allocator,
+                                  const Address & address,
+                                  uint64_t protocolId,
+                                  double time,
+                                  int maxPacketSize = DefaultMaxPacketSize,
+                                  int sendQueueSize = DefaultPacketSendQueueSize,
+                                  int receiveQueueSize = DefaultPacketReceiveQueueSize,
+                                  int socketSendBufferSize = DefaultSocketSendBufferSize,
+                                  int socketReceiveBufferSize = DefaultSocketReceiveBufferSize,
+                                  int receiveBatchSize = DefaultSocketReceiveBatchSize,
+                                  int sendBatchSize = DefaultSocketSendBatchSize );
+
+        /// Stops the IO thread. Any packets still in the send ring are sent before it exits.
+
+        ~ThreadedNetworkTransport();
+
+        /**
+            You should call this after creating a threaded network transport, to make sure the socket and the IO thread were created successfully.
+
+            @returns True if the socket is in error state, or the IO thread could not be created.
+
+            @see ThreadedNetworkTransport::GetError
+         */
+
+        bool IsError() const;
+
+        /** 
+            Get the socket error code. 
+
+            @returns The socket error code. One of the values in yojimbo::SocketError enum.
+
+            @see yojimbo::SocketError
+         */
+
+        int GetError() const;
+
+        /// Discards any packets in the receive ring, so they are not delivered across the reset boundary.
+
+        void Reset();
+
+    protected:
+
+        /// Overridden internal packet send function. Passes the packet to the IO thread as a batch of one.
+
+        virtual void InternalSendPacket( const Address & to, const void * packetData, int packetBytes );
+
+        /// Overridden internal batch send function. Copies the batch into the send ring for the IO thread to send.
+
+        virtual int InternalSendPackets( int numPackets, const Address * to, const uint8_t * packetData, const int * packetBytes, int packetStride );
+    
+        /// Overridden internal packet receive function. Returns packets from batches in the receive ring, in the order the IO thread read them.
+
+        virtual int InternalReceivePacket( Address & from, void * packetData, int maxPacketSize );
+
+    private:
+
+        /// A batch of raw packets passed between the IO thread and the thread calling into the transport.
+
+        struct PacketBatch
+        {
+            int numPackets;                                     ///< The number of packets in the batch.
+            uint8_t * packetData;                               ///< Packet data. Packet n is stored at offset n * GetMaxPacketSize() in the receive ring, and n * m_sendPacketStride in the send ring.
+            int * packetBytes;                                  ///< Array of packet sizes in bytes.
+            Address * address;                                  ///< Array of addresses. Where each packet came from in the receive ring, and where to send it in the send ring.
+        };
+
+        static void IOThreadFunction( void * data );
+
+        void IOThread();
+
+        void SendPacketsFromRing();
+
+        void ReceivePacketsToRing();
+
+        void CollectIOCounters();
+
+        void AllocatePacketBatches( SPSCQueue<PacketBatch> & ring, int batchSize, int packetStride );
+
+        void FreePacketBatches( SPSCQueue<PacketBatch> & ring );
+
+        class Socket * m_socket;                                ///< The socket used for sending and receiving UDP packets. Only accessed by the IO thread once it is running.
+
+        PlatformThread * m_thread;                              ///< The IO thread. NULL if the thread could not be created.
+
+        volatile uint32_t m_quit;                               ///< Set to 1 to tell the IO thread to exit.
+
+        int m_receiveBatchSize;                                 ///< The maximum number of packets in each batch in the receive ring.
+
+        int m_sendRingBatchSize;                                ///< The maximum number of packets in each batch in the send ring.
+
+        int m_receiveIndex;                                     ///< Index of the next packet to return from the oldest batch in the receive ring.
+
+        SPSCQueue<PacketBatch> * m_receiveRing;                 ///< Batches of packets read from the socket by the IO thread.
+
+        SPSCQueue<PacketBatch> * m_sendRing;                    ///< Batches of packets waiting for the IO thread to send them.
+
+        PacketBatch m_discardBatch;                             ///< Packets are read here and dropped when the receive ring is full. Only used by the IO thread.
+
+        volatile uint64_t m_ioCounters[TRANSPORT_COUNTER_NUM_COUNTERS];     ///< Counters updated by the IO thread since they were last collected. See ThreadedNetworkTransport::CollectIOCounters.
     };
 
 #endif // #if YOJIMBO_SOCKETS
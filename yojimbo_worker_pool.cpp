@@ -0,0 +1,155 @@
+/*
+    Yojimbo Client/Server Network Protocol Library.
+    
+    Copyright © 2016, The Network Protocol Company, Inc.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "yojimbo_worker_pool.h"
+
+namespace yojimbo
+{
+    WorkerPool::WorkerPool( Allocator & allocator, int numThreads )
+    {
+        assert( numThreads >= 0 );
+
+        m_allocator = &allocator;
+        m_numThreads = 0;
+        m_quit = false;
+        m_function = NULL;
+        m_data = NULL;
+        m_numItems = 0;
+
+        m_finished = platform_semaphore_create( allocator, 0 );
+
+        m_threads = numThreads > 0 ? (WorkerThreadData*) YOJIMBO_ALLOCATE( allocator, sizeof( WorkerThreadData ) * numThreads ) : NULL;
+
+        if ( !m_finished || !m_threads )
+            return;
+
+        for ( int i = 0; i < numThreads; ++i )
+        {
+            WorkerThreadData & thread = m_threads[m_numThreads];
+
+            thread.pool = this;
+            thread.workerIndex = m_numThreads + 1;
+            thread.start = platform_semaphore_create( allocator, 0 );
+            if ( !thread.start )
+                break;
+
+            thread.thread = platform_thread_create( allocator, WorkerThread, &thread );
+            if ( !thread.thread )
+            {
+                platform_semaphore_destroy( allocator, thread.start );
+                break;
+            }
+
+            m_numThreads++;
+        }
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        m_quit = true;
+
+        for ( int i = 0; i < m_numThreads; ++i )
+            platform_semaphore_signal( m_threads[i].start );
+
+        for ( int i = 0; i < m_numThreads; ++i )
+        {
+            platform_thread_join( m_threads[i].thread );
+            platform_thread_destroy( *m_allocator, m_threads[i].thread );
+            platform_semaphore_destroy( *m_allocator, m_threads[i].start );
+        }
+
+        if ( m_finished )
+            platform_semaphore_destroy( *m_allocator, m_finished );
+
+        YOJIMBO_FREE( *m_allocator, m_threads );
+    }
+
+    void WorkerPool::Run( WorkerPoolFunction function, void * data, int numItems )
+    {
+        assert( function );
+        assert( numItems >= 0 );
+
+        if ( numItems == 0 )
+            return;
+
+        // not worth waking threads for a single item
+
+        if ( m_numThreads == 0 || numItems == 1 )
+        {
+            function( data, 0, 0, numItems );
+            return;
+        }
+
+        m_function = function;
+        m_data = data;
+        m_numItems = numItems;
+
+        for ( int i = 0; i < m_numThreads; ++i )
+            platform_semaphore_signal( m_threads[i].start );
+
+        RunRange( 0 );
+
+        for ( int i = 0; i < m_numThreads; ++i )
+            platform_semaphore_wait( m_finished );
+
+        m_function = NULL;
+        m_data = NULL;
+        m_numItems = 0;
+    }
+
+    int WorkerPool::GetNumWorkers() const
+    {
+        return m_numThreads + 1;
+    }
+
+    void WorkerPool::WorkerThread( void * data )
+    {
+        WorkerThreadData * thread = (WorkerThreadData*) data;
+
+        WorkerPool * pool = thread->pool;
+
+        while ( true )
+        {
+            platform_semaphore_wait( thread->start );
+
+            if ( pool->m_quit )
+                break;
+
+            pool->RunRange( thread->workerIndex );
+
+            platform_semaphore_signal( pool->m_finished );
+        }
+    }
+
+    void WorkerPool::RunRange( int workerIndex )
+    {
+        const int numWorkers = m_numThreads + 1;
+
+        const int begin = int( int64_t( m_numItems ) * workerIndex / numWorkers );
+        const int end = int( int64_t( m_numItems ) * ( workerIndex + 1 ) / numWorkers );
+
+        if ( begin < end )
+            m_function( m_data, workerIndex, begin, end );
+    }
+}
@@ -0,0 +1,139 @@
+/*
+    Yojimbo Client/Server Network Protocol Library.
+    
+    Copyright © 2016, The Network Protocol Company, Inc.
+
+    Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+
+        1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+
+        2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer 
+           in the documentation and/or other materials provided with the distribution.
+
+        3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote products derived 
+           from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+    INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+    WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE
+    USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef YOJIMBO_WORKER_POOL_H
+#define YOJIMBO_WORKER_POOL_H
+
+#include "yojimbo_config.h"
+#include "yojimbo_allocator.h"
+#include "yojimbo_platform.h"
+#include <assert.h>
+
+/** @file */
+
+namespace yojimbo
+{
+    /**
+        Function run by the worker pool on a range of items.
+
+        @param data The data pointer passed in to WorkerPool::Run.
+        @param workerIndex The index of the worker running the function in [0,numWorkers-1]. Worker 0 is the thread that called WorkerPool::Run. Use this to index per-worker scratch buffers.
+        @param begin The first item to process.
+        @param end One past the last item to process.
+     */
+
+    typedef void (*WorkerPoolFunction)( void * data, int workerIndex, int begin, int end );
+
+    /**
+        A fixed pool of worker threads for splitting work across cores.
+
+        The thread calling WorkerPool::Run is a worker too. It processes its share of the items alongside the pool threads, and returns once all items are processed. Items are split into one contiguous range per-worker, so each item is processed by exactly one worker.
+
+        This is used by the server to update and generate packets for connected clients in parallel, and by the transport to serialize and encrypt packets in parallel. Each client has its own allocator, packet factory and message factory, so clients processed on different workers share no state.
+
+        IMPORTANT: WorkerPool::Run must only be called from one thread at a time.
+     */
+
+    class WorkerPool
+    {
+    public:
+
+        /**
+            Worker pool constructor.
+
+            Starts the worker threads. If a thread fails to start, the pool continues with fewer threads.
+
+            @param allocator The allocator used for threads and synchronization primitives.
+            @param numThreads The number of threads to start. The total number of workers is this plus one for the calling thread.
+         */
+
+        WorkerPool( Allocator & allocator, int numThreads );
+
+        /**
+            Worker pool destructor.
+
+            Stops and joins all worker threads.
+         */
+
+        ~WorkerPool();
+
+        /**
+            Process items in parallel.
+
+            Splits [0,numItems-1] into contiguous ranges, one per-worker, and calls the function for each non-empty range. Blocks until all ranges are processed.
+
+            @param function The function to run on each range.
+            @param data Data passed in to the function.
+            @param numItems The number of items to process.
+         */
+
+        void Run( WorkerPoolFunction function, void * data, int numItems );
+
+        /**
+            Get the number of workers.
+
+            @returns The number of threads started plus one for the calling thread.
+         */
+
+        int GetNumWorkers() const;
+
+    protected:
+
+        static void WorkerThread( void * data );
+
+        void RunRange( int workerIndex );
+
+    private:
+
+        struct WorkerThreadData
+        {
+            WorkerPool * pool;                                      ///< The worker pool this thread belongs to.
+            int workerIndex;                                        ///< The worker index for this thread in [1,numWorkers-1].
+            PlatformThread * thread;                                ///< The thread handle.
+            PlatformSemaphore * start;                              ///< Signalled when there is work for this thread, or when the pool is shutting down.
+        };
+
+        Allocator * m_allocator;                                    ///< The allocator passed in to the constructor.
+
+        int m_numThreads;                                           ///< The number of worker threads. Does not include the calling thread.
+
+        WorkerThreadData * m_threads;                               ///< Per-thread data.
+
+        PlatformSemaphore * m_finished;                             ///< Signalled by each worker thread when it has finished its range.
+
+        bool m_quit;                                                ///< Set to tell worker threads to exit.
+
+        WorkerPoolFunction m_function;                              ///< The function passed in to the current call to Run.
+
+        void * m_data;                                              ///< The data passed in to the current call to Run.
+
+        int m_numItems;                                             ///< The number of items passed in to the current call to Run.
+
+        WorkerPool( const WorkerPool & other );
+
+        const WorkerPool & operator = ( const WorkerPool & other );
+    };
+}
+
+#endif // #ifndef YOJIMBO_WORKER_POOL_H